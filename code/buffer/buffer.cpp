@@ -106,8 +106,8 @@ void Buffer::MakeResponse(size_t len) {
     buffer_.resize(write_pos_ + len + 1);
   } else {
     size_t readable = ReadableBytes();
-    std::copy(BeginPtr() + read_pos_, BeginPtr() + WriteableBytes(),
-              BeginPtr());
+    // 把未读的数据[read_pos_, write_pos_)移到开头
+    std::copy(BeginPtr() + read_pos_, BeginPtr() + write_pos_, BeginPtr());
     read_pos_ = 0;
     write_pos_ = read_pos_ + readable;
     assert(readable == ReadableBytes());
@@ -0,0 +1,204 @@
+#include "coserver.h"
+
+CoServer::CoServer(int port, int timeout, int sql_port, const char *sql_user,
+                   const char *sql_pwd, const char *dbname, int connpool_num,
+                   bool openlog, int log_level, int log_queue_size,
+                   int db_queue_size)
+    : port_(port), timeout_ms_(timeout) {
+  // 与WebServer相同：空闲超时用于长连接空闲和请求处理，其余阶段使用更短的期限
+  phase_limits_.keepalive_ms = timeout;
+  phase_limits_.process_ms = timeout;
+  phase_limits_.first_byte_ms = std::min(phase_limits_.first_byte_ms, timeout);
+  phase_limits_.header_ms = std::min(phase_limits_.header_ms, timeout);
+  db_threadpool_ = std::make_unique<ThreadPool>(connpool_num, db_queue_size);
+
+  src_dir_ = getcwd(nullptr, 256);
+  assert(src_dir_);
+  strncat(src_dir_, "/resources/", 16);
+  HttpConn::user_count_ = 0;
+  HttpConn::src_dir_ = src_dir_;
+  // 每次就绪只读一次，读不到数据时再co_await
+  HttpConn::is_et_ = false;
+  // 连接在后台建立，就绪之前登录/注册返回503，见watchReadiness
+  HttpConn::db_ready_ = false;
+  SqlConnPool::instance()->init("localhost", sql_port, sql_user, sql_pwd,
+                                dbname, connpool_num);
+  if (!initSocket()) {
+    is_close_ = true;
+  }
+
+  if (openlog) {
+    Log::instance()->init(log_level, "./log", ".log", log_queue_size);
+    if (is_close_) {
+      LOG_ERROR("========== Server init error!===========");
+    } else {
+      LOG_INFO("========== Coroutine server init ==========");
+      LOG_INFO("Port:%d, timeout:%dms", port_, timeout_ms_);
+      LOG_INFO("srcDir: %s", HttpConn::src_dir_);
+      LOG_INFO("SqlConnPool num: %d, DbTaskQueue size: %d", connpool_num,
+               db_queue_size);
+    }
+  }
+}
+
+CoServer::~CoServer() {
+  close(listen_fd_);
+  is_close_ = true;
+  free(src_dir_);
+  SqlConnPool::instance()->closePool();
+}
+
+void CoServer::start() {
+  if (is_close_) {
+    return;
+  }
+  LOG_INFO("========== Server start ==========");
+  sched_.spawn(acceptLoop());
+  sched_.spawn(watchReadiness());
+  sched_.run();
+}
+
+Task<void> CoServer::watchReadiness() {
+  while (!is_close_) {
+    bool ready = SqlConnPool::instance()->ready();
+    if (ready != HttpConn::db_ready_.load(std::memory_order_relaxed)) {
+      HttpConn::db_ready_.store(ready, std::memory_order_relaxed);
+      if (ready) {
+        LOG_INFO("Database ready");
+      } else {
+        LOG_WARN("Database unavailable");
+      }
+    }
+    co_await sched_.sleep(READINESS_CHECK_MS);
+  }
+}
+
+int CoServer::remainMs(const HttpConn &conn) const {
+  int64_t remain = conn.deadline(phase_limits_) - LoopClock::nowMs();
+  return static_cast<int>(std::max<int64_t>(remain, 0));
+}
+
+Task<void> CoServer::acceptLoop() {
+  while (!is_close_) {
+    co_await sched_.readable(listen_fd_);
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    while (true) {
+      int fd = accept(listen_fd_, (sockaddr *)&addr, &len);
+      if (fd <= 0) {
+        break;
+      } else if (HttpConn::user_count_ >= MAX_FD) {
+        send(fd, "Server busy!", 12, 0);
+        close(fd);
+        LOG_WARN("client is full!");
+        break;
+      }
+      setFdNonblock(fd);
+      sched_.spawn(serve(fd, addr));
+    }
+  }
+}
+
+Task<void> CoServer::serve(int fd, sockaddr_in addr) {
+  HttpConn conn;
+  conn.init(fd, addr);
+  while (true) {
+    // 每次等待只到当前阶段的期限：逐字节发送请求头也不能无限期占住连接
+    // GCC 12在条件表达式中co_await会生成错误代码，先保存结果
+    int remain = remainMs(conn);
+    bool ready = false;
+    if (remain > 0) {
+      ready = co_await sched_.readable(fd, remain);
+    }
+    if (!ready) {
+      LOG_INFO("client[%d] %s timeout!", fd, HttpConn::phaseName(conn.phase()));
+      break;
+    }
+    int read_errno = 0;
+    ssize_t len = conn.read(&read_errno);
+    if (len == 0 || (len < 0 && read_errno != EAGAIN)) {
+      break;
+    }
+    if (!conn.process()) {
+      continue;
+    }
+    if (conn.needVerify() &&
+        !HttpConn::db_ready_.load(std::memory_order_relaxed)) {
+      // 数据库连接还没有就绪，直接返回错误而不是排队等待
+      LOG_WARN("database not ready, client[%d] rejected!", fd);
+      conn.reject(503);
+    } else if (conn.needVerify()) {
+      // 数据库查询在线程池中完成，期间协程挂起，不占用调度线程
+      auto done = co_await sched_.offload(*db_threadpool_, [&conn] {
+        conn.verify();
+        return true;
+      });
+      if (!done) {
+        LOG_WARN("db task queue is full, client[%d] rejected!", fd);
+        conn.reject(503);
+      }
+    }
+    bool written = co_await writeResponse(conn);
+    if (!written || !conn.isKeepalive()) {
+      break;
+    }
+  }
+  sched_.forget(fd);
+  conn.closeConn();
+}
+
+Task<bool> CoServer::writeResponse(HttpConn &conn) {
+  while (conn.toWriteBytes() > 0) {
+    int write_errno = 0;
+    ssize_t len = conn.write(&write_errno);
+    if (len < 0 && write_errno == EAGAIN) {
+      // 发送同样有最低速率要求，期限随已发送的字节数延长
+      int remain = remainMs(conn);
+      bool ready = false;
+      if (remain > 0) {
+        ready = co_await sched_.writable(conn.getFd(), remain);
+      }
+      if (!ready) {
+        co_return false;
+      }
+    } else if (len <= 0) {
+      co_return false;
+    }
+  }
+  co_return true;
+}
+
+bool CoServer::initSocket() {
+  if (port_ > 65535 || port_ < 1024) {
+    LOG_ERROR("Port:%d error!", port_);
+    return false;
+  }
+  sockaddr_in addr;
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port_);
+
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    LOG_ERROR("create socket error!");
+    return false;
+  }
+  int opt_val = 1;
+  // 设置端口复用
+  if (setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, (const void *)&opt_val,
+                 sizeof(int)) == -1 ||
+      bind(listen_fd_, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listen_fd_, 128) < 0) {
+    LOG_ERROR("bind/listen port:%d error!", port_);
+    close(listen_fd_);
+    return false;
+  }
+  setFdNonblock(listen_fd_);
+  LOG_INFO("Server port:%d", port_);
+  return true;
+}
+
+int CoServer::setFdNonblock(int fd) {
+  assert(fd > 0);
+  return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include "../http/connection.h"
+#include "../log/log.h"
+#include "../pool/sqlconnpool.h"
+#include "../pool/threadpool.hpp"
+#include "scheduler.h"
+
+// 基于协程的服务器：每个连接是一个协程，在调度线程上co_await读写就绪，
+// 只有访问数据库的请求才会占用线程池中的线程
+class CoServer {
+ public:
+  CoServer(int port, int timeout, int sql_port, const char *sql_user,
+           const char *sql_pwd, const char *dbname, int connpool_num,
+           bool openlog, int log_level, int log_queue_size,
+           int db_queue_size = 256);
+  ~CoServer();
+  void start();
+
+ private:
+  bool initSocket();
+  Task<void> acceptLoop();
+  Task<void> serve(int fd, sockaddr_in addr);
+  Task<bool> writeResponse(HttpConn &conn);
+  // 按连接池的状态更新HttpConn::db_ready_
+  Task<void> watchReadiness();
+  // 距离连接当前阶段期限的剩余时间，已超时返回0
+  int remainMs(const HttpConn &conn) const;
+
+  static const int MAX_FD = 65535;
+  static const int READINESS_CHECK_MS = 100;
+  static int setFdNonblock(int fd);
+
+  int port_;
+  int timeout_ms_;
+  HttpConn::PhaseLimits phase_limits_;
+  bool is_close_{false};
+  int listen_fd_{-1};
+  char *src_dir_;
+
+  CoScheduler sched_;
+  std::unique_ptr<ThreadPool> db_threadpool_;
+};
@@ -0,0 +1,11 @@
+#include <unistd.h>
+
+#include "coserver.h"
+
+int main() {
+  CoServer server(10000, 60000, 0, "root", "12345678", "webserver", 12, true,
+                  1, 1024, 256);
+  server.start();
+
+  return 0;
+}
@@ -0,0 +1,143 @@
+#include "scheduler.h"
+
+CoScheduler::CoScheduler()
+    : epoller_(1024),
+      wakeup_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      fds_(MAX_FD) {
+  assert(wakeup_fd_ > 0);
+  epoller_.AddFd(wakeup_fd_, EPOLLIN);
+}
+
+CoScheduler::~CoScheduler() { close(wakeup_fd_); }
+
+void CoScheduler::post(std::function<void()> func) {
+  {
+    std::lock_guard locker(mtx_);
+    pending_functions_.push_back(std::move(func));
+  }
+  uint64_t one = 1;
+  ::write(wakeup_fd_, &one, sizeof(one));
+}
+
+void CoScheduler::resumeLater(std::coroutine_handle<> handle) {
+  {
+    std::lock_guard locker(mtx_);
+    remote_ready_.push_back(handle);
+  }
+  uint64_t one = 1;
+  ::write(wakeup_fd_, &one, sizeof(one));
+}
+
+void CoScheduler::stop() {
+  post([this] { running_ = false; });
+}
+
+void CoScheduler::run() {
+  running_ = true;
+  std::vector<std::coroutine_handle<>> resuming;
+  LoopClock::update();
+  while (running_) {
+    // getNextTick会先处理到期的定时器
+    int timeout = timer_.getNextTick();
+    if (timeout < 0 || timeout > CLOCK_REFRESH_MS) {
+      timeout = CLOCK_REFRESH_MS;
+    }
+    if (!ready_.empty()) {
+      timeout = 0;
+    }
+    int event_count = epoller_.Wait(timeout);
+    LoopClock::update();
+    for (int i = 0; i < event_count; ++i) {
+      int fd = epoller_.GetEventFd(i);
+      if (fd == wakeup_fd_) {
+        drainWakeup();
+      } else {
+        onFdEvent(fd);
+      }
+    }
+    // 恢复协程时可能产生新的就绪协程，留到下一轮处理
+    resuming.swap(ready_);
+    for (auto handle : resuming) {
+      handle.resume();
+    }
+    resuming.clear();
+  }
+}
+
+void CoScheduler::drainWakeup() {
+  uint64_t count = 0;
+  ::read(wakeup_fd_, &count, sizeof(count));
+  std::vector<std::function<void()>> functions;
+  {
+    std::lock_guard locker(mtx_);
+    ready_.insert(ready_.end(), remote_ready_.begin(), remote_ready_.end());
+    remote_ready_.clear();
+    functions.swap(pending_functions_);
+  }
+  for (auto &func : functions) {
+    func();
+  }
+}
+
+void CoScheduler::waitFd(IoAwaiter *awaiter) {
+  int fd = awaiter->fd_;
+  assert(fd >= 0 && fd < MAX_FD);
+  FdState &state = fds_[fd];
+  assert(state.waiter == nullptr);
+  state.waiter = awaiter;
+  uint32_t events = awaiter->events_ | EPOLLONESHOT;
+  if (state.registered) {
+    epoller_.ModFd(fd, events);
+  } else {
+    state.registered = epoller_.AddFd(fd, events);
+  }
+  if (awaiter->timeout_ms_ >= 0) {
+    awaiter->timer_id_ = nextTimerId();
+    timer_.add(awaiter->timer_id_, awaiter->timeout_ms_,
+               [this, fd] { onFdTimeout(fd); });
+  }
+}
+
+void CoScheduler::onFdEvent(int fd) {
+  FdState &state = fds_[fd];
+  IoAwaiter *awaiter = state.waiter;
+  if (awaiter == nullptr) {
+    return;
+  }
+  state.waiter = nullptr;
+  if (awaiter->timer_id_ >= 0) {
+    timer_.cancel(awaiter->timer_id_);
+  }
+  awaiter->ready_ = true;
+  schedule(awaiter->handle_);
+}
+
+void CoScheduler::onFdTimeout(int fd) {
+  FdState &state = fds_[fd];
+  IoAwaiter *awaiter = state.waiter;
+  if (awaiter == nullptr) {
+    return;
+  }
+  state.waiter = nullptr;
+  // EPOLLONESHOT下不带事件的修改相当于暂停监听
+  epoller_.ModFd(fd, EPOLLONESHOT);
+  awaiter->ready_ = false;
+  schedule(awaiter->handle_);
+}
+
+void CoScheduler::forget(int fd) {
+  assert(fd >= 0 && fd < MAX_FD);
+  FdState &state = fds_[fd];
+  if (state.registered) {
+    epoller_.DelFd(fd);
+  }
+  state.waiter = nullptr;
+  state.registered = false;
+}
+
+int CoScheduler::nextTimerId() {
+  if (next_timer_id_ == INT_MAX) {
+    next_timer_id_ = 0;
+  }
+  return next_timer_id_++;
+}
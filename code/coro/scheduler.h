@@ -0,0 +1,143 @@
+#pragma once
+
+#include <sys/eventfd.h>
+
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "../pool/threadpool.hpp"
+#include "../server/epoller.h"
+#include "../utility/timer.h"
+#include "task.h"
+
+// 单线程协程调度器：epoll等待fd就绪，HeapTimer管理超时与睡眠
+// 所有协程都在调用run()的线程上恢复，阻塞操作通过offload交给线程池
+class CoScheduler {
+ public:
+  // 等待fd就绪，timeout_ms < 0表示不超时
+  // co_await的结果为true表示就绪，false表示超时
+  class IoAwaiter {
+   public:
+    IoAwaiter(CoScheduler *sched, int fd, uint32_t events, int timeout_ms)
+        : sched_(sched), fd_(fd), events_(events), timeout_ms_(timeout_ms) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      handle_ = handle;
+      sched_->waitFd(this);
+    }
+    bool await_resume() const noexcept { return ready_; }
+
+   private:
+    friend class CoScheduler;
+    CoScheduler *sched_;
+    int fd_;
+    uint32_t events_;
+    int timeout_ms_;
+    int timer_id_{-1};
+    bool ready_{false};
+    std::coroutine_handle<> handle_;
+  };
+
+  class SleepAwaiter {
+   public:
+    SleepAwaiter(CoScheduler *sched, int ms) : sched_(sched), ms_(ms) {}
+    bool await_ready() const noexcept { return ms_ <= 0; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      sched_->timer_.add(sched_->nextTimerId(), ms_,
+                         [sched = sched_, handle] { sched->schedule(handle); });
+    }
+    void await_resume() const noexcept {}
+
+   private:
+    CoScheduler *sched_;
+    int ms_;
+  };
+
+  // 在线程池中执行func，完成后回到调度线程恢复协程
+  // co_await的结果为std::optional，线程池队列已满时为空
+  template <typename F>
+  class OffloadAwaiter {
+   public:
+    using Result = std::invoke_result_t<F>;
+    static_assert(!std::is_void_v<Result>, "offload needs a result");
+
+    OffloadAwaiter(CoScheduler *sched, ThreadPool *pool, F func)
+        : sched_(sched), pool_(pool), func_(std::move(func)) {}
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      auto res = pool_->Enqueue([this, handle] {
+        result_.emplace(func_());
+        sched_->resumeLater(handle);
+      });
+      // 入队失败时不挂起，直接返回空结果
+      return res.valid();
+    }
+    std::optional<Result> await_resume() { return std::move(result_); }
+
+   private:
+    CoScheduler *sched_;
+    ThreadPool *pool_;
+    F func_;
+    std::optional<Result> result_;
+  };
+
+  CoScheduler();
+  ~CoScheduler();
+
+  // 分离一个协程任务，在下一轮循环中开始执行
+  void spawn(Task<void> task) { schedule(std::move(task).detach()); }
+  // 线程安全：在调度线程中执行func
+  void post(std::function<void()> func);
+  void run();
+  void stop();
+
+  IoAwaiter readable(int fd, int timeout_ms = -1) {
+    return IoAwaiter(this, fd, EPOLLIN | EPOLLRDHUP, timeout_ms);
+  }
+  IoAwaiter writable(int fd, int timeout_ms = -1) {
+    return IoAwaiter(this, fd, EPOLLOUT, timeout_ms);
+  }
+  SleepAwaiter sleep(int ms) { return SleepAwaiter(this, ms); }
+  template <typename F>
+  OffloadAwaiter<F> offload(ThreadPool &pool, F func) {
+    return OffloadAwaiter<F>(this, &pool, std::move(func));
+  }
+
+  // 关闭fd之前调用，将fd移出epoll
+  void forget(int fd);
+
+ private:
+  struct FdState {
+    IoAwaiter *waiter{nullptr};
+    bool registered{false};
+  };
+
+  void waitFd(IoAwaiter *awaiter);
+  void onFdEvent(int fd);
+  void onFdTimeout(int fd);
+  void schedule(std::coroutine_handle<> handle) { ready_.push_back(handle); }
+  void resumeLater(std::coroutine_handle<> handle);
+  void drainWakeup();
+  int nextTimerId();
+
+  static constexpr int MAX_FD = 65536;
+  static constexpr int CLOCK_REFRESH_MS = 1000;
+
+  Epoller epoller_;
+  HeapTimer timer_;
+  int wakeup_fd_;
+  bool running_{false};
+  int next_timer_id_{0};
+
+  std::vector<FdState> fds_;
+  std::vector<std::coroutine_handle<>> ready_;
+
+  std::mutex mtx_;
+  std::vector<std::coroutine_handle<>> remote_ready_;
+  std::vector<std::function<void()>> pending_functions_;
+};
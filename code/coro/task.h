@@ -0,0 +1,129 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// 惰性启动的协程任务：被co_await时才开始执行，结束后恢复等待它的协程
+// 没有等待者的任务通过detach交给调度器，执行结束后自行销毁
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) noexcept {
+      auto &promise = handle.promise();
+      if (promise.detached_) {
+        // 分离的任务不能抛出异常，否则直接终止
+        if (promise.exception_) {
+          std::terminate();
+        }
+        handle.destroy();
+        return std::noop_coroutine();
+      }
+      return promise.continuation_;
+    }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { exception_ = std::current_exception(); }
+
+  std::coroutine_handle<> continuation_{std::noop_coroutine()};
+  std::exception_ptr exception_;
+  bool detached_{false};
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+  Task<T> get_return_object();
+  template <typename U>
+  void return_value(U &&value) {
+    value_.emplace(std::forward<U>(value));
+  }
+  T result() {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+    return std::move(*value_);
+  }
+
+  std::optional<T> value_;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+  void result() {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+};
+
+}  // namespace detail
+
+template <typename T>
+class Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  explicit Task(Handle handle) : handle_(handle) {}
+  Task(Task &&rhs) noexcept : handle_(std::exchange(rhs.handle_, nullptr)) {}
+  Task &operator=(Task &&rhs) noexcept {
+    if (this != &rhs) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(rhs.handle_, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+  // 对称转移：直接切换到子任务，子任务结束后切回
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().continuation_ = awaiting;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().result(); }
+
+  // 放弃所有权，返回尚未开始执行的协程，由调用者负责恢复
+  std::coroutine_handle<> detach() && {
+    handle_.promise().detached_ = true;
+    return std::exchange(handle_, nullptr);
+  }
+
+ private:
+  Handle handle_;
+};
+
+namespace detail {
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+}  // namespace detail
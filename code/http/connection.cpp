@@ -3,6 +3,8 @@
 const char *HttpConn::src_dir_{""};
 std::atomic<int> HttpConn ::user_count_{0};
 bool HttpConn::is_et_{false};
+std::atomic<bool> HttpConn::db_ready_{true};
+std::atomic<bool> HttpConn::admin_paths_{false};
 
 HttpConn::~HttpConn() { closeConn(); }
 
@@ -13,14 +15,29 @@ void HttpConn::init(int fd, const sockaddr_in &addr) {
   write_buffer_.RetrieveAll();
   read_buffer_.RetrieveAll();
   is_close_ = false;
+  generation_++;
   fd_ = fd;
+  access_pending_ = false;
+  accept_us_ = Metrics::nowUs();
+  trace_id_ = 0;
+  setPhase(Phase::FIRST_BYTE);
   LOG_INFO("client[%d](%s:%d) in", fd_, getIP(), getPort());
 }
 
 void HttpConn::closeConn() {
+  // 响应未发送完就断开的请求也要记录
+  if (access_pending_) {
+    logAccess();
+  }
   response_.UnmapFile();
+  if (trace_id_) {
+    Trace::request(trace_id_, trace_name_ + " closed", trace_begin_us_,
+                   Metrics::nowUs());
+    trace_id_ = 0;
+  }
   if (is_close_ == false) {
     is_close_ = true;
+    generation_++;
     user_count_--;
     close(fd_);
     LOG_INFO("client[%d](%s:%d) quit", fd_, getIP(), getPort());
@@ -37,23 +54,47 @@ int HttpConn::getPort() const { return addr_.sin_port; }
 
 ssize_t HttpConn::read(int *save_errno) {
   ssize_t len = -1;
+  size_t before = read_buffer_.ReadableBytes();
+  int64_t begin_us = trace_id_ ? Metrics::nowUs() : 0;
   do {
     len = read_buffer_.ReadFd(fd_, save_errno);
     if (len <= 0) {
       break;
     }
   } while (is_et_);
+  Trace::span(trace_id_, "read", begin_us, Metrics::nowUs());
+  // ET模式下最后一次读取返回EAGAIN，用缓冲区长度判断是否收到数据
+  Phase phase = phase_;
+  size_t received = read_buffer_.ReadableBytes() - before;
+  if (received > 0) {
+    Metrics::add(Metrics::BYTES_READ, received);
+  }
+  if (received > 0 && accept_us_ > 0) {
+    Metrics::record(Metrics::ACCEPT_READ, Metrics::nowUs() - accept_us_);
+    accept_us_ = 0;
+  }
+  if (received > 0 &&
+      (phase == Phase::FIRST_BYTE || phase == Phase::KEEPALIVE)) {
+    setPhase(Phase::HEADER);
+    request_start_ = std::chrono::steady_clock::now();
+    request_wall_us_ = LoopClock::wallUs();
+  }
   return len;
 }
 
 ssize_t HttpConn::write(int *save_errno) {
   ssize_t len = 1;
+  int64_t sent = 0;
+  int64_t begin_us = trace_id_ ? Metrics::nowUs() : 0;
   do {
     len = writev(fd_, iov_, iov_cnt_);
     if (len <= 0) {
       *save_errno = errno;
       break;
     }
+    phase_bytes_ += len;
+    bytes_sent_ += len;
+    sent += len;
     if (iov_[0].iov_len + iov_[1].iov_len == 0) {
       break;
     } else if (static_cast<size_t>(len) > iov_[0].iov_len) {
@@ -69,6 +110,25 @@ ssize_t HttpConn::write(int *save_errno) {
       write_buffer_.Retrieve(len);
     }
   } while (is_et_ || toWriteBytes() > 10240);
+  Metrics::add(Metrics::BYTES_SENT, sent);
+  int64_t end_us = Metrics::nowUs();
+  Trace::span(trace_id_, "writev", begin_us, end_us);
+  if (toWriteBytes() == 0) {
+    Metrics::record(Metrics::WRITE, end_us - write_start_us_);
+    if (trace_id_) {
+      Trace::request(trace_id_,
+                     trace_name_ + " " + std::to_string(response_.Code()),
+                     trace_begin_us_, end_us);
+      trace_id_ = 0;
+    }
+    setPhase(Phase::KEEPALIVE);
+    if (access_pending_) {
+      logAccess();
+    }
+    // 长连接中已收到的下一个请求从这里开始计时
+    request_start_ = std::chrono::steady_clock::now();
+    request_wall_us_ = LoopClock::wallUs();
+  }
   return len;
 }
 
@@ -76,14 +136,257 @@ bool HttpConn::process() {
   request_.init();
   if (read_buffer_.ReadableBytes() <= 0) {
     return false;
-  } else if (request_.parse(read_buffer_)) {
+  }
+  bool too_large = false;
+  db_us_ = 0;
+  if (!requestComplete(&too_large)) {
+    if (!too_large) {
+      return false;
+    }
+    LOG_WARN("client[%d] request too large", fd_);
+    read_buffer_.RetrieveAll();
+    // 未解析出路径，直接指向错误页面，否则会被当作资源不存在
+    request_.path() = "/400.html";
+    access_path_ = request_.path();
+    response_.Init(src_dir_, request_.path(), false, 400);
+    makeResponse();
+    return true;
+  }
+  setPhase(Phase::PROCESS);
+  int64_t parse_begin = Metrics::nowUs();
+  bool parsed = request_.parse(read_buffer_);
+  int64_t parse_end = Metrics::nowUs();
+  Metrics::record(Metrics::PARSE, parse_end - parse_begin);
+  if (trace_id_) {
+    Trace::span(trace_id_, "parse", parse_begin, parse_end);
+    trace_name_ = request_.method() + " " + request_.path();
+  }
+  if (AccessLog::instance()->isOpen()) {
+    access_path_ = request_.path();
+  }
+  if (parsed) {
     LOG_DEBUG("%s", request_.path().data());
+    if (request_.needVerify()) {
+      return true;
+    }
+    if (request_.path() == READY_PATH) {
+      // 负载均衡的就绪检查：数据库连接就绪之前返回503
+      bool ready = db_ready_.load(std::memory_order_relaxed);
+      response_.Init(src_dir_, request_.path(), request_.isKeepalive(),
+                     ready ? 200 : 503);
+      response_.SetBody(ready ? "ready\n" : "starting\n");
+      makeResponse();
+      return true;
+    }
+    if (request_.path() == METRICS_PATH && adminAllowed()) {
+      response_.Init(src_dir_, request_.path(), request_.isKeepalive(), 200);
+      response_.SetBody(Metrics::instance()->render());
+      makeResponse();
+      return true;
+    }
+    if (request_.path() == TRACE_PATH && adminAllowed()) {
+      response_.Init(src_dir_, request_.path(), request_.isKeepalive(), 200);
+      response_.SetBody(Trace::instance()->dump());
+      makeResponse();
+      return true;
+    }
+    if (request_.path() == SESSION_PATH) {
+      // 解析时已经查过会话表，不访问数据库
+      bool ok = !request_.user().empty();
+      response_.Init(src_dir_, request_.path(), request_.isKeepalive(),
+                     ok ? 200 : 401);
+      response_.SetBody(ok ? request_.user() + "\n" : "no session\n");
+      makeResponse();
+      return true;
+    }
+    if (request_.path() == LOGOUT_PATH) {
+      SessionStore::instance()->destroy(
+          request_.getCookie(SessionStore::COOKIE_NAME));
+      request_.path() = "/login.html";
+      response_.Init(src_dir_, request_.path(), request_.isKeepalive(), 200);
+      response_.SetCookie(sessionCookie(""));
+      makeResponse();
+      return true;
+    }
     response_.Init(src_dir_, request_.path(), request_.isKeepalive(), 200);
   } else {
     response_.Init(src_dir_, request_.path(), false, 400);
   }
+  makeResponse();
+  return true;
+}
+
+void HttpConn::verify() {
+  auto begin = std::chrono::steady_clock::now();
+  request_.verify();
+  db_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - begin)
+               .count();
+  Metrics::record(Metrics::DB, db_us_);
+  int64_t now_us = Metrics::nowUs();
+  Trace::span(trace_id_, "db", now_us - db_us_, now_us);
+  response_.Init(src_dir_, request_.path(), request_.isKeepalive(), 200);
+  if (!request_.newSession().empty()) {
+    response_.SetCookie(sessionCookie(request_.newSession()));
+  }
+  makeResponse();
+}
+
+bool HttpConn::verifyAsync(AsyncSqlClient *client,
+                           std::function<void()> done) {
+  uint64_t generation = generation_;
+  auto begin = std::chrono::steady_clock::now();
+  return request_.verifyAsync(
+      client, [this, generation, begin, done](bool ok) {
+        if (generation != generation_) {
+          return;
+        }
+        db_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - begin)
+                     .count();
+        Metrics::record(Metrics::DB, db_us_);
+        int64_t now_us = Metrics::nowUs();
+        Trace::span(trace_id_, "db", now_us - db_us_, now_us);
+        request_.finishVerify(ok);
+        response_.Init(src_dir_, request_.path(), request_.isKeepalive(), 200);
+        if (!request_.newSession().empty()) {
+          response_.SetCookie(sessionCookie(request_.newSession()));
+        }
+        makeResponse();
+        done();
+      });
+}
+
+bool HttpConn::adminAllowed() const {
+  // 127.0.0.0/8
+  return admin_paths_.load(std::memory_order_relaxed) &&
+         (ntohl(addr_.sin_addr.s_addr) >> 24) == 127;
+}
 
+std::string HttpConn::sessionCookie(const std::string &sid) {
+  int max_age = sid.empty() ? 0 : SessionStore::instance()->maxTtlMs() / 1000;
+  return std::string(SessionStore::COOKIE_NAME) + "=" + sid +
+         "; Path=/; Max-Age=" + std::to_string(max_age) +
+         "; HttpOnly; SameSite=Lax";
+}
+
+void HttpConn::reject(int code) {
+  response_.Init(src_dir_, request_.path(), false, code);
+  makeResponse();
+}
+
+bool HttpConn::requestComplete(bool *too_large) {
+  // 请求头和请求体都收齐后才解析，未收齐时记录所处阶段
+  static const char HEADER_END[] = "\r\n\r\n";
+  static const char CONTENT_LENGTH[] = "\r\ncontent-length:";
+  const char *begin = read_buffer_.Peek();
+  const char *end = read_buffer_.BeginWriteConst();
+  const char *header_end = std::search(begin, end, HEADER_END, HEADER_END + 4);
+  if (header_end == end) {
+    *too_large = read_buffer_.ReadableBytes() > MAX_HEADER_SIZE;
+    return false;
+  }
+  if (static_cast<size_t>(header_end - begin) > MAX_HEADER_SIZE) {
+    *too_large = true;
+    return false;
+  }
+  size_t body_len = 0;
+  const char *field = std::search(
+      begin, header_end, CONTENT_LENGTH, CONTENT_LENGTH + 17,
+      [](char a, char b) { return tolower(a) == b; });
+  if (field != header_end) {
+    body_len = strtoul(field + 17, nullptr, 10);
+  }
+  size_t received = end - header_end - 4;
+  if (received >= body_len) {
+    return true;
+  }
+  if (body_len > MAX_BODY_SIZE) {
+    *too_large = true;
+  } else if (phase_ != Phase::BODY) {
+    setPhase(Phase::BODY, received);
+  } else {
+    phase_bytes_ = received;
+  }
+  return false;
+}
+
+void HttpConn::setPhase(Phase phase, int64_t bytes) {
+  phase_bytes_ = bytes;
+  phase_start_ = LoopClock::nowMs();
+  phase_ = phase;
+}
+
+int64_t HttpConn::deadline(const PhaseLimits &limits) const {
+  int64_t start = phase_start_;
+  int64_t bytes = phase_bytes_;
+  switch (phase_.load()) {
+    case Phase::FIRST_BYTE:
+      return start + limits.first_byte_ms;
+    case Phase::HEADER:
+      return start + limits.header_ms;
+    case Phase::BODY:
+      // 宽限期之后，每收到body_min_rate字节可以再多等1s
+      return start + limits.body_grace_ms +
+             bytes * 1000 / std::max(limits.body_min_rate, 1);
+    case Phase::PROCESS:
+      return start + limits.process_ms;
+    case Phase::WRITE:
+      return start + limits.write_grace_ms +
+             bytes * 1000 / std::max(limits.write_min_rate, 1);
+    case Phase::KEEPALIVE:
+    default:
+      return start + limits.keepalive_ms;
+  }
+}
+
+void HttpConn::beginTrace(int64_t begin_us) {
+  Phase phase = phase_;
+  if (trace_id_ || (phase != Phase::FIRST_BYTE && phase != Phase::KEEPALIVE)) {
+    return;
+  }
+  trace_id_ = Trace::instance()->sample();
+  trace_begin_us_ = begin_us;
+  trace_name_.clear();
+}
+
+const char *HttpConn::phaseName(Phase phase) {
+  static const char *names[] = {"first-byte", "header",  "body",
+                                "process",    "write",   "keepalive"};
+  assert(phase < Phase::COUNT);
+  return names[static_cast<int>(phase)];
+}
+
+void HttpConn::logAccess() {
+  access_pending_ = false;
+  AccessLog *access_log = AccessLog::instance();
+  if (!access_log->isOpen() || !access_log->sampled(response_.Code())) {
+    return;
+  }
+  AccessRecord record{};
+  record.wall_us = request_wall_us_;
+  record.request_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - request_start_)
+                          .count();
+  record.db_us = db_us_;
+  record.bytes = bytes_sent_;
+  record.ip = addr_.sin_addr.s_addr;
+  record.port = addr_.sin_port;
+  record.status = response_.Code();
+  access_log->append(record, request_.method().c_str(), access_path_.c_str());
+}
+
+void HttpConn::makeResponse() {
+  setPhase(Phase::WRITE);
+  access_pending_ = true;
+  bytes_sent_ = 0;
+  write_start_us_ = Metrics::nowUs();
   response_.MakeResponse(write_buffer_);
+  // stat、open和mmap都在MakeResponse中
+  Trace::span(trace_id_, "response", write_start_us_, Metrics::nowUs());
+  // 状态码在MakeResponse中才最终确定(如文件不存在时改为404)
+  Metrics::add(Metrics::REQUESTS);
+  Metrics::status(response_.Code());
   // 响应头
   iov_[0].iov_base = const_cast<char *>(write_buffer_.Peek());
   iov_[0].iov_len = write_buffer_.ReadableBytes();
@@ -97,5 +400,4 @@ bool HttpConn::process() {
   }
   LOG_DEBUG("filesize:%d, %d to %d", response_.FileLen(), iov_cnt_,
             toWriteBytes());
-  return true;
 }
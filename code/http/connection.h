@@ -4,17 +4,45 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstdlib>
 
 #include "../buffer/buffer.h"
+#include "../log/accesslog.h"
 #include "../log/log.h"
+#include "../log/metrics.h"
+#include "../log/trace.h"
 #include "../pool/sqlconnRAII.h"
+#include "../utility/clock.h"
 #include "request.h"
 #include "response.h"
 
 class HttpConn {
  public:
+  // 连接所处的阶段，每个阶段有各自的期限
+  enum class Phase : uint8_t {
+    FIRST_BYTE,  // 建立连接后等待第一个字节
+    HEADER,      // 等待请求头接收完整
+    BODY,        // 接收请求体，要求最低速率
+    PROCESS,     // 处理请求(包括等待数据库)
+    WRITE,       // 发送响应，要求最低速率
+    KEEPALIVE,   // 长连接空闲，等待下一个请求
+    COUNT
+  };
+  // 各阶段的期限，速率单位为字节/秒
+  struct PhaseLimits {
+    int first_byte_ms{10000};
+    int header_ms{20000};
+    int body_grace_ms{10000};
+    int body_min_rate{1024};
+    int process_ms{60000};
+    int write_grace_ms{10000};
+    int write_min_rate{4096};
+    int keepalive_ms{60000};
+  };
+
   HttpConn() = default;
   ~HttpConn();
 
@@ -29,17 +57,63 @@ class HttpConn {
   sockaddr_in getAddr() const;
 
   bool process();
+  // 请求需要访问数据库时process只完成解析，由数据库线程池调用verify
+  bool needVerify() const { return request_.needVerify(); }
+  void verify();
+  // 由异步客户端完成校验，查询无法提交时返回false
+  // 完成后调用done(通常在事件循环线程中)；连接已被关闭或复用时不再调用
+  bool verifyAsync(AsyncSqlClient *client, std::function<void()> done);
+  // 无法处理请求时(如数据库线程池已满)直接返回错误页面
+  void reject(int code);
   int toWriteBytes() { return iov_[0].iov_len + iov_[1].iov_len; }
   bool isKeepalive() const { return request_.isKeepalive(); }
+  bool isClose() const { return is_close_; }
+
+  // 读写线程推进阶段，事件循环线程据此计算连接的到期时间(ms)
+  Phase phase() const { return phase_; }
+  int64_t deadline(const PhaseLimits &limits) const;
+  static const char *phaseName(Phase phase);
+
+  // 事件循环分发读事件时调用，新请求按采样率决定是否追踪，begin_us为epoll返回的时间
+  void beginTrace(int64_t begin_us);
+  // 追踪中的请求ID，未采样时为0
+  uint64_t traceId() const { return trace_id_; }
 
   static bool is_et_;
   static const char *src_dir_;
   static std::atomic<int> user_count_;
+  // 访问数据库的请求能否处理，由服务器按连接池的状态更新，GET /ready据此返回200或503
+  static std::atomic<bool> db_ready_;
+  static constexpr const char *READY_PATH = "/ready";
+  // 返回会话对应的用户名(没有会话时401)，以及退出登录
+  static constexpr const char *SESSION_PATH = "/session";
+  static constexpr const char *LOGOUT_PATH = "/logout";
+  // Prometheus抓取，直接由Metrics生成，不经过文件
+  static constexpr const char *METRICS_PATH = "/metrics";
+  // 采样请求的追踪记录(Chrome trace JSON)
+  static constexpr const char *TRACE_PATH = "/trace.json";
+  // 是否响应以上两个路径，默认关闭；打开后也只接受来自本机(回环地址)的连接，
+  // 其他来源与不存在的路径一样返回404
+  static std::atomic<bool> admin_paths_;
 
  private:
+  void makeResponse();
+  void logAccess();
+  bool adminAllowed() const;
+  bool requestComplete(bool *too_large);
+  void setPhase(Phase phase, int64_t bytes = 0);
+  // 登录成功后设置会话cookie，sid为空时清除
+  static std::string sessionCookie(const std::string &sid);
+
+  // 请求头过大时直接返回错误，避免慢速客户端占用大量内存
+  static const size_t MAX_HEADER_SIZE = 8192;
+  static const size_t MAX_BODY_SIZE = 1 << 20;
+
   int fd_{-1};
   sockaddr_in addr_{0};
   bool is_close_{true};
+  // 每次init/closeConn加一，异步回调据此判断连接是否还是发起查询的那个
+  std::atomic<uint64_t> generation_{0};
   int iov_cnt_;
   iovec iov_[2];
 
@@ -48,4 +122,25 @@ class HttpConn {
 
   HttpRequest request_;
   HttpResponse response_;
+
+  std::atomic<Phase> phase_{Phase::FIRST_BYTE};
+  std::atomic<int64_t> phase_start_{0};
+  std::atomic<int64_t> phase_bytes_{0};  // 本阶段已收发的字节数
+
+  // 访问日志，记录的是请求原本的路径(校验后path会被改写为结果页面)
+  bool access_pending_{false};
+  std::chrono::steady_clock::time_point request_start_;
+  int64_t request_wall_us_{0};
+  int64_t db_us_{0};
+  int64_t bytes_sent_{0};
+  std::string access_path_;
+
+  // 阶段耗时的起点(us)，accept_us_在收到第一个字节后清零
+  int64_t accept_us_{0};
+  int64_t write_start_us_{0};
+
+  // 请求追踪，trace_name_为方法和路径，发送完毕或连接关闭时记录整个请求
+  uint64_t trace_id_{0};
+  int64_t trace_begin_us_{0};
+  std::string trace_name_;
 };
\ No newline at end of file
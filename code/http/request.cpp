@@ -8,8 +8,11 @@ const std::unordered_map<std::string, int> HttpRequest::default_html_tag_{
 
 void HttpRequest::init() {
   state_ = HttpRequest::PARSE_STATE::REQUEST_LINE;
+  need_verify_ = false;
   header_.clear();
   post_.clear();
+  user_.clear();
+  new_session_.clear();
 }
 
 bool HttpRequest::isKeepalive() const {
@@ -56,9 +59,38 @@ bool HttpRequest::parse(Buffer &buff) {
     buff.RetrieveUntil(line_end + 2);
   }
   LOG_DEBUG("[%s], [%s], [%s]", method_.data(), path_.data(), version_.data());
+  std::string sid = getCookie(SessionStore::COOKIE_NAME);
+  if (!sid.empty()) {
+    SessionStore::instance()->lookup(sid, &user_);
+  }
   return true;
 }
 
+std::string HttpRequest::getCookie(const std::string &name) const {
+  auto it = header_.find("Cookie");
+  if (it == header_.end()) {
+    return "";
+  }
+  // Cookie: a=1; sid=...
+  const std::string &cookies = it->second;
+  size_t pos = 0;
+  while (pos < cookies.size()) {
+    size_t end = cookies.find(';', pos);
+    if (end == std::string::npos) {
+      end = cookies.size();
+    }
+    while (pos < end && cookies[pos] == ' ') {
+      ++pos;
+    }
+    if (cookies.compare(pos, name.size(), name) == 0 &&
+        pos + name.size() < end && cookies[pos + name.size()] == '=') {
+      return cookies.substr(pos + name.size() + 1, end - pos - name.size() - 1);
+    }
+    pos = end + 1;
+  }
+  return "";
+}
+
 void HttpRequest::parsePath() {
   if (path_ == "/") {
     path_ = "/index.html";
@@ -111,21 +143,133 @@ int HttpRequest::converHex(char ch) {
 
 void HttpRequest::parsePost() {
   if (method_ == "POST" &&
-      header_["Content-Type"] == "application/x-www-from-urlencoded") {
+      header_["Content-Type"] == "application/x-www-form-urlencoded") {
     parseFromUrlencoded();
     if (default_html_tag_.count(path_)) {
       int tag = default_html_tag_.find(path_)->second;
       LOG_DEBUG("Tag:%d", tag);
       if (tag == 0 || tag == 1) {
-        bool is_login = (tag == 1);
-        if (userVerify(post_["username"], post_["password"], is_login)) {
-          path_ = "/welcome.html";
-        } else {
-          path_ = "/error.html";
-        }
+        is_login_ = (tag == 1);
+        need_verify_ = true;
+      }
+    }
+  }
+}
+
+void HttpRequest::verify() {
+  assert(need_verify_);
+  finishVerify(userVerify(post_["username"], post_["password"], is_login_));
+}
+
+void HttpRequest::finishVerify(bool ok) {
+  need_verify_ = false;
+  path_ = ok ? "/welcome.html" : "/error.html";
+  if (ok && is_login_) {
+    // 之后的请求凭cookie识别用户，不再访问数据库
+    std::string name = getPost("username");
+    new_session_ = SessionStore::instance()->create(name);
+    if (!new_session_.empty()) {
+      user_ = name;
+    }
+  }
+}
+
+bool HttpRequest::verifyAsync(AsyncSqlClient *client,
+                              std::function<void(bool)> done) const {
+  assert(need_verify_);
+  std::string name = getPost("username");
+  std::string pwd = getPost("password");
+  bool is_login = is_login_;
+  if (name == "" || pwd == "") {
+    // 与同步校验一致，不访问数据库直接失败
+    done(false);
+    return true;
+  }
+  LOG_INFO("Verify name:%s", name.data());
+  // 回调只使用拷贝的数据，连接在查询期间被关闭也不会访问失效的请求
+  auto decide = [client, name, pwd, is_login, done](UserCache::State state) {
+    VerifyStep step = checkUser(state, is_login);
+    if (step != VerifyStep::INSERT) {
+      done(step == VerifyStep::PASS);
+      return;
+    }
+    LOG_DEBUG("user(%s) register!", name.data());
+    // 哈希在计算线程中完成，query可以在任意线程调用，回调回到事件循环线程
+    bool queued = PasswordHasher::instance()->hashAsync(
+        pwd, [client, name, done](std::string stored) {
+          bool queued =
+              !stored.empty() &&
+              client->execute(MysqlUserStore::INSERT_USER_STMT,
+                              {name, std::move(stored)},
+                              [name, done](SqlResult &result) {
+                                if (!result.ok) {
+                                  LOG_DEBUG("Insert error!");
+                                }
+                                UserCache::instance()->invalidate(name);
+                                done(result.ok);
+                              });
+          if (!queued) {
+            client->post([done] { done(false); });
+          }
+        });
+    if (!queued) {
+      LOG_WARN("password hasher busy!");
+      done(false);
+    }
+  };
+  // 数据库中是慢哈希时交给计算线程校验，结果回到事件循环线程
+  auto settle = [client, name, pwd, decide](const UserCache::Load &load) {
+    if (!load.ok || !load.exists || !PasswordHasher::isHashed(load.password)) {
+      UserCache::State state = UserCache::check(load, pwd);
+      if (state == UserCache::State::MATCH) {
+        upgradePassword(client, name, pwd);
       }
+      decide(state);
+      return;
+    }
+    bool queued = PasswordHasher::instance()->verifyAsync(
+        pwd, load.password, [client, name, pwd, decide](bool match) {
+          client->post([name, pwd, match, decide] {
+            // 与同步校验相同，只在remember_verified打开时缓存
+            if (match) {
+              UserCache::instance()->remember(name, pwd);
+            }
+            decide(match ? UserCache::State::MATCH
+                         : UserCache::State::MISMATCH);
+          });
+        });
+    if (!queued) {
+      LOG_WARN("password hasher busy!");
+      decide(UserCache::State::ERROR);
     }
+  };
+
+  UserCache *cache = UserCache::instance();
+  UserCache::State state = cache->lookup(name, pwd);
+  if (state != UserCache::State::MISS) {
+    decide(state);
+    return true;
+  }
+  // 同一用户已有查询在进行，等它的结果
+  if (!cache->join(name, settle)) {
+    return true;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  bool queued = client->execute(
+      MysqlUserStore::SELECT_USER_STMT, {name},
+      [name, begin, settle](SqlResult &result) {
+        if (!result.ok) {
+          LOG_WARN("verify query error: %s", result.error.c_str());
+        }
+        UserCache::Load load = MysqlUserStore::toLoad(result);
+        UserCache::instance()->complete(name, load, elapsedUs(begin));
+        settle(load);
+      });
+  if (!queued) {
+    // 等待这次查询的其他请求一起失败
+    cache->complete(name, UserCache::Load(), 0);
   }
+  return queued;
 }
 
 void HttpRequest::parseFromUrlencoded() {
@@ -169,70 +313,136 @@ void HttpRequest::parseFromUrlencoded() {
   }
 }
 
-bool HttpRequest::userVerify(const std::string &name, const std::string &pwd,
-                             bool is_login) {
-  if (name == "" || pwd == "") return false;
-  LOG_INFO("Verify name:%s, pwd:%s", name.data(), pwd.data());
+HttpRequest::VerifyStep HttpRequest::checkUser(UserCache::State state,
+                                               bool is_login) {
+  switch (state) {
+    case UserCache::State::ABSENT:
+      // 用户不存在：登录失败，注册需要插入
+      return is_login ? VerifyStep::FAIL : VerifyStep::INSERT;
+    case UserCache::State::MATCH:
+    case UserCache::State::MISMATCH:
+      if (!is_login) {
+        LOG_DEBUG("user used!");
+        return VerifyStep::FAIL;
+      }
+      if (state == UserCache::State::MISMATCH) {
+        LOG_DEBUG("password error!");
+        return VerifyStep::FAIL;
+      }
+      return VerifyStep::PASS;
+    default:
+      return VerifyStep::FAIL;
+  }
+}
 
-  auto sqlconn = SqlConn(SqlConnPool::instance());
-  MYSQL *sql = sqlconn.get();
-  
-  bool flag = false;
-  // unsigned int j = 0;
-  char order[256] = {0};
-  // MYSQL_FIELD *fields{nullptr};
-  MYSQL_RES *res{nullptr};
+int64_t HttpRequest::elapsedUs(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - begin)
+      .count();
+}
+
+// 哈希在计算线程中完成，不增加这次登录的延迟；UPDATE只在密码仍是这个明文时
+// 生效，并发的升级只有一个写入。计算队列已满时放弃，下次登录再试
+void HttpRequest::upgradePassword(AsyncSqlClient *client,
+                                  const std::string &name,
+                                  const std::string &pwd) {
+  PasswordHasher *hasher = PasswordHasher::instance();
+  if (!hasher->isEnabled()) {
+    return;
+  }
+  auto upgraded = [name](bool ok) {
+    if (ok) {
+      LOG_INFO("user(%s) password upgraded to scrypt", name.data());
+      UserCache::instance()->invalidate(name);
+    }
+  };
+  hasher->hashAsync(pwd, [client, name, pwd, upgraded](std::string stored) {
+    if (stored.empty()) {
+      return;
+    }
+    if (!client) {
+      // 同步校验没有事件循环，直接在计算线程中写回
+      upgraded(UserStore::instance()->update(name, pwd, stored));
+      return;
+    }
+    client->execute(MysqlUserStore::UPDATE_USER_STMT,
+                    {std::move(stored), name, pwd},
+                    [upgraded](SqlResult &result) {
+                      upgraded(result.ok && result.affected_rows == 1);
+                    });
+  });
+}
 
-  if (!is_login) {
-    flag = true;
+UserCache::State HttpRequest::loadUser(const std::string &name,
+                                       const std::string &pwd) {
+  UserCache *cache = UserCache::instance();
+  std::promise<UserCache::Load> promise;
+  std::future<UserCache::Load> future = promise.get_future();
+  if (!cache->join(name, [&promise](const UserCache::Load &load) {
+        promise.set_value(load);
+      })) {
+    // 其他数据库线程正在查询同一用户
+    return checkLoad(name, future.get(), pwd);
   }
-  snprintf(order, 256,
-           "SELECT username, password FROM user WHERE username='%s' LIMIT 1",
-           name.data());
-  LOG_DEBUG("%s", order);
+  auto begin = std::chrono::steady_clock::now();
+  UserCache::Load load = UserStore::instance()->find(name);
+  cache->complete(name, load, elapsedUs(begin));
+  return checkLoad(name, load, pwd);
+}
 
-  if (mysql_query(sql, order)) {
-    mysql_free_result(res);
-    return false;
+UserCache::State HttpRequest::checkLoad(const std::string &name,
+                                        const UserCache::Load &load,
+                                        const std::string &pwd) {
+  if (!load.ok || !load.exists || !PasswordHasher::isHashed(load.password)) {
+    UserCache::State state = UserCache::check(load, pwd);
+    if (state == UserCache::State::MATCH) {
+      upgradePassword(nullptr, name, pwd);
+    }
+    return state;
+  }
+  bool match = false;
+  if (!PasswordHasher::instance()->verify(pwd, load.password, &match)) {
+    LOG_WARN("password hasher busy!");
+    return UserCache::State::ERROR;
+  }
+  // 本地存储不经过UserCache；remember默认关闭，打开时用TTL内的快哈希
+  // 换掉重复登录的scrypt(见UserCache::Options::remember_verified)
+  if (match && !UserStore::instance()->isLocal()) {
+    UserCache::instance()->remember(name, pwd);
   }
+  return match ? UserCache::State::MATCH : UserCache::State::MISMATCH;
+}
 
-  res = mysql_store_result(sql);
-  // j = mysql_num_fields(res);
-  // fields = mysql_fetch_fields(res);
+bool HttpRequest::userVerify(const std::string &name, const std::string &pwd,
+                             bool is_login) {
+  if (name == "" || pwd == "") return false;
+  LOG_INFO("Verify name:%s", name.data());
 
-  if (MYSQL_ROW row = mysql_fetch_row(res)) {
-    LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-    std::string password(row[1]);
-    if (is_login) {
-      if (pwd == password) {
-        flag = true;
-      } else {
-        flag = false;
-        LOG_DEBUG("password error!");
-      }
-    } else {
-      flag = false;
-      LOG_DEBUG("user used!");
+  UserStore *store = UserStore::instance();
+  UserCache::State state;
+  if (store->isLocal()) {
+    // 查询本身就在内存中完成，不经过缓存
+    state = checkLoad(name, store->find(name), pwd);
+  } else {
+    state = UserCache::instance()->lookup(name, pwd);
+    if (state == UserCache::State::MISS) {
+      state = loadUser(name, pwd);
     }
   }
-  mysql_free_result(res);
+  VerifyStep step = checkUser(state, is_login);
 
   // 注册行为且用户名未被使用
-  if (!is_login && flag == true) {
+  bool flag = step == VerifyStep::PASS;
+  if (step == VerifyStep::INSERT) {
     LOG_DEBUG("user(%s) register!", name.data());
-    std::memset(order, 0, 256);
-    snprintf(order, 256,
-             "INSERT INTO user(username, password) VALUES('%s','%s')",
-             name.data(), pwd.data());
-    LOG_DEBUG("order: %s", order);
-    if (mysql_query(sql, order)) {
+    std::string stored;
+    flag = PasswordHasher::instance()->hash(pwd, &stored) &&
+           store->insert(name, stored);
+    if (!flag) {
       LOG_DEBUG("Insert error!");
-      flag = false;
-    } else {
-      flag = true;
     }
+    UserCache::instance()->invalidate(name);
   }
-  SqlConnPool::instance()->freeConn(sql);
   LOG_DEBUG("user verify success!");
   return flag;
 }
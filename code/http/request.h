@@ -3,6 +3,8 @@
 #include <mysql/mysql.h>
 
 #include <cerrno>
+#include <chrono>
+#include <future>
 #include <regex>
 #include <string>
 #include <unordered_map>
@@ -10,8 +12,11 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
-#include "../pool/sqlconnRAII.h"
-#include "../pool/sqlconnpool.h"
+#include "../pool/asyncsql.h"
+#include "../pool/passwordhasher.h"
+#include "../pool/sessionstore.h"
+#include "../pool/usercache.h"
+#include "../pool/userstore.h"
 
 class HttpRequest {
  public:
@@ -40,6 +45,22 @@ class HttpRequest {
   std::string getPost(const std::string &key) const;
   std::string getPost(const char *key) const;
   bool isKeepalive() const;
+  std::string getCookie(const std::string &name) const;
+  // 会话cookie对应的用户(解析时查询SessionStore)或本次登录的用户，未登录时为空
+  const std::string &user() const { return user_; }
+  // 本次登录创建的会话ID，需要在响应中设置cookie
+  const std::string &newSession() const { return new_session_; }
+
+  // 登录/注册请求需要访问数据库，解析阶段只做标记
+  // 由数据库线程池调用verify完成校验并确定响应页面
+  bool needVerify() const { return need_verify_; }
+  void verify();
+  // 通过事件循环中的异步客户端校验，查询无法提交时返回false
+  // 完成后在事件循环线程中以校验结果调用done(不需要查询时在当前线程直接调用)，
+  // done之前不再访问本对象，由done确认连接仍然有效后调用finishVerify确定响应页面
+  bool verifyAsync(AsyncSqlClient *client,
+                   std::function<void(bool)> done) const;
+  void finishVerify(bool ok);
 
  private:
   bool parseRequestLine(const std::string &line);
@@ -50,16 +71,35 @@ class HttpRequest {
   void parsePost();
   void parseFromUrlencoded();
 
+  // 用户是否存在、密码是否匹配决定校验结果，注册时还需要插入
+  enum class VerifyStep { PASS, FAIL, INSERT };
+  static VerifyStep checkUser(UserCache::State state, bool is_login);
+  static int64_t elapsedUs(std::chrono::steady_clock::time_point begin);
+  // 明文密码校验通过后在后台换成慢哈希，client为空时通过UserStore写回
+  static void upgradePassword(AsyncSqlClient *client, const std::string &name,
+                              const std::string &pwd);
+  // 同步校验通过UserStore访问用户数据，MySQL存储先查UserCache，
+  // 未命中时由loadUser查询数据库(同一用户的并发查询合并为一次)
+  static UserCache::State loadUser(const std::string &name,
+                                   const std::string &pwd);
+  // 慢哈希在PasswordHasher的线程池中校验(阻塞等待)，通过后写入UserCache
+  static UserCache::State checkLoad(const std::string &name,
+                                    const UserCache::Load &load,
+                                    const std::string &pwd);
   static bool userVerify(const std::string &name, const std::string &pwd,
                          bool is_login);
 
   PARSE_STATE state_{};
+  bool need_verify_{false};
+  bool is_login_{false};
   std::string method_{""};
   std::string path_{""};
   std::string version_{""};
   std::string body_{""};
   std::unordered_map<std::string, std::string> header_;
   std::unordered_map<std::string, std::string> post_;
+  std::string user_;
+  std::string new_session_;
 
   static const std::unordered_map<std::string, int> default_html_tag_;
   static const std::unordered_set<std::string> default_html_;
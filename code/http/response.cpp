@@ -4,6 +4,7 @@ const std::unordered_map<std::string, std::string> HttpResponse::suffix_type_ =
         {".html", "text/html"},
         {".xml", "text/xml"},
         {".txt", "text/plain"},
+        {".json", "application/json"},
         {"css", "text/css"},
         {".js", "text/js"},
         {".xhtml", "application/xhtml+xml"},
@@ -23,10 +24,18 @@ const std::unordered_map<std::string, std::string> HttpResponse::suffix_type_ =
 };
 
 const std::unordered_map<int, std::string> HttpResponse::code_status_ = {
-    {200, "OK"}, {400, "Bad Reques"}, {403, "Forbidden"}, {404, "Not Found"}};
+    {200, "OK"},
+    {400, "Bad Reques"},
+    {401, "Unauthorized"},
+    {403, "Forbidden"},
+    {404, "Not Found"},
+    {503, "Service Unavailable"}};
 
 const std::unordered_map<int, std::string> HttpResponse::code_path_ = {
-    {400, "/400.html"}, {403, "/403.html"}, {404, "/404.html"}};
+    {400, "/400.html"},
+    {403, "/403.html"},
+    {404, "/404.html"},
+    {503, "/error.html"}};
 
 HttpResponse::~HttpResponse() { UnmapFile(); }
 
@@ -40,9 +49,27 @@ void HttpResponse::Init(const std::string &src_dir, std::string &path,
   is_keepalive_ = is_keepalive;
   path_ = path;
   src_dir_ = src_dir;
+  body_.clear();
+  has_body_ = false;
+  cookie_.clear();
 }
 
+void HttpResponse::SetBody(std::string body) {
+  body_ = std::move(body);
+  has_body_ = true;
+}
+
+void HttpResponse::SetCookie(std::string cookie) { cookie_ = std::move(cookie); }
+
 void HttpResponse::MakeResponse(Buffer &buff) {
+  if (has_body_) {
+    AddStateLine(buff);
+    AddHeader(buff);
+    buff.Append("Content-length: " + std::to_string(body_.size()) +
+                "\r\n\r\n");
+    buff.Append(body_);
+    return;
+  }
   // 判断请求资源是否存在
   if (stat((src_dir_ + path_).data(), &mm_filestat_) < 0 ||
       S_ISDIR(mm_filestat_.st_mode)) {
@@ -89,6 +116,14 @@ void HttpResponse::AddHeader(Buffer &buff) {
     buff.Append("close\r\n");
   }
   buff.Append("Content-type: " + GetFileType() + "\r\n");
+  if (!cookie_.empty()) {
+    buff.Append("Set-Cookie: " + cookie_ + "\r\n");
+  }
+  LoopClock::WallTime now;
+  LoopClock::wallTime(&now);
+  buff.Append("Date: ");
+  buff.Append(now.http_date, strlen(now.http_date));
+  buff.Append("\r\n");
 }
 
 void HttpResponse::AddContent(Buffer &buff) {
@@ -18,6 +18,10 @@ class HttpResponse {
 
   void Init(const std::string &str_dir, std::string &path,
             bool keep_alive = false, int code = -1);
+  // 响应内容直接给出而不是来自文件，在Init之后调用
+  void SetBody(std::string body);
+  // 附加Set-Cookie头，在Init之后调用
+  void SetCookie(std::string cookie);
   void MakeResponse(Buffer &buff);
   void UnmapFile();
   char *File();
@@ -36,6 +40,9 @@ class HttpResponse {
   bool is_keepalive_{false};
   std::string path_{""};
   std::string src_dir_{""};
+  std::string body_{""};
+  bool has_body_{false};
+  std::string cookie_{""};
   char *mm_file_{nullptr};
   struct stat mm_filestat_ {
     0
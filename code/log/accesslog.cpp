@@ -0,0 +1,386 @@
+#include "accesslog.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+AccessLog *AccessLog::instance() {
+  static AccessLog inst;
+  return &inst;
+}
+
+AccessLog::~AccessLog() {
+  if (write_thread_ && write_thread_->joinable()) {
+    {
+      std::lock_guard locker(writer_mtx_);
+      stop_ = true;
+    }
+    writer_cv_.notify_one();
+    write_thread_->join();
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool AccessLog::init(const Options &options) {
+  // 只能初始化一次，格式和缓冲大小在运行中不再改变
+  if (is_open_ || options.path.empty()) {
+    return false;
+  }
+  options_ = options;
+  options_.sample = std::max(options_.sample, 1);
+  size_t ring_size = 1;
+  while (ring_size < options_.ring_size) {
+    ring_size <<= 1;
+  }
+  options_.ring_size = ring_size;
+  tokens_ = parseFormat(options_.format);
+  if (!openFile()) {
+    return false;
+  }
+  if (options_.rotate_interval_s > 0) {
+    time_t now = time(nullptr);
+    next_rotate_ = (now / options_.rotate_interval_s + 1) *
+                   options_.rotate_interval_s;
+  }
+  write_thread_ = std::make_unique<std::thread>([this] { asyncWrite(); });
+  is_open_ = true;
+  return true;
+}
+
+std::vector<AccessLog::Token> AccessLog::parseFormat(
+    const std::string &format) {
+  static const struct {
+    const char *name;
+    Field field;
+  } vars[] = {{"remote_addr", Field::REMOTE_ADDR},
+              {"remote_port", Field::REMOTE_PORT},
+              {"time_local", Field::TIME_LOCAL},
+              {"time_iso8601", Field::TIME_ISO8601},
+              {"msec", Field::MSEC},
+              {"request_method", Field::METHOD},
+              {"request_uri", Field::URI},
+              {"status", Field::STATUS},
+              {"bytes_sent", Field::BYTES_SENT},
+              {"request_time", Field::REQUEST_TIME},
+              {"db_time", Field::DB_TIME}};
+  std::vector<Token> tokens;
+  auto text = [&tokens](const std::string &str) {
+    if (!tokens.empty() && tokens.back().field == Field::TEXT) {
+      tokens.back().text += str;
+    } else {
+      tokens.push_back({Field::TEXT, str});
+    }
+  };
+  size_t i = 0;
+  while (i < format.size()) {
+    size_t dollar = format.find('$', i);
+    if (dollar == std::string::npos) {
+      text(format.substr(i));
+      break;
+    }
+    text(format.substr(i, dollar - i));
+    size_t end = dollar + 1;
+    while (end < format.size() &&
+           (isalnum(static_cast<unsigned char>(format[end])) ||
+            format[end] == '_')) {
+      ++end;
+    }
+    std::string name = format.substr(dollar + 1, end - dollar - 1);
+    auto var = std::find_if(std::begin(vars), std::end(vars),
+                            [&name](const auto &v) { return name == v.name; });
+    if (var == std::end(vars)) {
+      // 不认识的变量原样输出
+      text(format.substr(dollar, end - dollar));
+    } else {
+      tokens.push_back({var->field, ""});
+    }
+    i = end;
+  }
+  return tokens;
+}
+
+bool AccessLog::sampled(int status) const {
+  if (options_.sample <= 1 || status >= 400) {
+    return true;
+  }
+  thread_local uint32_t counter = 0;
+  return ++counter % options_.sample == 0;
+}
+
+void AccessLog::append(const AccessRecord &record, const char *method,
+                       const char *path) {
+  char buf[sizeof(AccessRecord) + UINT8_MAX + MAX_PATH_LEN];
+  AccessRecord *header = reinterpret_cast<AccessRecord *>(buf);
+  *header = record;
+  header->method_len = std::min<size_t>(strlen(method), UINT8_MAX);
+  header->path_len = std::min<size_t>(strlen(path), MAX_PATH_LEN);
+  memcpy(buf + sizeof(AccessRecord), method, header->method_len);
+  memcpy(buf + sizeof(AccessRecord) + header->method_len, path,
+         header->path_len);
+  size_t len = sizeof(AccessRecord) + header->method_len + header->path_len;
+  LogRing *ring = localRing();
+  // 访问日志不值得让请求线程等待，写不进去直接丢弃
+  if (!ring->push(buf, len)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    wakeWriter();
+    return;
+  }
+  if (ring->size() > ring->capacity() / 2) {
+    wakeWriter();
+  }
+}
+
+LogRing *AccessLog::localRing() {
+  struct Holder {
+    std::shared_ptr<LogRing> ring;
+    ~Holder() {
+      if (ring) {
+        ring->orphan();
+      }
+    }
+  };
+  thread_local Holder holder;
+  if (!holder.ring) {
+    holder.ring = std::make_shared<LogRing>(options_.ring_size);
+    std::lock_guard locker(rings_mtx_);
+    rings_.push_back(holder.ring);
+    rings_version_++;
+  }
+  return holder.ring.get();
+}
+
+void AccessLog::wakeWriter() {
+  if (!wake_pending_.exchange(true, std::memory_order_relaxed)) {
+    writer_cv_.notify_one();
+  }
+}
+
+void AccessLog::flush() {
+  if (!write_thread_) {
+    return;
+  }
+  std::unique_lock locker(writer_mtx_);
+  uint64_t request = ++flush_request_;
+  writer_cv_.notify_one();
+  flushed_cv_.wait(locker, [&] { return flush_done_ >= request || stop_; });
+}
+
+void AccessLog::asyncWrite() {
+  std::unique_lock locker(writer_mtx_);
+  while (true) {
+    writer_cv_.wait_for(locker,
+                        std::chrono::milliseconds(options_.flush_interval_ms),
+                        [this] {
+                          return stop_ || wake_pending_ ||
+                                 flush_request_ != flush_done_;
+                        });
+    wake_pending_ = false;
+    bool stop = stop_;
+    uint64_t request = flush_request_;
+    locker.unlock();
+    // 文件切换也在这里进行，请求线程不会被阻塞
+    rotateIfNeeded(time(nullptr));
+    while (drain() > 0) {
+    }
+    locker.lock();
+    flush_done_ = request;
+    flushed_cv_.notify_all();
+    if (stop) {
+      break;
+    }
+  }
+}
+
+size_t AccessLog::drain() {
+  if (snapshot_version_ != rings_version_.load()) {
+    std::lock_guard locker(rings_mtx_);
+    snapshot_ = rings_;
+    snapshot_version_ = rings_version_;
+  }
+  staging_.clear();
+  bool has_orphan = false;
+  for (auto &ring : snapshot_) {
+    has_orphan |= ring->orphaned();
+    iovec iov[2];
+    int n = ring->peek(iov);
+    size_t len = 0;
+    for (int i = 0; i < n; ++i) {
+      const char *base = static_cast<const char *>(iov[i].iov_base);
+      staging_.insert(staging_.end(), base, base + iov[i].iov_len);
+      len += iov[i].iov_len;
+    }
+    ring->consume(len);
+  }
+  output_.clear();
+  const char *end = staging_.data() + staging_.size();
+  for (const char *p = staging_.data(); p < end;) {
+    AccessRecord record;
+    memcpy(&record, p, sizeof(record));
+    const char *payload = p + sizeof(record);
+    p = payload + record.method_len + record.path_len;
+    formatRecord(record, payload);
+    // 单个文件达到上限时在记录之间切换
+    if (options_.max_bytes > 0 &&
+        file_bytes_ + output_.size() >= options_.max_bytes) {
+      writeOut();
+      rotateIfNeeded(time(nullptr));
+    }
+  }
+  writeOut();
+  if (has_orphan) {
+    std::lock_guard locker(rings_mtx_);
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                                [](const std::shared_ptr<LogRing> &ring) {
+                                  return ring->orphaned() && ring->size() == 0;
+                                }),
+                 rings_.end());
+    rings_version_++;
+  }
+  return staging_.size();
+}
+
+// 方法和路径来自客户端，与nginx一样把引号、反斜杠和不可打印字节写成\xHH，
+// 避免破坏带引号的字段或在日志中写入控制字符
+static void AppendEscaped(std::string &out, const char *text, size_t len) {
+  static const char HEX[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char c = text[i];
+    if (c == '"' || c == '\\' || c < 0x20 || c >= 0x7f) {
+      char escaped[4] = {'\\', 'x', HEX[c >> 4], HEX[c & 0xf]};
+      out.append(escaped, sizeof(escaped));
+    } else {
+      out += c;
+    }
+  }
+}
+
+void AccessLog::formatRecord(const AccessRecord &record,
+                             const char *payload) {
+  time_t sec = record.wall_us / 1000000;
+  if (sec != formatted_sec_) {
+    struct tm t;
+    localtime_r(&sec, &t);
+    strftime(time_local_, sizeof(time_local_), "%d/%b/%Y:%H:%M:%S %z", &t);
+    strftime(time_iso8601_, sizeof(time_iso8601_), "%Y-%m-%dT%H:%M:%S%z", &t);
+    formatted_sec_ = sec;
+  }
+  char buf[64];
+  for (const Token &token : tokens_) {
+    switch (token.field) {
+      case Field::TEXT:
+        output_ += token.text;
+        break;
+      case Field::REMOTE_ADDR: {
+        in_addr addr{record.ip};
+        inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+        output_ += buf;
+        break;
+      }
+      case Field::REMOTE_PORT:
+        output_ += std::to_string(ntohs(record.port));
+        break;
+      case Field::TIME_LOCAL:
+        output_ += time_local_;
+        break;
+      case Field::TIME_ISO8601:
+        output_ += time_iso8601_;
+        break;
+      case Field::MSEC:
+        snprintf(buf, sizeof(buf), "%ld.%03ld", long(sec),
+                 long(record.wall_us / 1000 % 1000));
+        output_ += buf;
+        break;
+      case Field::METHOD:
+        AppendEscaped(output_, payload, record.method_len);
+        break;
+      case Field::URI:
+        AppendEscaped(output_, payload + record.method_len, record.path_len);
+        break;
+      case Field::STATUS:
+        output_ += std::to_string(record.status);
+        break;
+      case Field::BYTES_SENT:
+        output_ += std::to_string(record.bytes);
+        break;
+      case Field::REQUEST_TIME:
+        // 与nginx一致，以秒为单位，精确到毫秒
+        snprintf(buf, sizeof(buf), "%u.%03u", record.request_us / 1000000,
+                 record.request_us / 1000 % 1000);
+        output_ += buf;
+        break;
+      case Field::DB_TIME:
+        snprintf(buf, sizeof(buf), "%u.%03u", record.db_us / 1000000,
+                 record.db_us / 1000 % 1000);
+        output_ += buf;
+        break;
+    }
+  }
+  output_ += '\n';
+  written_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AccessLog::writeOut() {
+  const char *data = output_.data();
+  size_t len = output_.size();
+  while (len > 0 && fd_ >= 0) {
+    ssize_t n = ::write(fd_, data, len);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    data += n;
+    len -= n;
+    file_bytes_ += n;
+  }
+  output_.clear();
+}
+
+void AccessLog::rotateIfNeeded(time_t now) {
+  bool by_size = options_.max_bytes > 0 && file_bytes_ >= options_.max_bytes;
+  bool by_time = next_rotate_ > 0 && now >= next_rotate_;
+  if (!by_size && !by_time) {
+    return;
+  }
+  if (by_time) {
+    next_rotate_ = (now / options_.rotate_interval_s + 1) *
+                   options_.rotate_interval_s;
+  }
+  // 当前文件改名为 path.YYYYmmdd-HHMMSS[.N]，再重新打开path
+  struct tm t;
+  localtime_r(&now, &t);
+  char suffix[32];
+  strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &t);
+  std::string target = options_.path + suffix;
+  for (int i = 1; access(target.c_str(), F_OK) == 0; ++i) {
+    target = options_.path + suffix + "." + std::to_string(i);
+  }
+  if (rename(options_.path.c_str(), target.c_str()) == 0) {
+    rotations_.fetch_add(1, std::memory_order_relaxed);
+  }
+  openFile();
+}
+
+bool AccessLog::openFile() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+  fd_ = open(options_.path.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    size_t slash = options_.path.rfind('/');
+    if (slash != std::string::npos) {
+      mkdir(options_.path.substr(0, slash).c_str(), 0777);
+    }
+    fd_ = open(options_.path.c_str(), flags, 0644);
+  }
+  struct stat st;
+  file_bytes_ = (fd_ >= 0 && fstat(fd_, &st) == 0) ? st.st_size : 0;
+  return fd_ >= 0;
+}
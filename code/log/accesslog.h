@@ -0,0 +1,136 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logring.h"
+
+// 一次请求的访问记录，后面紧跟method和path的字节
+struct AccessRecord {
+  int64_t wall_us;      // 开始接收请求的墙上时间
+  uint32_t request_us;  // 从收到请求到响应发送完毕
+  uint32_t db_us;       // 其中访问数据库的时间
+  uint64_t bytes;       // 已发送的字节数
+  uint32_t ip;          // 网络字节序
+  uint16_t port;
+  uint16_t status;
+  uint8_t method_len;
+  uint8_t reserved;
+  uint16_t path_len;
+};
+
+// nginx风格的访问日志，格式中可用的变量：
+//   $remote_addr $remote_port $time_local $time_iso8601 $msec $request_method
+//   $request_uri $status $bytes_sent $request_time $db_time
+// 与Log一样每个线程写自己的LogRing，不加锁也不做格式化；
+// 独立的线程批量格式化、写入，并按大小和时间切换文件，请求线程从不等待
+class AccessLog {
+ public:
+  struct Options {
+    std::string path{"./log/access.log"};
+    std::string format{
+        "$remote_addr - [$time_local] \"$request_method $request_uri\" "
+        "$status $bytes_sent $request_time $db_time"};
+    int sample{1};                    // 每N个成功的请求记录一个，错误全部记录
+    size_t ring_size{1 << 18};        // 每个线程的缓冲字节数，取2的幂
+    size_t max_bytes{64 << 20};       // 单个文件的大小上限，0表示不限
+    int rotate_interval_s{86400};     // 按时间切换的间隔，0表示不切换
+    int flush_interval_ms{100};
+  };
+
+  static AccessLog *instance();
+  bool init(const Options &options);
+  bool isOpen() const { return is_open_.load(std::memory_order_relaxed); }
+
+  // 按状态码和采样率决定这次请求是否需要记录，调用线程本地计数
+  bool sampled(int status) const;
+  // 写入本线程的缓冲，缓冲已满时丢弃并计数
+  void append(const AccessRecord &record, const char *method,
+              const char *path);
+  // 等待已提交的记录写入文件
+  void flush();
+
+  uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  uint64_t rotations() const {
+    return rotations_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // 格式中的一段，变量或者原样输出的文本
+  enum class Field {
+    TEXT,
+    REMOTE_ADDR,
+    REMOTE_PORT,
+    TIME_LOCAL,
+    TIME_ISO8601,
+    MSEC,
+    METHOD,
+    URI,
+    STATUS,
+    BYTES_SENT,
+    REQUEST_TIME,
+    DB_TIME
+  };
+  struct Token {
+    Field field;
+    std::string text;
+  };
+
+  AccessLog() = default;
+  ~AccessLog();
+
+  static std::vector<Token> parseFormat(const std::string &format);
+  LogRing *localRing();
+  void wakeWriter();
+  void asyncWrite();
+  size_t drain();
+  void formatRecord(const AccessRecord &record, const char *payload);
+  void writeOut();
+  void rotateIfNeeded(time_t now);
+  bool openFile();
+
+  static constexpr size_t MAX_PATH_LEN = 1024;
+
+  Options options_;
+  std::vector<Token> tokens_;
+  std::atomic<bool> is_open_{false};
+  std::atomic<uint64_t> written_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> rotations_{0};
+
+  std::mutex rings_mtx_;
+  std::vector<std::shared_ptr<LogRing>> rings_;
+  std::atomic<uint64_t> rings_version_{0};
+
+  // 以下只由写日志的线程访问
+  std::vector<std::shared_ptr<LogRing>> snapshot_;
+  uint64_t snapshot_version_{0};
+  std::vector<char> staging_;
+  std::string output_;
+  int fd_{-1};
+  size_t file_bytes_{0};
+  time_t next_rotate_{0};
+  time_t formatted_sec_{-1};
+  char time_local_[32];
+  char time_iso8601_[32];
+
+  std::unique_ptr<std::thread> write_thread_{nullptr};
+  std::mutex writer_mtx_;
+  std::condition_variable writer_cv_;
+  std::condition_variable flushed_cv_;
+  std::atomic<bool> wake_pending_{false};
+  bool stop_{false};
+  uint64_t flush_request_{0};
+  uint64_t flush_done_{0};
+};
@@ -1,155 +1,344 @@
 #include "log.h"
 
+#include <cerrno>
+#include <climits>
+
 Log::~Log() {
   if (write_thread_ && write_thread_->joinable()) {
-    while (!deque_->empty()) {
-      deque_->flush();
+    {
+      std::lock_guard locker(writer_mtx_);
+      stop_ = true;
     }
-    deque_->close();
+    // 日志线程退出前会写完所有缓冲
+    writer_cv_.notify_one();
     write_thread_->join();
   }
-  if (fp_) {
-    std::unique_lock locker(mtx_);
-    flush();
-    fclose(fp_);
+  if (fd_ >= 0) {
+    close(fd_);
   }
 }
 
-int Log::getLevel() {
-  std::unique_lock locker(mtx_);
-  return level_;
+LogSite::LogSite(int level, const char *format, const char *file, int line)
+    : level(level), format(format), file(file), line(line) {
+  id = Log::instance()->registerSite(this);
 }
 
-void Log::setLevel(int level) {
-  std::unique_lock locker(mtx_);
+void Log::init(int level, const char *path, const char *suffix,
+               int max_queue_size, bool binary) {
   level_ = level;
-}
+  path_ = path;
+  suffix_ = suffix;
 
-void Log::init(int level = 1, const char *path, const char *suffix,
-               int max_queue_size) {
-  is_open_ = true;
-  level_ = level;
+  LoopClock::WallTime now;
+  LoopClock::wallTime(&now);
+  const struct tm &t = now.tm;
+  char file_name[LOG_NAME_LEN] = {0};
+  snprintf(file_name, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", path_,
+           t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
+  {
+    std::lock_guard locker(mtx_);
+    binary_ = binary;
+    today_ = t.tm_mday;
+    line_count_ = 0;
+    part_ = 0;
+    openFile(file_name);
+  }
 
   if (max_queue_size > 0) {
+    // 每个线程的缓冲区大小取2的幂
+    size_t bytes = static_cast<size_t>(max_queue_size) * 128;
+    ring_size_ = 1;
+    while (ring_size_ < bytes) {
+      ring_size_ <<= 1;
+    }
     is_async_ = true;
-    if (!deque_) {
-      deque_ = std::make_unique<BlockDeque<std::string>>();
+    if (!write_thread_) {
       write_thread_ = std::make_unique<std::thread>(flushLogThread);
     }
   } else {
     is_async_ = false;
   }
+  is_open_ = true;
+}
 
-  line_count_ = 0;
+void Log::openFile(const char *file_name) {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+  fd_ = open(file_name, flags, 0644);
+  if (fd_ < 0) {
+    mkdir(path_, 0777);
+    fd_ = open(file_name, flags, 0644);
+  }
+  assert(fd_ >= 0);
+  // 二进制日志的每个文件都要带上完整的调用点定义
+  sites_written_ = 0;
+  struct stat st;
+  if (binary_ && fstat(fd_, &st) == 0 && st.st_size == 0) {
+    writeAll(logfmt::FILE_MAGIC, sizeof(logfmt::FILE_MAGIC));
+  }
+}
 
-  time_t timer = time(nullptr);
-  struct tm *sys_time = localtime(&timer);
-  struct tm t = *sys_time;
-  path_ = path;
-  suffix_ = suffix;
-  char file_name[LOG_NAME_LEN] = {0};
-  snprintf(file_name, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", path_,
-           t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-  today_ = t.tm_mday;
+uint32_t Log::registerSite(const LogSite *site) {
+  std::lock_guard locker(sites_mtx_);
+  uint32_t id = site_count_.load(std::memory_order_relaxed);
+  assert(id < MAX_SITES);
+  if (id >= MAX_SITES) {
+    // 超出上限的调用点共用最后一个编号
+    return MAX_SITES - 1;
+  }
+  sites_[id].store(site, std::memory_order_relaxed);
+  site_count_.store(id + 1, std::memory_order_release);
+  return id;
+}
 
-  std::unique_lock locker(mtx_);
-  buff_.RetrieveAll();
-  if (fp_) {
-    flush();
-    fclose(fp_);
+void Log::setRateLimit(int rate, int burst) {
+  if (rate <= 0) {
+    interval_ns_ = 0;
+    return;
   }
+  int64_t interval = 1000000000LL / rate;
+  tolerance_ns_ = interval * (std::max(burst, 1) - 1);
+  interval_ns_ = interval;
+}
 
-  fp_ = fopen(file_name, "a");
-  if (fp_ == nullptr) {
-    mkdir(path_, 0777);
-    fp_ = fopen(file_name, "a");
-  }
-  assert(fp_ != nullptr);
-}
-
-void Log::write(int level, const char *format, ...) {
-  struct timeval now = {0, 0};
-  gettimeofday(&now, nullptr);
-  time_t sec = now.tv_sec;
-  struct tm *sys_time = localtime(&sec);
-  struct tm t = *sys_time;
-  va_list args;
-
-  // 日志日期与行数
-  if (today_ != t.tm_mday || (line_count_ && (line_count_ % MAX_LINES == 0))) {
-    char new_file[LOG_NAME_LEN] = {0};
-    char tail[36] = {0};
-    snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1,
-             t.tm_mday);
-    if (today_ != t.tm_mday) {
-      snprintf(new_file, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-      today_ = t.tm_mday;
-      line_count_ = 0;
-    } else {
-      snprintf(new_file, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail,
-               (line_count_ / MAX_LINES), suffix_);
+void Log::reportSuppressed(const LogSite &site) {
+  uint64_t count = site.suppressed.exchange(0, std::memory_order_relaxed);
+  if (count == 0) {
+    return;
+  }
+  // 汇总本身不经过限流，每次放行最多带出一条
+  static const LogSite summary(2, "%s:%d: %lu messages suppressed", __FILE__,
+                               __LINE__);
+  record(summary, site.file, site.line, count);
+}
+
+void Log::sweepSuppressed() {
+  // 调用点不再打印时，由日志线程定时报告剩余的限流条数
+  uint32_t count = site_count_.load(std::memory_order_acquire);
+  for (uint32_t i = 0; i < count; ++i) {
+    const LogSite *site = sites_[i].load(std::memory_order_relaxed);
+    if (site && site->suppressed.load(std::memory_order_relaxed) > 0) {
+      reportSuppressed(*site);
     }
-    std::unique_lock locker(mtx_);
-    flush();
-    fclose(fp_);
-    fp_ = fopen(new_file, "a");
-    assert(fp_ != nullptr);
-  }
-  std::unique_lock locker(mtx_);
-  line_count_++;
-  int n =
-      snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-               t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min,
-               t.tm_sec, now.tv_usec);
-  buff_.HasWritten(n);
-  appendLogLevelTitle(level);
-  va_start(args, format);
-  int m = vsnprintf(buff_.BeginWrite(), buff_.WriteableBytes(), format, args);
-  va_end(args);
-
-  buff_.HasWritten(m);
-  buff_.Append("\n\0", 2);
-
-  if (is_async_ && deque_ && !deque_->full()) {
-    deque_->push_back(buff_.RetrieveAllToStr());
-  } else {
-    fputs(buff_.Peek(), fp_);
   }
-  buff_.RetrieveAll();
 }
 
-void Log::appendLogLevelTitle(int level) {
-  switch (level) {
-    case 0:
-      buff_.Append("[debug]: ", 9);
-      break;
-    case 1:
-      buff_.Append("[info] : ", 9);
-      break;
-    case 2:
-      buff_.Append("[warn] : ", 9);
-      break;
-    case 3:
-      buff_.Append("[error]: ", 9);
-      break;
-    default:
-      buff_.Append("[info] : ", 9);
-      break;
+void Log::commit(const char *data, size_t len) {
+  if (!is_async_) {
+    std::lock_guard locker(mtx_);
+    writeRecords(data, len);
+    return;
   }
+  LogRing *ring = localRing();
+  for (int retry = 0; !ring->push(data, len); ++retry) {
+    // 缓冲已满，唤醒日志线程并让出CPU，仍然写不进去就丢弃
+    if (retry == PUSH_RETRY) {
+      dropped_++;
+      return;
+    }
+    wakeWriter();
+    std::this_thread::yield();
+  }
+  if (ring->size() > ring->capacity() / 2) {
+    wakeWriter();
+  }
+}
+
+LogRing *Log::localRing() {
+  // 线程退出时把缓冲标记为无主，由日志线程写完后回收
+  struct Holder {
+    std::shared_ptr<LogRing> ring;
+    ~Holder() {
+      if (ring) {
+        ring->orphan();
+      }
+    }
+  };
+  thread_local Holder holder;
+  if (!holder.ring) {
+    holder.ring = std::make_shared<LogRing>(ring_size_);
+    std::lock_guard locker(rings_mtx_);
+    rings_.push_back(holder.ring);
+    rings_version_++;
+  }
+  return holder.ring.get();
+}
+
+void Log::wakeWriter() {
+  if (!wake_pending_.exchange(true, std::memory_order_relaxed)) {
+    writer_cv_.notify_one();
+  }
+}
+
+void Log::rotate(const LoopClock::WallTime &now) {
+  // 调用者持有mtx_
+  const struct tm &t = now.tm;
+  if (today_ == t.tm_mday && line_count_ / MAX_LINES <= part_) {
+    return;
+  }
+  char new_file[LOG_NAME_LEN] = {0};
+  char tail[36] = {0};
+  snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1,
+           t.tm_mday);
+  if (today_ != t.tm_mday) {
+    snprintf(new_file, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+    today_ = t.tm_mday;
+    line_count_ = 0;
+    part_ = 0;
+  } else {
+    part_ = line_count_ / MAX_LINES;
+    snprintf(new_file, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, part_,
+             suffix_);
+  }
+  openFile(new_file);
 }
 
 void Log::flush() {
-  if (is_async_) {
-    deque_->flush();
+  if (!is_async_ || !write_thread_) {
+    return;
   }
-  fflush(fp_);
+  std::unique_lock locker(writer_mtx_);
+  uint64_t request = ++flush_request_;
+  writer_cv_.notify_one();
+  flushed_cv_.wait(locker, [&] { return flush_done_ >= request || stop_; });
 }
 
 void Log::asyncWrite() {
-  std::string str = "";
-  while (deque_->pop(str)) {
+  std::unique_lock locker(writer_mtx_);
+  auto last_sweep = std::chrono::steady_clock::now();
+  while (true) {
+    // 定时写出，某个线程的缓冲超过一半或有人等待flush时提前写出
+    writer_cv_.wait_for(locker, std::chrono::milliseconds(FLUSH_INTERVAL_MS),
+                        [this] {
+                          return stop_ || wake_pending_ ||
+                                 flush_request_ != flush_done_;
+                        });
+    wake_pending_ = false;
+    bool stop = stop_;
+    uint64_t request = flush_request_;
+    locker.unlock();
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sweep >= std::chrono::milliseconds(SWEEP_INTERVAL_MS)) {
+      sweepSuppressed();
+      last_sweep = now;
+    }
+    while (drain() > 0) {
+    }
+    locker.lock();
+    flush_done_ = request;
+    flushed_cv_.notify_all();
+    if (stop) {
+      break;
+    }
+  }
+}
+
+size_t Log::drain() {
+  if (snapshot_version_ != rings_version_.load()) {
+    std::lock_guard locker(rings_mtx_);
+    snapshot_ = rings_;
+    snapshot_version_ = rings_version_;
+  }
+  // 把各个环中的记录拷贝到连续的缓冲区，环随即可以继续写入
+  staging_.clear();
+  bool has_orphan = false;
+  for (auto &ring : snapshot_) {
+    // 先检查是否无主，再读取长度，保证不会漏掉线程退出前写入的数据
+    has_orphan |= ring->orphaned();
+    iovec iov[2];
+    int n = ring->peek(iov);
+    size_t len = 0;
+    for (int i = 0; i < n; ++i) {
+      const char *base = static_cast<const char *>(iov[i].iov_base);
+      staging_.insert(staging_.end(), base, base + iov[i].iov_len);
+      len += iov[i].iov_len;
+    }
+    ring->consume(len);
+  }
+  if (!staging_.empty()) {
     std::lock_guard locker(mtx_);
-    fputs(str.c_str(), fp_);
+    writeRecords(staging_.data(), staging_.size());
+  }
+  if (has_orphan) {
+    std::lock_guard locker(rings_mtx_);
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                                [](const std::shared_ptr<LogRing> &ring) {
+                                  return ring->orphaned() && ring->size() == 0;
+                                }),
+                 rings_.end());
+    rings_version_++;
+  }
+  return staging_.size();
+}
+
+void Log::writeRecords(const char *data, size_t len) {
+  // 调用者持有mtx_，data中是若干条完整的记录
+  LoopClock::WallTime now;
+  LoopClock::wallTime(&now);
+  rotate(now);
+  const char *end = data + len;
+  if (binary_) {
+    // 记录之前先写入新出现的调用点定义
+    writeSites();
+    for (const char *p = data; p < end;) {
+      logfmt::RecordHeader header;
+      memcpy(&header, p, sizeof(header));
+      p += sizeof(header) + header.size;
+      ++line_count_;
+    }
+    writeAll(data, len);
+    return;
+  }
+  output_.resize(std::max<size_t>(output_.size(), LINE_SIZE * 4));
+  size_t n = 0;
+  for (const char *p = data; p < end;) {
+    logfmt::RecordHeader header;
+    memcpy(&header, p, sizeof(header));
+    const char *args = p + sizeof(header);
+    p = args + header.size;
+    const LogSite *site = sites_[header.site].load(std::memory_order_acquire);
+    if (output_.size() - n < LINE_SIZE) {
+      writeAll(output_.data(), n);
+      n = 0;
+    }
+    n += logfmt::FormatLine(site->level, header.wall_us, site->format, args,
+                            header.size, output_.data() + n, LINE_SIZE);
+    ++line_count_;
+  }
+  writeAll(output_.data(), n);
+}
+
+void Log::writeSites() {
+  uint32_t count = site_count_.load(std::memory_order_acquire);
+  std::string defines;
+  for (; sites_written_ < count; ++sites_written_) {
+    // 调用点定义：级别、行号、文件名和format，字符串以'\0'结尾
+    const LogSite *site = sites_[sites_written_].load(std::memory_order_relaxed);
+    int32_t fields[2] = {site->level, site->line};
+    uint32_t size = sizeof(fields) + strlen(site->file) + 1 +
+                    strlen(site->format) + 1;
+    logfmt::RecordHeader header{logfmt::SITE_DEFINE | sites_written_, size, 0};
+    defines.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    defines.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+    defines.append(site->file, strlen(site->file) + 1);
+    defines.append(site->format, strlen(site->format) + 1);
+  }
+  writeAll(defines.data(), defines.size());
+}
+
+void Log::writeAll(const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd_, data, len);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    data += n;
+    len -= n;
   }
 }
 
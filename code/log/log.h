@@ -1,68 +1,182 @@
 #pragma once
 
+#include <fcntl.h>
 #include <sys/stat.h>
-#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstring>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
-#include "../buffer/buffer.h"
-#include "blockqueue.h"
+#include "../utility/clock.h"
+#include "logformat.h"
+#include "logring.h"
 
+// 编译期的最低日志级别，低于它的LOG_*调用不会生成任何代码
+// 例如 -DLOG_MIN_LEVEL=1 去掉所有LOG_DEBUG
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// 调用线程只把调用点编号、时间戳和参数编码后写入自己的LogRing，不需要加锁，
+// 也不做格式化；日志线程定时或在某个环超过一半时批量取出，
+// 文本模式下格式化后一次写入，二进制模式下原样写入，由logdecode离线还原
+// 日期变化和行数超限时的文件切换也只在日志线程中进行
 class Log {
  public:
+  // max_queue_capacity为每个线程缓冲的行数(按每行128字节估算)，为0时同步写入
   void init(int level, const char *path = "./log", const char *suffix = ".log",
-            int max_queue_capacity = 1024);
+            int max_queue_capacity = 1024, bool binary = false);
   static Log *instance();
   static void flushLogThread();
 
-  void write(int level, const char *format, ...);
+  template <typename... Args>
+  void record(const LogSite &site, const Args &...args) {
+    char buf[LINE_SIZE];
+    logfmt::Encoder encoder(buf + sizeof(logfmt::RecordHeader),
+                            LINE_SIZE - sizeof(logfmt::RecordHeader));
+    (encoder.put(args), ...);
+    logfmt::RecordHeader header{site.id, static_cast<uint32_t>(encoder.size()),
+                                LoopClock::wallUs()};
+    memcpy(buf, &header, sizeof(header));
+    commit(buf, sizeof(header) + encoder.size());
+  }
+  uint32_t registerSite(const LogSite *site);
+
+  // 每个调用点的限流(GCRA)：平均每秒rate条，最多连续burst条，rate为0时不限流
+  // 超出的日志只计数，下一次放行时先输出一条"N messages suppressed"
+  void setRateLimit(int rate, int burst);
+  bool admit(const LogSite &site) {
+    int64_t interval = interval_ns_.load(std::memory_order_relaxed);
+    if (interval == 0) {
+      return true;
+    }
+    int64_t now = LoopClock::now().time_since_epoch().count();
+    int64_t tolerance = tolerance_ns_.load(std::memory_order_relaxed);
+    int64_t tat = site.tat.load(std::memory_order_relaxed);
+    do {
+      if (tat - now > tolerance) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    } while (!site.tat.compare_exchange_weak(
+        tat, std::max(tat, now) + interval, std::memory_order_relaxed));
+    if (site.suppressed.load(std::memory_order_relaxed) > 0) {
+      reportSuppressed(site);
+    }
+    return true;
+  }
+
+  // 等待所有线程缓冲中的日志写入文件
   void flush();
 
-  int getLevel();
-  void setLevel(int level);
-  bool isOpen() { return is_open_; }
+  int getLevel() const { return level_.load(std::memory_order_relaxed); }
+  void setLevel(int level) { level_.store(level, std::memory_order_relaxed); }
+  bool isOpen() const { return is_open_.load(std::memory_order_relaxed); }
+  // 缓冲区已满被丢弃的行数
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  // 被限流的行数
+  uint64_t suppressed() const {
+    return suppressed_.load(std::memory_order_relaxed);
+  }
 
  private:
   Log() = default;
   ~Log();
 
-  void appendLogLevelTitle(int level = 0);
+  void commit(const char *data, size_t len);
+  void reportSuppressed(const LogSite &site);
+  void sweepSuppressed();
   void asyncWrite();
+  LogRing *localRing();
+  void wakeWriter();
+  size_t drain();
+  void writeRecords(const char *data, size_t len);
+  void writeSites();
+  void writeAll(const char *data, size_t len);
+  void rotate(const LoopClock::WallTime &now);
+  void openFile(const char *file_name);
 
  private:
   static constexpr int LOG_PATH_LEN = 256;
   static constexpr int LOG_NAME_LEN = 256;
   static constexpr int MAX_LINES = 50000;
+  static constexpr int LINE_SIZE = 4096;
+  static constexpr int FLUSH_INTERVAL_MS = 100;
+  static constexpr int PUSH_RETRY = 64;
+  static constexpr int MAX_SITES = 4096;
+  static constexpr int DEFAULT_RATE = 100;
+  static constexpr int DEFAULT_BURST = 1000;
+  static constexpr int SWEEP_INTERVAL_MS = 1000;
 
   const char *path_;
   const char *suffix_;
 
-  int max_lines_{0};
   int line_count_{0};
+  int part_{0};
   int today_{0};
-  bool is_open_{false};
-  Buffer buff_;
-  int level_{0};
+  std::atomic<bool> is_open_{false};
+  std::atomic<int> level_{0};
   bool is_async_{false};
+  bool binary_{false};
+  size_t ring_size_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> suppressed_{0};
+  std::atomic<int64_t> interval_ns_{1000000000 / DEFAULT_RATE};
+  std::atomic<int64_t> tolerance_ns_{1000000000LL / DEFAULT_RATE *
+                                     (DEFAULT_BURST - 1)};
 
-  FILE *fp_{nullptr};
-  std::unique_ptr<BlockDeque<std::string>> deque_{nullptr};
-  std::unique_ptr<std::thread> write_thread_{nullptr};
+  int fd_{-1};
+  // 同步写入及切换文件时使用
   std::mutex mtx_;
+
+  // 各线程的环形缓冲，日志线程按版本号判断是否需要重新拷贝列表
+  std::mutex rings_mtx_;
+  std::vector<std::shared_ptr<LogRing>> rings_;
+  std::atomic<uint64_t> rings_version_{0};
+  // 调用点表，编号即下标
+  std::mutex sites_mtx_;
+  std::atomic<const LogSite *> sites_[MAX_SITES]{};
+  std::atomic<uint32_t> site_count_{0};
+  uint32_t sites_written_{0};  // 当前二进制文件中已写入定义的调用点数
+
+  // 以下只由日志线程访问：从各个环取出的记录，以及格式化后的输出
+  std::vector<std::shared_ptr<LogRing>> snapshot_;
+  uint64_t snapshot_version_{0};
+  std::vector<char> staging_;
+  std::vector<char> output_;
+
+  std::unique_ptr<std::thread> write_thread_{nullptr};
+  std::mutex writer_mtx_;
+  std::condition_variable writer_cv_;
+  std::condition_variable flushed_cv_;
+  std::atomic<bool> wake_pending_{false};
+  bool stop_{false};
+  uint64_t flush_request_{0};
+  uint64_t flush_done_{0};
 };
 
-#define LOG_BASE(level, format, ...)                 \
-  do {                                               \
-    Log *log = Log::instance();                      \
-    if (log->isOpen() && log->getLevel() <= level) { \
-      log->write(level, format, ##__VA_ARGS__);     \
-      log->flush();                                  \
-    }                                                \
+#define LOG_BASE(level, format, ...)                                   \
+  do {                                                                 \
+    if constexpr (level >= LOG_MIN_LEVEL) {                            \
+      Log *log = Log::instance();                                      \
+      if (log->isOpen() && log->getLevel() <= level) {                 \
+        static const LogSite log_site(level, format, __FILE__, __LINE__); \
+        if (log->admit(log_site)) {                                    \
+          log->record(log_site, ##__VA_ARGS__);                        \
+        }                                                              \
+      }                                                                \
+    }                                                                  \
   } while (0);
 
 #define LOG_DEBUG(format, ...)          \
@@ -0,0 +1,107 @@
+// 把二进制日志还原为文本日志
+//   ./logdecode file.log [file.log ...]  结果输出到标准输出
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "logformat.h"
+
+namespace {
+
+struct Site {
+  int level{1};
+  int line{0};
+  std::string file;
+  std::string format;
+};
+
+bool ReadFile(const char *name, std::string *data) {
+  FILE *fp = fopen(name, "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    data->append(buf, n);
+  }
+  fclose(fp);
+  return true;
+}
+
+// 返回还原出的行数，文件格式错误时返回-1
+long Decode(const std::string &data, FILE *out) {
+  if (data.size() < sizeof(logfmt::FILE_MAGIC) ||
+      memcmp(data.data(), logfmt::FILE_MAGIC, sizeof(logfmt::FILE_MAGIC)) != 0) {
+    return -1;
+  }
+  // 每个文件自带完整的调用点定义
+  std::vector<Site> sites;
+  std::vector<char> line(8192);
+  long lines = 0;
+  const char *p = data.data() + sizeof(logfmt::FILE_MAGIC);
+  const char *end = data.data() + data.size();
+  while (end - p >= static_cast<long>(sizeof(logfmt::RecordHeader))) {
+    logfmt::RecordHeader header;
+    memcpy(&header, p, sizeof(header));
+    const char *payload = p + sizeof(header);
+    if (static_cast<size_t>(end - payload) < header.size) {
+      // 进程退出时写到一半的记录
+      break;
+    }
+    p = payload + header.size;
+    if (header.site & logfmt::SITE_DEFINE) {
+      uint32_t id = header.site & ~logfmt::SITE_DEFINE;
+      if (header.size < 2 * sizeof(int32_t) + 2) {
+        return -1;
+      }
+      if (sites.size() <= id) {
+        sites.resize(id + 1);
+      }
+      Site &site = sites[id];
+      int32_t fields[2];
+      memcpy(fields, payload, sizeof(fields));
+      site.level = fields[0];
+      site.line = fields[1];
+      const char *str = payload + sizeof(fields);
+      site.file = std::string(str, strnlen(str, p - str));
+      str += site.file.size() + 1;
+      site.format = str < p ? std::string(str, strnlen(str, p - str)) : "";
+      continue;
+    }
+    if (header.site >= sites.size()) {
+      fprintf(stderr, "logdecode: undefined site %u\n", header.site);
+      continue;
+    }
+    const Site &site = sites[header.site];
+    size_t n = logfmt::FormatLine(site.level, header.wall_us,
+                                  site.format.c_str(), payload, header.size,
+                                  line.data(), line.size());
+    fwrite(line.data(), 1, n, out);
+    ++lines;
+  }
+  return lines;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s file.log [file.log ...]\n", argv[0]);
+    return 1;
+  }
+  int ret = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string data;
+    if (!ReadFile(argv[i], &data)) {
+      fprintf(stderr, "logdecode: cannot open %s\n", argv[i]);
+      ret = 1;
+      continue;
+    }
+    if (Decode(data, stdout) < 0) {
+      fprintf(stderr, "logdecode: %s is not a binary log\n", argv[i]);
+      ret = 1;
+    }
+  }
+  return ret;
+}
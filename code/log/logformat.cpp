@@ -0,0 +1,199 @@
+#include "logformat.h"
+
+#include <cstdio>
+#include <ctime>
+
+namespace logfmt {
+
+namespace {
+
+// 读取下一个参数，数据不完整时返回false
+bool NextArg(const char *&args, const char *end, ArgType *type, int64_t *i,
+             double *d, const char **str, size_t *str_len) {
+  if (args >= end) {
+    return false;
+  }
+  *type = static_cast<ArgType>(*args++);
+  switch (*type) {
+    case INT:
+    case UINT:
+    case POINTER:
+      if (end - args < 8) {
+        return false;
+      }
+      memcpy(i, args, 8);
+      args += 8;
+      return true;
+    case DOUBLE:
+      if (end - args < 8) {
+        return false;
+      }
+      memcpy(d, args, 8);
+      args += 8;
+      return true;
+    case STRING: {
+      uint16_t len16;
+      if (end - args < 2) {
+        return false;
+      }
+      memcpy(&len16, args, 2);
+      args += 2;
+      if (end - args < len16) {
+        return false;
+      }
+      *str = args;
+      *str_len = len16;
+      args += len16;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+size_t FormatArgs(const char *format, const char *args, size_t len, char *out,
+                  size_t capacity) {
+  const char *end = args + len;
+  size_t n = 0;
+  auto append = [&](const char *data, size_t size) {
+    size = std::min(size, capacity - 1 - n);
+    memcpy(out + n, data, size);
+    n += size;
+  };
+  auto appendf = [&](const char *spec, auto value) {
+    int m = snprintf(out + n, capacity - n, spec, value);
+    if (m > 0) {
+      n += std::min<size_t>(m, capacity - 1 - n);
+    }
+  };
+  if (capacity == 0) {
+    return 0;
+  }
+  const char *p = format;
+  while (*p && n + 1 < capacity) {
+    if (*p != '%') {
+      const char *next = strchr(p, '%');
+      size_t size = next ? next - p : strlen(p);
+      append(p, size);
+      p += size;
+      continue;
+    }
+    if (p[1] == '%') {
+      append("%", 1);
+      p += 2;
+      continue;
+    }
+    // 保留标志、宽度和精度，长度修饰符按实际参数类型重新生成
+    char spec[32] = "%";
+    size_t spec_len = 1;
+    const char *q = p + 1;
+    while (*q && strchr("-+ #0123456789.", *q) && spec_len < 20) {
+      spec[spec_len++] = *q++;
+    }
+    while (*q && strchr("hlLqjzt", *q)) {
+      ++q;
+    }
+    char conv = *q ? *q++ : 's';
+    ArgType type;
+    int64_t i = 0;
+    double d = 0;
+    const char *str = nullptr;
+    size_t str_len = 0;
+    if (!NextArg(args, end, &type, &i, &d, &str, &str_len)) {
+      // 参数缺失时原样输出
+      append(p, q - p);
+      p = q;
+      continue;
+    }
+    p = q;
+    // 最常见的不带标志和宽度的%s、%d直接拷贝，不经过snprintf
+    if (spec_len == 1 && type == STRING && conv == 's') {
+      append(str, str_len);
+      continue;
+    }
+    if (spec_len == 1 && (type == INT || type == UINT) &&
+        (conv == 'd' || conv == 'i' || conv == 'u')) {
+      char digits[24];
+      char *d_end = digits + sizeof(digits);
+      char *d_begin = d_end;
+      bool negative = type == INT && i < 0;
+      uint64_t value = negative ? 0 - static_cast<uint64_t>(i) : i;
+      do {
+        *--d_begin = '0' + value % 10;
+        value /= 10;
+      } while (value > 0);
+      if (negative) {
+        *--d_begin = '-';
+      }
+      append(d_begin, d_end - d_begin);
+      continue;
+    }
+    bool is_float = strchr("fFeEgGaA", conv) != nullptr;
+    if (type == STRING) {
+      // 编码后的字符串没有'\0'，带宽度或精度时复制一份再格式化
+      std::string value(str, str_len);
+      memcpy(spec + spec_len, "s", 2);
+      appendf(spec, value.c_str());
+    } else if (conv == 'p' || type == POINTER) {
+      memcpy(spec + spec_len, "p", 2);
+      appendf(spec, reinterpret_cast<void *>(i));
+    } else if (is_float) {
+      spec[spec_len] = conv;
+      spec[spec_len + 1] = '\0';
+      appendf(spec, type == DOUBLE ? d : static_cast<double>(i));
+    } else if (conv == 'c') {
+      memcpy(spec + spec_len, "c", 2);
+      appendf(spec, static_cast<int>(i));
+    } else {
+      if (!strchr("diouxX", conv)) {
+        conv = type == UINT ? 'u' : 'd';
+      }
+      spec[spec_len] = 'l';
+      spec[spec_len + 1] = 'l';
+      spec[spec_len + 2] = conv;
+      spec[spec_len + 3] = '\0';
+      long long value = type == DOUBLE ? static_cast<long long>(d) : i;
+      appendf(spec, value);
+    }
+  }
+  out[n] = '\0';
+  return n;
+}
+
+size_t FormatLine(int level, int64_t wall_us, const char *format,
+                  const char *args, size_t len, char *out, size_t capacity) {
+  static const char *titles[] = {"[debug]: ", "[info] : ", "[warn] : ",
+                                 "[error]: "};
+  // 记录带有自己的时间(写线程落后或离线解码时不是当前时间)，
+  // 不能使用LoopClock按当前秒缓存的结果；同一秒内只格式化一次
+  thread_local time_t cached_sec = -1;
+  thread_local char cached_time[20];
+  time_t sec = wall_us / 1000000;
+  if (sec != cached_sec) {
+    struct tm t;
+    localtime_r(&sec, &t);
+    strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S", &t);
+    cached_sec = sec;
+  }
+  if (capacity < 40) {
+    return 0;
+  }
+  int64_t usec = wall_us % 1000000;
+  memcpy(out, cached_time, 19);
+  out[19] = '.';
+  for (int i = 25; i >= 20; --i) {
+    out[i] = '0' + usec % 10;
+    usec /= 10;
+  }
+  out[26] = ' ';
+  const char *title = titles[level >= 0 && level <= 3 ? level : 1];
+  memcpy(out + 27, title, 9);
+  size_t n = 36;
+  // 末尾留出换行符的位置
+  n += FormatArgs(format, args, len, out + n, capacity - n - 1);
+  out[n++] = '\n';
+  return n;
+}
+
+}  // namespace logfmt
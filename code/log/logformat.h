@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// 延迟格式化：调用线程只记录调用点编号、时间戳和参数的原始字节，
+// 由日志线程或离线的logdecode按调用点的format格式化
+
+// 每个LOG_*调用点对应一个静态的LogSite，首次执行时向Log注册并获得编号
+// 同时保存该调用点的限流状态
+struct LogSite {
+  LogSite(int level, const char *format, const char *file, int line);
+
+  int level;
+  const char *format;
+  const char *file;
+  int line;
+  uint32_t id;
+  // GCRA的理论到达时间(ns)，以及被限流后尚未报告的条数
+  mutable std::atomic<int64_t> tat{0};
+  mutable std::atomic<uint64_t> suppressed{0};
+};
+
+namespace logfmt {
+
+// 记录头，ring中和二进制日志文件中都是这个格式
+struct RecordHeader {
+  uint32_t site;   // 调用点编号，最高位为1表示调用点定义
+  uint32_t size;   // 后面参数(或调用点定义)的字节数
+  int64_t wall_us;
+};
+
+// 二进制日志文件以此开头，之后是调用点定义与日志记录
+constexpr char FILE_MAGIC[8] = {'T', 'W', 'L', 'O', 'G', 'B', 'I', 'N'};
+constexpr uint32_t SITE_DEFINE = 0x80000000u;
+constexpr size_t MAX_STRING = 1024;
+
+enum ArgType : uint8_t { INT, UINT, DOUBLE, STRING, POINTER };
+
+// 把参数按 类型(1字节)+数据 写入缓冲区，空间不足时后面的参数被丢弃
+class Encoder {
+ public:
+  Encoder(char *buf, size_t capacity) : buf_(buf), capacity_(capacity) {}
+
+  template <typename T>
+  void put(const T &value) {
+    using D = std::decay_t<T>;
+    if constexpr (std::is_array_v<T>) {
+      putString(value, strlen(value));
+    } else if constexpr (std::is_same_v<D, char *> ||
+                         std::is_same_v<D, const char *>) {
+      putString(value, value ? strlen(value) : 0);
+    } else if constexpr (std::is_same_v<D, std::string>) {
+      putString(value.data(), value.size());
+    } else if constexpr (std::is_floating_point_v<D>) {
+      putValue(DOUBLE, static_cast<double>(value));
+    } else if constexpr (std::is_enum_v<D>) {
+      putValue(INT, static_cast<int64_t>(value));
+    } else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>) {
+      putValue(INT, static_cast<int64_t>(value));
+    } else if constexpr (std::is_integral_v<D>) {
+      putValue(UINT, static_cast<uint64_t>(value));
+    } else if constexpr (std::is_pointer_v<D>) {
+      putValue(POINTER, reinterpret_cast<uint64_t>(value));
+    } else {
+      static_assert(std::is_arithmetic_v<D>, "unsupported log argument type");
+    }
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+  template <typename V>
+  void putValue(ArgType type, V value) {
+    if (size_ + 1 + sizeof(V) > capacity_) {
+      return;
+    }
+    buf_[size_] = type;
+    memcpy(buf_ + size_ + 1, &value, sizeof(V));
+    size_ += 1 + sizeof(V);
+  }
+
+  void putString(const char *str, size_t len) {
+    if (str == nullptr) {
+      str = "(null)";
+      len = 6;
+    }
+    len = std::min(len, MAX_STRING);
+    if (size_ + 3 + len > capacity_) {
+      return;
+    }
+    uint16_t len16 = static_cast<uint16_t>(len);
+    buf_[size_] = STRING;
+    memcpy(buf_ + size_ + 1, &len16, 2);
+    memcpy(buf_ + size_ + 3, str, len);
+    size_ += 3 + len;
+  }
+
+  char *buf_;
+  size_t capacity_;
+  size_t size_{0};
+};
+
+// 按format把编码后的参数格式化为文本，返回写入out的字节数(不含结尾的'\0')
+size_t FormatArgs(const char *format, const char *args, size_t len, char *out,
+                  size_t capacity);
+
+// 格式化一整行："时间戳 [级别]: 内容\n"
+size_t FormatLine(int level, int64_t wall_us, const char *format,
+                  const char *args, size_t len, char *out, size_t capacity);
+
+}  // namespace logfmt
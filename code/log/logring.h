@@ -0,0 +1,75 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+// 单生产者单消费者的字节环形缓冲区，每个写日志的线程独占一个
+// 生产者每次写入一条完整的日志，消费者(日志线程)批量取出环中的数据
+class LogRing {
+ public:
+  // capacity必须是2的幂
+  explicit LogRing(size_t capacity)
+      : buf_(new char[capacity]), capacity_(capacity), mask_(capacity - 1) {
+    assert(capacity > 0 && (capacity & mask_) == 0);
+  }
+
+  // 生产者调用，空间不足时整条放弃
+  bool push(const char *data, size_t len) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    if (capacity_ - (tail - head) < len) {
+      return false;
+    }
+    size_t index = tail & mask_;
+    size_t first = std::min(len, capacity_ - index);
+    memcpy(buf_.get() + index, data, first);
+    memcpy(buf_.get(), data + first, len - first);
+    tail_.store(tail + len, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_relaxed);
+  }
+  size_t capacity() const { return capacity_; }
+
+  // 消费者调用，环绕时需要两段，返回填入的iovec个数
+  int peek(iovec iov[2]) const {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t len = tail_.load(std::memory_order_acquire) - head;
+    if (len == 0) {
+      return 0;
+    }
+    size_t index = head & mask_;
+    size_t first = std::min(len, capacity_ - index);
+    iov[0] = {buf_.get() + index, first};
+    if (first == len) {
+      return 1;
+    }
+    iov[1] = {buf_.get(), len - first};
+    return 2;
+  }
+
+  void consume(size_t len) {
+    head_.store(head_.load(std::memory_order_relaxed) + len,
+                std::memory_order_release);
+  }
+
+  // 所属线程退出后由日志线程写完剩余数据再回收
+  void orphan() { orphaned_.store(true, std::memory_order_release); }
+  bool orphaned() const { return orphaned_.load(std::memory_order_acquire); }
+
+ private:
+  std::unique_ptr<char[]> buf_;
+  const size_t capacity_;
+  const size_t mask_;
+  std::atomic<bool> orphaned_{false};
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
@@ -0,0 +1,234 @@
+#include "metrics.h"
+
+#include <cmath>
+#include <cstdio>
+
+Metrics *Metrics::instance() {
+  static Metrics metrics;
+  return &metrics;
+}
+
+Metrics::Holder::~Holder() {
+  if (local) {
+    Metrics::instance()->release(local);
+  }
+}
+
+Metrics::Local *Metrics::acquire() {
+  std::lock_guard locker(mtx_);
+  if (!free_.empty()) {
+    Local *local = free_.back();
+    free_.pop_back();
+    return local;
+  }
+  locals_.push_back(std::make_unique<Local>());
+  return locals_.back().get();
+}
+
+void Metrics::release(Local *local) {
+  std::lock_guard locker(mtx_);
+  free_.push_back(local);
+}
+
+int Metrics::bucketOf(uint64_t us) {
+  if (us < static_cast<uint64_t>(SUB_COUNT)) {
+    return static_cast<int>(us);
+  }
+  int exp = 63 - __builtin_clzll(us);
+  if (exp > MAX_EXP) {
+    return BUCKETS - 1;
+  }
+  // [2^exp, 2^(exp+1))等分为SUB_COUNT份
+  int shift = exp - SUB_BITS;
+  return (shift + 1) * SUB_COUNT +
+         static_cast<int>((us >> shift) & (SUB_COUNT - 1));
+}
+
+uint64_t Metrics::bucketUpper(int bucket) {
+  if (bucket < SUB_COUNT) {
+    return bucket + 1;
+  }
+  int shift = bucket / SUB_COUNT - 1;
+  uint64_t lower = static_cast<uint64_t>(SUB_COUNT + bucket % SUB_COUNT)
+                   << shift;
+  return lower + (uint64_t(1) << shift);
+}
+
+void Metrics::record(Stage stage, int64_t us) {
+  if (us < 0) {
+    us = 0;
+  }
+  Local::Hist &hist = local().stages[stage];
+  bump(hist.counts[bucketOf(us)], 1);
+  bump(hist.sum, us);
+}
+
+uint64_t Metrics::Histogram::quantile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t target = std::max<uint64_t>(std::ceil(q * count), 1);
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += counts[i];
+    if (seen >= target) {
+      return bucketUpper(i) - 1;
+    }
+  }
+  return bucketUpper(BUCKETS - 1) - 1;
+}
+
+uint64_t Metrics::counter(Counter counter) const {
+  std::lock_guard locker(mtx_);
+  uint64_t sum = 0;
+  for (auto &local : locals_) {
+    sum += local->counters[counter].load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+Metrics::Histogram Metrics::histogram(Stage stage) const {
+  Histogram hist{};
+  std::lock_guard locker(mtx_);
+  for (auto &local : locals_) {
+    const Local::Hist &h = local->stages[stage];
+    for (int i = 0; i < BUCKETS; ++i) {
+      hist.counts[i] += h.counts[i].load(std::memory_order_relaxed);
+    }
+    hist.sum += h.sum.load(std::memory_order_relaxed);
+  }
+  // 总数由同一次读取的各个桶相加得到，而不是单独计数：
+  // 否则并发记录时总数可能小于某个桶的累计值，导出的直方图不单调
+  for (int i = 0; i < BUCKETS; ++i) {
+    hist.count += hist.counts[i];
+  }
+  return hist;
+}
+
+const char *Metrics::stageName(Stage stage) {
+  static const char *names[] = {"accept_read", "parse", "queue_wait", "db",
+                                "write"};
+  return names[stage];
+}
+
+void Metrics::family(std::string &out, const char *name, const char *type,
+                     const char *help) {
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+void Metrics::sample(std::string &out, const char *name,
+                     const std::string &labels, double value) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), " %.10g\n", value);
+  out += name;
+  if (!labels.empty()) {
+    out += '{';
+    out += labels;
+    out += '}';
+  }
+  out += buf;
+}
+
+int Metrics::addCollector(Collector collector) {
+  std::lock_guard locker(collect_mtx_);
+  collectors_.emplace_back(next_id_, std::move(collector));
+  return next_id_++;
+}
+
+void Metrics::removeCollector(int id) {
+  std::lock_guard locker(collect_mtx_);
+  for (auto it = collectors_.begin(); it != collectors_.end(); ++it) {
+    if (it->first == id) {
+      collectors_.erase(it);
+      return;
+    }
+  }
+}
+
+std::string Metrics::render() const {
+  std::string out;
+  out.reserve(16384);
+  struct {
+    Counter counter;
+    const char *name;
+    const char *help;
+  } counters[] = {
+      {ACCEPTS, "webserver_connections_accepted_total",
+       "Accepted connections."},
+      {REQUESTS, "webserver_requests_total", "Responses generated."},
+      {BYTES_READ, "webserver_read_bytes_total", "Bytes read from clients."},
+      {BYTES_SENT, "webserver_sent_bytes_total", "Bytes sent to clients."},
+      {TIMER_EXPIRIES, "webserver_timer_expiries_total",
+       "Connection timers that fired."},
+      {REJECTED, "webserver_rejected_total",
+       "Requests dropped because a task queue was full."},
+  };
+  for (auto &c : counters) {
+    family(out, c.name, "counter", c.help);
+    sample(out, c.name, "", counter(c.counter));
+  }
+  family(out, "webserver_responses_total", "counter",
+         "Responses by status class.");
+  for (int i = STATUS_1XX; i <= STATUS_5XX; ++i) {
+    std::string labels =
+        "code=\"" + std::to_string(i - STATUS_1XX + 1) + "xx\"";
+    sample(out, "webserver_responses_total", labels,
+           counter(static_cast<Counter>(i)));
+  }
+
+  // 导出的桶边界取2的幂(us)，正好是分桶的边界，不引入额外误差
+  static const int LE_MIN = 4, LE_MAX = 24;
+  std::vector<Histogram> hists;
+  for (int s = 0; s < STAGE_NUM; ++s) {
+    hists.push_back(histogram(static_cast<Stage>(s)));
+  }
+  family(out, "webserver_stage_seconds", "histogram",
+         "Latency of each request stage.");
+  for (int s = 0; s < STAGE_NUM; ++s) {
+    const Histogram &h = hists[s];
+    std::string stage =
+        std::string("stage=\"") + stageName(static_cast<Stage>(s)) + "\"";
+    uint64_t cumulative = 0;
+    int bucket = 0;
+    for (int k = LE_MIN; k <= LE_MAX; ++k) {
+      uint64_t le = uint64_t(1) << k;
+      while (bucket < BUCKETS && bucketUpper(bucket) <= le) {
+        cumulative += h.counts[bucket++];
+      }
+      char labels[96];
+      snprintf(labels, sizeof(labels), "%s,le=\"%g\"", stage.c_str(),
+               le / 1e6);
+      sample(out, "webserver_stage_seconds_bucket", labels, cumulative);
+    }
+    sample(out, "webserver_stage_seconds_bucket", stage + ",le=\"+Inf\"",
+           h.count);
+    sample(out, "webserver_stage_seconds_sum", stage, h.sum / 1e6);
+    sample(out, "webserver_stage_seconds_count", stage, h.count);
+  }
+  family(out, "webserver_stage_quantile_seconds", "gauge",
+         "Stage latency quantiles from the HDR histogram.");
+  for (int s = 0; s < STAGE_NUM; ++s) {
+    for (const char *q : {"0.5", "0.9", "0.99", "0.999"}) {
+      std::string labels = std::string("stage=\"") +
+                           stageName(static_cast<Stage>(s)) +
+                           "\",quantile=\"" + q + "\"";
+      sample(out, "webserver_stage_quantile_seconds", labels,
+             hists[s].quantile(atof(q)) / 1e6);
+    }
+  }
+
+  // 调用期间持有collect_mtx_，removeCollector返回之后不会再被调用
+  std::lock_guard locker(collect_mtx_);
+  for (auto &item : collectors_) {
+    item.second(out);
+  }
+  return out;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 以Prometheus文本格式导出的运行指标(GET /metrics)
+// 计数器和直方图按线程分开记录：每个线程第一次记录时分到一块按缓存行对齐的数据，
+// 只有它自己写(relaxed的load+store，没有原子的读改写)，抓取时才把所有线程的数据相加
+// 直方图是HDR式的对数线性分桶：每个2的幂区间再等分8份，相对误差不超过12.5%
+// 连接池、队列长度等瞬时值由各模块注册的collector在抓取时读取
+class Metrics {
+ public:
+  enum Counter {
+    ACCEPTS,
+    REQUESTS,
+    BYTES_READ,
+    BYTES_SENT,
+    STATUS_1XX,  // 按状态码的类别，STATUS_1XX + code / 100 - 1
+    STATUS_2XX,
+    STATUS_3XX,
+    STATUS_4XX,
+    STATUS_5XX,
+    TIMER_EXPIRIES,  // 连接定时器到期(包括按新阶段重新计时的)
+    REJECTED,        // 任务队列已满而关闭或拒绝的请求
+    COUNTER_NUM
+  };
+  // 请求各阶段的耗时(us)
+  enum Stage {
+    ACCEPT_READ,  // 建立连接到收到第一个字节
+    PARSE,
+    QUEUE_WAIT,  // 读写任务在线程池中排队
+    DB,          // 登录/注册的校验，包括等待连接和密码哈希
+    WRITE,       // 生成响应到发送完毕
+    STAGE_NUM
+  };
+
+  static const int SUB_BITS = 3;
+  static const int SUB_COUNT = 1 << SUB_BITS;
+  static const int MAX_EXP = 40;  // 2^40us约12.7天，超出的计入最后一个桶
+  static const int BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB_COUNT;
+
+  // 一个阶段的耗时分布，由各线程的数据相加得到
+  struct Histogram {
+    uint64_t counts[BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    // q在0到1之间，返回分桶的上界(us)
+    uint64_t quantile(double q) const;
+  };
+  using Collector = std::function<void(std::string &out)>;
+
+  static Metrics *instance();
+
+  static void add(Counter counter, uint64_t n = 1) {
+    bump(local().counters[counter], n);
+  }
+  static void record(Stage stage, int64_t us);
+  static void status(int code) {
+    if (code >= 100 && code < 600) {
+      add(static_cast<Counter>(STATUS_1XX + code / 100 - 1));
+    }
+  }
+  static int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  uint64_t counter(Counter counter) const;
+  Histogram histogram(Stage stage) const;
+  // 输出所有指标，包括collector的部分
+  std::string render() const;
+
+  // collector在抓取时调用，返回的id用于注销(持有者析构之前必须注销)
+  int addCollector(Collector collector);
+  void removeCollector(int id);
+
+  // 供collector输出：一组指标的HELP/TYPE，以及一行样本
+  static void family(std::string &out, const char *name, const char *type,
+                     const char *help);
+  static void sample(std::string &out, const char *name,
+                     const std::string &labels, double value);
+
+  static const char *stageName(Stage stage);
+  static int bucketOf(uint64_t us);
+  static uint64_t bucketUpper(int bucket);
+
+ private:
+  struct alignas(64) Local {
+    std::atomic<uint64_t> counters[COUNTER_NUM]{};
+    struct alignas(64) Hist {
+      std::atomic<uint64_t> counts[BUCKETS]{};
+      std::atomic<uint64_t> sum{0};
+    } stages[STAGE_NUM];
+  };
+  // 线程退出时归还自己的数据块，数值保留，由之后的新线程继续累加
+  struct Holder {
+    Local *local{nullptr};
+    ~Holder();
+  };
+
+  Metrics() = default;
+
+  // 只有所属线程写，不需要原子的读改写
+  static void bump(std::atomic<uint64_t> &value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+  }
+  static Local &local() {
+    thread_local Holder holder;
+    if (!holder.local) {
+      holder.local = instance()->acquire();
+    }
+    return *holder.local;
+  }
+  Local *acquire();
+  void release(Local *local);
+
+  // 保护locals_和free_，只在线程第一次记录和抓取时加锁
+  mutable std::mutex mtx_;
+  std::vector<std::unique_ptr<Local>> locals_;
+  std::vector<Local *> free_;
+  // collector中不能注册或注销collector
+  mutable std::mutex collect_mtx_;
+  std::vector<std::pair<int, Collector>> collectors_;
+  int next_id_{0};
+};
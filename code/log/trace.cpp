@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+volatile std::sig_atomic_t Trace::dump_requested_ = 0;
+
+Trace *Trace::instance() {
+  static Trace trace;
+  return &trace;
+}
+
+Trace::Holder::~Holder() {
+  if (ring) {
+    Trace::instance()->release(ring);
+  }
+}
+
+void Trace::init(const Options &options) {
+  ring_size_ = std::max<size_t>(options.ring_size, 1);
+  sample_.store(std::max(options.sample, 0), std::memory_order_relaxed);
+}
+
+uint64_t Trace::sample() {
+  int sample = sample_.load(std::memory_order_relaxed);
+  if (sample <= 0) {
+    return 0;
+  }
+  uint64_t n = requests_.fetch_add(1, std::memory_order_relaxed);
+  return n % sample == 0 ? n / sample + 1 : 0;
+}
+
+bool Trace::takeDumpRequest() {
+  if (!dump_requested_) {
+    return false;
+  }
+  dump_requested_ = 0;
+  return true;
+}
+
+Trace::Ring *Trace::acquire() {
+  std::lock_guard locker(mtx_);
+  if (!free_.empty()) {
+    Ring *ring = free_.back();
+    free_.pop_back();
+    return ring;
+  }
+  rings_.push_back(std::make_unique<Ring>());
+  rings_.back()->spans.resize(ring_size_);
+  return rings_.back().get();
+}
+
+void Trace::release(Ring *ring) {
+  std::lock_guard locker(mtx_);
+  free_.push_back(ring);
+}
+
+void Trace::append(uint64_t req, const char *name, int64_t begin_us,
+                   int64_t end_us, const char *detail) {
+  thread_local Holder holder;
+  thread_local int tid = static_cast<int>(syscall(SYS_gettid));
+  if (!holder.ring) {
+    holder.ring = acquire();
+  }
+  Ring &ring = *holder.ring;
+  std::lock_guard locker(ring.mtx);
+  Span &span = ring.spans[ring.next++ % ring.spans.size()];
+  span.req = req;
+  span.name = name;
+  span.begin_us = begin_us;
+  span.dur_us = std::max<int64_t>(end_us - begin_us, 0);
+  span.tid = tid;
+  span.detail[0] = '\0';
+  if (detail) {
+    snprintf(span.detail, sizeof(span.detail), "%s", detail);
+  }
+}
+
+// 路径来自客户端，引号、反斜杠和控制字符需要转义
+static void AppendEscaped(std::string &out, const char *text) {
+  for (const char *p = text; *p; ++p) {
+    unsigned char c = *p;
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+}
+
+std::string Trace::dump() const {
+  std::vector<Span> spans;
+  {
+    std::lock_guard locker(mtx_);
+    for (auto &ring : rings_) {
+      std::lock_guard ring_locker(ring->mtx);
+      size_t size = ring->spans.size();
+      uint64_t count = std::min<uint64_t>(ring->next, size);
+      for (uint64_t i = ring->next - count; i < ring->next; ++i) {
+        spans.push_back(ring->spans[i % size]);
+      }
+    }
+  }
+
+  std::string out;
+  out.reserve(spans.size() * 128 + 64);
+  out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  int pid = getpid();
+  char buf[256];
+  bool first = true;
+  for (const Span &span : spans) {
+    if (!first) {
+      out += ',';
+    }
+    first = false;
+    if (span.name != REQUEST) {
+      // 阶段显示在执行它的线程上，args中的req关联到所属的请求
+      snprintf(buf, sizeof(buf),
+               "\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":%ld,"
+               "\"dur\":%ld,\"pid\":%d,\"tid\":%d,\"args\":{\"req\":%lu}}",
+               span.name, span.begin_us, span.dur_us, pid, span.tid,
+               span.req);
+      out += buf;
+      continue;
+    }
+    // 整个请求跨越多个线程，用一对异步事件表示，按请求ID单独成行
+    for (int end = 0; end < 2; ++end) {
+      out += end ? ",\n{\"name\":\"" : "\n{\"name\":\"";
+      AppendEscaped(out, span.detail);
+      snprintf(buf, sizeof(buf),
+               "\",\"cat\":\"request\",\"ph\":\"%c\",\"id\":%lu,\"ts\":%ld,"
+               "\"pid\":%d,\"tid\":%d}",
+               end ? 'e' : 'b', span.req,
+               span.begin_us + (end ? span.dur_us : 0), pid, span.tid);
+      out += buf;
+    }
+  }
+  out += "\n]}\n";
+  return out;
+}
+
+bool Trace::dumpFile(const std::string &path) const {
+  FILE *fp = fopen(path.c_str(), "w");
+  if (!fp) {
+    return false;
+  }
+  std::string text = dump();
+  bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+  return fclose(fp) == 0 && ok;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 按1/N采样的请求追踪，导出为Chrome trace格式的JSON(Perfetto或chrome://tracing打开)
+// 采样到的请求得到一个非0的ID，之后各阶段(分发、排队、读、解析、数据库、生成响应、发送)
+// 的耗时记入当前线程的环形缓冲区，写满后覆盖最旧的记录
+// 未采样的请求ID为0，记录时只多一次判断
+class Trace {
+ public:
+  struct Options {
+    int sample{0};            // 每sample个请求追踪一个，0为关闭
+    size_t ring_size{4096};   // 每个线程保留的记录数
+  };
+
+  static Trace *instance();
+  void init(const Options &options);
+  bool isEnabled() const {
+    return sample_.load(std::memory_order_relaxed) > 0;
+  }
+
+  // 新请求开始时调用，采样到时返回请求ID，否则返回0
+  uint64_t sample();
+  // 记录一段耗时(us)，req为0时忽略
+  static void span(uint64_t req, const char *name, int64_t begin_us,
+                   int64_t end_us) {
+    if (req) {
+      instance()->append(req, name, begin_us, end_us, nullptr);
+    }
+  }
+  // 整个请求的记录，detail为方法、路径和状态码，显示为以请求ID分组的异步事件
+  static void request(uint64_t req, const std::string &detail,
+                      int64_t begin_us, int64_t end_us) {
+    if (req) {
+      instance()->append(req, REQUEST, begin_us, end_us, detail.c_str());
+    }
+  }
+
+  // 所有线程的记录，Chrome trace JSON
+  std::string dump() const;
+  bool dumpFile(const std::string &path) const;
+  // 信号处理函数中只设置标志，由事件循环取走后写文件
+  static void requestDump(int) { dump_requested_ = 1; }
+  static bool takeDumpRequest();
+
+  static constexpr const char *REQUEST = "request";
+
+ private:
+  struct Span {
+    uint64_t req;
+    const char *name;  // 只使用字符串常量
+    int64_t begin_us;
+    int64_t dur_us;
+    int tid;
+    char detail[52];
+  };
+  // 只有所属线程写入，锁只在导出时才有竞争
+  struct alignas(64) Ring {
+    std::mutex mtx;
+    std::vector<Span> spans;
+    uint64_t next{0};
+  };
+  // 线程退出时归还缓冲区，已有的记录保留到被新线程覆盖
+  struct Holder {
+    Ring *ring{nullptr};
+    ~Holder();
+  };
+
+  Trace() = default;
+
+  void append(uint64_t req, const char *name, int64_t begin_us,
+              int64_t end_us, const char *detail);
+  Ring *acquire();
+  void release(Ring *ring);
+
+  std::atomic<int> sample_{0};
+  size_t ring_size_{0};
+  std::atomic<uint64_t> requests_{0};
+
+  // 保护rings_和free_
+  mutable std::mutex mtx_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+  std::vector<Ring *> free_;
+
+  static volatile std::sig_atomic_t dump_requested_;
+};
@@ -2,9 +2,13 @@
 
 #include "server/webserver.h"
 
-int main() {
+// ./server [user_dir]：指定目录时用户保存在进程内的存储中，不需要MySQL(如压测时)
+int main(int argc, char *argv[]) {
+  const char *user_dir = argc > 1 ? argv[1] : nullptr;
+  // /metrics和/trace.json默认关闭，需要时把admin_paths设为true(只对本机开放)
   WebServer server(10000, 3, 60000, false, 0, "root", "12345678", "webserver",
-                   12, 4, true, 3, 1024);
+                   12, 4, true, 3, 1024, 1000, 256, 16, true, 1, true,
+                   user_dir, 100);
   server.start();
 
   return 0;
@@ -0,0 +1,645 @@
+#include "asyncsql.h"
+
+#include <algorithm>
+
+static bool ConnectionLost(unsigned int err) {
+  return err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
+}
+
+AsyncSqlClient::AsyncSqlClient(Epoller *epoller, size_t max_pending,
+                               int timeout_ms)
+    : epoller_(epoller), max_pending_(max_pending), timeout_ms_(timeout_ms) {
+  assert(epoller_);
+}
+
+size_t AsyncSqlClient::pending() const {
+  std::lock_guard locker(mtx_);
+  return queue_.size();
+}
+
+#ifdef MYSQL_WAIT_READ
+
+AsyncSqlClient::~AsyncSqlClient() {
+  for (Conn &conn : conns_) {
+    if (conn.fd >= 0) {
+      epoller_->DelFd(conn.fd);
+    }
+    if (conn.mysql) {
+      mysql_close(conn.mysql);
+    }
+  }
+  if (event_fd_ >= 0) {
+    epoller_->DelFd(event_fd_);
+    close(event_fd_);
+  }
+}
+
+bool AsyncSqlClient::init(const char *host, int port, const char *user,
+                          const char *pwd, const char *dbname, int conn_size) {
+  assert(conn_size > 0 && conns_.empty());
+  host_ = host;
+  user_ = user;
+  pwd_ = pwd;
+  dbname_ = dbname;
+  port_ = port;
+  // 其他线程提交查询后通过eventfd唤醒事件循环
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd_ < 0 || !epoller_->AddFd(event_fd_, EPOLLIN)) {
+    LOG_ERROR("AsyncSql eventfd error!");
+    return false;
+  }
+  fds_[event_fd_] = SIZE_MAX;
+  // 连接以下标登记在fds_中，之后不能再扩容
+  conns_.resize(conn_size);
+  for (Conn &conn : conns_) {
+    startConnect(conn);
+  }
+  return true;
+}
+
+bool AsyncSqlClient::query(std::string sql, Callback callback) {
+  Request request;
+  request.sql = std::move(sql);
+  request.callback = std::move(callback);
+  return submit(std::move(request));
+}
+
+bool AsyncSqlClient::execute(int stmt, std::vector<std::string> params,
+                             Callback callback) {
+  Request request;
+  request.stmt = stmt;
+  request.params = std::move(params);
+  request.callback = std::move(callback);
+  return submit(std::move(request));
+}
+
+bool AsyncSqlClient::submit(Request request) {
+  if (event_fd_ < 0) {
+    return false;
+  }
+  {
+    std::lock_guard locker(mtx_);
+    if (queue_.size() >= max_pending_) {
+      return false;
+    }
+    queue_.push_back(std::move(request));
+  }
+  wakeup();
+  return true;
+}
+
+bool AsyncSqlClient::post(std::function<void()> task) {
+  if (event_fd_ < 0) {
+    return false;
+  }
+  {
+    std::lock_guard locker(mtx_);
+    tasks_.push_back(std::move(task));
+  }
+  wakeup();
+  return true;
+}
+
+void AsyncSqlClient::wakeup() {
+  if (!notified_.exchange(true)) {
+    uint64_t one = 1;
+    ssize_t n = write(event_fd_, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+void AsyncSqlClient::handleEvent(int fd, uint32_t events) {
+  if (fd == event_fd_) {
+    uint64_t count;
+    ssize_t n = read(event_fd_, &count, sizeof(count));
+    (void)n;
+    notified_ = false;
+    std::vector<std::function<void()>> tasks;
+    {
+      std::lock_guard locker(mtx_);
+      tasks.swap(tasks_);
+    }
+    for (auto &task : tasks) {
+      task();
+    }
+    dispatch();
+    return;
+  }
+  auto it = fds_.find(fd);
+  assert(it != fds_.end());
+  Conn &conn = conns_[it->second];
+  if (conn.state == State::IDLE) {
+    // 空闲时只关注断开，通常是服务端关闭了超时的连接
+    LOG_WARN("AsyncSql connection closed by server");
+    fail(conn);
+    return;
+  }
+  int status = 0;
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+    status |= MYSQL_WAIT_READ;
+  }
+  if (events & EPOLLOUT) {
+    status |= MYSQL_WAIT_WRITE;
+  }
+  if (events & EPOLLPRI) {
+    status |= MYSQL_WAIT_EXCEPT;
+  }
+  resume(conn, status);
+}
+
+int AsyncSqlClient::nextTimeout() const {
+  int64_t now = LoopClock::nowMs();
+  int64_t next = -1;
+  for (const Conn &conn : conns_) {
+    for (int64_t deadline : {conn.deadline_ms, conn.expire_ms}) {
+      if (deadline >= 0) {
+        int64_t remain = std::max<int64_t>(deadline - now, 0);
+        next = next < 0 ? remain : std::min(next, remain);
+      }
+    }
+  }
+  return static_cast<int>(next);
+}
+
+void AsyncSqlClient::checkTimeouts() {
+  int64_t now = LoopClock::nowMs();
+  for (Conn &conn : conns_) {
+    if (conn.expire_ms >= 0 && conn.expire_ms <= now) {
+      // 数据库不应答而socket仍然打开时，只能由这里结束查询并放弃连接
+      bool connecting = conn.state == State::CONNECTING;
+      LOG_WARN("AsyncSql %s timeout", connecting ? "connect" : "query");
+      fail(conn, CR_SERVER_LOST,
+           connecting ? "connect timeout" : "query timeout");
+      if (connecting && ready_count_ == 0) {
+        failPending();
+      }
+      continue;
+    }
+    if (conn.deadline_ms < 0 || conn.deadline_ms > now) {
+      continue;
+    }
+    conn.deadline_ms = -1;
+    if (conn.state == State::BROKEN) {
+      startConnect(conn);
+    } else {
+      resume(conn, MYSQL_WAIT_TIMEOUT);
+    }
+  }
+}
+
+void AsyncSqlClient::startConnect(Conn &conn) {
+  conn.mysql = mysql_init(nullptr);
+  if (!conn.mysql) {
+    LOG_ERROR("Mysql init error!");
+    conn.deadline_ms = LoopClock::nowMs() + RECONNECT_MS;
+    return;
+  }
+  mysql_options(conn.mysql, MYSQL_OPT_NONBLOCK, 0);
+  // 客户端库的超时以秒为单位，由MYSQL_WAIT_TIMEOUT报告；expire_ms是精确的上限
+  unsigned int timeout_s = std::max((timeout_ms_ + 999) / 1000, 1);
+  mysql_options(conn.mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout_s);
+  mysql_options(conn.mysql, MYSQL_OPT_READ_TIMEOUT, &timeout_s);
+  mysql_options(conn.mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeout_s);
+  conn.state = State::CONNECTING;
+  conn.expire_ms = LoopClock::nowMs() + timeout_ms_;
+  MYSQL *ret = nullptr;
+  int status = mysql_real_connect_start(&ret, conn.mysql, host_.c_str(),
+                                        user_.c_str(), pwd_.c_str(),
+                                        dbname_.c_str(), port_, nullptr, 0);
+  if (status) {
+    wait(conn, status);
+  } else {
+    onConnected(conn, ret != nullptr);
+  }
+}
+
+void AsyncSqlClient::startQuery(Conn &conn) {
+  conn.expire_ms = LoopClock::nowMs() + timeout_ms_;
+  if (conn.request.stmt >= 0) {
+    startStmt(conn);
+    return;
+  }
+  conn.state = State::QUERY;
+  int err = 0;
+  int status = mysql_real_query_start(&err, conn.mysql, conn.request.sql.data(),
+                                      conn.request.sql.size());
+  if (status) {
+    wait(conn, status);
+  } else {
+    onQueryDone(conn, err);
+  }
+}
+
+void AsyncSqlClient::resume(Conn &conn, int status) {
+  switch (conn.state) {
+    case State::CONNECTING: {
+      MYSQL *ret = nullptr;
+      status = mysql_real_connect_cont(&ret, conn.mysql, status);
+      if (status) {
+        wait(conn, status);
+      } else {
+        onConnected(conn, ret != nullptr);
+      }
+      break;
+    }
+    case State::QUERY: {
+      int err = 0;
+      status = mysql_real_query_cont(&err, conn.mysql, status);
+      if (status) {
+        wait(conn, status);
+      } else {
+        onQueryDone(conn, err);
+      }
+      break;
+    }
+    case State::STORE: {
+      MYSQL_RES *res = nullptr;
+      status = mysql_store_result_cont(&res, conn.mysql, status);
+      if (status) {
+        wait(conn, status);
+      } else {
+        onStored(conn, res);
+      }
+      break;
+    }
+    case State::PREPARE: {
+      int err = 0;
+      status = mysql_stmt_prepare_cont(&err, conn.stmt, status);
+      if (status) {
+        wait(conn, status);
+      } else {
+        onPrepared(conn, err);
+      }
+      break;
+    }
+    case State::EXECUTE: {
+      int err = 0;
+      status = mysql_stmt_execute_cont(&err, conn.stmt, status);
+      if (status) {
+        wait(conn, status);
+      } else {
+        onExecuted(conn, err);
+      }
+      break;
+    }
+    case State::STMT_STORE: {
+      int err = 0;
+      status = mysql_stmt_store_result_cont(&err, conn.stmt, status);
+      if (status) {
+        wait(conn, status);
+      } else {
+        onStmtStored(conn, err);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void AsyncSqlClient::onConnected(Conn &conn, bool ok) {
+  if (!ok) {
+    LOG_ERROR("Mysql Connect error: %s", mysql_error(conn.mysql));
+    fail(conn);
+    // 没有任何可用连接时，排队的查询直接失败，不等到请求超时
+    if (ready_count_ == 0) {
+      failPending();
+    }
+    return;
+  }
+  conn.state = State::IDLE;
+  conn.deadline_ms = -1;
+  conn.expire_ms = -1;
+  conn.stmts = std::make_unique<SqlStmtCache>(conn.mysql);
+  watch(conn, EPOLLRDHUP);
+  ready_count_++;
+  dispatch();
+}
+
+void AsyncSqlClient::onQueryDone(Conn &conn, int err) {
+  if (err) {
+    unsigned int code = mysql_errno(conn.mysql);
+    if (ConnectionLost(code)) {
+      fail(conn);
+      return;
+    }
+    SqlResult result;
+    result.err = code;
+    result.error = mysql_error(conn.mysql);
+    finish(conn, result);
+    return;
+  }
+  conn.state = State::STORE;
+  MYSQL_RES *res = nullptr;
+  int status = mysql_store_result_start(&res, conn.mysql);
+  if (status) {
+    wait(conn, status);
+  } else {
+    onStored(conn, res);
+  }
+}
+
+void AsyncSqlClient::onStored(Conn &conn, MYSQL_RES *res) {
+  SqlResult result;
+  // 没有结果集的语句(如INSERT)返回nullptr且errno为0
+  if (!res && mysql_errno(conn.mysql)) {
+    result.err = mysql_errno(conn.mysql);
+    result.error = mysql_error(conn.mysql);
+    finish(conn, result);
+    return;
+  }
+  result.ok = true;
+  result.affected_rows = mysql_affected_rows(conn.mysql);
+  if (res) {
+    // 结果已全部读入内存，取行和释放都不会再访问网络
+    unsigned int fields = mysql_num_fields(res);
+    while (MYSQL_ROW row = mysql_fetch_row(res)) {
+      std::vector<std::string> values(fields);
+      for (unsigned int i = 0; i < fields; ++i) {
+        if (row[i]) {
+          values[i] = row[i];
+        }
+      }
+      result.rows.push_back(std::move(values));
+    }
+    mysql_free_result(res);
+  }
+  finish(conn, result);
+}
+
+void AsyncSqlClient::startStmt(Conn &conn) {
+  conn.stmt = conn.stmts->cached(conn.request.stmt);
+  if (conn.stmt) {
+    startExecute(conn);
+    return;
+  }
+  conn.stmt = mysql_stmt_init(conn.mysql);
+  if (!conn.stmt) {
+    SqlResult result;
+    result.err = mysql_errno(conn.mysql);
+    result.error = mysql_error(conn.mysql);
+    finish(conn, result);
+    return;
+  }
+  conn.state = State::PREPARE;
+  const std::string &sql = SqlStmtCache::sql(conn.request.stmt);
+  int err = 0;
+  int status =
+      mysql_stmt_prepare_start(&err, conn.stmt, sql.data(), sql.size());
+  if (status) {
+    wait(conn, status);
+  } else {
+    onPrepared(conn, err);
+  }
+}
+
+void AsyncSqlClient::onPrepared(Conn &conn, int err) {
+  if (err) {
+    unsigned int code = mysql_stmt_errno(conn.stmt);
+    if (ConnectionLost(code)) {
+      fail(conn, code, mysql_stmt_error(conn.stmt));
+      return;
+    }
+    SqlResult result;
+    result.err = code;
+    result.error = mysql_stmt_error(conn.stmt);
+    LOG_ERROR("prepare [%s] error: %s",
+              SqlStmtCache::sql(conn.request.stmt).c_str(),
+              result.error.c_str());
+    mysql_stmt_close(conn.stmt);
+    finish(conn, result);
+    return;
+  }
+  conn.stmts->add(conn.request.stmt, conn.stmt);
+  startExecute(conn);
+}
+
+void AsyncSqlClient::startExecute(Conn &conn) {
+  // 绑定只记录参数的地址，参数在request中保存到执行结束
+  std::vector<std::string_view> params(conn.request.params.begin(),
+                                       conn.request.params.end());
+  SqlResult result;
+  if (!conn.stmts->bindParams(conn.stmt, params.data(), params.size(),
+                              &result)) {
+    finish(conn, result);
+    return;
+  }
+  conn.state = State::EXECUTE;
+  int err = 0;
+  int status = mysql_stmt_execute_start(&err, conn.stmt);
+  if (status) {
+    wait(conn, status);
+  } else {
+    onExecuted(conn, err);
+  }
+}
+
+void AsyncSqlClient::onExecuted(Conn &conn, int err) {
+  SqlResult result;
+  if (err) {
+    unsigned int code = mysql_stmt_errno(conn.stmt);
+    if (ConnectionLost(code)) {
+      fail(conn, code, mysql_stmt_error(conn.stmt));
+      return;
+    }
+    // 服务端丢弃了语句(如表结构变化)，与SqlStmtCache一样重新prepare一次
+    bool stale = code == ER_UNKNOWN_STMT_HANDLER || code == ER_NEED_REPREPARE;
+    if (stale && !conn.request.reprepared) {
+      LOG_WARN("prepared statement %d lost: %s, re-prepare", conn.request.stmt,
+               mysql_stmt_error(conn.stmt));
+      conn.stmts->drop(conn.request.stmt);
+      conn.request.reprepared = true;
+      startStmt(conn);
+      return;
+    }
+    result.err = code;
+    result.error = mysql_stmt_error(conn.stmt);
+    finish(conn, result);
+    return;
+  }
+  unsigned int fields = mysql_stmt_field_count(conn.stmt);
+  if (fields == 0) {
+    result.ok = true;
+    result.affected_rows = mysql_stmt_affected_rows(conn.stmt);
+    finish(conn, result);
+    return;
+  }
+  if (!conn.stmts->bindResult(conn.stmt, fields, &result)) {
+    finish(conn, result);
+    return;
+  }
+  conn.state = State::STMT_STORE;
+  int status = mysql_stmt_store_result_start(&err, conn.stmt);
+  if (status) {
+    wait(conn, status);
+  } else {
+    onStmtStored(conn, err);
+  }
+}
+
+void AsyncSqlClient::onStmtStored(Conn &conn, int err) {
+  SqlResult result;
+  if (err) {
+    unsigned int code = mysql_stmt_errno(conn.stmt);
+    if (ConnectionLost(code)) {
+      fail(conn, code, mysql_stmt_error(conn.stmt));
+      return;
+    }
+    result.err = code;
+    result.error = mysql_stmt_error(conn.stmt);
+    finish(conn, result);
+    return;
+  }
+  // 结果已全部读入内存，取行不会再访问网络
+  unsigned int fields = mysql_stmt_field_count(conn.stmt);
+  if (conn.stmts->readRows(conn.stmt, fields, &result)) {
+    result.ok = true;
+    result.affected_rows = mysql_stmt_affected_rows(conn.stmt);
+  }
+  finish(conn, result);
+}
+
+void AsyncSqlClient::finish(Conn &conn, SqlResult &result) {
+  Callback callback = std::move(conn.request.callback);
+  conn.request = Request();
+  conn.stmt = nullptr;
+  conn.state = State::IDLE;
+  conn.deadline_ms = -1;
+  conn.expire_ms = -1;
+  watch(conn, EPOLLRDHUP);
+  callback(result);
+  dispatch();
+}
+
+void AsyncSqlClient::fail(Conn &conn, unsigned int err, const char *error) {
+  // 连接断开：正在执行的查询以错误结束，稍后重新连接
+  State state = conn.state;
+  SqlResult result;
+  if (err) {
+    result.err = err;
+    result.error = error ? error : "";
+  } else if (conn.mysql) {
+    result.err = mysql_errno(conn.mysql);
+    result.error = mysql_error(conn.mysql);
+  }
+  bool running = state != State::CONNECTING && state != State::IDLE &&
+                 state != State::BROKEN;
+  if (state == State::IDLE || running) {
+    ready_count_--;
+  }
+  if (conn.fd >= 0) {
+    // 先从epoll和fds_中移除，fd关闭后可能立即被新的客户端连接复用
+    epoller_->DelFd(conn.fd);
+    fds_.erase(conn.fd);
+    conn.fd = -1;
+    conn.events = 0;
+  }
+  if (conn.mysql) {
+    mysql_close(conn.mysql);
+    conn.mysql = nullptr;
+  }
+  // 连接关闭后语句句柄只在本地释放，不再访问网络；
+  // prepare中的语句还没有交给缓存，单独关闭
+  if (state == State::PREPARE) {
+    mysql_stmt_close(conn.stmt);
+  }
+  conn.stmt = nullptr;
+  conn.stmts.reset();
+  conn.state = State::BROKEN;
+  conn.deadline_ms = LoopClock::nowMs() + RECONNECT_MS;
+  conn.expire_ms = -1;
+  if (running) {
+    Callback callback = std::move(conn.request.callback);
+    conn.request = Request();
+    callback(result);
+  }
+}
+
+void AsyncSqlClient::failPending() {
+  std::deque<Request> requests;
+  {
+    std::lock_guard locker(mtx_);
+    requests.swap(queue_);
+  }
+  SqlResult result;
+  result.err = CR_SERVER_LOST;
+  result.error = "no mysql connection available";
+  for (Request &request : requests) {
+    request.callback(result);
+  }
+}
+
+void AsyncSqlClient::wait(Conn &conn, int status) {
+  uint32_t events = 0;
+  if (status & MYSQL_WAIT_READ) {
+    events |= EPOLLIN;
+  }
+  if (status & MYSQL_WAIT_WRITE) {
+    events |= EPOLLOUT;
+  }
+  if (status & MYSQL_WAIT_EXCEPT) {
+    events |= EPOLLPRI;
+  }
+  watch(conn, events);
+  conn.deadline_ms = -1;
+  if (status & MYSQL_WAIT_TIMEOUT) {
+    conn.deadline_ms =
+        LoopClock::nowMs() + mysql_get_timeout_value_ms(conn.mysql);
+  }
+}
+
+void AsyncSqlClient::watch(Conn &conn, uint32_t events) {
+  if (conn.fd < 0) {
+    // 连接开始后才有socket，重连后可能变化
+    conn.fd = mysql_get_socket(conn.mysql);
+    fds_[conn.fd] = &conn - conns_.data();
+    epoller_->AddFd(conn.fd, events);
+  } else if (events != conn.events) {
+    epoller_->ModFd(conn.fd, events);
+  }
+  conn.events = events;
+}
+
+void AsyncSqlClient::dispatch() {
+  for (Conn &conn : conns_) {
+    if (conn.state != State::IDLE) {
+      continue;
+    }
+    std::unique_lock locker(mtx_);
+    if (queue_.empty()) {
+      return;
+    }
+    conn.request = std::move(queue_.front());
+    queue_.pop_front();
+    locker.unlock();
+    startQuery(conn);
+  }
+}
+
+#else
+
+// Oracle MySQL的客户端库没有mysql_*_start/_cont，只能使用阻塞的连接池
+
+AsyncSqlClient::~AsyncSqlClient() = default;
+
+bool AsyncSqlClient::init(const char *, int, const char *, const char *,
+                          const char *, int) {
+  LOG_WARN("AsyncSql: mysql client library has no non-blocking API");
+  return false;
+}
+
+bool AsyncSqlClient::query(std::string, Callback) { return false; }
+
+bool AsyncSqlClient::execute(int, std::vector<std::string>, Callback) {
+  return false;
+}
+
+bool AsyncSqlClient::post(std::function<void()>) { return false; }
+
+void AsyncSqlClient::handleEvent(int, uint32_t) {}
+
+int AsyncSqlClient::nextTimeout() const { return -1; }
+
+void AsyncSqlClient::checkTimeouts() {}
+
+#endif
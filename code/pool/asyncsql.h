@@ -0,0 +1,124 @@
+#pragma once
+
+#include <mysql/errmsg.h>
+#include <mysql/mysql.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../log/log.h"
+#include "../server/epoller.h"
+#include "sqlstmt.h"
+
+// 基于MariaDB客户端非阻塞API(mysql_*_start/_cont)的异步客户端
+// 每个连接的socket注册在事件循环的epoll中，查询随读写就绪在事件循环线程中推进，
+// 等待数据库期间不占用任何线程；query可以在任意线程调用，回调在事件循环线程中执行
+// 客户端库不支持非阻塞API时init返回false，调用者应退回到阻塞的连接池
+class AsyncSqlClient {
+ public:
+  using Callback = std::function<void(SqlResult &result)>;
+
+  // max_pending为等待空闲连接的查询上限；timeout_ms是建立连接和每次查询的期限，
+  // 超时的查询以错误结束，连接关闭后重连，数据库无响应时连接不会被一直占用
+  explicit AsyncSqlClient(Epoller *epoller, size_t max_pending = 1024,
+                          int timeout_ms = 5000);
+  ~AsyncSqlClient();
+
+  // 发起连接，握手在事件循环中完成，期间提交的查询排队等待
+  bool init(const char *host, int port, const char *user, const char *pwd,
+            const char *dbname, int conn_size);
+  // 排队的查询过多时返回false，callback不会被调用
+  bool query(std::string sql, Callback callback);
+  // 执行SqlStmtCache::define登记的语句，参数以二进制绑定，不需要拼接和转义；
+  // 语句在每个连接上第一次使用时prepare，重连后重新prepare
+  bool execute(int stmt, std::vector<std::string> params, Callback callback);
+  // 让task在事件循环线程中执行，用于其他线程把结果交回事件循环
+  bool post(std::function<void()> task);
+
+  // 以下由事件循环线程调用
+  bool owns(int fd) const { return fds_.count(fd) > 0; }
+  void handleEvent(int fd, uint32_t events);
+  // 最近一个连接超时或重连的剩余时间(ms)，没有时返回-1
+  int nextTimeout() const;
+  void checkTimeouts();
+
+  size_t pending() const;
+  int readyCount() const { return ready_count_; }
+
+ private:
+  enum class State {
+    CONNECTING,
+    IDLE,
+    QUERY,
+    STORE,
+    PREPARE,
+    EXECUTE,
+    STMT_STORE,
+    BROKEN
+  };
+  struct Request {
+    std::string sql;
+    int stmt{-1};  // 不小于0时执行预编译语句，sql为空
+    std::vector<std::string> params;
+    bool reprepared{false};
+    Callback callback;
+  };
+  struct Conn {
+    MYSQL *mysql{nullptr};
+    State state{State::BROKEN};
+    int fd{-1};
+    uint32_t events{0};       // 当前注册的epoll事件
+    int64_t deadline_ms{-1};  // MYSQL_WAIT_TIMEOUT或重连的时间
+    int64_t expire_ms{-1};    // 正在进行的连接或查询的期限
+    Request request;
+    std::unique_ptr<SqlStmtCache> stmts;  // 随连接建立，重连后重建
+    MYSQL_STMT *stmt{nullptr};            // 正在执行的语句
+  };
+
+  void startConnect(Conn &conn);
+  void startQuery(Conn &conn);
+  void resume(Conn &conn, int status);
+  void onConnected(Conn &conn, bool ok);
+  void onQueryDone(Conn &conn, int err);
+  void onStored(Conn &conn, MYSQL_RES *res);
+  void startStmt(Conn &conn);
+  void onPrepared(Conn &conn, int err);
+  void startExecute(Conn &conn);
+  void onExecuted(Conn &conn, int err);
+  void onStmtStored(Conn &conn, int err);
+  bool submit(Request request);
+  void finish(Conn &conn, SqlResult &result);
+  // err不为0时作为查询的错误(如超时或语句上的错误)，否则取连接上的错误
+  void fail(Conn &conn, unsigned int err = 0, const char *error = nullptr);
+  void failPending();
+  void wait(Conn &conn, int status);
+  void dispatch();
+  void wakeup();
+  void watch(Conn &conn, uint32_t events);
+
+  static const int RECONNECT_MS = 1000;
+
+  Epoller *epoller_;
+  size_t max_pending_;
+  int timeout_ms_;
+  int event_fd_{-1};
+  std::string host_, user_, pwd_, dbname_;
+  int port_{0};
+
+  // 只由事件循环线程访问
+  std::vector<Conn> conns_;
+  std::unordered_map<int, size_t> fds_;
+  int ready_count_{0};
+
+  mutable std::mutex mtx_;
+  std::deque<Request> queue_;
+  std::vector<std::function<void()>> tasks_;
+  std::atomic<bool> notified_{false};
+};
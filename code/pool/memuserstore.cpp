@@ -0,0 +1,420 @@
+#include "memuserstore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+static const char SNAP_MAGIC[8] = {'T', 'W', 'U', 'S', 'N', 'A', 'P', '1'};
+// 快照按块写出，不必把全部用户复制到一个缓冲里
+static const size_t SNAP_CHUNK = 1 << 20;
+
+static bool WriteAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, data, len);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+MemUserStore::~MemUserStore() { close(); }
+
+bool MemUserStore::init(const Options &options) {
+  if (!stop_ || options.shards <= 0) {
+    return false;
+  }
+  options_ = options;
+  shards_.clear();
+  for (int i = 0; i < options_.shards; ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+  }
+  mkdir(options_.dir.c_str(), 0755);
+  auto begin = std::chrono::steady_clock::now();
+  if (!recover()) {
+    return false;
+  }
+  recover_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin)
+                    .count();
+  {
+    std::lock_guard locker(mtx_);
+    stop_ = false;
+  }
+  maintainer_ = std::thread([this] { maintain(); });
+  LOG_INFO("MemUserStore: %lu users recovered from %s in %.1fms", recovered_,
+           options_.dir.c_str(), recover_us_ / 1000.0);
+  return true;
+}
+
+void MemUserStore::close() {
+  {
+    std::lock_guard locker(mtx_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+  }
+  cv_.notify_all();
+  maintainer_.join();
+  // 下次启动只需要读快照
+  if (log_bytes_.load(std::memory_order_relaxed) > 0) {
+    snapshot();
+  }
+  std::lock_guard locker(log_mtx_);
+  if (log_fd_ >= 0) {
+    ::close(log_fd_);
+    log_fd_ = -1;
+  }
+}
+
+uint32_t MemUserStore::checksum(const char *name, uint32_t name_len,
+                                const char *pwd, uint32_t pwd_len) {
+  // FNV-1a，只用来发现写了一半的记录
+  uint32_t sum = 2166136261u;
+  auto mix = [&sum](const char *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+      sum = (sum ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+  };
+  mix(reinterpret_cast<const char *>(&name_len), sizeof(name_len));
+  mix(reinterpret_cast<const char *>(&pwd_len), sizeof(pwd_len));
+  mix(name, name_len);
+  mix(pwd, pwd_len);
+  return sum;
+}
+
+size_t MemUserStore::replay(const char *data, size_t len, uint64_t *count) {
+  size_t pos = 0;
+  while (len - pos >= sizeof(Record)) {
+    Record record;
+    memcpy(&record, data + pos, sizeof(record));
+    uint64_t body = static_cast<uint64_t>(record.name_len) + record.pwd_len;
+    if (body > len - pos - sizeof(Record)) {
+      break;
+    }
+    const char *name = data + pos + sizeof(Record);
+    const char *pwd = name + record.name_len;
+    if (checksum(name, record.name_len, pwd, record.pwd_len) != record.sum) {
+      break;
+    }
+    // 记录按写入的顺序重放，同一用户的多条记录(修改密码、快照和日志
+    // 重叠的部分)以最后一条为准
+    std::string key(name, record.name_len);
+    shard(key).users[std::move(key)].assign(pwd, record.pwd_len);
+    (*count)++;
+    pos += sizeof(Record) + body;
+  }
+  return pos;
+}
+
+std::vector<uint64_t> MemUserStore::logGens() const {
+  std::vector<uint64_t> gens;
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(options_.dir, ec)) {
+    // users.<gen>.log
+    std::string file = entry.path().filename().string();
+    if (file.size() <= 10 || file.compare(0, 6, "users.") != 0 ||
+        file.compare(file.size() - 4, 4, ".log") != 0) {
+      continue;
+    }
+    std::string gen = file.substr(6, file.size() - 10);
+    if (std::all_of(gen.begin(), gen.end(), ::isdigit)) {
+      gens.push_back(std::stoull(gen));
+    }
+  }
+  std::sort(gens.begin(), gens.end());
+  return gens;
+}
+
+bool MemUserStore::recover() {
+  uint64_t next_gen = 0;
+  uint64_t count = 0;
+  std::string path = snapPath();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0 && errno != ENOENT) {
+    LOG_ERROR("open %s error: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  if (fd >= 0) {
+    // 快照改名之前已经写完并fsync，任何错误都说明文件被破坏了
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 &&
+              static_cast<size_t>(st.st_size) >= sizeof(SnapHeader);
+    void *data = ok ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                    : MAP_FAILED;
+    ::close(fd);
+    ok = data != MAP_FAILED;
+    if (ok) {
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+      SnapHeader header;
+      memcpy(&header, data, sizeof(header));
+      size_t len = st.st_size - sizeof(header);
+      ok = memcmp(header.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) == 0 &&
+           replay(static_cast<const char *>(data) + sizeof(header), len,
+                  &count) == len &&
+           count == header.count;
+      next_gen = header.gen;
+      munmap(data, st.st_size);
+    }
+    if (!ok) {
+      LOG_ERROR("user snapshot %s is corrupted!", path.c_str());
+      return false;
+    }
+  }
+
+  for (uint64_t gen : logGens()) {
+    path = logPath(gen);
+    if (gen < next_gen) {
+      // 已经包含在快照中，删除之前进程退出了
+      unlink(path.c_str());
+      continue;
+    }
+    fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      LOG_ERROR("open %s error: %s", path.c_str(), strerror(errno));
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      return false;
+    }
+    if (st.st_size == 0) {
+      ::close(fd);
+      unlink(path.c_str());
+      continue;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      LOG_ERROR("mmap %s error: %s", path.c_str(), strerror(errno));
+      ::close(fd);
+      return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    size_t valid = replay(static_cast<const char *>(data), st.st_size, &count);
+    munmap(data, st.st_size);
+    if (valid < static_cast<size_t>(st.st_size)) {
+      LOG_WARN("%s: drop %lu bytes of incomplete records", path.c_str(),
+               st.st_size - valid);
+      ftruncate(fd, valid);
+    }
+    ::close(fd);
+    next_gen = gen + 1;
+  }
+  recovered_ = 0;
+  for (const auto &s : shards_) {
+    recovered_ += s->users.size();
+  }
+  return openLog(next_gen);
+}
+
+bool MemUserStore::openLog(uint64_t gen) {
+  std::string path = logPath(gen);
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    LOG_ERROR("open %s error: %s", path.c_str(), strerror(errno));
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return false;
+  }
+  if (log_fd_ >= 0) {
+    ::close(log_fd_);
+  }
+  log_fd_ = fd;
+  log_gen_ = gen;
+  log_bytes_.store(st.st_size, std::memory_order_relaxed);
+  return true;
+}
+
+bool MemUserStore::append(const std::string &name, const std::string &pwd) {
+  if (log_fd_ < 0) {
+    return false;
+  }
+  Record record;
+  record.name_len = name.size();
+  record.pwd_len = pwd.size();
+  record.sum = checksum(name.data(), record.name_len, pwd.data(),
+                        record.pwd_len);
+  std::string buf(reinterpret_cast<const char *>(&record), sizeof(record));
+  buf += name;
+  buf += pwd;
+  uint64_t size = log_bytes_.load(std::memory_order_relaxed);
+  if (!WriteAll(log_fd_, buf.data(), buf.size()) ||
+      (options_.sync && fdatasync(log_fd_) != 0)) {
+    // 写了一半的记录会挡住之后的记录，截回到写入之前
+    LOG_ERROR("write user log error: %s", strerror(errno));
+    ftruncate(log_fd_, size);
+    return false;
+  }
+  log_bytes_.store(size + buf.size(), std::memory_order_relaxed);
+  return true;
+}
+
+UserCache::Load MemUserStore::find(const std::string &name) {
+  Shard &s = shard(name);
+  UserCache::Load load;
+  load.ok = true;
+  std::shared_lock locker(s.mtx);
+  auto it = s.users.find(name);
+  if (it != s.users.end()) {
+    load.exists = true;
+    load.password = it->second;
+  }
+  return load;
+}
+
+bool MemUserStore::insert(const std::string &name, const std::string &pwd) {
+  Shard &s = shard(name);
+  // 持有分片的写锁直到加入哈希表，快照读到这个分片时记录要么在哈希表中，
+  // 要么写在切换之后的日志里
+  std::unique_lock locker(s.mtx);
+  if (s.users.count(name)) {
+    return false;
+  }
+  {
+    std::lock_guard log_locker(log_mtx_);
+    if (!append(name, pwd)) {
+      return false;
+    }
+  }
+  s.users.emplace(name, pwd);
+  inserts_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool MemUserStore::update(const std::string &name, const std::string &old_pwd,
+                          const std::string &pwd) {
+  Shard &s = shard(name);
+  std::unique_lock locker(s.mtx);
+  auto it = s.users.find(name);
+  if (it == s.users.end() || it->second != old_pwd) {
+    return false;
+  }
+  {
+    std::lock_guard log_locker(log_mtx_);
+    if (!append(name, pwd)) {
+      return false;
+    }
+  }
+  it->second = pwd;
+  return true;
+}
+
+bool MemUserStore::snapshot() {
+  std::lock_guard snap_locker(snap_mtx_);
+  uint64_t gen;
+  {
+    std::lock_guard locker(log_mtx_);
+    if (log_fd_ < 0 || !openLog(log_gen_ + 1)) {
+      return false;
+    }
+    gen = log_gen_;
+  }
+  std::string path = snapPath();
+  std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    LOG_ERROR("open %s error: %s", tmp.c_str(), strerror(errno));
+    return false;
+  }
+  SnapHeader header;
+  memcpy(header.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+  header.gen = gen;
+  header.count = 0;
+  std::string buf(reinterpret_cast<const char *>(&header), sizeof(header));
+  bool ok = true;
+  for (const auto &s : shards_) {
+    {
+      std::shared_lock locker(s->mtx);
+      for (const auto &[name, pwd] : s->users) {
+        Record record;
+        record.name_len = name.size();
+        record.pwd_len = pwd.size();
+        record.sum = checksum(name.data(), record.name_len, pwd.data(),
+                              record.pwd_len);
+        buf.append(reinterpret_cast<const char *>(&record), sizeof(record));
+        buf += name;
+        buf += pwd;
+        header.count++;
+      }
+    }
+    // 写文件时不持有分片的锁
+    if (buf.size() >= SNAP_CHUNK) {
+      ok = ok && WriteAll(fd, buf.data(), buf.size());
+      buf.clear();
+    }
+  }
+  ok = ok && WriteAll(fd, buf.data(), buf.size()) &&
+       pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+       fsync(fd) == 0;
+  ::close(fd);
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    LOG_ERROR("write user snapshot error: %s", strerror(errno));
+    unlink(tmp.c_str());
+    return false;
+  }
+  int dir = open(options_.dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir >= 0) {
+    fsync(dir);
+    ::close(dir);
+  }
+  // 快照已经包含切换之前的全部日志
+  for (uint64_t old : logGens()) {
+    if (old < gen) {
+      unlink(logPath(old).c_str());
+    }
+  }
+  snapshots_.fetch_add(1, std::memory_order_relaxed);
+  LOG_INFO("user snapshot: %lu users, log gen %lu", header.count, gen);
+  return true;
+}
+
+void MemUserStore::maintain() {
+  std::unique_lock locker(mtx_);
+  while (!stop_) {
+    cv_.wait_for(locker, std::chrono::milliseconds(options_.check_interval_ms));
+    if (stop_) {
+      break;
+    }
+    if (log_bytes_.load(std::memory_order_relaxed) >= options_.snapshot_bytes) {
+      locker.unlock();
+      snapshot();
+      locker.lock();
+    }
+  }
+}
+
+MemUserStore::Shard &MemUserStore::shard(const std::string &name) {
+  return *shards_[std::hash<std::string>{}(name) % shards_.size()];
+}
+
+std::string MemUserStore::logPath(uint64_t gen) const {
+  return options_.dir + "/users." + std::to_string(gen) + ".log";
+}
+
+std::string MemUserStore::snapPath() const {
+  return options_.dir + "/users.snap";
+}
+
+MemUserStore::Stats MemUserStore::stats() const {
+  Stats stats{};
+  for (const auto &s : shards_) {
+    std::shared_lock locker(s->mtx);
+    stats.users += s->users.size();
+  }
+  stats.inserts = inserts_.load(std::memory_order_relaxed);
+  stats.log_bytes = log_bytes_.load(std::memory_order_relaxed);
+  stats.snapshots = snapshots_.load(std::memory_order_relaxed);
+  stats.recovered = recovered_;
+  stats.recover_us = recover_us_;
+  return stats;
+}
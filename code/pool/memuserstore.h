@@ -0,0 +1,112 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "userstore.h"
+
+// 进程内的用户存储，不依赖MySQL
+// 用户按用户名分片保存在内存的哈希表中，查询只加分片的读锁；
+// 每次注册或修改密码追加一条记录到日志users.<gen>.log，日志超过snapshot_bytes后
+// 后台线程切换到新的日志，把全部用户写成快照users.snap并删除旧日志。
+// 启动时mmap快照和之后的日志恢复，日志末尾不完整的记录(写入时崩溃)被截掉
+class MemUserStore : public UserStore {
+ public:
+  struct Options {
+    std::string dir{"./data"};
+    int shards{64};
+    size_t snapshot_bytes{64 << 20};  // 日志达到这个大小后做快照
+    int check_interval_ms{1000};      // 后台线程检查日志大小的周期
+    bool sync{false};                 // 每条记录写入后fdatasync
+  };
+
+  struct Stats {
+    size_t users;
+    uint64_t inserts;
+    uint64_t log_bytes;     // 当前日志的大小
+    uint64_t snapshots;
+    uint64_t recovered;     // 启动时恢复的用户数
+    uint64_t recover_us;
+  };
+
+  MemUserStore() = default;
+  ~MemUserStore() override;
+
+  // 恢复数据并打开新的日志，失败返回false
+  bool init(const Options &options);
+  void close();
+
+  UserCache::Load find(const std::string &name) override;
+  bool insert(const std::string &name, const std::string &pwd) override;
+  bool update(const std::string &name, const std::string &old_pwd,
+              const std::string &pwd) override;
+  bool isLocal() const override { return true; }
+
+  // 立即切换日志并写快照
+  bool snapshot();
+  Stats stats() const;
+
+ private:
+  // 日志和快照中的一条记录，后面紧跟用户名和密码的字节
+  struct Record {
+    uint32_t name_len;
+    uint32_t pwd_len;
+    uint32_t sum;  // 长度和内容的校验和
+  };
+  struct SnapHeader {
+    char magic[8];
+    uint64_t gen;    // 快照开始时切换到的日志，恢复时从它开始重放
+    uint64_t count;
+  };
+  struct alignas(64) Shard {
+    std::shared_mutex mtx;
+    std::unordered_map<std::string, std::string> users;
+  };
+
+  static uint32_t checksum(const char *name, uint32_t name_len,
+                           const char *pwd, uint32_t pwd_len);
+  // 解析一段记录，返回完整有效的记录占用的字节数
+  size_t replay(const char *data, size_t len, uint64_t *count);
+  bool recover();
+  // 目录中所有日志的编号，从小到大
+  std::vector<uint64_t> logGens() const;
+  bool openLog(uint64_t gen);
+  bool append(const std::string &name, const std::string &pwd);
+  void maintain();
+
+  Shard &shard(const std::string &name);
+  std::string logPath(uint64_t gen) const;
+  std::string snapPath() const;
+
+  Options options_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::mutex log_mtx_;  // 保护日志的写入和切换，在分片的写锁之内获取
+  int log_fd_{-1};
+  uint64_t log_gen_{0};
+  std::atomic<uint64_t> log_bytes_{0};
+
+  std::mutex snap_mtx_;  // 同一时间只有一个快照
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_{true};
+  std::thread maintainer_;
+
+  std::atomic<uint64_t> inserts_{0};
+  std::atomic<uint64_t> snapshots_{0};
+  uint64_t recovered_{0};
+  uint64_t recover_us_{0};
+};
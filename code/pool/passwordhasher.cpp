@@ -0,0 +1,278 @@
+#include "passwordhasher.h"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+static const char SCRYPT_PREFIX[] = "$scrypt$";
+
+static int64_t ElapsedUs(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - begin)
+      .count();
+}
+
+static std::string Base64(const unsigned char *data, size_t len) {
+  std::string out(4 * ((len + 2) / 3) + 1, '\0');
+  out.resize(EVP_EncodeBlock(reinterpret_cast<unsigned char *>(out.data()),
+                             data, len));
+  return out;
+}
+
+static bool Unbase64(const std::string &in, std::string *out) {
+  if (in.empty() || in.size() % 4 != 0) {
+    return false;
+  }
+  out->assign(in.size() / 4 * 3 + 1, '\0');
+  int n = EVP_DecodeBlock(reinterpret_cast<unsigned char *>(out->data()),
+                          reinterpret_cast<const unsigned char *>(in.data()),
+                          in.size());
+  if (n < 0) {
+    return false;
+  }
+  // EVP_DecodeBlock把补齐的=也解码成了0
+  size_t pad = in.size() - in.find_last_not_of('=') - 1;
+  out->resize(n - std::min<size_t>(pad, 2));
+  return true;
+}
+
+PasswordHasher *PasswordHasher::instance() {
+  static PasswordHasher hasher;
+  return &hasher;
+}
+
+bool PasswordHasher::isHashed(const std::string &stored) {
+  return stored.compare(0, sizeof(SCRYPT_PREFIX) - 1, SCRYPT_PREFIX) == 0;
+}
+
+bool PasswordHasher::init(const Options &options) {
+  if (isEnabled()) {
+    return true;
+  }
+  options_ = options;
+  options_.threads = std::max(options_.threads, 1);
+  options_.min_log_n = std::max(options_.min_log_n, 1);
+  options_.max_log_n = std::max(options_.max_log_n, options_.min_log_n);
+  int log_n = options_.log_n > 0 ? options_.log_n : calibrate();
+  if (log_n <= 0) {
+    LOG_ERROR("PasswordHasher: scrypt unavailable!");
+    return false;
+  }
+  log_n_ = log_n;
+  pool_ = std::make_unique<ThreadPool>(options_.threads, options_.queue_size);
+  enabled_.store(true, std::memory_order_release);
+  LOG_INFO("PasswordHasher: scrypt N=2^%d r=%d p=%d, %d threads, queue %d",
+           log_n, options_.r, options_.p, options_.threads,
+           options_.queue_size);
+  return true;
+}
+
+int PasswordHasher::calibrate() {
+  unsigned char salt[SALT_LEN] = {0};
+  unsigned char out[HASH_LEN];
+  auto measure = [&](int log_n) {
+    auto begin = std::chrono::steady_clock::now();
+    Params params{log_n, options_.r, options_.p};
+    if (!derive("calibrate", salt, sizeof(salt), params, out, sizeof(out))) {
+      return -1.0;
+    }
+    return ElapsedUs(begin) / 1000.0;
+  };
+  int log_n = options_.min_log_n;
+  double ms = measure(log_n);
+  if (ms < 0) {
+    return -1;
+  }
+  // N每翻一倍耗时翻一倍，翻倍之后离目标更近(按比例)才继续
+  while (log_n < options_.max_log_n && ms * M_SQRT2 < options_.target_ms) {
+    double next = measure(log_n + 1);
+    if (next < 0) {
+      break;
+    }
+    log_n++;
+    ms = next;
+  }
+  LOG_INFO("PasswordHasher calibrated: N=2^%d takes %.1fms (target %dms)",
+           log_n, ms, options_.target_ms);
+  return log_n;
+}
+
+bool PasswordHasher::derive(const std::string &pwd, const unsigned char *salt,
+                            size_t salt_len, const Params &params,
+                            unsigned char *out, size_t out_len) {
+  uint64_t n = uint64_t(1) << params.log_n;
+  // scrypt需要的内存约为128 * r * (N + p)
+  uint64_t maxmem = 128 * uint64_t(params.r) * (n + params.p + 2) + (1 << 20);
+  return EVP_PBE_scrypt(pwd.data(), pwd.size(), salt, salt_len, n, params.r,
+                        params.p, maxmem, out, out_len) == 1;
+}
+
+std::string PasswordHasher::encode(const Params &params,
+                                   const unsigned char *salt,
+                                   const unsigned char *hash) const {
+  char head[64];
+  snprintf(head, sizeof(head), "%sln=%d,r=%d,p=%d$", SCRYPT_PREFIX,
+           params.log_n, params.r, params.p);
+  return head + Base64(salt, SALT_LEN) + "$" + Base64(hash, HASH_LEN);
+}
+
+bool PasswordHasher::decode(const std::string &stored, Params *params,
+                            std::string *salt, std::string *hash) const {
+  int consumed = 0;
+  if (sscanf(stored.c_str(), "$scrypt$ln=%d,r=%d,p=%d$%n", &params->log_n,
+             &params->r, &params->p, &consumed) != 3 ||
+      consumed == 0) {
+    return false;
+  }
+  size_t dollar = stored.find('$', consumed);
+  if (dollar == std::string::npos ||
+      !Unbase64(stored.substr(consumed, dollar - consumed), salt) ||
+      !Unbase64(stored.substr(dollar + 1), hash) ||
+      hash->size() != HASH_LEN) {
+    return false;
+  }
+  // 截短的哈希是完整哈希的前缀，同样能匹配，所以长度必须一致
+  // 存储的值决定计算量，超出上限的参数不计算
+  return params->log_n > 0 && params->log_n <= options_.max_log_n &&
+         params->r > 0 && params->r <= 32 && params->p > 0 &&
+         params->p <= 16;
+}
+
+std::string PasswordHasher::hashNow(const std::string &pwd) {
+  auto begin = std::chrono::steady_clock::now();
+  unsigned char salt[SALT_LEN];
+  unsigned char out[HASH_LEN];
+  int log_n = log_n_.load(std::memory_order_relaxed);
+  Params params{log_n > 0 ? log_n : options_.min_log_n, options_.r,
+                options_.p};
+  if (RAND_bytes(salt, sizeof(salt)) != 1 ||
+      !derive(pwd, salt, sizeof(salt), params, out, sizeof(out))) {
+    LOG_ERROR("scrypt hash error!");
+    return "";
+  }
+  hashes_.fetch_add(1, std::memory_order_relaxed);
+  compute_us_.fetch_add(ElapsedUs(begin), std::memory_order_relaxed);
+  return encode(params, salt, out);
+}
+
+bool PasswordHasher::verifyNow(const std::string &pwd,
+                               const std::string &stored) {
+  if (!isHashed(stored)) {
+    return pwd.size() == stored.size() &&
+           CRYPTO_memcmp(pwd.data(), stored.data(), pwd.size()) == 0;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  Params params;
+  std::string salt, hash;
+  if (!decode(stored, &params, &salt, &hash)) {
+    LOG_WARN("bad password hash: %.32s", stored.c_str());
+    return false;
+  }
+  std::string out(hash.size(), '\0');
+  bool ok = derive(pwd, reinterpret_cast<const unsigned char *>(salt.data()),
+                   salt.size(), params,
+                   reinterpret_cast<unsigned char *>(out.data()), out.size());
+  verifies_.fetch_add(1, std::memory_order_relaxed);
+  compute_us_.fetch_add(ElapsedUs(begin), std::memory_order_relaxed);
+  return ok && CRYPTO_memcmp(out.data(), hash.data(), hash.size()) == 0;
+}
+
+void PasswordHasher::lowerPriority() const {
+  thread_local bool lowered = false;
+  if (!lowered && options_.nice > 0) {
+    // Linux上setpriority对单个线程生效
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), options_.nice);
+  }
+  lowered = true;
+}
+
+bool PasswordHasher::hash(const std::string &pwd, std::string *encoded) {
+  if (!isEnabled()) {
+    *encoded = pwd;
+    return true;
+  }
+  auto result = pool_->Enqueue([this, pwd] {
+    lowerPriority();
+    return hashNow(pwd);
+  });
+  if (!result.valid()) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  *encoded = result.get();
+  return !encoded->empty();
+}
+
+bool PasswordHasher::verify(const std::string &pwd, const std::string &stored,
+                            bool *match) {
+  // 明文比较不需要进入线程池
+  if (!isEnabled() || !isHashed(stored)) {
+    *match = verifyNow(pwd, stored);
+    return true;
+  }
+  auto result = pool_->Enqueue([this, pwd, stored] {
+    lowerPriority();
+    return verifyNow(pwd, stored);
+  });
+  if (!result.valid()) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  *match = result.get();
+  return true;
+}
+
+bool PasswordHasher::hashAsync(std::string pwd,
+                               std::function<void(std::string)> done) {
+  if (!isEnabled()) {
+    done(std::move(pwd));
+    return true;
+  }
+  bool queued = pool_
+                    ->Enqueue([this, pwd = std::move(pwd), done] {
+                      lowerPriority();
+                      done(hashNow(pwd));
+                    })
+                    .valid();
+  if (!queued) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return queued;
+}
+
+bool PasswordHasher::verifyAsync(std::string pwd, std::string stored,
+                                 std::function<void(bool)> done) {
+  if (!isEnabled() || !isHashed(stored)) {
+    done(verifyNow(pwd, stored));
+    return true;
+  }
+  bool queued =
+      pool_
+          ->Enqueue([this, pwd = std::move(pwd), stored = std::move(stored),
+                     done] {
+            lowerPriority();
+            done(verifyNow(pwd, stored));
+          })
+          .valid();
+  if (!queued) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return queued;
+}
+
+PasswordHasher::Stats PasswordHasher::stats() const {
+  Stats stats{};
+  stats.hashes = hashes_.load(std::memory_order_relaxed);
+  stats.verifies = verifies_.load(std::memory_order_relaxed);
+  stats.rejected = rejected_.load(std::memory_order_relaxed);
+  stats.compute_us = compute_us_.load(std::memory_order_relaxed);
+  if (isEnabled()) {
+    stats.pool = pool_->GetStats();
+  }
+  stats.log_n = log_n_.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "../log/log.h"
+#include "threadpool.hpp"
+
+// 密码的慢哈希(scrypt)，计算在独立的有界线程池中进行，不占用处理请求的线程
+// 存储格式：$scrypt$ln=<log2 N>,r=<r>,p=<p>$<盐的base64>$<哈希的base64>
+// 不以$scrypt$开头的值是迁移之前的明文密码，仍按明文比较；
+// 没有init时hash原样返回明文，与原来的行为一致
+// init按target_ms校准N，计算线程降低调度优先级(nice)，CPU紧张时让给处理请求的线程
+class PasswordHasher {
+ public:
+  struct Options {
+    int threads{2};
+    int queue_size{256};  // 排队的计算上限，满时提交失败
+    int target_ms{50};    // 校准的目标：一次哈希的耗时
+    int log_n{0};         // 大于0时不校准，直接使用这个cost
+    int min_log_n{10};
+    int max_log_n{17};    // 内存占用为128 * r * N字节，r=8时为128MB
+    int r{8};
+    int p{1};
+    int nice{10};         // 计算线程的nice值
+  };
+
+  struct Stats {
+    uint64_t hashes;
+    uint64_t verifies;
+    uint64_t rejected;    // 队列已满被拒绝的计算
+    uint64_t compute_us;  // 所有计算的耗时之和
+    ThreadPool::Stats pool;
+    int log_n;
+  };
+
+  static PasswordHasher *instance();
+  // 校准cost并启动计算线程，进程退出前一直可用
+  bool init(const Options &options);
+  bool isEnabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  static bool isHashed(const std::string &stored);
+
+  // 在计算线程池中计算并等待结果，队列已满时返回false
+  bool hash(const std::string &pwd, std::string *encoded);
+  bool verify(const std::string &pwd, const std::string &stored, bool *match);
+  // done在计算线程中调用，队列已满时返回false且done不会被调用
+  bool hashAsync(std::string pwd, std::function<void(std::string)> done);
+  bool verifyAsync(std::string pwd, std::string stored,
+                   std::function<void(bool)> done);
+
+  // 在调用线程中直接计算，用于校准和测试
+  std::string hashNow(const std::string &pwd);
+  bool verifyNow(const std::string &pwd, const std::string &stored);
+
+  Stats stats() const;
+
+ private:
+  struct Params {
+    int log_n;
+    int r;
+    int p;
+  };
+
+  PasswordHasher() = default;
+
+  bool derive(const std::string &pwd, const unsigned char *salt,
+              size_t salt_len, const Params &params, unsigned char *out,
+              size_t out_len);
+  std::string encode(const Params &params, const unsigned char *salt,
+                     const unsigned char *hash) const;
+  bool decode(const std::string &stored, Params *params, std::string *salt,
+              std::string *hash) const;
+  // 选择耗时最接近target_ms的log_n
+  int calibrate();
+  // 第一次在计算线程中执行时降低该线程的优先级
+  void lowerPriority() const;
+
+  static const size_t SALT_LEN = 16;
+  static const size_t HASH_LEN = 32;
+
+  Options options_;
+  std::atomic<int> log_n_{0};
+  std::unique_ptr<ThreadPool> pool_;
+  std::atomic<bool> enabled_{false};
+
+  std::atomic<uint64_t> hashes_{0};
+  std::atomic<uint64_t> verifies_{0};
+  std::atomic<uint64_t> rejected_{0};
+  std::atomic<uint64_t> compute_us_{0};
+};
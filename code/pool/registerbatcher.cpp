@@ -0,0 +1,266 @@
+#include "registerbatcher.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+static const char BEGIN_SQL[] = "START TRANSACTION";
+
+std::vector<int> RegisterBatcher::defineBatch(const char *prefix,
+                                              const char *group,
+                                              const char *separator,
+                                              const char *suffix) {
+  std::vector<int> ids;
+  for (int n = 1; n <= MAX_BATCH; n *= 2) {
+    std::string sql = prefix;
+    for (int i = 0; i < n; ++i) {
+      sql += i ? separator : "";
+      sql += group;
+    }
+    sql += suffix;
+    ids.push_back(SqlStmtCache::define(sql.c_str()));
+  }
+  return ids;
+}
+
+const std::vector<int> RegisterBatcher::SELECT_STMTS =
+    defineBatch("SELECT username FROM user WHERE username IN (", "?", ",",
+                ") FOR UPDATE");
+const std::vector<int> RegisterBatcher::INSERT_STMTS = defineBatch(
+    "INSERT INTO user(username, password) VALUES", "(?,?)", ",", "");
+
+// 不小于n的2的幂的指数
+static int CeilLog2(size_t n) {
+  int k = 0;
+  while ((size_t(1) << k) < n) {
+    k++;
+  }
+  return k;
+}
+
+RegisterBatcher *RegisterBatcher::instance() {
+  static RegisterBatcher batcher;
+  return &batcher;
+}
+
+RegisterBatcher::~RegisterBatcher() { close(); }
+
+void RegisterBatcher::init(const Options &options) {
+  std::lock_guard locker(mtx_);
+  if (!stop_) {
+    return;
+  }
+  options_ = options;
+  options_.max_batch = std::clamp(options_.max_batch, 1, MAX_BATCH);
+  options_.max_delay_ms = std::max(options_.max_delay_ms, 0);
+  options_.workers = std::max(options_.workers, 1);
+  stop_ = false;
+  for (int i = 0; i < options_.workers; ++i) {
+    workers_.emplace_back([this] { work(); });
+  }
+  enabled_.store(true, std::memory_order_release);
+}
+
+void RegisterBatcher::close() {
+  {
+    std::lock_guard locker(mtx_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+    enabled_.store(false, std::memory_order_release);
+  }
+  // 工作线程提交完已经排队的请求后退出
+  cv_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+RegisterBatcher::Result RegisterBatcher::submit(const std::string &name,
+                                                const std::string &pwd) {
+  Request request;
+  request.name = name;
+  request.pwd = pwd;
+  request.enqueued = std::chrono::steady_clock::now();
+  std::future<Result> future = request.done.get_future();
+  {
+    std::lock_guard locker(mtx_);
+    if (stop_) {
+      return Result::ERROR;
+    }
+    queue_.push_back(&request);
+  }
+  cv_.notify_all();
+  requests_.fetch_add(1, std::memory_order_relaxed);
+  return future.get();
+}
+
+void RegisterBatcher::work() {
+  std::unique_lock locker(mtx_);
+  while (true) {
+    cv_.wait(locker, [this] {
+      return (stop_ || !queue_.empty()) && !collecting_;
+    });
+    if (queue_.empty()) {
+      break;
+    }
+    // 从第一个请求入队开始计时，凑满一批或到期就提交
+    collecting_ = true;
+    auto deadline = queue_.front()->enqueued +
+                    std::chrono::milliseconds(options_.max_delay_ms);
+    cv_.wait_until(locker, deadline, [this] {
+      return stop_ ||
+             queue_.size() >= static_cast<size_t>(options_.max_batch);
+    });
+    size_t n = std::min(queue_.size(), static_cast<size_t>(options_.max_batch));
+    std::vector<Request *> batch(queue_.begin(), queue_.begin() + n);
+    queue_.erase(queue_.begin(), queue_.begin() + n);
+    collecting_ = false;
+    locker.unlock();
+    // 提交期间由其他工作线程收集下一批
+    cv_.notify_all();
+    commit(batch);
+    locker.lock();
+  }
+}
+
+void RegisterBatcher::commit(std::vector<Request *> &batch) {
+  uint64_t largest = largest_.load(std::memory_order_relaxed);
+  while (batch.size() > largest &&
+         !largest_.compare_exchange_weak(largest, batch.size())) {
+  }
+  std::vector<Result> results(batch.size(), Result::ERROR);
+  // 批内重复的用户名只有第一个参与插入
+  std::unordered_map<std::string_view, size_t> first;
+  std::vector<Request *> unique;
+  std::vector<size_t> index;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (first.emplace(batch[i]->name, i).second) {
+      unique.push_back(batch[i]);
+      index.push_back(i);
+    } else {
+      results[i] = Result::DUPLICATE;
+    }
+  }
+  {
+    SqlConn sqlconn(SqlConnPool::instance());
+    SqlStmtCache *stmts = sqlconn.stmts();
+    std::vector<Result> unique_results(unique.size(), Result::ERROR);
+    if (!stmts) {
+      LOG_WARN("register batch: no mysql connection");
+    } else if (unique.size() == 1) {
+      unique_results[0] = insertOne(stmts, unique[0]);
+    } else if (!commitBatch(stmts, sqlconn.get(), unique, &unique_results)) {
+      fallbacks_.fetch_add(1, std::memory_order_relaxed);
+      for (size_t j = 0; j < unique.size(); ++j) {
+        if (unique_results[j] != Result::DUPLICATE) {
+          unique_results[j] = insertOne(stmts, unique[j]);
+        }
+      }
+    }
+    for (size_t j = 0; j < unique.size(); ++j) {
+      results[index[j]] = unique_results[j];
+    }
+  }
+  // 连接已经归还，再唤醒等待的线程
+  for (size_t i = 0; i < batch.size(); ++i) {
+    switch (results[i]) {
+      case Result::OK:
+        inserted_.fetch_add(1, std::memory_order_relaxed);
+        break;
+      case Result::DUPLICATE:
+        duplicates_.fetch_add(1, std::memory_order_relaxed);
+        break;
+      case Result::ERROR:
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        break;
+    }
+    batch[i]->done.set_value(results[i]);
+  }
+}
+
+bool RegisterBatcher::commitBatch(SqlStmtCache *stmts, MYSQL *sql,
+                                  const std::vector<Request *> &batch,
+                                  std::vector<Result> *results) {
+  SqlResult result;
+  auto fail = [sql](const char *step, const std::string &error) {
+    LOG_WARN("register batch %s error: %s", step, error.c_str());
+    mysql_rollback(sql);
+    return false;
+  };
+  if (mysql_real_query(sql, BEGIN_SQL, sizeof(BEGIN_SQL) - 1)) {
+    return fail("begin", mysql_error(sql));
+  }
+  // 锁住已经存在的用户名，不足2^k个的参数用第一个用户名补齐
+  int k = CeilLog2(batch.size());
+  std::vector<std::string_view> params;
+  for (size_t i = 0; i < (size_t(1) << k); ++i) {
+    params.push_back(batch[i < batch.size() ? i : 0]->name);
+  }
+  if (!stmts->execute(SELECT_STMTS[k], params, &result)) {
+    return fail("select", result.error);
+  }
+  std::unordered_set<std::string> existing;
+  for (const auto &row : result.rows) {
+    existing.insert(row[0]);
+  }
+  std::vector<size_t> rows;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (existing.count(batch[i]->name)) {
+      (*results)[i] = Result::DUPLICATE;
+    } else {
+      rows.push_back(i);
+    }
+  }
+  // 多行INSERT按2的幂拆开，每种行数只需要一个预编译语句
+  for (size_t done = 0; done < rows.size();) {
+    size_t remain = rows.size() - done;
+    k = CeilLog2(remain + 1) - 1;
+    params.clear();
+    for (size_t i = done; i < done + (size_t(1) << k); ++i) {
+      params.push_back(batch[rows[i]]->name);
+      params.push_back(batch[rows[i]]->pwd);
+    }
+    if (!stmts->execute(INSERT_STMTS[k], params, &result)) {
+      return fail("insert", result.error);
+    }
+    done += size_t(1) << k;
+  }
+  if (mysql_commit(sql)) {
+    return fail("commit", mysql_error(sql));
+  }
+  commits_.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i : rows) {
+    (*results)[i] = Result::OK;
+  }
+  return true;
+}
+
+RegisterBatcher::Result RegisterBatcher::insertOne(SqlStmtCache *stmts,
+                                                   const Request *request) {
+  SqlResult result;
+  if (stmts->execute(INSERT_STMTS[0], {request->name, request->pwd},
+                     &result)) {
+    commits_.fetch_add(1, std::memory_order_relaxed);
+    return Result::OK;
+  }
+  if (result.err == ER_DUP_ENTRY) {
+    return Result::DUPLICATE;
+  }
+  LOG_WARN("register insert error: %s", result.error.c_str());
+  return Result::ERROR;
+}
+
+RegisterBatcher::Stats RegisterBatcher::stats() const {
+  Stats stats{};
+  stats.requests = requests_.load(std::memory_order_relaxed);
+  stats.commits = commits_.load(std::memory_order_relaxed);
+  stats.inserted = inserted_.load(std::memory_order_relaxed);
+  stats.duplicates = duplicates_.load(std::memory_order_relaxed);
+  stats.errors = errors_.load(std::memory_order_relaxed);
+  stats.fallbacks = fallbacks_.load(std::memory_order_relaxed);
+  stats.largest = largest_.load(std::memory_order_relaxed);
+  return stats;
+}
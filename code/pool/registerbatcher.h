@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sqlconnRAII.h"
+
+// 注册的合并提交(group commit)
+// 注册请求先排队，最多等待max_delay_ms或凑满max_batch个，由一个工作线程取一个连接，
+// 在一个事务中用SELECT ... FOR UPDATE找出已被使用的用户名，再用多行INSERT插入其余的，
+// 一次COMMIT完成整批；每个请求得到自己的结果，批内重复的用户名只有第一个成功。
+// 批量提交失败(如唯一键冲突)时回滚，逐条插入以确定每个请求的结果。
+// 只有一个请求时与原来一样直接INSERT，不开启事务
+class RegisterBatcher {
+ public:
+  struct Options {
+    int max_batch{64};    // 不超过MAX_BATCH
+    int max_delay_ms{2};  // 第一个请求最多等待多久
+    int workers{2};       // 同时提交的批数，每个工作线程最多占用一个连接
+  };
+
+  enum class Result { OK, DUPLICATE, ERROR };
+
+  struct Stats {
+    uint64_t requests;
+    uint64_t commits;     // 提交的事务，包括单条的INSERT
+    uint64_t inserted;
+    uint64_t duplicates;
+    uint64_t errors;
+    uint64_t fallbacks;   // 批量提交失败后逐条插入的批数
+    uint64_t largest;     // 最大的一批
+  };
+
+  static constexpr int MAX_BATCH = 64;
+
+  static RegisterBatcher *instance();
+  void init(const Options &options);
+  void close();
+  bool isEnabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  // 阻塞直到所在的批提交完成
+  Result submit(const std::string &name, const std::string &pwd);
+
+  Stats stats() const;
+
+ private:
+  struct Request {
+    std::string name;
+    std::string pwd;
+    std::chrono::steady_clock::time_point enqueued;
+    std::promise<Result> done;
+  };
+
+  RegisterBatcher() = default;
+  ~RegisterBatcher();
+
+  void work();
+  void commit(std::vector<Request *> &batch);
+  // 在一个事务中提交，结果写入results，连接出错返回false
+  bool commitBatch(SqlStmtCache *stmts, MYSQL *sql,
+                   const std::vector<Request *> &batch,
+                   std::vector<Result> *results);
+  Result insertOne(SqlStmtCache *stmts, const Request *request);
+
+  // 第k个语句有2^k组参数
+  static std::vector<int> defineBatch(const char *prefix, const char *group,
+                                      const char *separator,
+                                      const char *suffix);
+  static const std::vector<int> SELECT_STMTS;
+  static const std::vector<int> INSERT_STMTS;
+
+  Options options_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<Request *> queue_;
+  bool collecting_{false};  // 同一时刻只有一个工作线程在凑批
+  bool stop_{true};
+  std::vector<std::thread> workers_;
+  std::atomic<bool> enabled_{false};
+
+  std::atomic<uint64_t> requests_{0};
+  std::atomic<uint64_t> commits_{0};
+  std::atomic<uint64_t> inserted_{0};
+  std::atomic<uint64_t> duplicates_{0};
+  std::atomic<uint64_t> errors_{0};
+  std::atomic<uint64_t> fallbacks_{0};
+  std::atomic<uint64_t> largest_{0};
+};
@@ -0,0 +1,232 @@
+#include "sessionstore.h"
+
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cstring>
+
+// 顺延的粒度：期限变化不到1s(或idle_ttl_ms的1/8)时不写，
+// 热门会话的查询不必每次写同一缓存行
+static const int64_t TOUCH_GRANULARITY_MS = 1000;
+
+// 超出短字符串优化的字符串另占的堆内存
+static size_t HeapBytes(const std::string &str) {
+  return str.capacity() > 15 ? str.capacity() + 1 : 0;
+}
+
+SessionStore *SessionStore::instance() {
+  static SessionStore store;
+  return &store;
+}
+
+void SessionStore::init(const Options &options) {
+  // 只能初始化一次，分片在运行中不再改变
+  if (isEnabled() || options.capacity == 0 || options.shards <= 0) {
+    return;
+  }
+  options_ = options;
+  options_.idle_ttl_ms = std::min(options_.idle_ttl_ms, options_.max_ttl_ms);
+  shard_capacity_ = std::max<size_t>(options.capacity / options.shards, 1);
+  touch_ms_ = std::min<int64_t>(TOUCH_GRANULARITY_MS, options_.idle_ttl_ms / 8);
+  for (int i = 0; i < options.shards; ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+  }
+  last_tick_ms_ = LoopClock::nowMs();
+  enabled_.store(true, std::memory_order_release);
+}
+
+size_t SessionStore::IdHash::operator()(const Id &id) const {
+  // ID本身是随机数，直接取前8个字节
+  uint64_t h;
+  memcpy(&h, id.data(), sizeof(h));
+  return h;
+}
+
+SessionStore::Shard &SessionStore::shard(const Id &id) {
+  // 分片用后8个字节，与分片内的哈希相互独立
+  uint64_t h;
+  memcpy(&h, id.data() + 8, sizeof(h));
+  return *shards_[h % shards_.size()];
+}
+
+bool SessionStore::parse(const std::string &sid, Id *id) {
+  if (sid.size() != id->size() * 2) {
+    return false;
+  }
+  auto hex = [](char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+  };
+  for (size_t i = 0; i < id->size(); ++i) {
+    int hi = hex(sid[2 * i]);
+    int lo = hex(sid[2 * i + 1]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    (*id)[i] = static_cast<unsigned char>(hi << 4 | lo);
+  }
+  return true;
+}
+
+std::string SessionStore::format(const Id &id) {
+  static const char DIGITS[] = "0123456789abcdef";
+  std::string sid(id.size() * 2, '0');
+  for (size_t i = 0; i < id.size(); ++i) {
+    sid[2 * i] = DIGITS[id[i] >> 4];
+    sid[2 * i + 1] = DIGITS[id[i] & 0xf];
+  }
+  return sid;
+}
+
+std::string SessionStore::create(const std::string &user) {
+  Id id;
+  if (!isEnabled() || RAND_bytes(id.data(), id.size()) != 1) {
+    return "";
+  }
+  Shard &s = shard(id);
+  int64_t now = LoopClock::nowMs();
+  std::unique_lock locker(s.mtx);
+  if (s.count >= shard_capacity_) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return "";
+  }
+  int slot;
+  if (!s.free.empty()) {
+    slot = s.free.back();
+    s.free.pop_back();
+  } else {
+    slot = static_cast<int>(s.slots.size());
+    s.slots.emplace_back();
+  }
+  if (!s.index.emplace(id, slot).second) {
+    // 128位随机数重复，几乎不可能
+    s.free.push_back(slot);
+    return "";
+  }
+  Slot &entry = s.slots[slot];
+  entry.id = id;
+  entry.user = user;
+  s.heap_bytes += HeapBytes(entry.user);
+  entry.deadline_ms = now + options_.max_ttl_ms;
+  int64_t expire_ms = now + options_.idle_ttl_ms;
+  entry.expire_ms.store(expire_ms, std::memory_order_relaxed);
+  s.count++;
+  schedule(s, slot, expire_ms);
+  created_.fetch_add(1, std::memory_order_relaxed);
+  return format(id);
+}
+
+bool SessionStore::lookup(const std::string &sid, std::string *user) {
+  Id id;
+  if (!isEnabled() || !parse(sid, &id)) {
+    return false;
+  }
+  Shard &s = shard(id);
+  s.lookups.fetch_add(1, std::memory_order_relaxed);
+  int64_t now = LoopClock::nowMs();
+  std::shared_lock locker(s.mtx);
+  auto it = s.index.find(id);
+  if (it == s.index.end()) {
+    s.misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  Slot &entry = s.slots[it->second];
+  int64_t expire_ms = entry.expire_ms.load(std::memory_order_relaxed);
+  if (expire_ms <= now) {
+    // 等tick删除
+    s.misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  int64_t next = std::min(now + options_.idle_ttl_ms, entry.deadline_ms);
+  if (next - expire_ms >= touch_ms_) {
+    entry.expire_ms.store(next, std::memory_order_relaxed);
+  }
+  *user = entry.user;
+  return true;
+}
+
+void SessionStore::destroy(const std::string &sid) {
+  Id id;
+  if (!isEnabled() || !parse(sid, &id)) {
+    return;
+  }
+  Shard &s = shard(id);
+  std::unique_lock locker(s.mtx);
+  auto it = s.index.find(id);
+  if (it == s.index.end()) {
+    return;
+  }
+  int slot = it->second;
+  s.index.erase(it);
+  s.wheel.cancel(slot);
+  release(s, slot);
+  destroyed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SessionStore::schedule(Shard &s, int slot, int64_t expire_ms) {
+  int timeout = static_cast<int>(
+      std::max<int64_t>(expire_ms - LoopClock::nowMs(), 0));
+  s.wheel.add(slot, timeout, [this, &s, slot] { onTimeout(s, slot); });
+}
+
+void SessionStore::onTimeout(Shard &s, int slot) {
+  Slot &entry = s.slots[slot];
+  int64_t expire_ms = entry.expire_ms.load(std::memory_order_relaxed);
+  if (expire_ms > LoopClock::nowMs()) {
+    // 期间被访问过，按顺延后的期限重新挂入
+    schedule(s, slot, expire_ms);
+    return;
+  }
+  s.index.erase(entry.id);
+  release(s, slot);
+  expired_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SessionStore::release(Shard &s, int slot) {
+  Slot &entry = s.slots[slot];
+  s.heap_bytes -= HeapBytes(entry.user);
+  std::string().swap(entry.user);
+  s.free.push_back(slot);
+  s.count--;
+}
+
+void SessionStore::tick() {
+  if (!isEnabled()) {
+    return;
+  }
+  int64_t now = LoopClock::nowMs();
+  if (now - last_tick_ms_ < options_.tick_ms) {
+    return;
+  }
+  last_tick_ms_ = now;
+  for (auto &s : shards_) {
+    std::unique_lock locker(s->mtx);
+    s->wheel.tick();
+  }
+}
+
+SessionStore::Stats SessionStore::stats() const {
+  Stats stats{};
+  stats.created = created_.load(std::memory_order_relaxed);
+  stats.expired = expired_.load(std::memory_order_relaxed);
+  stats.destroyed = destroyed_.load(std::memory_order_relaxed);
+  stats.rejected = rejected_.load(std::memory_order_relaxed);
+  // 哈希表节点：键值对加上next指针
+  const size_t node_bytes = sizeof(std::pair<const Id, int>) + sizeof(void *);
+  for (auto &s : shards_) {
+    // 未命中在查询计数之后累加，先读misses，两个值各读一次
+    uint64_t misses = s->misses.load(std::memory_order_relaxed);
+    uint64_t lookups = s->lookups.load(std::memory_order_relaxed);
+    stats.lookups += lookups;
+    stats.hits += lookups - std::min(misses, lookups);
+    std::shared_lock locker(s->mtx);
+    stats.active += s->count;
+    stats.memory_bytes += s->slots.size() * sizeof(Slot) +
+                          s->index.size() * node_bytes +
+                          s->index.bucket_count() * sizeof(void *) +
+                          s->free.capacity() * sizeof(int) +
+                          s->wheel.memoryBytes() + s->heap_bytes;
+  }
+  return stats;
+}
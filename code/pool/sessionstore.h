@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../utility/clock.h"
+#include "../utility/timewheel.h"
+
+// 登录后的会话表，会话ID为128位随机数(cookie中是32位十六进制)
+// 按ID分片，每个分片一把读写锁；查询只加读锁，O(1)且不访问数据库
+// 每次查询把空闲期限顺延idle_ttl_ms，但不超过创建后max_ttl_ms
+// 过期由每个分片的TimingWheel驱动：事件循环调用tick，到期时若期间被访问过则重新挂入，
+// 否则删除；查询本身也检查期限，tick不及时也不会返回过期的会话
+class SessionStore {
+ public:
+  struct Options {
+    int shards{64};
+    size_t capacity{1 << 20};  // 所有分片的会话总数，满时不再创建
+    int idle_ttl_ms{30 * 60 * 1000};
+    int max_ttl_ms{12 * 60 * 60 * 1000};
+    int tick_ms{100};  // tick的最小间隔
+  };
+
+  struct Stats {
+    uint64_t created;
+    uint64_t expired;
+    uint64_t destroyed;
+    uint64_t rejected;  // 已满而未能创建
+    uint64_t lookups;
+    uint64_t hits;
+    size_t active;
+    size_t memory_bytes;  // 估算的占用，包括空闲的槽和时间轮节点
+  };
+
+  static constexpr const char *COOKIE_NAME = "sid";
+
+  static SessionStore *instance();
+  void init(const Options &options);
+  bool isEnabled() const { return enabled_.load(std::memory_order_acquire); }
+  int maxTtlMs() const { return options_.max_ttl_ms; }
+
+  // 创建会话并返回cookie中的ID，已满或未启用时返回空串
+  std::string create(const std::string &user);
+  // 有效的会话返回true并给出用户名，同时顺延期限
+  bool lookup(const std::string &sid, std::string *user);
+  void destroy(const std::string &sid);
+  // 由事件循环线程调用，删除到期的会话
+  void tick();
+
+  Stats stats() const;
+
+ private:
+  using Id = std::array<unsigned char, 16>;
+  struct IdHash {
+    size_t operator()(const Id &id) const;
+  };
+  struct Slot {
+    Id id;
+    std::string user;
+    int64_t deadline_ms;                // 创建时间 + max_ttl_ms
+    std::atomic<int64_t> expire_ms{0};  // 读锁下顺延
+  };
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mtx;
+    std::unordered_map<Id, int, IdHash> index;
+    std::deque<Slot> slots;
+    std::vector<int> free;
+    TimingWheel wheel;
+    size_t count{0};
+    size_t heap_bytes{0};  // 用户名另占的堆内存，stats不必遍历所有槽
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> misses{0};  // 命中是常态，只计未命中
+  };
+
+  SessionStore() = default;
+
+  static bool parse(const std::string &sid, Id *id);
+  static std::string format(const Id &id);
+  Shard &shard(const Id &id);
+  // 以下调用时持有分片的写锁
+  void schedule(Shard &s, int slot, int64_t expire_ms);
+  void onTimeout(Shard &s, int slot);
+  void release(Shard &s, int slot);
+
+  Options options_;
+  size_t shard_capacity_{0};
+  int64_t touch_ms_{0};
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<bool> enabled_{false};
+  int64_t last_tick_ms_{0};
+
+  std::atomic<uint64_t> created_{0};
+  std::atomic<uint64_t> expired_{0};
+  std::atomic<uint64_t> destroyed_{0};
+  std::atomic<uint64_t> rejected_{0};
+};
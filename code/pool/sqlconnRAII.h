@@ -18,6 +18,10 @@ class SqlConn {
   MYSQL *get() {
     return sql_;
   }
+
+  SqlStmtCache *stmts() {
+    return sql_ ? pool_->stmtCache(sql_) : nullptr;
+  }
  private:
   MYSQL *sql_;
   SqlConnPool *pool_;
@@ -1,5 +1,15 @@
 #include "sqlconnpool.h"
 
+#include <algorithm>
+
+// 维护线程不在事件循环中，不能读取LoopClock：它最多落后一个刷新周期，
+// 事件循环退出后也不再前进
+static int64_t SteadyMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 SqlConnPool::~SqlConnPool() { closePool(); }
 
 SqlConnPool *SqlConnPool::instance() {
@@ -9,58 +19,358 @@ SqlConnPool *SqlConnPool::instance() {
 
 void SqlConnPool::init(const char *host, int port, const char *user,
                        const char *pwd, const char *dbname, int conn_size) {
-  assert(conn_size > 0);
+  Options options;
+  options.min_size = conn_size;
+  options.max_size = conn_size;
+  init(host, port, user, pwd, dbname, options);
+}
+
+void SqlConnPool::init(const char *host, int port, const char *user,
+                       const char *pwd, const char *dbname,
+                       const Options &options) {
+  assert(options.max_size > 0 && options.min_size <= options.max_size);
+  std::unique_lock locker(mtx_);
+  if (!closed_) {
+    return;
+  }
+  options_ = options;
+  options_.min_size = std::max(options_.min_size, 0);
+  host_ = host;
+  user_ = user;
+  pwd_ = pwd;
+  dbname_ = dbname;
+  port_ = port;
+  broken_ = 0;
+  warmed_ = options_.min_size == 0;
+  ready_ = warmed_;
+  closed_ = false;
+  // 预热的连接计入connecting_，后台线程不会重复建立
+  connecting_ += options_.min_size;
+  locker.unlock();
+
+  // 不等待连接建立，服务器可以先开始处理不访问数据库的请求
   mysql_server_init(0, nullptr, nullptr);
-  for (int i = 0; i < conn_size; ++i) {
-    MYSQL *sql{nullptr};
-    sql = mysql_init(sql);
-    if (!sql) {
-      LOG_ERROR("Mysql init error!");
-      assert(sql);
-    }
-    sql = mysql_real_connect(sql, host, user, pwd, dbname, port, nullptr, 0);
-    if (!sql) {
-      LOG_ERROR("Mysql Connect error!");
-    }
-    conn_queue_.push(sql);
+  for (int i = 0; i < options_.min_size; ++i) {
+    warmers_.emplace_back([this] { warmUp(); });
   }
-  max_count_ = conn_size;
-  sem_init(&sem_id_, 0, max_count_);
+  maintainer_ = std::thread([this] { maintain(); });
 }
 
-MYSQL *SqlConnPool::getConn() {
-  MYSQL *sql = nullptr;
-  if (conn_queue_.empty()) {
-    LOG_WARN("mysql connection pool is busy!");
+void SqlConnPool::warmUp() {
+  // 连接失败不放入连接池，由后台线程稍后重试
+  MYSQL *sql = connect();
+  if (sql) {
+    add(sql, false);
+  }
+  std::lock_guard locker(mtx_);
+  connecting_--;
+  if (!sql) {
+    maintain_cv_.notify_one();
+  }
+}
+
+MYSQL *SqlConnPool::connect() {
+  MYSQL *sql = mysql_init(nullptr);
+  if (!sql) {
+    LOG_ERROR("Mysql init error!");
+    connect_errors_++;
+    return nullptr;
+  }
+  // 数据库变慢或失去响应时，阻塞的调用也有上限
+  unsigned int connect_timeout = options_.connect_timeout_s;
+  unsigned int rw_timeout = options_.rw_timeout_s;
+  mysql_options(sql, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+  mysql_options(sql, MYSQL_OPT_READ_TIMEOUT, &rw_timeout);
+  mysql_options(sql, MYSQL_OPT_WRITE_TIMEOUT, &rw_timeout);
+  if (!mysql_real_connect(sql, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                          dbname_.c_str(), port_, nullptr, 0)) {
+    LOG_ERROR("Mysql Connect error: %s", mysql_error(sql));
+    mysql_close(sql);
+    connect_errors_++;
     return nullptr;
   }
-  sem_wait(&sem_id_);
+  connects_++;
+  return sql;
+}
+
+void SqlConnPool::add(MYSQL *sql, bool in_use) {
+  std::lock_guard locker(mtx_);
+  Conn &conn = conns_[sql];
+  conn.sql = sql;
+  conn.stmts = std::make_unique<SqlStmtCache>(sql);
+  conn.in_use = in_use;
+  conn.idle_since_ms = SteadyMs();
+  if (!in_use && !handOff(sql)) {
+    idle_.push_back(sql);
+  }
+  if (static_cast<int>(conns_.size()) >= options_.min_size) {
+    warmed_ = true;
+  }
+  ready_ = warmed_;
+}
+
+void SqlConnPool::discard(MYSQL *sql) {
+  // 语句要在所属的连接关闭之前释放，调用时不持有锁
+  std::unique_ptr<SqlStmtCache> stmts;
   {
     std::lock_guard locker(mtx_);
-    sql = conn_queue_.front();
-    conn_queue_.pop();
+    auto it = conns_.find(sql);
+    if (it != conns_.end()) {
+      stmts = std::move(it->second.stmts);
+      conns_.erase(it);
+    }
+    ready_ = warmed_ && !conns_.empty();
   }
+  stmts.reset();
+  mysql_close(sql);
+}
+
+bool SqlConnPool::handOff(MYSQL *sql) {
+  if (waiters_.empty()) {
+    return false;
+  }
+  Waiter *waiter = waiters_.front();
+  waiters_.pop_front();
+  conns_[sql].in_use = true;
+  waiter->sql = sql;
+  waiter->cv.notify_one();
+  return true;
+}
+
+bool SqlConnPool::grow() {
+  // 排队的线程比正在建立的连接多，并且还没有到上限
+  return waiters_.size() > static_cast<size_t>(connecting_) &&
+         static_cast<int>(conns_.size()) + connecting_ < options_.max_size;
+}
+
+MYSQL *SqlConnPool::getConn(int timeout_ms) {
+  if (timeout_ms < 0) {
+    timeout_ms = options_.wait_timeout_ms;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  std::unique_lock locker(mtx_);
+  if (closed_) {
+    return nullptr;
+  }
+  MYSQL *sql = nullptr;
+  if (!idle_.empty() && waiters_.empty()) {
+    // 后进先出，最近用过的连接最可能仍然有效，空闲最久的留在队首等待回收
+    sql = idle_.back();
+    idle_.pop_back();
+    conns_[sql].in_use = true;
+  } else {
+    Waiter waiter;
+    waiters_.push_back(&waiter);
+    if (grow()) {
+      maintain_cv_.notify_one();
+    }
+    waiter.cv.wait_until(locker, begin + std::chrono::milliseconds(timeout_ms),
+                         [&] { return waiter.sql || closed_; });
+    sql = waiter.sql;
+    if (!sql) {
+      waiters_.erase(std::find(waiters_.begin(), waiters_.end(), &waiter));
+    }
+  }
+  locker.unlock();
+
+  uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+  wait_us_.fetch_add(wait_us, std::memory_order_relaxed);
+  uint64_t max_wait = max_wait_us_.load(std::memory_order_relaxed);
+  while (wait_us > max_wait &&
+         !max_wait_us_.compare_exchange_weak(max_wait, wait_us)) {
+  }
+  if (!sql) {
+    timeouts_.fetch_add(1, std::memory_order_relaxed);
+    LOG_WARN("mysql connection pool is busy!");
+    return nullptr;
+  }
+  acquires_.fetch_add(1, std::memory_order_relaxed);
   return sql;
 }
 
 void SqlConnPool::freeConn(MYSQL *sql) {
   assert(sql);
+  // 最后一次调用因断线失败的连接不再放回，由后台线程补充新的连接
+  unsigned int err = mysql_errno(sql);
+  bool broken = err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
   std::unique_lock locker(mtx_);
-  conn_queue_.push(sql);
-  sem_post(&sem_id_);
+  if (closed_ || broken) {
+    if (broken) {
+      LOG_WARN("mysql connection lost: %s", mysql_error(sql));
+      broken_++;
+      maintain_cv_.notify_one();
+    }
+    locker.unlock();
+    discard(sql);
+    return;
+  }
+  Conn &conn = conns_[sql];
+  conn.in_use = false;
+  conn.idle_since_ms = SteadyMs();
+  if (!handOff(sql)) {
+    idle_.push_back(sql);
+  }
 }
 
-void SqlConnPool::closePool() {
+void SqlConnPool::maintain() {
+  int64_t next_check = SteadyMs() + options_.check_interval_ms;
+  int64_t retry_at = 0;
   std::unique_lock locker(mtx_);
-  while (!conn_queue_.empty()) {
-    auto sql = conn_queue_.front();
-    conn_queue_.pop();
-    mysql_close(sql);
+  while (!closed_) {
+    int64_t now = SteadyMs();
+    int total = static_cast<int>(conns_.size()) + connecting_;
+    bool refill = total < options_.min_size;
+    // 只有补足min_size的新连接才算作重连
+    broken_ = std::min(broken_, std::max(options_.min_size - total, 0));
+    if ((grow() || refill) && now >= retry_at) {
+      // 建立连接时不持有锁，其他线程照常取还连接
+      connecting_++;
+      locker.unlock();
+      MYSQL *sql = connect();
+      if (sql) {
+        add(sql, false);
+      }
+      locker.lock();
+      connecting_--;
+      if (!sql) {
+        retry_at = SteadyMs() + options_.reconnect_ms;
+      } else if (broken_ > 0) {
+        broken_--;
+        reconnects_++;
+      }
+      continue;
+    }
+    if (now >= next_check) {
+      locker.unlock();
+      checkIdle();
+      locker.lock();
+      next_check = SteadyMs() + options_.check_interval_ms;
+      continue;
+    }
+    int64_t wake = next_check;
+    if (grow() || refill) {
+      wake = std::min(wake, retry_at);
+    }
+    maintain_cv_.wait_for(locker, std::chrono::milliseconds(wake - now));
+  }
+}
+
+void SqlConnPool::checkIdle() {
+  int64_t now = SteadyMs();
+  std::vector<MYSQL *> expired;
+  std::vector<MYSQL *> check;
+  {
+    std::lock_guard locker(mtx_);
+    int total = static_cast<int>(conns_.size());
+    // 队首是空闲最久的连接；一个检查周期内用过的连接不需要检查
+    while (!idle_.empty()) {
+      MYSQL *sql = idle_.front();
+      Conn &conn = conns_[sql];
+      int64_t idle_ms = now - conn.idle_since_ms;
+      if (idle_ms < options_.check_interval_ms) {
+        break;
+      }
+      idle_.pop_front();
+      conn.in_use = true;
+      if (total > options_.min_size && idle_ms >= options_.idle_timeout_ms) {
+        expired.push_back(sql);
+        total--;
+      } else {
+        check.push_back(sql);
+      }
+    }
+  }
+  for (MYSQL *sql : expired) {
+    closed_idle_++;
+    discard(sql);
+  }
+  for (MYSQL *sql : check) {
+    pings_++;
+    if (mysql_ping(sql) == 0) {
+      std::lock_guard locker(mtx_);
+      Conn &conn = conns_[sql];
+      conn.in_use = false;
+      if (closed_) {
+        // 连接池已关闭，由closePool之后的清理释放
+        idle_.push_back(sql);
+      } else if (!handOff(sql)) {
+        // 检查不算使用，保持原来的空闲时间以便回收
+        idle_.push_front(sql);
+      }
+      continue;
+    }
+    LOG_WARN("mysql ping error: %s", mysql_error(sql));
+    {
+      std::lock_guard locker(mtx_);
+      broken_++;
+    }
+    discard(sql);
   }
-  mysql_server_end();
 }
 
 int SqlConnPool::getFreeConnCount() {
-  std::unique_lock locker(mtx_);
-  return conn_queue_.size();
+  std::lock_guard locker(mtx_);
+  return idle_.size();
+}
+
+SqlStmtCache *SqlConnPool::stmtCache(MYSQL *sql) {
+  std::lock_guard locker(mtx_);
+  auto it = conns_.find(sql);
+  return it == conns_.end() ? nullptr : it->second.stmts.get();
+}
+
+void SqlConnPool::closePool() {
+  {
+    std::lock_guard locker(mtx_);
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    for (Waiter *waiter : waiters_) {
+      waiter->cv.notify_one();
+    }
+    waiters_.clear();
+  }
+  maintain_cv_.notify_one();
+  for (std::thread &warmer : warmers_) {
+    warmer.join();
+  }
+  warmers_.clear();
+  if (maintainer_.joinable()) {
+    maintainer_.join();
+  }
+  // 使用中的连接在归还时关闭
+  std::deque<MYSQL *> idle;
+  {
+    std::lock_guard locker(mtx_);
+    idle.swap(idle_);
+    ready_ = false;
+  }
+  for (MYSQL *sql : idle) {
+    discard(sql);
+  }
+  mysql_server_end();
+}
+
+SqlConnPool::Stats SqlConnPool::stats() {
+  Stats stats{};
+  {
+    std::lock_guard locker(mtx_);
+    stats.total = conns_.size();
+    stats.idle = idle_.size();
+    stats.waiting = waiters_.size();
+  }
+  stats.in_use = stats.total - stats.idle;
+  stats.acquires = acquires_.load(std::memory_order_relaxed);
+  stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+  stats.wait_us = wait_us_.load(std::memory_order_relaxed);
+  stats.max_wait_us = max_wait_us_.load(std::memory_order_relaxed);
+  stats.connects = connects_.load(std::memory_order_relaxed);
+  stats.connect_errors = connect_errors_.load(std::memory_order_relaxed);
+  stats.reconnects = reconnects_.load(std::memory_order_relaxed);
+  stats.pings = pings_.load(std::memory_order_relaxed);
+  stats.closed_idle = closed_idle_.load(std::memory_order_relaxed);
+  return stats;
 }
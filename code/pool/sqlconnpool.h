@@ -1,34 +1,126 @@
 #pragma once
 
+#include <mysql/errmsg.h>
 #include <mysql/mysql.h>
-#include <semaphore.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "../log/log.h"
+#include "sqlstmt.h"
 
+// 阻塞的MySQL连接池
+// init不等待连接建立，min_size个连接在后台并行建立，全部就绪后ready()为真；
+// 连接数在min_size与max_size之间伸缩：没有空闲连接时按需新建，空闲过久的连接关闭到min_size；
+// 取连接的线程按到达顺序排队，等待有上限，超时返回nullptr而不是一直阻塞。
+// 后台线程定期用mysql_ping检查空闲连接，断开的连接(检查失败或归还时带着断线错误)
+// 被关闭并在后台重新建立，调用者不需要处理重连
 class SqlConnPool {
  public:
+  struct Options {
+    int min_size{4};
+    int max_size{12};
+    int wait_timeout_ms{1000};    // getConn的默认等待上限
+    int check_interval_ms{5000};  // 空闲连接检查和重连的周期
+    int idle_timeout_ms{60000};   // 超过min_size的连接空闲多久后关闭
+    int reconnect_ms{1000};       // 连接失败后重试的间隔
+    int connect_timeout_s{3};
+    int rw_timeout_s{5};          // 单次读写的超时，数据库失去响应时查询不会一直阻塞
+  };
+
+  struct Stats {
+    int total;         // 已建立的连接
+    int in_use;
+    int idle;
+    int waiting;       // 正在排队的线程
+    uint64_t acquires;
+    uint64_t timeouts;
+    uint64_t wait_us;  // 所有getConn的等待时间之和
+    uint64_t max_wait_us;
+    uint64_t connects;
+    uint64_t connect_errors;
+    uint64_t reconnects;  // 因断线重新建立的连接
+    uint64_t pings;
+    uint64_t closed_idle;
+  };
+
   static SqlConnPool *instance();
-  MYSQL *getConn();
+  // timeout_ms小于0时使用Options::wait_timeout_ms，超时或连接池已关闭返回nullptr
+  MYSQL *getConn(int timeout_ms = -1);
   void freeConn(MYSQL *conn);
   int getFreeConnCount();
+  // 连接自己的预编译语句缓存，只能由持有该连接的线程使用
+  SqlStmtCache *stmtCache(MYSQL *sql);
+  // 固定大小的连接池
   void init(const char *host, int port, const char *user, const char *pwd,
             const char *dbname, int conn_size = 10);
+  void init(const char *host, int port, const char *user, const char *pwd,
+            const char *dbname, const Options &options);
   void closePool();
+  // 预热完成并且至少有一个可用连接，可以接收访问数据库的请求
+  bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+  Stats stats();
 
  private:
+  struct Conn {
+    MYSQL *sql{nullptr};
+    std::unique_ptr<SqlStmtCache> stmts;
+    int64_t idle_since_ms{0};
+    bool in_use{false};
+  };
+  // 排队等待连接的线程，freeConn直接把连接交给队首
+  struct Waiter {
+    std::condition_variable cv;
+    MYSQL *sql{nullptr};
+  };
+
   SqlConnPool() = default;
   ~SqlConnPool();
 
-  int max_count_{0};
-  int use_count_{0};
-  int free_count_{0};
+  void warmUp();
+  MYSQL *connect();
+  void add(MYSQL *sql, bool in_use);
+  void discard(MYSQL *sql);
+  bool handOff(MYSQL *sql);
+  bool grow();
+  void maintain();
+  void checkIdle();
+  void refill();
+
+  Options options_;
+  std::string host_, user_, pwd_, dbname_;
+  int port_{0};
 
-  std::queue<MYSQL *> conn_queue_;
   std::mutex mtx_;
-  sem_t sem_id_;
-};
\ No newline at end of file
+  std::unordered_map<MYSQL *, Conn> conns_;
+  std::deque<MYSQL *> idle_;      // 尾部最近归还
+  std::deque<Waiter *> waiters_;
+  int connecting_{0};             // 正在建立的连接，计入总数上限
+  int broken_{0};                 // 断开后等待后台重连的连接
+  bool closed_{true};
+  bool warmed_{false};  // 连接数曾经达到min_size
+  std::atomic<bool> ready_{false};
+
+  std::vector<std::thread> warmers_;
+  std::thread maintainer_;
+  std::condition_variable maintain_cv_;
+
+  std::atomic<uint64_t> acquires_{0};
+  std::atomic<uint64_t> timeouts_{0};
+  std::atomic<uint64_t> wait_us_{0};
+  std::atomic<uint64_t> max_wait_us_{0};
+  std::atomic<uint64_t> connects_{0};
+  std::atomic<uint64_t> connect_errors_{0};
+  std::atomic<uint64_t> reconnects_{0};
+  std::atomic<uint64_t> pings_{0};
+  std::atomic<uint64_t> closed_idle_{0};
+};
@@ -0,0 +1,214 @@
+#include "sqlstmt.h"
+
+#include <cstring>
+
+std::vector<std::string> &SqlStmtCache::statements() {
+  static std::vector<std::string> statements;
+  return statements;
+}
+
+int SqlStmtCache::define(const char *sql) {
+  statements().push_back(sql);
+  return static_cast<int>(statements().size()) - 1;
+}
+
+const std::string &SqlStmtCache::sql(int id) {
+  assert(id >= 0 && id < static_cast<int>(statements().size()));
+  return statements()[id];
+}
+
+MYSQL_STMT *SqlStmtCache::cached(int id) const {
+  return static_cast<size_t>(id) < stmts_.size() ? stmts_[id] : nullptr;
+}
+
+void SqlStmtCache::add(int id, MYSQL_STMT *stmt) {
+  if (stmts_.size() <= static_cast<size_t>(id)) {
+    stmts_.resize(id + 1, nullptr);
+  }
+  assert(!stmts_[id]);
+  stmts_[id] = stmt;
+  prepares_++;
+}
+
+void SqlStmtCache::drop(int id) {
+  if (MYSQL_STMT *stmt = cached(id)) {
+    mysql_stmt_close(stmt);
+    stmts_[id] = nullptr;
+  }
+}
+
+void SqlStmtCache::reset() {
+  for (MYSQL_STMT *&stmt : stmts_) {
+    if (stmt) {
+      mysql_stmt_close(stmt);
+      stmt = nullptr;
+    }
+  }
+}
+
+bool SqlStmtCache::execute(int id, std::initializer_list<std::string_view> params,
+                           SqlResult *result) {
+  return execute(id, params.begin(), params.size(), result);
+}
+
+bool SqlStmtCache::execute(int id, const std::vector<std::string_view> &params,
+                           SqlResult *result) {
+  return execute(id, params.data(), params.size(), result);
+}
+
+bool SqlStmtCache::execute(int id, const std::string_view *params,
+                           size_t count, SqlResult *result) {
+  assert(id >= 0 && id < static_cast<int>(statements().size()));
+  *result = SqlResult();
+  // 重连后服务端已经没有这些语句，旧句柄只能关闭
+  unsigned long thread_id = mysql_thread_id(sql_);
+  if (thread_id != thread_id_) {
+    reset();
+    thread_id_ = thread_id;
+  }
+  for (int attempt = 0;; ++attempt) {
+    MYSQL_STMT *stmt = prepare(id, result);
+    if (!stmt) {
+      return false;
+    }
+    if (run(stmt, params, count, result)) {
+      return true;
+    }
+    if (result->err == CR_SERVER_LOST || result->err == CR_SERVER_GONE_ERROR) {
+      reset();
+      return false;
+    }
+    // 服务端丢弃了语句(如表结构变化、连接被重置)，重新prepare后再试一次
+    bool stale = result->err == ER_UNKNOWN_STMT_HANDLER ||
+                 result->err == ER_NEED_REPREPARE;
+    if (!stale || attempt > 0) {
+      return false;
+    }
+    LOG_WARN("prepared statement %d lost: %s, re-prepare", id,
+             result->error.c_str());
+    drop(id);
+  }
+}
+
+MYSQL_STMT *SqlStmtCache::prepare(int id, SqlResult *result) {
+  if (MYSQL_STMT *stmt = cached(id)) {
+    return stmt;
+  }
+  MYSQL_STMT *stmt = mysql_stmt_init(sql_);
+  if (!stmt) {
+    result->err = mysql_errno(sql_);
+    result->error = mysql_error(sql_);
+    return nullptr;
+  }
+  const std::string &sql = statements()[id];
+  if (mysql_stmt_prepare(stmt, sql.data(), sql.size())) {
+    result->err = mysql_stmt_errno(stmt);
+    result->error = mysql_stmt_error(stmt);
+    LOG_ERROR("prepare [%s] error: %s", sql.c_str(), result->error.c_str());
+    mysql_stmt_close(stmt);
+    return nullptr;
+  }
+  add(id, stmt);
+  return stmt;
+}
+
+bool SqlStmtCache::run(MYSQL_STMT *stmt, const std::string_view *params,
+                       size_t count, SqlResult *result) {
+  if (!bindParams(stmt, params, count, result) || mysql_stmt_execute(stmt)) {
+    result->err = mysql_stmt_errno(stmt);
+    result->error = mysql_stmt_error(stmt);
+    return false;
+  }
+  unsigned int fields = mysql_stmt_field_count(stmt);
+  if (fields > 0 && !fetch(stmt, fields, result)) {
+    return false;
+  }
+  result->affected_rows = mysql_stmt_affected_rows(stmt);
+  result->ok = true;
+  return true;
+}
+
+bool SqlStmtCache::bindParams(MYSQL_STMT *stmt, const std::string_view *params,
+                              size_t count, SqlResult *result) {
+  params_.assign(count, MYSQL_BIND());
+  lengths_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    lengths_[i] = params[i].size();
+    params_[i].buffer_type = MYSQL_TYPE_STRING;
+    params_[i].buffer = const_cast<char *>(params[i].data());
+    params_[i].buffer_length = params[i].size();
+    params_[i].length = &lengths_[i];
+  }
+  if (count > 0 && mysql_stmt_bind_param(stmt, params_.data())) {
+    result->err = mysql_stmt_errno(stmt);
+    result->error = mysql_stmt_error(stmt);
+    return false;
+  }
+  return true;
+}
+
+bool SqlStmtCache::fetch(MYSQL_STMT *stmt, unsigned int fields,
+                         SqlResult *result) {
+  if (!bindResult(stmt, fields, result)) {
+    return false;
+  }
+  if (mysql_stmt_store_result(stmt)) {
+    result->err = mysql_stmt_errno(stmt);
+    result->error = mysql_stmt_error(stmt);
+    return false;
+  }
+  return readRows(stmt, fields, result);
+}
+
+bool SqlStmtCache::bindResult(MYSQL_STMT *stmt, unsigned int fields,
+                              SqlResult *result) {
+  binds_.assign(fields, MYSQL_BIND());
+  columns_.resize(fields);
+  for (unsigned int i = 0; i < fields; ++i) {
+    binds_[i].buffer_type = MYSQL_TYPE_STRING;
+    binds_[i].buffer = columns_[i].buf;
+    binds_[i].buffer_length = COLUMN_BUF;
+    binds_[i].length = &columns_[i].length;
+    binds_[i].is_null = &columns_[i].is_null;
+  }
+  if (mysql_stmt_bind_result(stmt, binds_.data())) {
+    result->err = mysql_stmt_errno(stmt);
+    result->error = mysql_stmt_error(stmt);
+    return false;
+  }
+  return true;
+}
+
+bool SqlStmtCache::readRows(MYSQL_STMT *stmt, unsigned int fields,
+                            SqlResult *result) {
+  int status;
+  while ((status = mysql_stmt_fetch(stmt)) == 0 ||
+         status == MYSQL_DATA_TRUNCATED) {
+    std::vector<std::string> row(fields);
+    for (unsigned int i = 0; i < fields; ++i) {
+      Column &column = columns_[i];
+      if (column.is_null) {
+        continue;
+      }
+      if (column.length <= COLUMN_BUF) {
+        row[i].assign(column.buf, column.length);
+        continue;
+      }
+      // 缓冲区放不下，按实际长度重新读取这一列
+      row[i].resize(column.length);
+      MYSQL_BIND bind = MYSQL_BIND();
+      bind.buffer_type = MYSQL_TYPE_STRING;
+      bind.buffer = row[i].data();
+      bind.buffer_length = column.length;
+      mysql_stmt_fetch_column(stmt, &bind, i, 0);
+    }
+    result->rows.push_back(std::move(row));
+  }
+  bool ok = status == MYSQL_NO_DATA;
+  if (!ok) {
+    result->err = mysql_stmt_errno(stmt);
+    result->error = mysql_stmt_error(stmt);
+  }
+  mysql_stmt_free_result(stmt);
+  return ok;
+}
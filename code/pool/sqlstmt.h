@@ -0,0 +1,94 @@
+#pragma once
+
+#include <mysql/errmsg.h>
+#include <mysql/mysql.h>
+#include <mysql/mysqld_error.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "../log/log.h"
+
+// 查询结果，NULL字段为空字符串
+struct SqlResult {
+  bool ok{false};
+  unsigned int err{0};
+  std::string error;
+  uint64_t affected_rows{0};
+  std::vector<std::vector<std::string>> rows;
+};
+
+// 一个连接上的预编译语句缓存
+// 语句用define登记的编号标识，在连接上第一次使用时才prepare，之后只发送参数；
+// 参数和结果都使用二进制绑定，不需要拼接和转义SQL。连接重连(thread id变化)后
+// 服务端的语句全部失效，下次使用时自动重新prepare。同一时刻只能由一个线程使用
+class SqlStmtCache {
+ public:
+  // 登记语句的SQL(参数用?占位)，返回编号，在静态初始化时调用
+  static int define(const char *sql);
+
+  explicit SqlStmtCache(MYSQL *sql) : sql_(sql) {}
+  ~SqlStmtCache() { reset(); }
+  SqlStmtCache(const SqlStmtCache &) = delete;
+  SqlStmtCache &operator=(const SqlStmtCache &) = delete;
+
+  // 按顺序以字符串绑定参数执行语句，结果写入result，返回result.ok
+  bool execute(int id, std::initializer_list<std::string_view> params,
+               SqlResult *result);
+  // 参数个数在运行时确定的语句，如多行INSERT
+  bool execute(int id, const std::vector<std::string_view> &params,
+               SqlResult *result);
+  // 关闭所有语句，连接断开或重建后调用
+  void reset();
+
+  // 在这个连接上执行过的prepare次数
+  uint64_t prepares() const { return prepares_; }
+
+  // 以下供非阻塞客户端分步执行：prepare、execute和store_result由调用者用
+  // mysql_stmt_*_start/_cont完成，语句的缓存、绑定和取结果与execute共用
+  static const std::string &sql(int id);
+  // 已经prepare过的语句，没有时返回nullptr
+  MYSQL_STMT *cached(int id) const;
+  // 保存prepare成功的语句
+  void add(int id, MYSQL_STMT *stmt);
+  // 关闭服务端已丢弃的语句，下次使用时重新prepare
+  void drop(int id);
+  bool bindParams(MYSQL_STMT *stmt, const std::string_view *params,
+                  size_t count, SqlResult *result);
+  bool bindResult(MYSQL_STMT *stmt, unsigned int fields, SqlResult *result);
+  // 结果集已经由store_result读入内存，取出所有行后释放
+  bool readRows(MYSQL_STMT *stmt, unsigned int fields, SqlResult *result);
+
+ private:
+  using NullFlag = std::remove_pointer_t<decltype(MYSQL_BIND::is_null)>;
+  // 结果列的缓冲区，超过COLUMN_BUF的值用mysql_stmt_fetch_column单独读取
+  static constexpr unsigned long COLUMN_BUF = 256;
+  struct Column {
+    char buf[COLUMN_BUF];
+    unsigned long length;
+    NullFlag is_null;
+  };
+
+  static std::vector<std::string> &statements();
+  bool execute(int id, const std::string_view *params, size_t count,
+               SqlResult *result);
+  MYSQL_STMT *prepare(int id, SqlResult *result);
+  bool run(MYSQL_STMT *stmt, const std::string_view *params, size_t count,
+           SqlResult *result);
+  bool fetch(MYSQL_STMT *stmt, unsigned int fields, SqlResult *result);
+
+  MYSQL *sql_;
+  unsigned long thread_id_{0};
+  std::vector<MYSQL_STMT *> stmts_;
+  uint64_t prepares_{0};
+
+  // 绑定用的缓冲，每次执行复用
+  std::vector<MYSQL_BIND> params_;
+  std::vector<unsigned long> lengths_;
+  std::vector<MYSQL_BIND> binds_;
+  std::vector<Column> columns_;
+};
@@ -1,5 +1,14 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
+#include <cassert>
 #include <chrono>
+#include <climits>
 #include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
@@ -7,6 +16,7 @@
 #include <future>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -14,12 +24,26 @@
 #define cyber_unlikely(x) (x)
 constexpr auto CACHELINE_SIZE = 64;
 
+// 自旋等待时提示CPU当前处于忙等
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
 // 线程池中的等待策略
+// PrepareWait在检查队列之前调用，返回当前的通知序号，EmptyWait据此判断
+// 检查之后是否已有新的通知，从而避免丢失唤醒
 class WaitStrategy {
  public:
   virtual void NotifyOne() {}
   virtual void BreakAllWait() {}
-  virtual bool EmptyWait() = 0;
+  virtual uint64_t PrepareWait() { return 0; }
+  virtual bool EmptyWait(uint64_t ticket) = 0;
   virtual ~WaitStrategy() {}
 };
 
@@ -27,17 +51,36 @@ class WaitStrategy {
 class BlockWaitStrategy : public WaitStrategy {
  public:
   BlockWaitStrategy() = default;
-  void NotifyOne() override { cv_.notify_one(); }
-  bool EmptyWait() override {
+  void NotifyOne() override {
+    epoch_.fetch_add(1);
+    // 没有等待者时不必加锁
+    if (waiters_.load() > 0) {
+      std::lock_guard lck(mutex_);
+      cv_.notify_one();
+    }
+  }
+  uint64_t PrepareWait() override { return epoch_.load(); }
+  bool EmptyWait(uint64_t ticket) override {
     std::unique_lock lck(mutex_);
-    cv_.wait(lck);
-    return false;
+    waiters_.fetch_add(1);
+    cv_.wait(lck, [&] { return epoch_.load() != ticket || break_; });
+    waiters_.fetch_sub(1);
+    return !break_;
+  }
+  void BreakAllWait() override {
+    {
+      std::lock_guard lck(mutex_);
+      break_ = true;
+    }
+    cv_.notify_all();
   }
-  void BreakAllWait() override { cv_.notify_all(); }
 
  private:
   std::mutex mutex_;
   std::condition_variable cv_;
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> waiters_{0};
+  bool break_{false};
 };
 
 // sleep wait
@@ -46,7 +89,7 @@ class SleepWaitStrategy : public WaitStrategy {
   SleepWaitStrategy() = default;
   explicit SleepWaitStrategy(uint64_t us) : sleep_time_us_(us) {}
 
-  bool EmptyWait() override {
+  bool EmptyWait(uint64_t) override {
     std::this_thread::sleep_for(std::chrono::microseconds(sleep_time_us_));
     return true;
   }
@@ -60,7 +103,7 @@ class SleepWaitStrategy : public WaitStrategy {
 class YieldWaitStrategy : public WaitStrategy {
  public:
   YieldWaitStrategy() = default;
-  bool EmptyWait() override {
+  bool EmptyWait(uint64_t) override {
     // 相当于被其他任务抢占了，被抢占线程会被OS重新调度
     std::this_thread::yield();
     return true;
@@ -74,15 +117,30 @@ class TimeoutBlockWaitStrategy : public WaitStrategy {
   explicit TimeoutBlockWaitStrategy(uint64_t timeout)
       : timeout_(std::chrono::milliseconds(timeout)) {}
 
-  void NotifyOne() override { cv_.notify_one(); }
-  bool EmptyWait() override {
+  void NotifyOne() override {
+    epoch_.fetch_add(1);
+    if (waiters_.load() > 0) {
+      std::lock_guard lck(mutex_);
+      cv_.notify_one();
+    }
+  }
+  uint64_t PrepareWait() override { return epoch_.load(); }
+  bool EmptyWait(uint64_t ticket) override {
     std::unique_lock lck(mutex_);
-    if (cv_.wait_for(lck, timeout_) == std::cv_status::timeout) {
-      return false;
+    waiters_.fetch_add(1);
+    bool notified = cv_.wait_for(lck, timeout_, [&] {
+      return epoch_.load() != ticket || break_;
+    });
+    waiters_.fetch_sub(1);
+    return notified && !break_;
+  }
+  void BreakAllWait() override {
+    {
+      std::lock_guard lck(mutex_);
+      break_ = true;
     }
-    return true;
+    cv_.notify_all();
   }
-  void BreakAllWait() override { cv_.notify_all(); }
   void SetTimeout(uint64_t timeout) {
     timeout_ = std::chrono::milliseconds(timeout);
   }
@@ -90,12 +148,97 @@ class TimeoutBlockWaitStrategy : public WaitStrategy {
  private:
   std::mutex mutex_;
   std::condition_variable cv_;
-  std::chrono::milliseconds timeout_;
+  std::chrono::milliseconds timeout_{1000};
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> waiters_{0};
+  bool break_{false};
+};
+
+// 自适应策略：先pause自旋一段时间，再yield让出CPU，最后在futex上挂起
+// 短暂的任务间隙由自旋吸收，长时间空闲时不再占用CPU
+class AdaptiveWaitStrategy : public WaitStrategy {
+ public:
+  AdaptiveWaitStrategy() : AdaptiveWaitStrategy(20, 200) {}
+  AdaptiveWaitStrategy(uint64_t spin_us, uint64_t yield_us)
+      : spin_iters_(spin_us * PausePerMicroSecond()),
+        yield_time_(std::chrono::microseconds(yield_us)) {}
+
+  void NotifyOne() override {
+    epoch_.fetch_add(1);
+    // 只有进入futex的线程才需要系统调用唤醒
+    if (waiters_.load() > 0) {
+      FutexWake(1);
+    }
+  }
+  uint64_t PrepareWait() override { return epoch_.load(); }
+  bool EmptyWait(uint64_t ticket) override {
+    const uint32_t expected = static_cast<uint32_t>(ticket);
+    // 1. 自旋
+    for (uint64_t i = 0; i < spin_iters_; ++i) {
+      if (epoch_.load(std::memory_order_acquire) != expected) {
+        return !break_.load();
+      }
+      CpuRelax();
+    }
+    // 2. 让出CPU
+    auto deadline = std::chrono::steady_clock::now() + yield_time_;
+    while (std::chrono::steady_clock::now() < deadline) {
+      if (epoch_.load(std::memory_order_acquire) != expected) {
+        return !break_.load();
+      }
+      std::this_thread::yield();
+    }
+    // 3. 挂起，futex会原子地比较序号，期间的通知不会丢失
+    waiters_.fetch_add(1);
+    while (epoch_.load() == expected && !break_.load()) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_),
+              FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    }
+    waiters_.fetch_sub(1);
+    return !break_.load();
+  }
+  void BreakAllWait() override {
+    break_ = true;
+    epoch_.fetch_add(1);
+    FutexWake(INT_MAX);
+  }
+
+  // 校准每微秒能执行的pause次数，不同CPU上pause的耗时差别很大
+  static uint64_t PausePerMicroSecond() {
+    static const uint64_t per_us = [] {
+      constexpr uint64_t kProbe = 20000;
+      auto begin = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < kProbe; ++i) {
+        CpuRelax();
+      }
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin)
+                    .count();
+      return std::max<uint64_t>(1, kProbe * 1000 / std::max<int64_t>(ns, 1));
+    }();
+    return per_us;
+  }
+
+ private:
+  void FutexWake(int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE,
+            count, nullptr, nullptr, 0);
+  }
+
+  uint64_t spin_iters_;
+  std::chrono::microseconds yield_time_;
+  alignas(CACHELINE_SIZE) std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> waiters_{0};
+  std::atomic_bool break_{false};
 };
 
 /* 有界队列，用来存放线程池任务
+ * 生产者先通过tail_抢占槽位，写入后按顺序推进commit_；
+ * 消费者先通过head_抢占槽位，取出后按顺序推进release_，
+ * 生产者只会复用已经release的槽位，因此读写同一槽位不会并发。
+ * kPowerOfTwo为true时容量向上取整为2的幂，用掩码代替取模计算下标。
  */
-template <typename T>
+template <typename T, bool kPowerOfTwo = false>
 class BoundQueue {
  public:
   using value_type = T;
@@ -113,12 +256,16 @@ class BoundQueue {
   bool Init(uint64_t size, WaitStrategy* strategy);
 
   bool Enqueue(const T& element);
-  bool WaitEnqueue(const T& element);
   bool Dequeue(T* element);
   bool WaitDequeue(T* element);
 
-  uint64_t Size() { return tail_ - head_ - 1; }
+  // 先读head_再读commit_，commit_只增不减，结果不会下溢
+  uint64_t Size() {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    return commit_.load(std::memory_order_acquire) - head - 1;
+  }
   bool Empty() { return Size() == 0; }
+  uint64_t Capacity() const { return pool_size - 2; }
   void SetWaitStrategy(WaitStrategy* strategy) {
     wait_strategy_.reset(strategy);
   }
@@ -126,29 +273,33 @@ class BoundQueue {
   uint64_t GetHead() { return head_.load(); }
   uint64_t GetTail() { return tail_.load(); }
   uint64_t GetCommit() { return commit_.load(); }
+  uint64_t GetRelease() { return release_.load(); }
 
  private:
   uint64_t GetIndex(uint64_t num);
 
   // 指定内存对齐方式，提高代码性能
   alignas(CACHELINE_SIZE) std::atomic<uint64_t> head_{0};
+  alignas(CACHELINE_SIZE) std::atomic<uint64_t> release_{0};
   alignas(CACHELINE_SIZE) std::atomic<uint64_t> tail_{1};
   alignas(CACHELINE_SIZE) std::atomic<uint64_t> commit_{1};
 
-  uint64_t pool_size{0};
+  alignas(CACHELINE_SIZE) uint64_t pool_size{0};
+  uint64_t mask_{0};
   T* pool_{nullptr};
   std::unique_ptr<WaitStrategy> wait_strategy_{nullptr};
   volatile bool break_all_wait_{false};
 };
 
-template <typename T>
-bool BoundQueue<T>::WaitDequeue(T* element) {
+template <typename T, bool kPowerOfTwo>
+bool BoundQueue<T, kPowerOfTwo>::WaitDequeue(T* element) {
   while (!break_all_wait_) {
+    uint64_t ticket = wait_strategy_->PrepareWait();
     if (Dequeue(element)) {
       return true;
     }
 
-    if (wait_strategy_->EmptyWait()) {
+    if (wait_strategy_->EmptyWait(ticket)) {
       continue;
     }
     break;
@@ -157,8 +308,8 @@ bool BoundQueue<T>::WaitDequeue(T* element) {
 }
 
 // 基于原子变量的出队方式
-template <typename T>
-bool BoundQueue<T>::Dequeue(T* element) {
+template <typename T, bool kPowerOfTwo>
+bool BoundQueue<T, kPowerOfTwo>::Dequeue(T* element) {
   uint64_t new_head = 0;
   uint64_t old_head = head_.load(std::memory_order_acquire);
 
@@ -168,39 +319,31 @@ bool BoundQueue<T>::Dequeue(T* element) {
     if (new_head == commit_.load(std::memory_order_acquire)) {
       return false;
     }
-
-    *element = pool_[GetIndex(new_head)];
   } while (!head_.compare_exchange_weak(old_head, new_head,
                                         std::memory_order_acq_rel,
                                         std::memory_order_relaxed));
-  return true;
-}
-
-template <typename T>
-bool BoundQueue<T>::WaitEnqueue(const T& element) {
-  while (!break_all_wait_) {
-    if (Enqueue(element)) {
-      return true;
-    }
+  // 抢到槽位之后再取数据，release之前生产者不会覆盖该槽位
+  *element = std::move(pool_[GetIndex(new_head)]);
 
-    if (wait_strategy_->EmptyWait()) {
-      continue;
-    }
-    break;
-  }
-
-  return false;
+  uint64_t old_release = 0;
+  do {
+    old_release = old_head;
+  } while (cyber_unlikely(!release_.compare_exchange_weak(
+      old_release, new_head, std::memory_order_acq_rel,
+      std::memory_order_relaxed)));
+  return true;
 }
 
-template <typename T>
-bool BoundQueue<T>::Enqueue(const T& element) {
+template <typename T, bool kPowerOfTwo>
+bool BoundQueue<T, kPowerOfTwo>::Enqueue(const T& element) {
   uint64_t new_tail = 0;
   uint64_t old_commit = 0;
   uint64_t old_tail = tail_.load(std::memory_order_acquire);
 
   do {
     new_tail = old_tail + 1;
-    if (GetIndex(new_tail) == GetIndex(head_.load(std::memory_order_acquire))) {
+    if (GetIndex(new_tail) ==
+        GetIndex(release_.load(std::memory_order_acquire))) {
       return false;
     }
   } while (!tail_.compare_exchange_weak(old_tail, new_tail,
@@ -219,20 +362,32 @@ bool BoundQueue<T>::Enqueue(const T& element) {
   return true;
 }
 
-template <typename T>
-inline uint64_t BoundQueue<T>::GetIndex(uint64_t num) {
-  return num - (num / pool_size) * pool_size;
+template <typename T, bool kPowerOfTwo>
+inline uint64_t BoundQueue<T, kPowerOfTwo>::GetIndex(uint64_t num) {
+  if constexpr (kPowerOfTwo) {
+    return num & mask_;
+  } else {
+    return num - (num / pool_size) * pool_size;
+  }
 }
 
-template <typename T>
-inline bool BoundQueue<T>::Init(uint64_t size) {
+template <typename T, bool kPowerOfTwo>
+inline bool BoundQueue<T, kPowerOfTwo>::Init(uint64_t size) {
   return Init(size, new SleepWaitStrategy());
 }
 
-template <typename T>
-bool BoundQueue<T>::Init(uint64_t size, WaitStrategy* strategy) {
+template <typename T, bool kPowerOfTwo>
+bool BoundQueue<T, kPowerOfTwo>::Init(uint64_t size, WaitStrategy* strategy) {
   // 保证队列两端各留一个空位
   pool_size = size + 2;
+  if constexpr (kPowerOfTwo) {
+    uint64_t power = 1;
+    while (power < pool_size) {
+      power <<= 1;
+    }
+    pool_size = power;
+    mask_ = pool_size - 1;
+  }
   pool_ = reinterpret_cast<T*>(std::calloc(pool_size, sizeof(T)));
 
   if (pool_ == nullptr) {
@@ -248,14 +403,14 @@ bool BoundQueue<T>::Init(uint64_t size, WaitStrategy* strategy) {
   return true;
 }
 
-template <typename T>
-inline void BoundQueue<T>::BreakAllWait() {
+template <typename T, bool kPowerOfTwo>
+inline void BoundQueue<T, kPowerOfTwo>::BreakAllWait() {
   break_all_wait_ = true;
   wait_strategy_->BreakAllWait();
 }
 
-template <typename T>
-BoundQueue<T>::~BoundQueue() {
+template <typename T, bool kPowerOfTwo>
+BoundQueue<T, kPowerOfTwo>::~BoundQueue() {
   if (wait_strategy_) {
     BreakAllWait();
   }
@@ -271,31 +426,68 @@ BoundQueue<T>::~BoundQueue() {
 // 第三部分 线程池
 class ThreadPool {
  public:
-  explicit ThreadPool(std::size_t thread_num, std::size_t max_task_num = 1000)
+  // 线程池运行统计
+  struct Stats {
+    uint64_t submitted;    // 成功入队的任务数
+    uint64_t rejected;     // 队列已满或已停止而被拒绝的任务数
+    uint64_t completed;    // 执行完成的任务数
+    uint64_t queue_size;   // 当前排队的任务数
+    uint64_t wait_us;      // 任务累计排队时间
+    uint64_t max_wait_us;  // 任务最长排队时间
+    uint64_t busy_us;      // 工作线程累计执行任务的时间
+    uint64_t threads;      // 当前工作线程数
+    uint64_t grows;        // 扩容次数
+    uint64_t shrinks;      // 缩容次数
+  };
+
+  // 一次伸缩决策，交给on_resize回调(如写日志)
+  struct ResizeEvent {
+    std::size_t from;
+    std::size_t to;
+    uint64_t avg_wait_us;  // 采样周期内任务的平均排队时间
+    double busy_ratio;     // 采样周期内工作线程的忙碌比例
+    uint64_t queue_size;
+  };
+
+  // 弹性伸缩参数
+  // 排队时间或忙碌比例超过阈值立即扩容；连续shrink_periods个周期空闲才缩容，
+  // 每次只缩一个线程，避免负载抖动时反复伸缩
+  struct ScaleOptions {
+    std::size_t min_threads{1};
+    std::size_t max_threads{1};
+    uint32_t interval_ms{500};
+    uint64_t grow_wait_us{2000};
+    double grow_busy_ratio{0.85};
+    double shrink_busy_ratio{0.3};
+    int shrink_periods{6};
+    std::function<void(const ResizeEvent&)> on_resize;
+  };
+
+  // strategy的所有权交给任务队列，为空时使用BlockWaitStrategy
+  explicit ThreadPool(std::size_t thread_num, std::size_t max_task_num = 1000,
+                      WaitStrategy* strategy = nullptr)
       : stop_(false) {
+    if (strategy == nullptr) {
+      strategy = new BlockWaitStrategy();
+    }
     // 初始化失败抛出异常
-    if (!task_queue_.Init(max_task_num, new BlockWaitStrategy())) {
+    if (!task_queue_.Init(max_task_num, strategy)) {
       throw std::runtime_error("Task queue init failed.");
     }
 
     // 存放多个thread对象
+    std::lock_guard lck(workers_mtx_);
     workers_.reserve(thread_num);
     for (size_t i = 0; i < thread_num; ++i) {
-      workers_.emplace_back([this] {
-        while (!stop_) {
-          std::function<void()> task;
-          if (task_queue_.WaitDequeue(&task)) {
-            task();
-          }
-        }
-      });
+      AddWorker();
     }
   }
 
+  // 队列已满时任务被丢弃，返回的future无效(valid()为false)
   template <typename F, typename... Args>
   auto Enqueue(F&& f, Args&&... args)
-      -> std::future<typename std::result_of<F(Args...)>::type> {
-    using return_type = typename std::result_of<F(Args...)>::type;
+      -> std::future<std::invoke_result_t<F, Args...>> {
+    using return_type = std::invoke_result_t<F, Args...>;
     // 将函数f和args打包成一个package_task对象，放入任务队列中
     auto task = std::make_shared<std::packaged_task<return_type()>>(
         std::bind(std::forward<F>(f), std::forward<Args>(args)...));
@@ -303,27 +495,239 @@ class ThreadPool {
     std::future<return_type> res = task->get_future();
 
     if (stop_) {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
       return std::future<return_type>();
     }
 
-    task_queue_.Enqueue([task]() { (*task)(); });
+    auto enqueue_time = std::chrono::steady_clock::now();
+    if (!task_queue_.Enqueue([this, task, enqueue_time]() {
+          RecordWait(enqueue_time);
+          (*task)();
+        })) {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      return std::future<return_type>();
+    }
+    submitted_.fetch_add(1, std::memory_order_relaxed);
     return res;
   }
 
+  // 启动后台控制线程，按采样结果在[min_threads, max_threads]之间调整线程数
+  void StartAutoScale(const ScaleOptions& options) {
+    assert(options.min_threads > 0 &&
+           options.min_threads <= options.max_threads);
+    if (scaler_.joinable()) {
+      return;
+    }
+    scale_ = options;
+    {
+      std::lock_guard lck(workers_mtx_);
+      while (thread_count_.load() < scale_.min_threads) {
+        AddWorker();
+      }
+    }
+    scaler_ = std::thread([this] { ScaleLoop(); });
+  }
+
+  Stats GetStats() const {
+    Stats stats;
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    uint64_t started = started_.load(std::memory_order_relaxed);
+    stats.queue_size =
+        stats.submitted > started ? stats.submitted - started : 0;
+    stats.wait_us = wait_us_.load(std::memory_order_relaxed);
+    stats.max_wait_us = max_wait_us_.load(std::memory_order_relaxed);
+    stats.busy_us = busy_us_.load(std::memory_order_relaxed);
+    stats.threads = thread_count_.load(std::memory_order_relaxed);
+    stats.grows = grows_.load(std::memory_order_relaxed);
+    stats.shrinks = shrinks_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  std::size_t ThreadNum() const { return thread_count_.load(); }
+
   inline ~ThreadPool() {
     if (stop_.exchange(true)) {
       return;
     }
+    if (scaler_.joinable()) {
+      std::unique_lock lck(scaler_mtx_);
+      scaler_cv_.notify_all();
+      lck.unlock();
+      scaler_.join();
+    }
     // 停止线程池中的所有线程
     task_queue_.BreakAllWait();
     // 并等待它们完成队列中的所有任务
+    std::lock_guard lck(workers_mtx_);
     for (std::thread& worker : workers_) {
       worker.join();
     }
   }
 
  private:
+  // 调用者需持有workers_mtx_
+  void AddWorker() {
+    thread_count_.fetch_add(1);
+    workers_.emplace_back([this] {
+      while (!stop_ && !retire_self_) {
+        std::function<void()> task;
+        if (task_queue_.WaitDequeue(&task)) {
+          auto begin = std::chrono::steady_clock::now();
+          task();
+          if (retire_self_) {
+            break;
+          }
+          busy_us_.fetch_add(
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - begin)
+                  .count(),
+              std::memory_order_relaxed);
+          completed_.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+      if (retire_self_) {
+        std::lock_guard lck(retired_mtx_);
+        retired_.push_back(std::this_thread::get_id());
+      }
+    });
+  }
+
+  // 缩容时投递一个退出任务，由取到它的工作线程自行退出，
+  // 这样不必唤醒正在等待的线程
+  bool RetireWorker() {
+    if (!task_queue_.Enqueue([] { retire_self_ = true; })) {
+      return false;
+    }
+    thread_count_.fetch_sub(1);
+    return true;
+  }
+
+  void JoinRetired() {
+    std::vector<std::thread::id> retired;
+    {
+      std::lock_guard lck(retired_mtx_);
+      retired.swap(retired_);
+    }
+    std::lock_guard lck(workers_mtx_);
+    for (auto id : retired) {
+      auto it = std::find_if(workers_.begin(), workers_.end(),
+                             [id](const std::thread& t) {
+                               return t.get_id() == id;
+                             });
+      if (it != workers_.end()) {
+        it->join();
+        workers_.erase(it);
+      }
+    }
+  }
+
+  void ScaleLoop() {
+    Stats last = GetStats();
+    auto last_time = std::chrono::steady_clock::now();
+    int idle_periods = 0;
+    std::unique_lock lck(scaler_mtx_);
+    while (!stop_) {
+      if (scaler_cv_.wait_for(lck,
+                              std::chrono::milliseconds(scale_.interval_ms),
+                              [this] { return stop_.load(); })) {
+        break;
+      }
+      JoinRetired();
+
+      Stats now = GetStats();
+      auto now_time = std::chrono::steady_clock::now();
+      uint64_t elapsed_us =
+          std::chrono::duration_cast<std::chrono::microseconds>(now_time -
+                                                                last_time)
+              .count();
+      uint64_t started = (now.submitted - now.queue_size) -
+                         (last.submitted - last.queue_size);
+      uint64_t avg_wait = (now.wait_us - last.wait_us) /
+                          std::max<uint64_t>(1, started);
+      double busy = static_cast<double>(now.busy_us - last.busy_us) /
+                    std::max<uint64_t>(1, elapsed_us * now.threads);
+      last = now;
+      last_time = now_time;
+
+      std::size_t threads = now.threads;
+      std::size_t target = threads;
+      if ((avg_wait > scale_.grow_wait_us ||
+           busy > scale_.grow_busy_ratio) &&
+          threads < scale_.max_threads) {
+        // 扩容：每次增加一半，尽快追上负载
+        target = std::min(scale_.max_threads,
+                          threads + std::max<std::size_t>(1, threads / 2));
+        idle_periods = 0;
+      } else if (busy < scale_.shrink_busy_ratio &&
+                 avg_wait < scale_.grow_wait_us / 4 && now.queue_size == 0 &&
+                 threads > scale_.min_threads) {
+        if (++idle_periods >= scale_.shrink_periods) {
+          target = threads - 1;
+          idle_periods = 0;
+        }
+      } else {
+        idle_periods = 0;
+      }
+
+      if (target > threads) {
+        std::lock_guard workers_lck(workers_mtx_);
+        for (std::size_t i = threads; i < target; ++i) {
+          AddWorker();
+        }
+        grows_.fetch_add(1, std::memory_order_relaxed);
+      } else if (target < threads) {
+        if (!RetireWorker()) {
+          continue;
+        }
+        shrinks_.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        continue;
+      }
+      if (scale_.on_resize) {
+        scale_.on_resize({threads, target, avg_wait, busy, now.queue_size});
+      }
+    }
+  }
+
+  void RecordWait(std::chrono::steady_clock::time_point enqueue_time) {
+    uint64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - enqueue_time)
+                        .count();
+    started_.fetch_add(1, std::memory_order_relaxed);
+    wait_us_.fetch_add(wait, std::memory_order_relaxed);
+    uint64_t max_wait = max_wait_us_.load(std::memory_order_relaxed);
+    while (wait > max_wait &&
+           !max_wait_us_.compare_exchange_weak(max_wait, wait,
+                                               std::memory_order_relaxed)) {
+    }
+  }
+
+  // 工作线程取到退出任务后置位
+  inline static thread_local bool retire_self_ = false;
+
   std::vector<std::thread> workers_;
-  BoundQueue<std::function<void()>> task_queue_;
+  std::mutex workers_mtx_;
+  std::atomic<std::size_t> thread_count_{0};
+  BoundQueue<std::function<void()>, true> task_queue_;
   std::atomic_bool stop_;
+
+  ScaleOptions scale_;
+  std::thread scaler_;
+  std::mutex scaler_mtx_;
+  std::condition_variable scaler_cv_;
+  std::vector<std::thread::id> retired_;
+  std::mutex retired_mtx_;
+  std::atomic<uint64_t> grows_{0};
+  std::atomic<uint64_t> shrinks_{0};
+
+  // 生产者(事件循环)与消费者(工作线程)更新的计数放在不同的缓存行
+  alignas(CACHELINE_SIZE) std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> rejected_{0};
+  alignas(CACHELINE_SIZE) std::atomic<uint64_t> started_{0};
+  std::atomic<uint64_t> completed_{0};
+  std::atomic<uint64_t> wait_us_{0};
+  std::atomic<uint64_t> max_wait_us_{0};
+  std::atomic<uint64_t> busy_us_{0};
 };
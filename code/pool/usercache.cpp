@@ -0,0 +1,218 @@
+#include "usercache.h"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+#include "passwordhasher.h"
+
+UserCache *UserCache::instance() {
+  static UserCache cache;
+  return &cache;
+}
+
+void UserCache::init(const Options &options) {
+  // 只能初始化一次，分片在运行中不再改变
+  if (isEnabled() || options.capacity == 0 || options.shards <= 0) {
+    return;
+  }
+  options_ = options;
+  shard_capacity_ = std::max<size_t>(options.capacity / options.shards, 1);
+  for (int i = 0; i < options.shards; ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+  }
+  // 每个进程使用随机的盐，内存中的摘要无法与其他进程或字典比对
+  std::random_device rd;
+  for (unsigned char &byte : salt_) {
+    byte = static_cast<unsigned char>(rd());
+  }
+  enabled_.store(true, std::memory_order_release);
+}
+
+UserCache::Shard &UserCache::shard(const std::string &name) {
+  return *shards_[std::hash<std::string>()(name) % shards_.size()];
+}
+
+UserCache::Digest UserCache::digest(const std::string &pwd) const {
+  Digest out{};
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+  EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+  EVP_DigestUpdate(ctx, salt_.data(), salt_.size());
+  EVP_DigestUpdate(ctx, pwd.data(), pwd.size());
+  EVP_DigestFinal_ex(ctx, out.data(), nullptr);
+  EVP_MD_CTX_free(ctx);
+  return out;
+}
+
+UserCache::State UserCache::check(const Load &load, const std::string &pwd) {
+  if (!load.ok) {
+    return State::ERROR;
+  }
+  if (!load.exists) {
+    return State::ABSENT;
+  }
+  return load.password == pwd ? State::MATCH : State::MISMATCH;
+}
+
+UserCache::State UserCache::lookup(const std::string &name,
+                                   const std::string &pwd) {
+  if (!isEnabled()) {
+    return State::MISS;
+  }
+  Shard &s = shard(name);
+  bool exists;
+  Digest stored;
+  {
+    std::lock_guard locker(s.mtx);
+    auto it = s.index.find(name);
+    if (it == s.index.end()) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return State::MISS;
+    }
+    if (it->second->expire_ms <= LoopClock::nowMs()) {
+      s.lru.erase(it->second);
+      s.index.erase(it);
+      expirations_.fetch_add(1, std::memory_order_relaxed);
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return State::MISS;
+    }
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    exists = it->second->exists;
+    stored = it->second->digest;
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  if (!exists) {
+    negative_hits_.fetch_add(1, std::memory_order_relaxed);
+    return State::ABSENT;
+  }
+  // 摘要在锁外计算
+  return digest(pwd) == stored ? State::MATCH : State::MISMATCH;
+}
+
+bool UserCache::join(const std::string &name, Waiter waiter) {
+  if (!isEnabled()) {
+    return true;
+  }
+  Shard &s = shard(name);
+  std::lock_guard locker(s.mtx);
+  auto it = s.inflight.find(name);
+  if (it == s.inflight.end()) {
+    s.inflight.emplace(name, Inflight());
+    return true;
+  }
+  it->second.waiters.push_back(std::move(waiter));
+  coalesced_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void UserCache::complete(const std::string &name, const Load &load,
+                         int64_t load_us) {
+  if (!isEnabled()) {
+    return;
+  }
+  Digest value{};
+  // 慢哈希要等校验通过后由remember缓存；启用慢哈希时明文密码也不缓存，
+  // 下一次登录回到数据库，校验通过后升级为哈希
+  bool deferred = load.exists && (PasswordHasher::isHashed(load.password) ||
+                                  PasswordHasher::instance()->isEnabled());
+  if (load.ok) {
+    loads_.fetch_add(1, std::memory_order_relaxed);
+    load_us_.fetch_add(std::max<int64_t>(load_us, 0),
+                       std::memory_order_relaxed);
+    if (load.exists && !deferred) {
+      value = digest(load.password);
+    }
+  }
+  Shard &s = shard(name);
+  std::vector<Waiter> waiters;
+  {
+    std::lock_guard locker(s.mtx);
+    auto inflight = s.inflight.find(name);
+    bool stale = false;
+    if (inflight != s.inflight.end()) {
+      stale = inflight->second.stale;
+      waiters.swap(inflight->second.waiters);
+      s.inflight.erase(inflight);
+    }
+    if (load.ok && !stale && !deferred) {
+      put(s, name, load.exists, value);
+    }
+  }
+  for (Waiter &waiter : waiters) {
+    waiter(load);
+  }
+}
+
+void UserCache::remember(const std::string &name, const std::string &pwd) {
+  if (!isEnabled() || !options_.remember_verified) {
+    return;
+  }
+  Digest value = digest(pwd);
+  Shard &s = shard(name);
+  std::lock_guard locker(s.mtx);
+  put(s, name, true, value);
+}
+
+void UserCache::put(Shard &s, const std::string &name, bool exists,
+                    const Digest &value) {
+  int ttl = exists ? options_.ttl_ms : options_.negative_ttl_ms;
+  int64_t expire_ms = LoopClock::nowMs() + ttl;
+  auto it = s.index.find(name);
+  if (it != s.index.end()) {
+    *it->second = {name, exists, value, expire_ms};
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    return;
+  }
+  s.lru.push_front({name, exists, value, expire_ms});
+  s.index[name] = s.lru.begin();
+  if (s.lru.size() > shard_capacity_) {
+    s.index.erase(s.lru.back().name);
+    s.lru.pop_back();
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void UserCache::invalidate(const std::string &name) {
+  if (!isEnabled()) {
+    return;
+  }
+  Shard &s = shard(name);
+  std::lock_guard locker(s.mtx);
+  auto it = s.index.find(name);
+  if (it != s.index.end()) {
+    s.lru.erase(it->second);
+    s.index.erase(it);
+  }
+  // 正在进行的查询可能读到了修改之前的数据
+  auto inflight = s.inflight.find(name);
+  if (inflight != s.inflight.end()) {
+    inflight->second.stale = true;
+  }
+  invalidations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+UserCache::Stats UserCache::stats() const {
+  Stats stats{};
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.negative_hits = negative_hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+  stats.loads = loads_.load(std::memory_order_relaxed);
+  stats.evictions = evictions_.load(std::memory_order_relaxed);
+  stats.expirations = expirations_.load(std::memory_order_relaxed);
+  stats.invalidations = invalidations_.load(std::memory_order_relaxed);
+  stats.load_us = load_us_.load(std::memory_order_relaxed);
+  // 命中和合并的查询都省去了一次数据库访问
+  stats.saved_us = stats.loads ? (stats.hits + stats.coalesced) *
+                                     stats.load_us / stats.loads
+                               : 0;
+  if (isEnabled()) {
+    for (const auto &s : shards_) {
+      std::lock_guard locker(s->mtx);
+      stats.size += s->lru.size();
+    }
+  }
+  return stats;
+}
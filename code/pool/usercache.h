@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../utility/clock.h"
+
+// 登录校验前的用户缓存，按用户名分片的LRU，条目在TTL后过期
+// 只保存加盐的密码摘要(SHA-256)，不保存明文；不存在的用户也缓存(负缓存，TTL更短)
+// 未命中时对同一用户的并发查询只有第一个调用者访问数据库，其余的等待它的结果
+// 注册等修改user表的操作之后调用invalidate
+// 数据库中是慢哈希(PasswordHasher)时complete不缓存存在的用户，每次登录都要
+// 计算哈希；打开remember_verified后校验通过的明文摘要缓存到TTL，省掉这些计算；
+// 启用慢哈希后明文密码的用户也不缓存，等待登录时升级为哈希
+class UserCache {
+ public:
+  struct Options {
+    size_t capacity{100000};  // 所有分片的条目总数
+    int shards{16};
+    int ttl_ms{60000};
+    int negative_ttl_ms{5000};
+    // 慢哈希校验通过后缓存加盐的SHA-256摘要，TTL内的登录不再计算scrypt。
+    // 代价是进程内存泄露(如core dump)时这些摘要可以按快哈希的速度穷举，
+    // 相当于在TTL内放弃了慢哈希的保护，默认关闭
+    bool remember_verified{false};
+  };
+
+  // 校验的结果，ERROR只来自出错的数据库查询
+  enum class State { MISS, ABSENT, MATCH, MISMATCH, ERROR };
+
+  // 一次数据库查询的结果，ok为false表示查询出错，结果不缓存
+  struct Load {
+    bool ok{false};
+    bool exists{false};
+    std::string password;
+  };
+  using Waiter = std::function<void(const Load &load)>;
+  // 明文比较，load.password是慢哈希时由调用者交给PasswordHasher校验
+  static State check(const Load &load, const std::string &pwd);
+
+  struct Stats {
+    uint64_t hits;           // 包括负缓存命中
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t coalesced;      // 未命中但合并到了其他调用者的查询
+    uint64_t loads;          // 实际访问数据库的次数
+    uint64_t evictions;
+    uint64_t expirations;
+    uint64_t invalidations;
+    uint64_t load_us;        // 数据库查询的总耗时
+    uint64_t saved_us;       // 按平均查询耗时估算的命中节省的时间
+    size_t size;
+  };
+
+  static UserCache *instance();
+  void init(const Options &options);
+  bool isEnabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  State lookup(const std::string &name, const std::string &pwd);
+  // 未命中时调用：第一个调用者返回true，由它查询数据库后调用complete；
+  // 其余调用者返回false，waiter在complete时以同一结果调用(在调用complete的线程中)
+  bool join(const std::string &name, Waiter waiter);
+  // 填充缓存并唤醒等待者，load_us为这次查询的耗时
+  void complete(const std::string &name, const Load &load, int64_t load_us);
+  // 慢哈希校验通过之后缓存，之后的登录不再计算哈希；没有打开
+  // Options::remember_verified时什么也不做
+  void remember(const std::string &name, const std::string &pwd);
+  void invalidate(const std::string &name);
+
+  Stats stats() const;
+
+ private:
+  using Digest = std::array<unsigned char, 32>;
+  struct Entry {
+    std::string name;
+    bool exists;
+    Digest digest;
+    int64_t expire_ms;
+  };
+  // 正在查询的用户，invalidate之后的结果不能写入缓存
+  struct Inflight {
+    std::vector<Waiter> waiters;
+    bool stale{false};
+  };
+  struct Shard {
+    std::mutex mtx;
+    std::list<Entry> lru;  // 头部最近使用
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::unordered_map<std::string, Inflight> inflight;
+  };
+
+  UserCache() = default;
+
+  Shard &shard(const std::string &name);
+  Digest digest(const std::string &pwd) const;
+  // 调用时持有s.mtx
+  void put(Shard &s, const std::string &name, bool exists, const Digest &value);
+
+  Options options_;
+  size_t shard_capacity_{0};
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::array<unsigned char, 16> salt_{};
+  std::atomic<bool> enabled_{false};
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> negative_hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> coalesced_{0};
+  std::atomic<uint64_t> loads_{0};
+  std::atomic<uint64_t> evictions_{0};
+  std::atomic<uint64_t> expirations_{0};
+  std::atomic<uint64_t> invalidations_{0};
+  std::atomic<uint64_t> load_us_{0};
+};
@@ -0,0 +1,66 @@
+#include "userstore.h"
+
+static std::unique_ptr<UserStore> g_installed;
+
+UserStore *UserStore::instance() {
+  static MysqlUserStore mysql;
+  return g_installed ? g_installed.get() : &mysql;
+}
+
+void UserStore::install(std::unique_ptr<UserStore> store) {
+  g_installed = std::move(store);
+}
+
+const int MysqlUserStore::SELECT_USER_STMT = SqlStmtCache::define(
+    "SELECT username, password FROM user WHERE username=? LIMIT 1");
+const int MysqlUserStore::INSERT_USER_STMT =
+    SqlStmtCache::define("INSERT INTO user(username, password) VALUES(?,?)");
+const int MysqlUserStore::UPDATE_USER_STMT = SqlStmtCache::define(
+    "UPDATE user SET password=? WHERE username=? AND password=?");
+
+UserCache::Load MysqlUserStore::toLoad(const SqlResult &result) {
+  UserCache::Load load;
+  load.ok = result.ok;
+  if (result.ok && !result.rows.empty() && result.rows[0].size() >= 2) {
+    load.exists = true;
+    load.password = result.rows[0][1];
+  }
+  return load;
+}
+
+UserCache::Load MysqlUserStore::find(const std::string &name) {
+  SqlResult result;
+  SqlConn sqlconn(SqlConnPool::instance());
+  SqlStmtCache *stmts = sqlconn.stmts();
+  if (!stmts) {
+    result.error = "no mysql connection";
+  } else {
+    stmts->execute(SELECT_USER_STMT, {name}, &result);
+  }
+  if (!result.ok) {
+    LOG_WARN("verify query error: %s", result.error.c_str());
+  }
+  return toLoad(result);
+}
+
+bool MysqlUserStore::insert(const std::string &name, const std::string &pwd) {
+  RegisterBatcher *batcher = RegisterBatcher::instance();
+  if (batcher->isEnabled()) {
+    return batcher->submit(name, pwd) == RegisterBatcher::Result::OK;
+  }
+  SqlConn sqlconn(SqlConnPool::instance());
+  SqlStmtCache *stmts = sqlconn.stmts();
+  SqlResult result;
+  return stmts && stmts->execute(INSERT_USER_STMT, {name, pwd}, &result);
+}
+
+bool MysqlUserStore::update(const std::string &name,
+                            const std::string &old_pwd,
+                            const std::string &pwd) {
+  SqlConn sqlconn(SqlConnPool::instance());
+  SqlStmtCache *stmts = sqlconn.stmts();
+  SqlResult result;
+  return stmts &&
+         stmts->execute(UPDATE_USER_STMT, {pwd, name, old_pwd}, &result) &&
+         result.affected_rows == 1;
+}
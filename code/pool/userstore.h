@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "asyncsql.h"
+#include "registerbatcher.h"
+#include "sqlconnRAII.h"
+#include "usercache.h"
+
+// 用户表的存储接口，同步校验(HttpRequest::userVerify)只通过它访问用户数据
+// 默认是MySQL连接池，没有MySQL的节点或做基准测试时换成进程内的MemUserStore
+class UserStore {
+ public:
+  virtual ~UserStore() = default;
+
+  // 按用户名查询，load.ok为false表示出错
+  virtual UserCache::Load find(const std::string &name) = 0;
+  // 插入新用户，用户名已被使用或出错时返回false
+  virtual bool insert(const std::string &name, const std::string &pwd) = 0;
+  // 密码仍是old_pwd时换成pwd(迁移之前的明文密码升级为慢哈希)，
+  // 用户不存在、密码已被修改或出错时返回false
+  virtual bool update(const std::string &name, const std::string &old_pwd,
+                      const std::string &pwd) = 0;
+  // 在内存中完成查询的存储不需要UserCache
+  virtual bool isLocal() const { return false; }
+
+  // 当前使用的存储，没有调用install时是MysqlUserStore
+  static UserStore *instance();
+  // 替换存储，只能在开始处理请求之前调用
+  static void install(std::unique_ptr<UserStore> store);
+};
+
+// 使用连接池连接上缓存的预编译语句，RegisterBatcher启用时注册合并提交
+class MysqlUserStore : public UserStore {
+ public:
+  UserCache::Load find(const std::string &name) override;
+  bool insert(const std::string &name, const std::string &pwd) override;
+  bool update(const std::string &name, const std::string &old_pwd,
+              const std::string &pwd) override;
+
+  // 查询结果的第二列是密码，异步校验也用它转换结果
+  static UserCache::Load toLoad(const SqlResult &result);
+
+  // 异步校验在AsyncSqlClient上执行同样的预编译语句
+  static const int SELECT_USER_STMT;
+  static const int INSERT_USER_STMT;
+  // 参数依次为新密码、用户名、旧密码
+  static const int UPDATE_USER_STMT;
+};
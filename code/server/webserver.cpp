@@ -3,26 +3,91 @@
 WebServer::WebServer(int port, int trig_mode, int timeout, bool opt_linger,
                      int sql_port, const char *sql_user, const char *sql_pwd,
                      const char *dbname, int connpool_num, int thread_num,
-                     bool openlog, int log_level, int log_queue_size)
-    : port_(port) {
+                     bool openlog, int log_level, int log_queue_size,
+                     int task_queue_size, int db_queue_size, int thread_max,
+                     bool open_access_log, int access_sample, bool async_sql,
+                     const char *user_dir, int trace_sample,
+                     bool admin_paths)
+    : port_(port),
+      open_linger_(opt_linger),
+      timeout_ms_(timeout),
+      is_close_(false) {
+  // 原有的空闲超时用于长连接空闲和请求处理，其余阶段使用更短的默认期限
+  phase_limits_.keepalive_ms = timeout;
+  phase_limits_.process_ms = timeout;
+  phase_limits_.first_byte_ms = std::min(phase_limits_.first_byte_ms, timeout);
+  phase_limits_.header_ms = std::min(phase_limits_.header_ms, timeout);
+  // 日志最先初始化，之后的启动步骤都可以记录
+  if (openlog) {
+    Log::instance()->init(log_level, "./log", ".log", log_queue_size);
+  }
   epoller_ = std::make_unique<Epoller>();
-  timer_ = std::make_unique<HeapTimer>();
-  threadpool_ = std::make_unique<ThreadPool>(thread_num);
+  // 每个连接的定时器节点以fd为下标，预留到最大连接数避免扩容
+  timer_ = std::make_unique<TimingWheel>(MAX_FD);
+  threadpool_ = std::make_unique<ThreadPool>(thread_num, task_queue_size);
 
   src_dir_ = getcwd(nullptr, 256);
   assert(src_dir_);
   strncat(src_dir_, "/resources/", 16);
   HttpConn::user_count_ = 0;
   HttpConn::src_dir_ = src_dir_;
-  SqlConnPool::instance()->init("localhost", sql_port, sql_user, sql_pwd,
-                                dbname, connpool_num);
+  // 先开始监听：数据库连接在后台建立，期间已经可以处理静态资源的请求
   initEventMode(trig_mode);
   if (!initSocket()) {
     is_close_ = true;
   }
 
+  if (user_dir) {
+    // 进程内的用户存储，不连接MySQL，也不需要用户缓存
+    auto store = std::make_unique<MemUserStore>();
+    MemUserStore::Options options;
+    options.dir = user_dir;
+    if (store->init(options)) {
+      user_store_ = store.get();
+      UserStore::install(std::move(store));
+    } else {
+      is_close_ = true;
+    }
+  } else {
+    // 登录校验前的用户缓存，同步和异步校验共用
+    UserCache::instance()->init(UserCache::Options());
+  }
+  if (async_sql && !user_dir) {
+    async_sql_ = std::make_unique<AsyncSqlClient>(epoller_.get(), db_queue_size);
+    if (!async_sql_->init("localhost", sql_port, sql_user, sql_pwd, dbname,
+                          connpool_num)) {
+      async_sql_.reset();
+    }
+  }
+  // 同步校验(阻塞的连接池，或本地存储加上等待密码哈希)在数据库线程池中执行，
+  // 异步客户端可用时不需要这些线程
+  if (!async_sql_) {
+    // 每个数据库线程最多占用一个连接，线程数与连接池大小一致
+    db_threadpool_ = std::make_unique<ThreadPool>(connpool_num, db_queue_size);
+  }
+  // 异步客户端不可用时退回到阻塞的连接池
+  if (!async_sql_ && !user_dir) {
+    // 连接数随负载在一半到connpool_num之间伸缩，数据库线程不会无限期等待连接
+    SqlConnPool::Options options;
+    options.max_size = connpool_num;
+    options.min_size = std::max(connpool_num / 2, 1);
+    SqlConnPool::instance()->init("localhost", sql_port, sql_user, sql_pwd,
+                                  dbname, options);
+    // 注册高峰时合并成批量提交，每批只占用一个连接
+    RegisterBatcher::instance()->init(RegisterBatcher::Options());
+  }
+  // 登录后的会话，过期由事件循环中的tick驱动
+  SessionStore::instance()->init(SessionStore::Options());
+  // 新注册的密码以scrypt保存，哈希计算在独立的低优先级线程池中进行
+  if (!PasswordHasher::instance()->init(PasswordHasher::Options())) {
+    LOG_WARN("PasswordHasher off, passwords stored in plaintext");
+  }
+  // 连接就绪之前登录/注册直接返回503，GET /ready也返回503
+  HttpConn::db_ready_ = false;
+  metrics_collector_ = Metrics::instance()->addCollector(
+      [this](std::string &out) { collectMetrics(out); });
+
   if (openlog) {
-    Log::instance()->init(log_level, "./log", ".log", log_queue_size);
     if (is_close_) {
       LOG_ERROR("========== Server init error!===========");
     } else {
@@ -35,15 +100,272 @@ WebServer::WebServer(int port, int trig_mode, int timeout, bool opt_linger,
       LOG_INFO("srcDir: %s", HttpConn::src_dir_);
       LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connpool_num,
                thread_num);
+      LOG_INFO("TaskQueue size: %d, DbTaskQueue size: %d", task_queue_size,
+               db_queue_size);
+      LOG_INFO("AsyncSql: %s", async_sql_ ? "on" : "off");
+      LOG_INFO("UserStore: %s", user_dir ? user_dir : "mysql");
+    }
+  }
+
+  // 指标和追踪记录暴露连接数、请求路径等内部信息，只对本机开放
+  HttpConn::admin_paths_ = admin_paths;
+  if (admin_paths) {
+    LOG_INFO("Admin paths: %s %s (loopback only)", HttpConn::METRICS_PATH,
+             HttpConn::TRACE_PATH);
+  }
+
+  if (trace_sample > 0) {
+    // kill -USR2(admin_paths打开时还有GET /trace.json)导出采样请求的各阶段耗时
+    Trace::Options options;
+    options.sample = trace_sample;
+    Trace::instance()->init(options);
+    signal(SIGUSR2, Trace::requestDump);
+    LOG_INFO("Trace: sample 1/%d", trace_sample);
+  }
+
+  if (open_access_log) {
+    // 需要自定义格式或切换策略时直接调用AccessLog::instance()->init
+    AccessLog::Options options;
+    options.sample = access_sample;
+    if (!AccessLog::instance()->init(options)) {
+      LOG_ERROR("open access log %s error!", options.path.c_str());
+    } else {
+      LOG_INFO("AccessLog: %s, sample 1/%d", options.path.c_str(),
+               access_sample);
+    }
+  }
+
+  // thread_num作为下限，负载升高时最多扩容到thread_max
+  if (thread_max > thread_num) {
+    ThreadPool::ScaleOptions options;
+    options.min_threads = thread_num;
+    options.max_threads = thread_max;
+    options.on_resize = [](const ThreadPool::ResizeEvent &event) {
+      LOG_INFO("ThreadPool resize %zu -> %zu, wait:%luus busy:%.2f queue:%lu",
+               event.from, event.to, event.avg_wait_us, event.busy_ratio,
+               event.queue_size);
+    };
+    threadpool_->StartAutoScale(options);
+    LOG_INFO("ThreadPool auto scale: %d - %d", thread_num, thread_max);
+  }
+  if (!is_close_) {
+    warmStaticFiles();
+  }
+}
+
+void WebServer::warmStaticFiles() {
+  // 静态资源由工作线程并行读入页缓存，前几个请求不必等待磁盘
+  std::error_code ec;
+  std::filesystem::recursive_directory_iterator it(src_dir_, ec), end;
+  size_t files = 0;
+  uintmax_t bytes = 0;
+  for (; !ec && it != end; it.increment(ec)) {
+    if (!it->is_regular_file(ec)) {
+      continue;
+    }
+    uintmax_t size = it->file_size(ec);
+    if (ec || bytes + size > WARM_MAX_BYTES) {
+      continue;
+    }
+    std::string path = it->path().string();
+    auto task = threadpool_->Enqueue([path, size] {
+      int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd >= 0) {
+        readahead(fd, 0, size);
+        close(fd);
+      }
+    });
+    if (!task.valid()) {
+      break;
+    }
+    files++;
+    bytes += size;
+  }
+  LOG_INFO("Warming %zu static files (%luKB)", files,
+           static_cast<unsigned long>(bytes >> 10));
+}
+
+void WebServer::updateReadiness() {
+  bool ready = user_store_  ? true
+               : async_sql_ ? async_sql_->readyCount() > 0
+                            : SqlConnPool::instance()->ready();
+  if (ready != HttpConn::db_ready_.load(std::memory_order_relaxed)) {
+    HttpConn::db_ready_.store(ready, std::memory_order_relaxed);
+    if (ready) {
+      LOG_INFO("Database ready");
+    } else {
+      LOG_WARN("Database unavailable");
     }
   }
 }
 
 WebServer::~WebServer() {
+  // 先注销，之后的抓取不再访问正在析构的成员
+  Metrics::instance()->removeCollector(metrics_collector_);
+  for (int i = 0; i < static_cast<int>(HttpConn::Phase::COUNT); ++i) {
+    auto phase = static_cast<HttpConn::Phase>(i);
+    if (timeoutKills(phase) > 0) {
+      LOG_INFO("%s timeout closed: %lu", HttpConn::phaseName(phase),
+               timeoutKills(phase));
+    }
+  }
+  UserCache::Stats cache = UserCache::instance()->stats();
+  if (cache.hits + cache.misses > 0) {
+    LOG_INFO(
+        "UserCache hits: %lu (negative %lu), misses: %lu, coalesced: %lu, "
+        "evictions: %lu, saved: %lums",
+        cache.hits, cache.negative_hits, cache.misses, cache.coalesced,
+        cache.evictions, cache.saved_us / 1000);
+  }
+  PasswordHasher::Stats hasher = PasswordHasher::instance()->stats();
+  if (hasher.hashes + hasher.verifies > 0) {
+    LOG_INFO("PasswordHasher N=2^%d hashes: %lu, verifies: %lu, busy: %lu, "
+             "avg: %lums",
+             hasher.log_n, hasher.hashes, hasher.verifies, hasher.rejected,
+             hasher.compute_us / 1000 / (hasher.hashes + hasher.verifies));
+  }
+  SessionStore::Stats sessions = SessionStore::instance()->stats();
+  if (sessions.created > 0) {
+    LOG_INFO("SessionStore active: %zu (%zuKB), created: %lu, expired: %lu, "
+             "lookups: %lu, hits: %lu",
+             sessions.active, sessions.memory_bytes >> 10, sessions.created,
+             sessions.expired, sessions.lookups, sessions.hits);
+  }
   close(listen_fd_);
   is_close_ = true;
   free(src_dir_);
-  SqlConnPool::instance()->closePool();
+  if (user_store_) {
+    MemUserStore::Stats store = user_store_->stats();
+    LOG_INFO("MemUserStore users: %lu, inserts: %lu, snapshots: %lu",
+             store.users, store.inserts, store.snapshots);
+    user_store_->close();
+  } else if (!async_sql_) {
+    RegisterBatcher *batcher = RegisterBatcher::instance();
+    batcher->close();
+    RegisterBatcher::Stats batch = batcher->stats();
+    if (batch.requests > 0) {
+      LOG_INFO("RegisterBatcher requests: %lu, commits: %lu, largest: %lu, "
+               "duplicates: %lu, fallbacks: %lu",
+               batch.requests, batch.commits, batch.largest, batch.duplicates,
+               batch.fallbacks);
+    }
+    SqlConnPool::Stats pool = SqlConnPool::instance()->stats();
+    LOG_INFO(
+        "SqlConnPool acquires: %lu, timeouts: %lu, max wait: %lums, "
+        "reconnects: %lu, connect errors: %lu",
+        pool.acquires, pool.timeouts, pool.max_wait_us / 1000,
+        pool.reconnects, pool.connect_errors);
+    SqlConnPool::instance()->closePool();
+  }
+}
+
+void WebServer::collectMetrics(std::string &out) const {
+  Metrics::family(out, "webserver_connections", "gauge", "Open connections.");
+  Metrics::sample(out, "webserver_connections", "", HttpConn::user_count_);
+  Metrics::family(out, "webserver_db_ready", "gauge",
+                  "Whether login and register can be served.");
+  Metrics::sample(out, "webserver_db_ready", "",
+                  HttpConn::db_ready_.load(std::memory_order_relaxed));
+  Metrics::family(out, "webserver_timeout_closed_total", "counter",
+                  "Connections closed by a phase timeout.");
+  for (int i = 0; i < static_cast<int>(HttpConn::Phase::COUNT); ++i) {
+    auto phase = static_cast<HttpConn::Phase>(i);
+    Metrics::sample(out, "webserver_timeout_closed_total",
+                    std::string("phase=\"") + HttpConn::phaseName(phase) + "\"",
+                    timeoutKills(phase));
+  }
+
+  std::vector<std::pair<const char *, ThreadPool::Stats>> pools = {
+      {"request", threadpool_->GetStats()},
+      {"hasher", PasswordHasher::instance()->stats().pool},
+  };
+  if (db_threadpool_) {
+    pools.push_back({"db", db_threadpool_->GetStats()});
+  }
+  Metrics::family(out, "webserver_threadpool_queued", "gauge",
+                  "Tasks waiting in the queue.");
+  for (auto &pool : pools) {
+    Metrics::sample(out, "webserver_threadpool_queued",
+                    std::string("pool=\"") + pool.first + "\"",
+                    pool.second.queue_size);
+  }
+  Metrics::family(out, "webserver_threadpool_threads", "gauge",
+                  "Worker threads.");
+  for (auto &pool : pools) {
+    Metrics::sample(out, "webserver_threadpool_threads",
+                    std::string("pool=\"") + pool.first + "\"",
+                    pool.second.threads);
+  }
+  Metrics::family(out, "webserver_threadpool_rejected_total", "counter",
+                  "Tasks rejected because the queue was full.");
+  for (auto &pool : pools) {
+    Metrics::sample(out, "webserver_threadpool_rejected_total",
+                    std::string("pool=\"") + pool.first + "\"",
+                    pool.second.rejected);
+  }
+
+  if (user_store_) {
+    MemUserStore::Stats store = user_store_->stats();
+    Metrics::family(out, "webserver_user_store_users", "gauge",
+                    "Users in the embedded store.");
+    Metrics::sample(out, "webserver_user_store_users", "", store.users);
+  } else if (async_sql_) {
+    Metrics::family(out, "webserver_async_sql_pending", "gauge",
+                    "Queries waiting for or running on a connection.");
+    Metrics::sample(out, "webserver_async_sql_pending", "",
+                    async_sql_->pending());
+  } else {
+    SqlConnPool::Stats pool = SqlConnPool::instance()->stats();
+    Metrics::family(out, "webserver_sql_connections", "gauge",
+                    "MySQL connections by state.");
+    Metrics::sample(out, "webserver_sql_connections", "state=\"in_use\"",
+                    pool.in_use);
+    Metrics::sample(out, "webserver_sql_connections", "state=\"idle\"",
+                    pool.idle);
+    Metrics::family(out, "webserver_sql_waiting", "gauge",
+                    "Threads waiting for a connection.");
+    Metrics::sample(out, "webserver_sql_waiting", "", pool.waiting);
+    Metrics::family(out, "webserver_sql_acquire_timeouts_total", "counter",
+                    "Connection acquisitions that timed out.");
+    Metrics::sample(out, "webserver_sql_acquire_timeouts_total", "",
+                    pool.timeouts);
+    Metrics::family(out, "webserver_sql_reconnects_total", "counter",
+                    "Connections re-established after a failure.");
+    Metrics::sample(out, "webserver_sql_reconnects_total", "",
+                    pool.reconnects);
+    RegisterBatcher::Stats batch = RegisterBatcher::instance()->stats();
+    Metrics::family(out, "webserver_register_commits_total", "counter",
+                    "Transactions committed by the register batcher.");
+    Metrics::sample(out, "webserver_register_commits_total", "",
+                    batch.commits);
+  }
+  if (!user_store_) {
+    UserCache::Stats cache = UserCache::instance()->stats();
+    Metrics::family(out, "webserver_user_cache_lookups_total", "counter",
+                    "User cache lookups by result.");
+    Metrics::sample(out, "webserver_user_cache_lookups_total",
+                    "result=\"hit\"", cache.hits);
+    Metrics::sample(out, "webserver_user_cache_lookups_total",
+                    "result=\"miss\"", cache.misses);
+    Metrics::family(out, "webserver_user_cache_entries", "gauge",
+                    "Cached users.");
+    Metrics::sample(out, "webserver_user_cache_entries", "", cache.size);
+  }
+
+  SessionStore::Stats sessions = SessionStore::instance()->stats();
+  Metrics::family(out, "webserver_sessions", "gauge", "Active sessions.");
+  Metrics::sample(out, "webserver_sessions", "", sessions.active);
+  Metrics::family(out, "webserver_sessions_memory_bytes", "gauge",
+                  "Estimated memory held by the session store.");
+  Metrics::sample(out, "webserver_sessions_memory_bytes", "",
+                  sessions.memory_bytes);
+  PasswordHasher::Stats hasher = PasswordHasher::instance()->stats();
+  Metrics::family(out, "webserver_password_hashes_total", "counter",
+                  "Password hash computations by kind.");
+  Metrics::sample(out, "webserver_password_hashes_total", "kind=\"hash\"",
+                  hasher.hashes);
+  Metrics::sample(out, "webserver_password_hashes_total", "kind=\"verify\"",
+                  hasher.verifies);
 }
 
 void WebServer::initEventMode(int trig_mode) {
@@ -75,17 +397,48 @@ void WebServer::start() {
   if (!is_close_) {
     LOG_INFO("========== Server start ==========");
   }
+  LoopClock::update();
   while (!is_close_) {
+    // 最多阻塞1s，保证缓存时钟的秒数不会过期
+    timeout = CLOCK_REFRESH_MS;
     if (timeout_ms_ > 0) {
-      timeout = timer_->getNextTick();
+      int next_tick = timer_->getNextTick();
+      if (next_tick >= 0 && next_tick < timeout) {
+        timeout = next_tick;
+      }
+    }
+    if (async_sql_) {
+      int next = async_sql_->nextTimeout();
+      if (next >= 0 && next < timeout) {
+        timeout = next;
+      }
     }
     int event_count = epoller_->Wait(timeout);
+    wake_us_ = Metrics::nowUs();
+    // 每轮只读取一次系统时钟，定时器、日志和响应头都使用这个时间
+    LoopClock::update();
+    if (Trace::takeDumpRequest()) {
+      std::string path =
+          "./log/trace_" + std::to_string(LoopClock::wallUs() / 1000) + ".json";
+      if (Trace::instance()->dumpFile(path)) {
+        LOG_INFO("Trace dumped to %s", path.c_str());
+      } else {
+        LOG_ERROR("dump trace to %s error!", path.c_str());
+      }
+    }
+    if (async_sql_) {
+      async_sql_->checkTimeouts();
+    }
+    updateReadiness();
+    SessionStore::instance()->tick();
     for (int i = 0; i < event_count; ++i) {
       // 处理事件
       int fd = epoller_->GetEventFd(i);
       uint32_t events = epoller_->GetEvents(i);
       if (fd == listen_fd_) {
         dealListen();
+      } else if (async_sql_ && async_sql_->owns(fd)) {
+        async_sql_->handleEvent(fd, events);
       } else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
         assert(users_.count(fd) > 0);
         closeConn(&users_[fd]);
@@ -120,10 +473,11 @@ void WebServer::closeConn(HttpConn *client) {
 
 void WebServer::addClient(int fd, sockaddr_in addr) {
   assert(fd > 0);
+  Metrics::add(Metrics::ACCEPTS);
   users_[fd].init(fd, addr);
   if (timeout_ms_ > 0) {
-    timer_->add(fd, timeout_ms_,
-                std::bind(&WebServer::closeConn, this, &users_[fd]));
+    timer_->add(fd, phase_limits_.first_byte_ms,
+                std::bind(&WebServer::onTimeout, this, &users_[fd]));
   }
   epoller_->AddFd(fd, EPOLLIN | conn_event_);
   setFdNonblock(fd);
@@ -150,22 +504,69 @@ void WebServer::dealListen() {
 void WebServer::dealRead(HttpConn *client) {
   assert(client);
   extentTime(client);
-  threadpool_->Enqueue(std::bind(&WebServer::onRead, this, client));
+  client->beginTrace(wake_us_);
+  int64_t enqueue_us = Metrics::nowUs();
+  Trace::span(client->traceId(), "dispatch", wake_us_, enqueue_us);
+  if (!threadpool_
+           ->Enqueue([this, client, enqueue_us] {
+             int64_t now_us = Metrics::nowUs();
+             Metrics::record(Metrics::QUEUE_WAIT, now_us - enqueue_us);
+             Trace::span(client->traceId(), "queue", enqueue_us, now_us);
+             onRead(client);
+           })
+           .valid()) {
+    Metrics::add(Metrics::REJECTED);
+    LOG_WARN("task queue is full, client[%d] closed!", client->getFd());
+    closeConn(client);
+  }
 }
 
 void WebServer::dealWrtie(HttpConn *client) {
   assert(client);
   extentTime(client);
-  threadpool_->Enqueue(std::bind(&WebServer::onWrite, this, client));
+  int64_t enqueue_us = Metrics::nowUs();
+  if (!threadpool_
+           ->Enqueue([this, client, enqueue_us] {
+             int64_t now_us = Metrics::nowUs();
+             Metrics::record(Metrics::QUEUE_WAIT, now_us - enqueue_us);
+             Trace::span(client->traceId(), "queue", enqueue_us, now_us);
+             onWrite(client);
+           })
+           .valid()) {
+    Metrics::add(Metrics::REJECTED);
+    LOG_WARN("task queue is full, client[%d] closed!", client->getFd());
+    closeConn(client);
+  }
 }
 
 void WebServer::extentTime(HttpConn *client) {
   assert(client);
   if (timeout_ms_ > 0) {
-    timer_->adjust(client->getFd(), timeout_ms_);
+    int64_t remain = client->deadline(phase_limits_) - LoopClock::nowMs();
+    timer_->adjust(client->getFd(), std::max<int64_t>(remain, 0));
   }
 }
 
+void WebServer::onTimeout(HttpConn *client) {
+  assert(client);
+  if (client->isClose()) {
+    return;
+  }
+  // 读写线程可能已经推进到下一阶段，按新阶段的期限重新计时
+  int64_t remain = client->deadline(phase_limits_) - LoopClock::nowMs();
+  if (remain > 0) {
+    timer_->add(client->getFd(), remain,
+                std::bind(&WebServer::onTimeout, this, client));
+    return;
+  }
+  Metrics::add(Metrics::TIMER_EXPIRIES);
+  HttpConn::Phase phase = client->phase();
+  timeout_kills_[static_cast<int>(phase)]++;
+  LOG_INFO("client[%d] %s timeout!", client->getFd(),
+           HttpConn::phaseName(phase));
+  closeConn(client);
+}
+
 void WebServer::onRead(HttpConn *client) {
   assert(client);
   int ret = -1;
@@ -179,11 +580,46 @@ void WebServer::onRead(HttpConn *client) {
 }
 
 void WebServer::onProcess(HttpConn *client) {
-  if (client->process()) {
-    epoller_->ModFd(client->getFd(), conn_event_ | EPOLLOUT);
-  } else {
+  if (!client->process()) {
     epoller_->ModFd(client->getFd(), conn_event_ | EPOLLIN);
+    return;
+  }
+  if (client->needVerify() &&
+      !HttpConn::db_ready_.load(std::memory_order_relaxed)) {
+    // 数据库连接还没有就绪，直接返回错误而不是排队等待
+    Metrics::add(Metrics::REJECTED);
+    LOG_WARN("database not ready, client[%d] rejected!", client->getFd());
+    client->reject(503);
+  } else if (client->needVerify()) {
+    if (async_sql_) {
+      // 查询随数据库socket就绪在事件循环中推进，完成后直接注册写事件
+      if (client->verifyAsync(async_sql_.get(), [this, client] {
+            epoller_->ModFd(client->getFd(), conn_event_ | EPOLLOUT);
+          })) {
+        return;
+      }
+    } else if (db_threadpool_ &&
+               db_threadpool_
+                   ->Enqueue([this, client, enqueue_us = Metrics::nowUs()] {
+                     Trace::span(client->traceId(), "db-queue", enqueue_us,
+                                 Metrics::nowUs());
+                     onVerify(client);
+                   })
+                   .valid()) {
+      // 解析完成后转交数据库线程池
+      return;
+    }
+    Metrics::add(Metrics::REJECTED);
+    LOG_WARN("db task queue is full, client[%d] rejected!", client->getFd());
+    client->reject(503);
   }
+  epoller_->ModFd(client->getFd(), conn_event_ | EPOLLOUT);
+}
+
+void WebServer::onVerify(HttpConn *client) {
+  assert(client);
+  client->verify();
+  epoller_->ModFd(client->getFd(), conn_event_ | EPOLLOUT);
 }
 
 void WebServer::onWrite(HttpConn *client) {
@@ -256,7 +692,8 @@ bool WebServer::initSocket() {
     return false;
   }
 
-  ret = listen(listen_fd_, 6);
+  // 慢速连接会在短时间内大量涌入，积压队列过小时正常连接会被丢弃
+  ret = listen(listen_fd_, SOMAXCONN);
   if (ret < 0) {
     LOG_ERROR("listen port:%d error!", port_);
     close(listen_fd_);
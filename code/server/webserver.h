@@ -8,13 +8,20 @@
 
 #include <cassert>
 #include <cerrno>
+#include <csignal>
+#include <filesystem>
 #include <unordered_map>
 
 #include "../http/connection.h"
 #include "../log/log.h"
+#include "../log/metrics.h"
+#include "../pool/asyncsql.h"
+#include "../pool/memuserstore.h"
+#include "../pool/passwordhasher.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.hpp"
-#include "../utility/timer.h"
+#include "../pool/usercache.h"
+#include "../utility/timewheel.h"
 #include "epoller.h"
 
 class WebServer {
@@ -22,9 +29,17 @@ class WebServer {
   WebServer(int port, int trig_mode, int timeout, bool opt_linger, int sql_port,
             const char *sql_user, const char *sql_pwd, const char *dbname,
             int connpool_num, int thread_num, bool openlog, int log_level,
-            int log_queue_size);
+            int log_queue_size, int task_queue_size = 1000,
+            int db_queue_size = 256, int thread_max = 0,
+            bool open_access_log = false, int access_sample = 1,
+            bool async_sql = false, const char *user_dir = nullptr,
+            int trace_sample = 0, bool admin_paths = false);
   ~WebServer();
   void start();
+  // 因某个阶段超时被关闭的连接数
+  uint64_t timeoutKills(HttpConn::Phase phase) const {
+    return timeout_kills_[static_cast<int>(phase)];
+  }
 
  private:
   bool initSocket();
@@ -37,13 +52,24 @@ class WebServer {
 
   void sendError(int fd, const char *info);
   void extentTime(HttpConn *client);
+  void onTimeout(HttpConn *client);
   void closeConn(HttpConn *client);
 
   void onRead(HttpConn *client);
   void onWrite(HttpConn *client);
   void onProcess(HttpConn *client);
+  void onVerify(HttpConn *client);
+
+  void warmStaticFiles();
+  // 抓取/metrics时输出连接数、线程池和数据库等瞬时值
+  void collectMetrics(std::string &out) const;
+  // 按数据库连接的状态更新HttpConn::db_ready_，每轮事件循环调用
+  void updateReadiness();
 
   static const int MAX_FD = 65535;
+  static const int CLOCK_REFRESH_MS = 1000;
+  // 启动时预读的静态资源总量上限
+  static const uintmax_t WARM_MAX_BYTES = 256 << 20;
   static int setFdNonblock(int fd);
 
   int port_;
@@ -53,11 +79,27 @@ class WebServer {
   int listen_fd_;
   char *src_dir_;
 
+  // 每个连接只占用一个定时器，到期时按所处阶段重新计算期限
+  HttpConn::PhaseLimits phase_limits_;
+  std::atomic<uint64_t>
+      timeout_kills_[static_cast<int>(HttpConn::Phase::COUNT)]{};
+
+  // 本轮epoll_wait返回的时间(us)，请求追踪的起点
+  int64_t wake_us_{0};
+
   uint32_t listen_event_;
   uint32_t conn_event_;
 
-  std::unique_ptr<HeapTimer> timer_;
+  std::unique_ptr<TimingWheel> timer_;
   std::unique_ptr<Epoller> epoller_;
   std::unique_ptr<ThreadPool> threadpool_;
+  // 同步校验使用独立的阻塞线程池，慢查询不会占满处理静态资源的线程；
+  // 异步客户端可用时不创建
+  std::unique_ptr<ThreadPool> db_threadpool_;
+  // 可用时登录/注册改由事件循环中的非阻塞客户端查询，不占用数据库线程
+  std::unique_ptr<AsyncSqlClient> async_sql_;
+  // user_dir不为空时使用的进程内用户存储，由UserStore::install持有
+  MemUserStore *user_store_{nullptr};
   std::unordered_map<int, HttpConn> users_;
+  int metrics_collector_{-1};
 };
\ No newline at end of file
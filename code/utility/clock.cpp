@@ -0,0 +1,83 @@
+#include "clock.h"
+
+#include <cstring>
+
+std::atomic<int64_t> LoopClock::mono_ns_{0};
+std::atomic<int64_t> LoopClock::wall_us_{0};
+std::atomic<bool> LoopClock::driven_{false};
+std::atomic<uint32_t> LoopClock::seq_{0};
+std::atomic<bool> LoopClock::formatting_{false};
+std::atomic<int64_t> LoopClock::formatted_sec_{-1};
+LoopClock::WallTime LoopClock::wall_{};
+
+LoopClock::time_point LoopClock::now() noexcept {
+  if (!driven_.load(std::memory_order_relaxed)) {
+    refresh();
+  }
+  return time_point(duration(mono_ns_.load(std::memory_order_relaxed)));
+}
+
+int64_t LoopClock::nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             now().time_since_epoch())
+      .count();
+}
+
+int64_t LoopClock::wallUs() {
+  if (!driven_.load(std::memory_order_relaxed)) {
+    refresh();
+  }
+  return wall_us_.load(std::memory_order_relaxed);
+}
+
+void LoopClock::update() {
+  refresh();
+  driven_.store(true, std::memory_order_relaxed);
+}
+
+void LoopClock::refresh() {
+  timespec mono, wall;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &mono);
+  clock_gettime(CLOCK_REALTIME_COARSE, &wall);
+  mono_ns_.store(mono.tv_sec * 1000000000LL + mono.tv_nsec,
+                 std::memory_order_relaxed);
+  wall_us_.store(wall.tv_sec * 1000000LL + wall.tv_nsec / 1000,
+                 std::memory_order_relaxed);
+  // 每秒只格式化一次，其他线程正在格式化时直接跳过
+  if (formatted_sec_.load(std::memory_order_relaxed) != wall.tv_sec &&
+      !formatting_.exchange(true, std::memory_order_acquire)) {
+    format(wall.tv_sec);
+    formatted_sec_.store(wall.tv_sec, std::memory_order_relaxed);
+    formatting_.store(false, std::memory_order_release);
+  }
+}
+
+void LoopClock::format(time_t sec) {
+  WallTime wall;
+  wall.sec = sec;
+  localtime_r(&sec, &wall.tm);
+  struct tm gmt;
+  gmtime_r(&sec, &gmt);
+  strftime(wall.http_date, sizeof(wall.http_date),
+           "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+
+  uint32_t seq = seq_.load(std::memory_order_relaxed);
+  seq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&wall_, &wall, sizeof(wall));
+  seq_.store(seq + 2, std::memory_order_release);
+}
+
+void LoopClock::wallTime(WallTime *out) {
+  if (!driven_.load(std::memory_order_relaxed) ||
+      formatted_sec_.load(std::memory_order_relaxed) < 0) {
+    refresh();
+  }
+  uint32_t before, after;
+  do {
+    before = seq_.load(std::memory_order_acquire);
+    memcpy(out, &wall_, sizeof(*out));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = seq_.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <ctime>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// 事件循环每轮刷新一次的粗粒度时钟，满足std::chrono的Clock要求
+// 单调时间与墙上时间来自CLOCK_MONOTONIC_COARSE/CLOCK_REALTIME_COARSE，
+// HTTP Date和本地时间每秒只计算一次，定时器、日志和响应头都从这里读取
+// 没有事件循环调用update()之前，每次读取都会自行刷新
+class LoopClock {
+ public:
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<LoopClock>;
+  static constexpr bool is_steady = true;
+
+  // 按秒缓存的墙上时间
+  struct WallTime {
+    time_t sec;
+    struct tm tm;
+    char http_date[30];  // Wed, 28 Feb 2024 04:00:00 GMT
+  };
+
+  static time_point now() noexcept;
+  static int64_t nowMs();
+  static int64_t wallUs();
+  static void wallTime(WallTime *out);
+
+  // 由事件循环在每轮开始时调用
+  static void update();
+
+ private:
+  static void refresh();
+  static void format(time_t sec);
+
+  static std::atomic<int64_t> mono_ns_;
+  static std::atomic<int64_t> wall_us_;
+  static std::atomic<bool> driven_;
+  // 格式化结果由seq_保护，奇数表示正在写入
+  static std::atomic<uint32_t> seq_;
+  static std::atomic<bool> formatting_;
+  static std::atomic<int64_t> formatted_sec_;
+  static WallTime wall_;
+};
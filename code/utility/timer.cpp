@@ -1,15 +1,15 @@
 #include "timer.h"
 
 void HeapTimer::siftup(size_t i) {
-  assert(i >= 0 && i < heap_.size());
-  size_t j = (i - 1) / 2;
-  while (j >= 0) {
+  assert(i < heap_.size());
+  // i为0时(i - 1) / 2会回绕，必须先判断
+  while (i > 0) {
+    size_t j = (i - 1) / 2;
     if (heap_[j] < heap_[i]) {
       break;
     }
     swap(i, j);
     i = j;
-    j = (i - 1) / 2;
   }
 }
 
@@ -65,6 +65,14 @@ void HeapTimer::doWork(int id) {
   del(i);
 }
 
+void HeapTimer::cancel(int id) {
+  // 删除节点但不执行回调
+  if (heap_.empty() || ref_.count(id) == 0) {
+    return;
+  }
+  del(ref_[id]);
+}
+
 void HeapTimer::del(size_t index) {
   assert(!heap_.empty() && index >= 0 && index < heap_.size());
   // 将要删除的结点放入队尾，然后调整堆
@@ -113,7 +121,7 @@ void HeapTimer::clear() {
 
 int HeapTimer::getNextTick() {
   tick();
-  size_t res = -1;
+  int64_t res = -1;
   if (!heap_.empty()) {
     res = std::chrono::duration_cast<MS>(heap_.front().expires_ - Clock::now())
               .count();
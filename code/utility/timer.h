@@ -11,9 +11,11 @@
 #include <vector>
 
 #include "../log/log.h"
+#include "clock.h"
 
 using TimeoutCallback = std::function<void()>;
-using Clock = std::chrono::high_resolution_clock;
+// 读取事件循环缓存的时间，不再每次调用系统时钟
+using Clock = LoopClock;
 using MS = std::chrono::milliseconds;
 using TimeStamp = Clock::time_point;
 
@@ -32,6 +34,7 @@ class HeapTimer {
   void adjust(int id, int expires);
   void add(int id, int timeout, const TimeoutCallback &cb);
   void doWork(int id);
+  void cancel(int id);
   void clear();
   void tick();
   void pop();
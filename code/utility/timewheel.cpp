@@ -0,0 +1,204 @@
+#include "timewheel.h"
+
+#include <climits>
+
+TimingWheel::TimingWheel(size_t capacity) : current_(nowMs()) {
+  nodes_.reserve(capacity);
+  for (auto &level : heads_) {
+    std::fill(level, level + SLOTS, -1);
+  }
+  std::fill(occupied_, occupied_ + LEVELS, 0);
+}
+
+int64_t TimingWheel::nowMs() { return LoopClock::nowMs(); }
+
+void TimingWheel::link(int id) {
+  WheelNode &node = nodes_[id];
+  assert(node.level_ < 0);
+  int64_t due = std::max(node.expires_, current_);
+  int64_t delta = due - current_;
+  int level = 0;
+  while (level < LEVELS - 1 && delta >= (1LL << ((level + 1) * SLOT_BITS))) {
+    ++level;
+  }
+  // 超出最高层范围的先挂在最远处，到期时再重新挂入
+  int64_t span = 1LL << (LEVELS * SLOT_BITS);
+  if (delta >= span) {
+    due = current_ + span - 1;
+  }
+  int slot = (due >> (level * SLOT_BITS)) & SLOT_MASK;
+  node.due_ = due;
+  node.level_ = static_cast<int8_t>(level);
+  node.slot_ = static_cast<uint8_t>(slot);
+  node.prev_ = -1;
+  node.next_ = heads_[level][slot];
+  if (node.next_ >= 0) {
+    nodes_[node.next_].prev_ = id;
+  }
+  heads_[level][slot] = id;
+  occupied_[level] |= 1ULL << slot;
+  ++count_;
+}
+
+void TimingWheel::unlink(int id) {
+  WheelNode &node = nodes_[id];
+  assert(node.level_ >= 0);
+  int &head = heads_[node.level_][node.slot_];
+  if (node.prev_ >= 0) {
+    nodes_[node.prev_].next_ = node.next_;
+  } else {
+    head = node.next_;
+  }
+  if (node.next_ >= 0) {
+    nodes_[node.next_].prev_ = node.prev_;
+  }
+  if (head < 0) {
+    occupied_[node.level_] &= ~(1ULL << node.slot_);
+  }
+  node.level_ = -1;
+  --count_;
+}
+
+void TimingWheel::add(int id, int timeout, const TimeoutCallback &cb) {
+  assert(id >= 0);
+  if (static_cast<size_t>(id) >= nodes_.size()) {
+    nodes_.resize(id + 1);
+  }
+  WheelNode &node = nodes_[id];
+  if (node.level_ >= 0) {
+    unlink(id);
+  }
+  node.expires_ = nowMs() + timeout;
+  node.cb_ = cb;
+  link(id);
+}
+
+void TimingWheel::adjust(int id, int timeout) {
+  assert(static_cast<size_t>(id) < nodes_.size() && nodes_[id].level_ >= 0);
+  WheelNode &node = nodes_[id];
+  node.expires_ = nowMs() + timeout;
+  // 延后不移动节点，提前则需要换到更早的槽
+  if (node.expires_ < node.due_) {
+    unlink(id);
+    link(id);
+  }
+}
+
+void TimingWheel::doWork(int id) {
+  // 删除节点并执行回调函数
+  if (static_cast<size_t>(id) >= nodes_.size() || nodes_[id].level_ < 0) {
+    return;
+  }
+  unlink(id);
+  TimeoutCallback cb = std::move(nodes_[id].cb_);
+  nodes_[id].cb_ = nullptr;
+  cb();
+}
+
+void TimingWheel::cancel(int id) {
+  // 删除节点但不执行回调
+  if (static_cast<size_t>(id) >= nodes_.size() || nodes_[id].level_ < 0) {
+    return;
+  }
+  unlink(id);
+  nodes_[id].cb_ = nullptr;
+}
+
+void TimingWheel::clear() {
+  nodes_.clear();
+  for (auto &level : heads_) {
+    std::fill(level, level + SLOTS, -1);
+  }
+  std::fill(occupied_, occupied_ + LEVELS, 0);
+  count_ = 0;
+}
+
+void TimingWheel::cascade(int level) {
+  // 将高层当前槽中的节点按剩余时间重新挂入较低的层
+  int slot = (current_ >> (level * SLOT_BITS)) & SLOT_MASK;
+  int id;
+  while ((id = heads_[level][slot]) >= 0) {
+    unlink(id);
+    link(id);
+    assert(nodes_[id].level_ < level || nodes_[id].slot_ != slot);
+  }
+}
+
+void TimingWheel::expire() {
+  int slot = current_ & SLOT_MASK;
+  int id;
+  while ((id = heads_[0][slot]) >= 0) {
+    unlink(id);
+    WheelNode &node = nodes_[id];
+    if (node.expires_ > current_) {
+      // 被adjust延后的节点
+      link(id);
+      continue;
+    }
+    // 回调中可能重新add同一个id，先把回调取出
+    TimeoutCallback cb = std::move(node.cb_);
+    node.cb_ = nullptr;
+    cb();
+  }
+}
+
+int64_t TimingWheel::nextEvent() const {
+  // 每层找到从当前位置起第一个非空槽，返回最早需要处理的时刻
+  auto first_set = [](uint64_t bits, int start) {
+    uint64_t rotated =
+        start == 0 ? bits : (bits >> start) | (bits << (SLOTS - start));
+    return __builtin_ctzll(rotated);
+  };
+  int64_t next = INT64_MAX;
+  if (occupied_[0]) {
+    next = current_ + first_set(occupied_[0], current_ & SLOT_MASK);
+  }
+  for (int level = 1; level < LEVELS; ++level) {
+    if (!occupied_[level]) {
+      continue;
+    }
+    int shift = level * SLOT_BITS;
+    int64_t base = current_ >> shift;
+    // current_恰好对齐时，本层当前槽还没有下放
+    if ((base << shift) != current_) {
+      ++base;
+    }
+    int64_t t = (base + first_set(occupied_[level], base & SLOT_MASK)) << shift;
+    next = std::min(next, t);
+  }
+  return next;
+}
+
+void TimingWheel::advance(int64_t now) {
+  while (current_ <= now) {
+    int64_t next = count_ == 0 ? INT64_MAX : nextEvent();
+    if (next > now) {
+      // 中间没有需要处理的槽，直接跳过
+      current_ = now + 1;
+      return;
+    }
+    current_ = next;
+    for (int level = 1; level < LEVELS; ++level) {
+      if (current_ & ((1LL << (level * SLOT_BITS)) - 1)) {
+        break;
+      }
+      cascade(level);
+    }
+    expire();
+    ++current_;
+  }
+}
+
+void TimingWheel::tick() { advance(nowMs()); }
+
+int TimingWheel::getNextTick() {
+  tick();
+  if (count_ == 0) {
+    return -1;
+  }
+  int64_t res = nextEvent() - nowMs();
+  if (res < 0) {
+    res = 0;
+  }
+  return static_cast<int>(std::min<int64_t>(res, INT_MAX));
+}
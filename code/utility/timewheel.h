@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "timer.h"
+
+// 分层时间轮：4层，每层64个槽，精度1ms，最长约4.6小时
+// 与HeapTimer接口一致，add/adjust/cancel均为O(1)
+// 节点按id(即fd)存放在数组中，通过下标串成双向链表，运行期间不再分配内存
+// adjust延长超时时间时只修改到期时间，节点所在的槽到期时再重新挂入(惰性重排)
+class TimingWheel {
+ public:
+  explicit TimingWheel(size_t capacity = 1024);
+  ~TimingWheel() { clear(); }
+
+  void adjust(int id, int timeout);
+  void add(int id, int timeout, const TimeoutCallback &cb);
+  void doWork(int id);
+  void cancel(int id);
+  void clear();
+  void tick();
+  int getNextTick();
+  size_t size() const { return count_; }
+  // 节点数组占用的内存
+  size_t memoryBytes() const { return nodes_.capacity() * sizeof(WheelNode); }
+
+ private:
+  static const int LEVELS = 4;
+  static const int SLOT_BITS = 6;
+  static const int SLOTS = 1 << SLOT_BITS;
+  static const int SLOT_MASK = SLOTS - 1;
+
+  struct WheelNode {
+    int64_t expires_;  // 实际到期时间
+    int64_t due_;      // 挂入槽时使用的到期时间，不晚于expires_
+    int prev_;
+    int next_;
+    int8_t level_{-1};  // -1表示不在时间轮中
+    uint8_t slot_;
+    TimeoutCallback cb_;
+  };
+
+  static int64_t nowMs();
+  void link(int id);
+  void unlink(int id);
+  void cascade(int level);
+  void expire();
+  void advance(int64_t now);
+  int64_t nextEvent() const;
+
+  std::vector<WheelNode> nodes_;
+  int heads_[LEVELS][SLOTS];
+  uint64_t occupied_[LEVELS];  // 非空槽的位图，用于跳过空槽
+  int64_t current_;            // 下一个待处理的时刻
+  size_t count_{0};
+};
@@ -0,0 +1,111 @@
+// 访问日志基准测试：多个线程同时提交访问记录，统计每条在请求线程上的耗时，
+// 并检查采样、按大小切换文件后写入的行数，以及路径中特殊字符的转义
+//   ./accesslog_bench [threads] [records_per_thread]
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../code/log/accesslog.h"
+
+using SteadyClock = std::chrono::steady_clock;
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             SteadyClock::now().time_since_epoch())
+      .count();
+}
+
+static size_t CountLines(const char *dir) {
+  std::string cmd = std::string("cat ") + dir + "/access.log* | wc -l";
+  FILE *pipe = popen(cmd.c_str(), "r");
+  size_t lines = 0;
+  if (pipe) {
+    fscanf(pipe, "%zu", &lines);
+    pclose(pipe);
+  }
+  return lines;
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  int records = argc > 2 ? atoi(argv[2]) : 200000;
+  const char *dir = "./accesslog_bench.out";
+  system("rm -rf ./accesslog_bench.out");
+
+  // 每4个成功的请求记录1个，错误请求全部记录；文件超过1MB切换
+  AccessLog::Options options;
+  options.path = std::string(dir) + "/access.log";
+  options.sample = 4;
+  options.max_bytes = 1 << 20;
+  AccessLog *log = AccessLog::instance();
+  if (!log->init(options)) {
+    printf("init access log FAIL\n");
+    return 1;
+  }
+
+  std::vector<std::thread> workers;
+  std::vector<int64_t> cost(threads);
+  std::vector<size_t> expected(threads);
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([t, records, log, &cost, &expected] {
+      AccessRecord record{};
+      record.ip = htonl(0x7f000001);
+      record.port = htons(40000 + t);
+      record.bytes = 3270;
+      int64_t begin = NowNs();
+      for (int i = 0; i < records; ++i) {
+        record.wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+        record.status = i % 100 == 0 ? 404 : 200;
+        record.request_us = i & 4095;
+        if (log->sampled(record.status)) {
+          log->append(record, "GET", "/index.html");
+          expected[t]++;
+        }
+      }
+      cost[t] = NowNs() - begin;
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  log->flush();
+
+  int64_t total_cost = 0;
+  size_t total = 0;
+  for (int t = 0; t < threads; ++t) {
+    total_cost += cost[t];
+    total += expected[t];
+  }
+  printf("access : %7.1f ns/request, sampled %zu of %d, dropped %lu\n",
+         double(total_cost) / threads / records, total, threads * records,
+         log->dropped());
+  size_t lines = CountLines(dir);
+  bool ok = lines == total - log->dropped() && lines == log->written() &&
+            log->rotations() > 0;
+  printf("lines written %zu, rotations %lu, %s\n", lines, log->rotations(),
+         ok ? "PASS" : "FAIL");
+
+  // 引号、反斜杠和控制字符写成\xHH，整条记录仍占一行
+  AccessRecord record{};
+  record.status = 404;
+  log->append(record, "GET", "/a\"b\\c\n\x80");
+  log->flush();
+  std::ifstream file(options.path);
+  std::string line, last;
+  while (std::getline(file, line)) {
+    last = line;
+  }
+  bool escaped = last.find("\"GET /a\\x22b\\x5Cc\\x0A\\x80\" 404 ") !=
+                 std::string::npos;
+  printf("uri escaped %s\n", escaped ? "PASS" : "FAIL");
+  ok = ok && escaped;
+  system("rm -rf ./accesslog_bench.out");
+  return ok ? 0 : 1;
+}
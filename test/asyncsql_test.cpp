@@ -0,0 +1,151 @@
+// 异步MySQL客户端测试，使用test/mock中的客户端库替身，不需要真实的数据库
+// 1. 工作线程提交的查询在事件循环中并发执行，总耗时约为 延迟*查询数/连接数
+// 2. HttpRequest::verifyAsync 的登录/注册结果与同步校验一致，
+//    用户名和密码以预编译语句的参数传递，每个连接只prepare一次
+// 3. 数据库断开后查询失败，客户端自动重连后恢复
+// 4. 数据库不应答时查询在期限内失败，连接重连，不会被一直占用
+//   ./asyncsql_test [connections] [queries] [latency_ms]
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "verifyutil.h"
+
+int main(int argc, char *argv[]) {
+  int conns = argc > 1 ? atoi(argv[1]) : 4;
+  int queries = argc > 2 ? atoi(argv[2]) : 40;
+  int latency = argc > 3 ? atoi(argv[3]) : 20;
+  mock_mysql_set_latency(latency);
+  mock_mysql_add_user("root", "123456");
+
+  Epoller epoller;
+  const int timeout = 300;
+  AsyncSqlClient client(&epoller, queries, timeout);
+  Check(client.init("localhost", 3306, "root", "12345678", "webserver", conns),
+        "init");
+  RunLoop(epoller, client, [&] { return client.readyCount() == conns; });
+  Check(client.readyCount() == conns, "all connections ready");
+
+  // 查询由其他线程提交，与服务器中的工作线程一样
+  std::atomic<int> done{0};
+  std::atomic<int> found{0};
+  int64_t begin = NowMs();
+  std::thread submitter([&] {
+    for (int i = 0; i < queries; ++i) {
+      std::string name = i % 2 ? "root" : "nobody";
+      client.query(
+          "SELECT username, password FROM user WHERE username='" + name +
+              "' LIMIT 1",
+          [&](SqlResult &result) {
+            found += result.ok && result.rows.size() == 1;
+            done++;
+          });
+    }
+  });
+  RunLoop(epoller, client, [&] { return done == queries; });
+  submitter.join();
+  int64_t cost = NowMs() - begin;
+  printf("%d queries, %d connections, %dms latency: %ldms (serial %dms)\n",
+         queries, conns, latency, cost, queries * latency);
+  Check(done == queries && found == queries / 2, "all queries answered");
+  Check(mock_mysql_max_inflight() == conns, "queries run concurrently");
+  Check(cost < queries * latency / 2, "faster than one connection");
+
+  Check(VerifyAsync(epoller, client, "/login", "root", "123456") ==
+            "/welcome.html",
+        "login with correct password");
+  Check(VerifyAsync(epoller, client, "/login", "root", "bad") ==
+            "/error.html",
+        "login with wrong password");
+  Check(VerifyAsync(epoller, client, "/login", "ghost", "123") ==
+            "/error.html",
+        "login unknown user");
+  // query_count包括prepare，只统计执行的语句
+  auto executed = [] {
+    return mock_mysql_query_count() - mock_mysql_prepare_count();
+  };
+  int before = executed();
+  Check(VerifyAsync(epoller, client, "/register", "alice", "pw") ==
+                "/welcome.html" &&
+            executed() == before + 2,
+        "register new user (select + insert)");
+  Check(VerifyAsync(epoller, client, "/register", "alice", "pw") ==
+            "/error.html",
+        "register existing user");
+  Check(VerifyAsync(epoller, client, "/login", "alice", "pw") ==
+            "/welcome.html",
+        "login registered user");
+  // 参数原样绑定，引号和反斜杠不需要转义
+  std::string odd = "o'neil\\\" --";
+  bool inserted = false, selected = false, finished = false;
+  client.execute(MysqlUserStore::INSERT_USER_STMT, {odd, "p'w"},
+                 [&](SqlResult &result) {
+                   inserted = result.ok && result.affected_rows == 1;
+                   client.execute(MysqlUserStore::SELECT_USER_STMT, {odd},
+                                  [&](SqlResult &result) {
+                                    selected = result.ok &&
+                                               result.rows.size() == 1 &&
+                                               result.rows[0][0] == odd &&
+                                               result.rows[0][1] == "p'w";
+                                    finished = true;
+                                  });
+                 });
+  RunLoop(epoller, client, [&] { return finished; });
+  std::string stored;
+  Check(inserted && selected && mock_mysql_get_user(odd.c_str(), &stored) &&
+            stored == "p'w",
+        "statement parameters are bound, not escaped");
+  int prepares = mock_mysql_prepare_count();
+  for (int i = 0; i < conns * 4; ++i) {
+    VerifyAsync(epoller, client, "/login", "root", "123456");
+  }
+  Check(mock_mysql_prepare_count() == prepares,
+        "statements prepared once per connection");
+  mock_mysql_reset_statements();
+  Check(VerifyAsync(epoller, client, "/login", "root", "123456") ==
+                "/welcome.html" &&
+            mock_mysql_prepare_count() == prepares + 1,
+        "statement re-prepared after server reset");
+
+  // 服务端断开所有连接，客户端应在1s后重连
+  mock_mysql_drop_connections();
+  RunLoop(epoller, client, [&] { return client.readyCount() == 0; }, 1000);
+  Check(client.readyCount() == 0, "connections dropped detected");
+  RunLoop(epoller, client, [&] { return client.readyCount() == conns; });
+  Check(client.readyCount() == conns, "reconnected");
+  Check(VerifyAsync(epoller, client, "/login", "root", "123456") ==
+            "/welcome.html",
+        "login after reconnect");
+
+  // 数据库挂起：占满所有连接的查询和排队的查询都应在期限内失败
+  mock_mysql_set_stall(true);
+  int stalled = conns * 2;
+  done = 0;
+  int failed = 0;
+  begin = NowMs();
+  for (int i = 0; i < stalled; ++i) {
+    client.query("SELECT username, password FROM user WHERE username='root'",
+                 [&](SqlResult &result) {
+                   failed += !result.ok;
+                   done++;
+                 });
+  }
+  RunLoop(epoller, client, [&] { return done == stalled; });
+  cost = NowMs() - begin;
+  printf("%d stalled queries failed after %ldms\n", stalled, cost);
+  Check(done == stalled && failed == stalled, "stalled queries fail");
+  // 排队的查询等到1s后重连的握手也超时才失败
+  Check(cost >= timeout && cost < timeout * 2 + 1000 + 500,
+        "stalled queries fail near the timeout");
+  Check(client.readyCount() == 0, "stalled connections closed");
+  mock_mysql_set_stall(false);
+  RunLoop(epoller, client, [&] { return client.readyCount() == conns; });
+  Check(client.readyCount() == conns, "reconnected after stall");
+  Check(VerifyAsync(epoller, client, "/login", "root", "123456") ==
+            "/welcome.html",
+        "login after stall");
+
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+// BoundQueue吞吐量与延迟基准测试，以互斥锁队列为对照
+// 吞吐量：P个生产者、C个消费者忙等收发固定数量的元素
+// 延迟：单生产者单消费者，元素携带入队时间，统计出队时的延迟分位数
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../code/pool/threadpool.hpp"
+
+using SteadyClock = std::chrono::steady_clock;
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             SteadyClock::now().time_since_epoch())
+      .count();
+}
+
+// 对照组：std::mutex保护的有界队列
+template <typename T>
+class MutexQueue {
+ public:
+  bool Init(uint64_t size) {
+    capacity_ = size;
+    return true;
+  }
+  bool Enqueue(const T &element) {
+    std::lock_guard lck(mtx_);
+    if (deq_.size() >= capacity_) {
+      return false;
+    }
+    deq_.push_back(element);
+    return true;
+  }
+  bool Dequeue(T *element) {
+    std::lock_guard lck(mtx_);
+    if (deq_.empty()) {
+      return false;
+    }
+    *element = std::move(deq_.front());
+    deq_.pop_front();
+    return true;
+  }
+
+ private:
+  std::mutex mtx_;
+  std::deque<T> deq_;
+  uint64_t capacity_{0};
+};
+
+template <typename Queue>
+static bool InitQueue(Queue &queue, uint64_t size) {
+  return queue.Init(size, new YieldWaitStrategy());
+}
+
+template <>
+bool InitQueue(MutexQueue<int64_t> &queue, uint64_t size) {
+  return queue.Init(size);
+}
+
+template <typename Queue>
+static void Throughput(const char *name, int producers, int consumers,
+                       uint64_t items) {
+  Queue queue;
+  InitQueue(queue, 1024);
+  std::atomic<uint64_t> consumed{0};
+  const uint64_t per_producer = items / producers;
+  const uint64_t total = per_producer * producers;
+
+  int64_t begin = NowNs();
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&] {
+      for (uint64_t i = 0; i < per_producer; ++i) {
+        while (!queue.Enqueue(static_cast<int64_t>(i))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&] {
+      int64_t value = 0;
+      while (consumed.load(std::memory_order_relaxed) < total) {
+        if (queue.Dequeue(&value)) {
+          consumed.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  double seconds = (NowNs() - begin) / 1e9;
+  printf("%-10s P=%d C=%d  %8.2f Mops/s\n", name, producers, consumers,
+         total / seconds / 1e6);
+}
+
+template <typename Queue>
+static void Latency(const char *name, uint64_t items) {
+  Queue queue;
+  InitQueue(queue, 1024);
+  std::vector<int64_t> latency;
+  latency.reserve(items);
+
+  std::thread consumer([&] {
+    int64_t stamp = 0;
+    while (latency.size() < items) {
+      if (queue.Dequeue(&stamp)) {
+        latency.push_back(NowNs() - stamp);
+      }
+    }
+  });
+  for (uint64_t i = 0; i < items; ++i) {
+    while (!queue.Enqueue(NowNs())) {
+      std::this_thread::yield();
+    }
+    // 控制发送速率，测量的是空队列附近的延迟而不是排队时间
+    if (i % 64 == 0) {
+      std::this_thread::yield();
+    }
+  }
+  consumer.join();
+
+  std::sort(latency.begin(), latency.end());
+  auto pct = [&](double p) {
+    return latency[static_cast<size_t>(p * (latency.size() - 1))];
+  };
+  printf("%-10s p50=%ldns p90=%ldns p99=%ldns p999=%ldns\n", name, pct(0.5),
+         pct(0.9), pct(0.99), pct(0.999));
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t items = argc > 1 ? atoll(argv[1]) : 1000000;
+  const int cases[][2] = {{1, 1}, {2, 2}, {4, 4}, {4, 1}, {1, 4}};
+
+  printf("== throughput (%lu items, capacity 1024)\n", items);
+  for (auto &c : cases) {
+    Throughput<BoundQueue<int64_t, false>>("mod", c[0], c[1], items);
+    Throughput<BoundQueue<int64_t, true>>("pow2", c[0], c[1], items);
+    Throughput<MutexQueue<int64_t>>("mutex", c[0], c[1], items);
+  }
+
+  printf("== latency 1P1C (%lu items)\n", items / 10);
+  Latency<BoundQueue<int64_t, false>>("mod", items / 10);
+  Latency<BoundQueue<int64_t, true>>("pow2", items / 10);
+  Latency<MutexQueue<int64_t>>("mutex", items / 10);
+  return 0;
+}
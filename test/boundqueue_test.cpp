@@ -0,0 +1,143 @@
+// BoundQueue多生产者/多消费者压力测试
+// 每个生产者按顺序写入(producer, seq)，检查：
+//   1. 守恒：每个元素恰好被取出一次，既不丢失也不重复
+//   2. 顺序：同一个消费者看到的同一生产者的seq严格递增(FIFO)
+//   3. Size()始终不超过容量(不会下溢成极大值)
+// 元素携带std::string，槽位被并发读写时更容易暴露问题
+//   ./boundqueue_test [items]
+// 默认元素数按CPU数缩放，单核上也能很快跑完；传入items做长时间压测
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/threadpool.hpp"
+#include "testutil.h"
+
+struct Item {
+  uint32_t producer{0};
+  uint64_t seq{0};
+  std::string payload;
+};
+
+static bool CheckPayload(const Item &item) {
+  return item.payload == std::to_string(item.producer) + ":" +
+                             std::to_string(item.seq) + std::string(24, 'x');
+}
+
+template <bool kPowerOfTwo>
+static void RunCase(int producers, int consumers, uint64_t capacity,
+                    uint64_t per_producer) {
+  BoundQueue<Item, kPowerOfTwo> queue;
+  if (!queue.Init(capacity, new YieldWaitStrategy())) {
+    Check(false, "init");
+    return;
+  }
+
+  const uint64_t total = per_producer * producers;
+  std::vector<std::atomic<uint8_t>> seen(total);
+  for (auto &s : seen) {
+    s.store(0);
+  }
+  std::atomic<uint64_t> consumed{0};
+  std::atomic<bool> ok{true};
+  std::atomic<bool> running{true};
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p] {
+      for (uint64_t i = 0; i < per_producer; ++i) {
+        Item item;
+        item.producer = p;
+        item.seq = i;
+        item.payload = std::to_string(p) + ":" + std::to_string(i) +
+                       std::string(24, 'x');
+        while (!queue.Enqueue(item)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&] {
+      std::vector<int64_t> last(producers, -1);
+      Item item;
+      while (consumed.load() < total) {
+        if (!queue.Dequeue(&item)) {
+          std::this_thread::yield();
+          continue;
+        }
+        consumed.fetch_add(1);
+        if (item.producer >= static_cast<uint32_t>(producers) ||
+            item.seq >= per_producer || !CheckPayload(item)) {
+          printf("  corrupted item p=%u seq=%lu\n", item.producer, item.seq);
+          ok = false;
+          continue;
+        }
+        if (static_cast<int64_t>(item.seq) <= last[item.producer]) {
+          printf("  order violation p=%u seq=%lu after %ld\n", item.producer,
+                 item.seq, last[item.producer]);
+          ok = false;
+        }
+        last[item.producer] = item.seq;
+        if (seen[item.producer * per_producer + item.seq].fetch_add(1) != 0) {
+          printf("  duplicate p=%u seq=%lu\n", item.producer, item.seq);
+          ok = false;
+        }
+      }
+    });
+  }
+  // 监控Size()
+  std::thread monitor([&] {
+    while (running.load()) {
+      uint64_t size = queue.Size();
+      if (size > queue.Capacity()) {
+        printf("  Size() out of range: %lu\n", size);
+        ok = false;
+      }
+      std::this_thread::yield();
+    }
+  });
+
+  for (auto &t : threads) {
+    t.join();
+  }
+  running = false;
+  monitor.join();
+
+  for (uint64_t i = 0; i < total; ++i) {
+    if (seen[i].load() != 1) {
+      printf("  element %lu seen %u times\n", i, seen[i].load());
+      ok = false;
+      break;
+    }
+  }
+  if (!queue.Empty()) {
+    printf("  queue not empty after drain: %lu\n", queue.Size());
+    ok = false;
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "%-4s P=%d C=%d capacity=%-4lu items=%lu",
+           kPowerOfTwo ? "pow2" : "mod", producers, consumers, capacity, total);
+  Check(ok, name);
+}
+
+int main(int argc, char *argv[]) {
+  // 线程数多于CPU时生产者和消费者要轮流等待时间片，每核只测5000个
+  unsigned cpus = std::max(std::thread::hardware_concurrency(), 1u);
+  uint64_t items = argc > 1 ? atoll(argv[1]) : std::min(5000u * cpus, 50000u);
+  const int cases[][2] = {{1, 1}, {2, 2}, {4, 4}, {4, 1}, {1, 4}, {8, 8}};
+  const uint64_t capacities[] = {1, 6, 62, 1000};
+
+  for (auto &c : cases) {
+    for (uint64_t capacity : capacities) {
+      RunCase<false>(c[0], c[1], capacity, items / c[0]);
+      RunCase<true>(c[0], c[1], capacity, items / c[0]);
+    }
+  }
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// 协程调度器测试：单个调度线程同时挂起数千个慢请求
+//   1. N对socketpair，写端协程sleep后写入，读端协程co_await可读
+//   2. 从不写入的fd等待超时，co_await结果为false
+//   3. 通过offload把阻塞操作交给小线程池，完成后回到调度线程
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "../code/coro/scheduler.h"
+#include "testutil.h"
+
+static Task<int> Echo(CoScheduler &sched, int fd) {
+  bool ready = co_await sched.readable(fd, 5000);
+  if (!ready) {
+    co_return -1;
+  }
+  char buf[16];
+  co_return static_cast<int>(read(fd, buf, sizeof(buf)));
+}
+
+static Task<void> SlowWriter(CoScheduler &sched, int fd, int delay_ms) {
+  co_await sched.sleep(delay_ms);
+  write(fd, "ping", 4);
+}
+
+static Task<void> SlowReader(CoScheduler &sched, int fd, int *done) {
+  int len = co_await Echo(sched, fd);
+  if (len == 4) {
+    ++*done;
+  }
+}
+
+static Task<void> TimeoutReader(CoScheduler &sched, int fd, int *timeouts) {
+  bool ready = co_await sched.readable(fd, 20);
+  if (!ready) {
+    ++*timeouts;
+  }
+}
+
+static Task<void> Blocking(CoScheduler &sched, ThreadPool &pool,
+                           std::thread::id loop_id, int *done) {
+  auto result = co_await sched.offload(pool, [] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return std::this_thread::get_id();
+  });
+  // 恢复后必须回到调度线程
+  if (result && *result != loop_id && std::this_thread::get_id() == loop_id) {
+    ++*done;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int pairs = argc > 1 ? atoi(argv[1]) : 2000;
+  rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  CoScheduler sched;
+  ThreadPool pool(2, 1024);
+  std::vector<int> fds;
+  int done = 0, timeouts = 0, offloaded = 0;
+  const int blocking = 100;
+
+  for (int i = 0; i < pairs; ++i) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) < 0) {
+      printf("socketpair failed at %d, raise the fd limit\n", i);
+      return 1;
+    }
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+    sched.spawn(SlowReader(sched, sv[0], &done));
+    sched.spawn(SlowWriter(sched, sv[1], 50 + i % 50));
+  }
+  int silent[2];
+  socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, silent);
+  sched.spawn(TimeoutReader(sched, silent[0], &timeouts));
+
+  std::thread::id loop_id = std::this_thread::get_id();
+  for (int i = 0; i < blocking; ++i) {
+    sched.spawn(Blocking(sched, pool, loop_id, &offloaded));
+  }
+
+  // 所有协程结束后停止调度
+  std::function<Task<void>()> watcher = [&]() -> Task<void> {
+    while (done + timeouts < pairs + 1 || offloaded < blocking) {
+      co_await sched.sleep(10);
+    }
+    sched.stop();
+  };
+  int64_t begin = NowMs();
+  sched.spawn(watcher());
+  sched.run();
+  int64_t elapsed = NowMs() - begin;
+
+  for (int fd : fds) {
+    close(fd);
+  }
+  close(silent[0]);
+  close(silent[1]);
+
+  bool ok = done == pairs && timeouts == 1 && offloaded == blocking;
+  printf("slow requests: %d/%d, timeouts: %d, offloaded: %d/%d, %ldms, %s\n",
+         done, pairs, timeouts, offloaded, blocking, elapsed,
+         ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
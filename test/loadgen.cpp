@@ -0,0 +1,578 @@
+// HTTP压测工具：需要先启动服务器(./server <目录>使用进程内用户存储，不依赖MySQL)
+//   ./loadgen [-p port] [-t threads] [-c conns] [-d seconds] [-w warmup]
+//             [-r rate] [-P depth] [-n] [-m mix] [-R resources]
+// -r为0时是闭环：每个连接收到响应后立即发送下一个请求，保持depth个请求在途
+// -r大于0时是开环：按固定速率(所有线程合计，请求/秒)生成请求，没有空闲连接时排队，
+//   延迟从计划发送的时间算起，服务器变慢时排队的时间也计入(修正coordinated omission)
+// -n使用短连接，每个请求新建连接；-P为长连接上的pipeline深度
+// -m为请求的比例，如static:90,login:5,register:5；static在-R目录下的文件中随机选择
+// 结果以JSON输出到stdout，摘要输出到stderr
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../code/log/metrics.h"
+
+static int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct Config {
+  int port{10000};
+  int threads{2};
+  int conns{64};
+  double seconds{10};
+  double warmup{1};
+  double rate{0};  // 0为闭环
+  int depth{1};
+  bool keepalive{true};
+  std::string mix{"static:90,login:5,register:5"};
+  std::string resources{"./resources"};
+};
+
+enum Kind { STATIC, LOGIN, REGISTER, KINDS };
+static const char *kKindName[] = {"static", "login", "register"};
+
+// 一个线程的统计，结束后合并
+struct Result {
+  Metrics::Histogram latency{};  // 从计划发送的时间算起(us)
+  Metrics::Histogram service{};  // 从实际发送的时间算起(us)
+  uint64_t max_us{0};
+  uint64_t service_max_us{0};
+  uint64_t requests{0};
+  uint64_t bytes{0};
+  uint64_t status[6]{};  // 按状态码的类别，下标为code / 100
+  uint64_t kinds[KINDS]{};
+  uint64_t connect_errors{0};
+  uint64_t io_errors{0};  // 响应未收完连接就断开
+  uint64_t backlog{0};    // 开环结束时仍在排队的请求
+
+  void merge(const Result &other) {
+    for (int i = 0; i < Metrics::BUCKETS; ++i) {
+      latency.counts[i] += other.latency.counts[i];
+      service.counts[i] += other.service.counts[i];
+    }
+    latency.count += other.latency.count;
+    latency.sum += other.latency.sum;
+    service.count += other.service.count;
+    service.sum += other.service.sum;
+    max_us = std::max(max_us, other.max_us);
+    service_max_us = std::max(service_max_us, other.service_max_us);
+    requests += other.requests;
+    bytes += other.bytes;
+    for (int i = 0; i < 6; ++i) {
+      status[i] += other.status[i];
+    }
+    for (int i = 0; i < KINDS; ++i) {
+      kinds[i] += other.kinds[i];
+    }
+    connect_errors += other.connect_errors;
+    io_errors += other.io_errors;
+    backlog += other.backlog;
+  }
+};
+
+class Worker {
+ public:
+  Worker(const Config &config, const std::vector<std::string> &files,
+         const std::vector<std::pair<Kind, int>> &mix, int id, int conns)
+      : config_(config), files_(files), mix_(mix), id_(id), rng_(id) {
+    conns_.resize(conns);
+    for (auto &item : mix_) {
+      total_weight_ += item.second;
+    }
+  }
+
+  // begin_us之后开始记录，end_us停止发送新请求
+  void run(int64_t begin_us, int64_t end_us);
+  const Result &result() const { return result_; }
+
+ private:
+  struct Pending {
+    int64_t intended_us;
+    int64_t sent_us;
+    Kind kind;
+  };
+  struct Conn {
+    int fd{-1};
+    std::string out;
+    std::string in;  // 未解析完的响应头
+    int64_t body_left{0};
+    int status{0};
+    bool want_write{false};
+    bool connected{false};  // 发出过数据，之前失败算连接错误
+    std::deque<Pending> inflight;
+  };
+
+  Kind pickKind();
+  std::string buildRequest(Kind kind);
+  bool open(Conn &conn);
+  void closeConn(Conn &conn, bool error);
+  void send(Conn &conn, int64_t intended_us);
+  void flush(Conn &conn);
+  void onReadable(Conn &conn);
+  void complete(Conn &conn);
+  void updateEvents(Conn &conn);
+
+  const Config &config_;
+  const std::vector<std::string> &files_;
+  const std::vector<std::pair<Kind, int>> &mix_;
+  int total_weight_{0};
+  int id_;
+  std::mt19937 rng_;
+  uint64_t registered_{0};
+  int epfd_{-1};
+  std::vector<Conn> conns_;
+  int64_t record_from_us_{0};
+  Result result_;
+};
+
+Kind Worker::pickKind() {
+  int value = rng_() % total_weight_;
+  for (auto &item : mix_) {
+    if (value < item.second) {
+      return item.first;
+    }
+    value -= item.second;
+  }
+  return STATIC;
+}
+
+std::string Worker::buildRequest(Kind kind) {
+  const char *connection = config_.keepalive ? "keep-alive" : "close";
+  if (kind == STATIC) {
+    return "GET " + files_[rng_() % files_.size()] +
+           " HTTP/1.1\r\nHost: localhost\r\nConnection: " + connection +
+           "\r\n\r\n";
+  }
+  // 注册使用不重复的用户名，登录总是同一个用户(是否存在不影响压测)
+  std::string body =
+      kind == LOGIN ? "username=bench&password=bench"
+                    : "username=bench_" + std::to_string(getpid()) + "_" +
+                          std::to_string(id_) + "_" +
+                          std::to_string(registered_++) + "&password=bench";
+  return std::string("POST ") +
+         (kind == LOGIN ? "/login.html" : "/register.html") +
+         " HTTP/1.1\r\nHost: localhost\r\nConnection: " + connection +
+         "\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+         "Content-Length: " +
+         std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+bool Worker::open(Conn &conn) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(config_.port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (fd < 0 || (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0 &&
+                 errno != EINPROGRESS)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    result_.connect_errors++;
+    return false;
+  }
+  // 连接建立后可写，请求在EPOLLOUT时发出
+  conn.fd = fd;
+  conn.want_write = true;
+  conn.connected = false;
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = &conn;
+  epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &event);
+  return true;
+}
+
+void Worker::closeConn(Conn &conn, bool error) {
+  if (conn.fd >= 0) {
+    close(conn.fd);
+    conn.fd = -1;
+  }
+  if (error && !conn.connected) {
+    result_.connect_errors++;
+  } else if (error && !conn.inflight.empty()) {
+    result_.io_errors += conn.inflight.size();
+  }
+  conn.inflight.clear();
+  conn.out.clear();
+  conn.in.clear();
+  conn.body_left = 0;
+  conn.status = 0;
+}
+
+void Worker::send(Conn &conn, int64_t intended_us) {
+  if (conn.fd < 0 && !open(conn)) {
+    return;
+  }
+  Kind kind = pickKind();
+  conn.out += buildRequest(kind);
+  conn.inflight.push_back({intended_us, NowUs(), kind});
+  if (!conn.want_write) {
+    flush(conn);
+  }
+}
+
+void Worker::flush(Conn &conn) {
+  while (!conn.out.empty()) {
+    ssize_t len = ::send(conn.fd, conn.out.data(), conn.out.size(),
+                         MSG_NOSIGNAL);
+    if (len < 0) {
+      if (errno != EAGAIN) {
+        closeConn(conn, true);
+        return;
+      }
+      break;
+    }
+    conn.connected = true;
+    conn.out.erase(0, len);
+  }
+  updateEvents(conn);
+}
+
+void Worker::updateEvents(Conn &conn) {
+  bool want_write = !conn.out.empty();
+  if (want_write == conn.want_write) {
+    return;
+  }
+  conn.want_write = want_write;
+  epoll_event event{};
+  event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+  event.data.ptr = &conn;
+  epoll_ctl(epfd_, EPOLL_CTL_MOD, conn.fd, &event);
+}
+
+void Worker::onReadable(Conn &conn) {
+  static thread_local char buf[65536];
+  while (conn.fd >= 0) {
+    ssize_t len = recv(conn.fd, buf, sizeof(buf), 0);
+    if (len == 0 || (len < 0 && errno != EAGAIN)) {
+      closeConn(conn, true);
+      return;
+    }
+    if (len < 0) {
+      return;
+    }
+    result_.bytes += len;
+    const char *data = buf;
+    size_t left = len;
+    while (left > 0 && conn.fd >= 0) {
+      if (conn.body_left > 0) {
+        // 响应体只计数，不保存
+        size_t skip = std::min<size_t>(left, conn.body_left);
+        conn.body_left -= skip;
+        data += skip;
+        left -= skip;
+        if (conn.body_left == 0) {
+          complete(conn);
+        }
+        continue;
+      }
+      conn.in.append(data, left);
+      left = 0;
+      // 响应头收齐后解析状态码和长度，剩下的数据交给下一轮处理
+      size_t end;
+      while (conn.fd >= 0 &&
+             (end = conn.in.find("\r\n\r\n")) != std::string::npos) {
+        conn.status = atoi(conn.in.c_str() + 9);
+        int64_t length = 0;
+        auto it = std::search(
+            conn.in.begin(), conn.in.begin() + end, "\r\ncontent-length:",
+            "\r\ncontent-length:" + 17,
+            [](char a, char b) { return tolower(a) == b; });
+        if (it != conn.in.begin() + end) {
+          length = strtoll(&*it + 17, nullptr, 10);
+        }
+        size_t body = conn.in.size() - end - 4;
+        if (static_cast<int64_t>(body) >= length) {
+          conn.in.erase(0, end + 4 + length);
+          complete(conn);
+        } else {
+          conn.body_left = length - body;
+          conn.in.clear();
+          break;
+        }
+      }
+    }
+  }
+}
+
+void Worker::complete(Conn &conn) {
+  if (conn.inflight.empty()) {
+    closeConn(conn, true);
+    return;
+  }
+  Pending pending = conn.inflight.front();
+  conn.inflight.pop_front();
+  int64_t now = NowUs();
+  if (pending.intended_us >= record_from_us_) {
+    uint64_t latency = std::max<int64_t>(now - pending.intended_us, 0);
+    uint64_t service = std::max<int64_t>(now - pending.sent_us, 0);
+    result_.latency.counts[Metrics::bucketOf(latency)]++;
+    result_.latency.count++;
+    result_.latency.sum += latency;
+    result_.service.counts[Metrics::bucketOf(service)]++;
+    result_.service.count++;
+    result_.service.sum += service;
+    result_.max_us = std::max(result_.max_us, latency);
+    result_.service_max_us = std::max(result_.service_max_us, service);
+    result_.requests++;
+    result_.status[std::min(std::max(conn.status / 100, 0), 5)]++;
+    result_.kinds[pending.kind]++;
+  }
+  if (!config_.keepalive) {
+    closeConn(conn, false);
+  }
+}
+
+void Worker::run(int64_t begin_us, int64_t end_us) {
+  epfd_ = epoll_create1(EPOLL_CLOEXEC);
+  record_from_us_ = begin_us;
+  bool open_loop = config_.rate > 0;
+  int depth = config_.keepalive ? config_.depth : 1;
+  // 开环时每个线程承担总速率的1/threads
+  double interval_us = open_loop ? 1e6 * config_.threads / config_.rate : 0;
+  double next_us = NowUs();
+  std::deque<int64_t> backlog;
+  std::vector<epoll_event> events(conns_.size() + 1);
+  while (true) {
+    int64_t now = NowUs();
+    if (now >= end_us) {
+      break;
+    }
+    if (open_loop) {
+      while (next_us <= now) {
+        backlog.push_back(static_cast<int64_t>(next_us));
+        next_us += interval_us;
+      }
+    }
+    for (auto &conn : conns_) {
+      while (static_cast<int>(conn.inflight.size()) < depth &&
+             (!open_loop || !backlog.empty())) {
+        size_t before = conn.inflight.size();
+        if (open_loop) {
+          send(conn, backlog.front());
+          backlog.pop_front();
+        } else {
+          send(conn, NowUs());
+        }
+        if (conn.inflight.size() == before) {
+          break;  // 连接失败
+        }
+      }
+    }
+    // 开环时在下一个请求的计划时间醒来，最迟在结束时醒来
+    int64_t timeout_us = open_loop ? next_us - NowUs() : 100000;
+    timeout_us = std::max<int64_t>(std::min(timeout_us, end_us - now), 0);
+    int count = epoll_wait(epfd_, events.data(), events.size(),
+                           (timeout_us + 999) / 1000);
+    for (int i = 0; i < count; ++i) {
+      Conn &conn = *static_cast<Conn *>(events[i].data.ptr);
+      if (conn.fd < 0) {
+        continue;
+      }
+      if (events[i].events & EPOLLIN) {
+        onReadable(conn);
+      } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        closeConn(conn, true);
+      }
+      if (conn.fd >= 0 && (events[i].events & EPOLLOUT)) {
+        flush(conn);
+      }
+    }
+  }
+  result_.backlog = backlog.size();
+  for (auto &conn : conns_) {
+    closeConn(conn, false);
+  }
+  close(epfd_);
+}
+
+static bool ParseMix(const std::string &text,
+                     std::vector<std::pair<Kind, int>> *mix) {
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t comma = text.find(',', pos);
+    std::string item = text.substr(pos, comma - pos);
+    pos = comma == std::string::npos ? text.size() : comma + 1;
+    size_t colon = item.find(':');
+    std::string name = item.substr(0, colon);
+    int weight =
+        colon == std::string::npos ? 1 : atoi(item.c_str() + colon + 1);
+    int kind = 0;
+    while (kind < KINDS && name != kKindName[kind]) {
+      ++kind;
+    }
+    if (kind == KINDS || weight < 0) {
+      return false;
+    }
+    if (weight > 0) {
+      mix->emplace_back(static_cast<Kind>(kind), weight);
+    }
+  }
+  return !mix->empty();
+}
+
+// 目录下的所有文件，返回请求路径
+static std::vector<std::string> ListFiles(const std::string &dir) {
+  std::vector<std::string> files;
+  std::error_code ec;
+  std::filesystem::recursive_directory_iterator it(dir, ec), end;
+  for (; !ec && it != end; it.increment(ec)) {
+    if (it->is_regular_file(ec)) {
+      files.push_back(
+          "/" + std::filesystem::relative(it->path(), dir, ec).string());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+static void PrintLatency(FILE *fp, const char *name,
+                         const Metrics::Histogram &hist, uint64_t max_us) {
+  fprintf(fp,
+          "\"%s\":{\"mean\":%.1f,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,"
+          "\"p999\":%lu,\"max\":%lu}",
+          name, hist.count ? hist.sum * 1.0 / hist.count : 0.0,
+          hist.quantile(0.5), hist.quantile(0.9), hist.quantile(0.99),
+          hist.quantile(0.999), max_us);
+}
+
+int main(int argc, char *argv[]) {
+  Config config;
+  int opt;
+  while ((opt = getopt(argc, argv, "p:t:c:d:w:r:P:nm:R:")) != -1) {
+    switch (opt) {
+      case 'p':
+        config.port = atoi(optarg);
+        break;
+      case 't':
+        config.threads = std::max(atoi(optarg), 1);
+        break;
+      case 'c':
+        config.conns = std::max(atoi(optarg), 1);
+        break;
+      case 'd':
+        config.seconds = atof(optarg);
+        break;
+      case 'w':
+        config.warmup = atof(optarg);
+        break;
+      case 'r':
+        config.rate = atof(optarg);
+        break;
+      case 'P':
+        config.depth = std::max(atoi(optarg), 1);
+        break;
+      case 'n':
+        config.keepalive = false;
+        break;
+      case 'm':
+        config.mix = optarg;
+        break;
+      case 'R':
+        config.resources = optarg;
+        break;
+      default:
+        fprintf(stderr,
+                "usage: %s [-p port] [-t threads] [-c conns] [-d seconds] "
+                "[-w warmup] [-r rate] [-P depth] [-n] [-m mix] "
+                "[-R resources]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  std::vector<std::pair<Kind, int>> mix;
+  if (!ParseMix(config.mix, &mix)) {
+    fprintf(stderr, "bad mix: %s\n", config.mix.c_str());
+    return 2;
+  }
+  std::vector<std::string> files = ListFiles(config.resources);
+  if (files.empty()) {
+    fprintf(stderr, "no files under %s\n", config.resources.c_str());
+    return 2;
+  }
+  config.threads = std::min(config.threads, config.conns);
+
+  rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (int t = 0; t < config.threads; ++t) {
+    int conns = config.conns / config.threads +
+                (t < config.conns % config.threads ? 1 : 0);
+    workers.push_back(std::make_unique<Worker>(config, files, mix, t, conns));
+  }
+  int64_t begin_us = NowUs() + static_cast<int64_t>(config.warmup * 1e6);
+  int64_t end_us = begin_us + static_cast<int64_t>(config.seconds * 1e6);
+  std::vector<std::thread> threads;
+  for (auto &worker : workers) {
+    threads.emplace_back([&worker, begin_us, end_us] {
+      worker->run(begin_us, end_us);
+    });
+  }
+  Result total;
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+    total.merge(workers[t]->result());
+  }
+
+  double seconds = (end_us - begin_us) / 1e6;
+  printf("{\"mode\":\"%s\",\"keepalive\":%s,\"threads\":%d,\"connections\":%d,"
+         "\"depth\":%d,\"target_rate\":%.1f,\"duration_s\":%.3f,",
+         config.rate > 0 ? "open" : "closed",
+         config.keepalive ? "true" : "false", config.threads, config.conns,
+         config.keepalive ? config.depth : 1, config.rate, seconds);
+  printf("\"requests\":%lu,\"throughput_rps\":%.1f,\"bytes_per_s\":%.0f,",
+         total.requests, total.requests / seconds, total.bytes / seconds);
+  printf("\"status\":{\"1xx\":%lu,\"2xx\":%lu,\"3xx\":%lu,\"4xx\":%lu,"
+         "\"5xx\":%lu,\"other\":%lu},",
+         total.status[1], total.status[2], total.status[3], total.status[4],
+         total.status[5], total.status[0]);
+  printf("\"mix\":{");
+  for (int i = 0; i < KINDS; ++i) {
+    printf("%s\"%s\":%lu", i ? "," : "", kKindName[i], total.kinds[i]);
+  }
+  printf("},\"errors\":{\"connect\":%lu,\"io\":%lu,\"backlog\":%lu},",
+         total.connect_errors, total.io_errors, total.backlog);
+  printf("\"latency_us\":{");
+  PrintLatency(stdout, "corrected", total.latency, total.max_us);
+  printf(",");
+  PrintLatency(stdout, "service", total.service, total.service_max_us);
+  printf("}}\n");
+
+  fprintf(stderr,
+          "%s loop, %d threads, %d conns: %.0f req/s, p50 %luus, "
+          "p99 %luus, p999 %luus, errors %lu\n",
+          config.rate > 0 ? "open" : "closed", config.threads, config.conns,
+          total.requests / seconds, total.latency.quantile(0.5),
+          total.latency.quantile(0.99), total.latency.quantile(0.999),
+          total.connect_errors + total.io_errors);
+  return total.requests > 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// 日志基准测试：多个线程同时写INFO日志，统计每行在调用线程上的平均耗时
+// 同时测量级别不足时被过滤的DEBUG日志、被限流的日志以及二进制模式的开销，
+// 结束后检查写入文件的行数/记录数
+//   ./log_bench [threads] [lines_per_thread]
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../code/log/log.h"
+
+using SteadyClock = std::chrono::steady_clock;
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             SteadyClock::now().time_since_epoch())
+      .count();
+}
+
+static size_t CountLines(const char *dir) {
+  std::string cmd = std::string("cat ") + dir + "/*.log | wc -l";
+  FILE *pipe = popen(cmd.c_str(), "r");
+  size_t lines = 0;
+  if (pipe) {
+    fscanf(pipe, "%zu", &lines);
+    pclose(pipe);
+  }
+  return lines;
+}
+
+// 统计二进制日志中的日志记录数，不含调用点定义
+static size_t CountRecords(const char *dir) {
+  std::string cmd = std::string("ls ") + dir + "/*.log";
+  FILE *pipe = popen(cmd.c_str(), "r");
+  size_t records = 0;
+  char name[256];
+  while (pipe && fscanf(pipe, "%255s", name) == 1) {
+    // 每个文件以FILE_MAGIC开头
+    FILE *fp = fopen(name, "rb");
+    if (fp == nullptr || fseek(fp, sizeof(logfmt::FILE_MAGIC), SEEK_SET) != 0) {
+      continue;
+    }
+    logfmt::RecordHeader header;
+    while (fread(&header, sizeof(header), 1, fp) == 1) {
+      if (!(header.site & logfmt::SITE_DEFINE)) {
+        ++records;
+      }
+      fseek(fp, header.size, SEEK_CUR);
+    }
+    fclose(fp);
+  }
+  if (pipe) {
+    pclose(pipe);
+  }
+  return records;
+}
+
+// 统计限流汇总的行数和其中报告的条数
+static void CountSuppressed(const char *dir, size_t *lines, size_t *total) {
+  std::string cmd = std::string("grep -h 'messages suppressed' ") + dir +
+                    "/*.log | awk '{s+=$(NF-2)} END {print NR, s+0}'";
+  FILE *pipe = popen(cmd.c_str(), "r");
+  *lines = *total = 0;
+  if (pipe) {
+    fscanf(pipe, "%zu %zu", lines, total);
+    pclose(pipe);
+  }
+}
+
+static double RunThreads(int threads, int lines, bool enabled) {
+  std::vector<std::thread> workers;
+  std::vector<int64_t> cost(threads);
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([t, lines, enabled, &cost] {
+      int64_t begin = NowNs();
+      for (int i = 0; i < lines; ++i) {
+        if (enabled) {
+          LOG_INFO("client[%d](%s:%d) in, userCount:%d", i, "127.0.0.1",
+                   40000 + t, i & 1023);
+        } else {
+          LOG_DEBUG("client[%d](%s:%d) in, userCount:%d", i, "127.0.0.1",
+                    40000 + t, i & 1023);
+        }
+      }
+      cost[t] = NowNs() - begin;
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  int64_t total = 0;
+  for (int64_t c : cost) {
+    total += c;
+  }
+  return double(total) / threads / lines;
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  int lines = argc > 2 ? atoi(argv[2]) : 200000;
+  const char *dir = "./log_bench.out";
+  const char *bin_dir = "./log_bench_bin.out";
+  system("rm -rf ./log_bench.out ./log_bench_bin.out");
+
+  // 同步模式作为对照，写入的行数少一些；先关闭限流，测量完整的写入开销
+  Log::instance()->setRateLimit(0, 0);
+  Log::instance()->init(1, dir, ".log", 0);
+  int sync_lines = std::max(lines / 20, 1);
+  double sync_ns = RunThreads(threads, sync_lines, true);
+  printf("sync   INFO  : %7.1f ns/line\n", sync_ns);
+
+  Log::instance()->init(1, dir, ".log", 4096);
+  double async_ns = RunThreads(threads, lines, true);
+  Log::instance()->flush();
+  printf("async  INFO  : %7.1f ns/line, dropped %lu\n", async_ns,
+         Log::instance()->dropped());
+  double off_ns = RunThreads(threads, lines, false);
+  printf("level  DEBUG : %7.1f ns/line (filtered)\n", off_ns);
+
+  size_t expected = size_t(threads) * (sync_lines + lines) -
+                    Log::instance()->dropped();
+  size_t written = CountLines(dir);
+  bool ok = written == expected;
+  printf("lines written %zu, expected %zu, %s\n", written, expected,
+         ok ? "PASS" : "FAIL");
+
+  // 同一调用点持续刷屏时只放行突发量和限定速率，其余只计数
+  Log::instance()->setRateLimit(100, 1000);
+  uint64_t dropped = Log::instance()->dropped();
+  double limited_ns = RunThreads(threads, lines, true);
+  // 等待日志线程定时报告剩余的限流条数
+  std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+  Log::instance()->flush();
+  uint64_t suppressed = Log::instance()->suppressed();
+  printf("limit  INFO  : %7.1f ns/line, suppressed %lu\n", limited_ns,
+         suppressed);
+  size_t summary_lines = 0;
+  size_t reported = 0;
+  CountSuppressed(dir, &summary_lines, &reported);
+  size_t admitted = CountLines(dir) - written - summary_lines;
+  dropped = Log::instance()->dropped() - dropped;
+  bool limit_ok = reported == suppressed &&
+                  admitted + suppressed + dropped == size_t(threads) * lines;
+  printf("admitted %zu, summaries %zu reporting %zu, %s\n", admitted,
+         summary_lines, reported, limit_ok ? "PASS" : "FAIL");
+  ok = ok && limit_ok;
+  Log::instance()->setRateLimit(0, 0);
+
+  // 二进制模式：日志线程也不做格式化，由logdecode离线还原
+  dropped = Log::instance()->dropped();
+  Log::instance()->init(1, bin_dir, ".log", 4096, true);
+  double bin_ns = RunThreads(threads, lines, true);
+  Log::instance()->flush();
+  dropped = Log::instance()->dropped() - dropped;
+  printf("binary INFO  : %7.1f ns/line, dropped %lu\n", bin_ns, dropped);
+  expected = size_t(threads) * lines - dropped;
+  written = CountRecords(bin_dir);
+  bool bin_ok = written == expected;
+  printf("records written %zu, expected %zu, %s\n", written, expected,
+         bin_ok ? "PASS" : "FAIL");
+  ok = ok && bin_ok;
+  system("rm -rf ./log_bench.out ./log_bench_bin.out");
+  return ok ? 0 : 1;
+}
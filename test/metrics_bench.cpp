@@ -0,0 +1,54 @@
+// 运行指标基准测试：1..threads个线程记录计数和耗时的开销，
+// 与所有线程共享一个原子计数器(fetch_add)对比
+//   ./metrics_bench [threads] [iterations]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../code/log/metrics.h"
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 每个线程执行iterations次fn，返回平均每次的耗时(ns)
+template <typename Fn>
+static double Run(int threads, int iterations, Fn fn) {
+  std::vector<std::thread> workers;
+  int64_t begin = NowNs();
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&fn, iterations] {
+      for (int i = 0; i < iterations; ++i) {
+        fn(i);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return (NowNs() - begin) * 1.0 / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  int iterations = argc > 2 ? atoi(argv[2]) : 10000000;
+  alignas(64) std::atomic<uint64_t> shared{0};
+  for (int n = 1; n <= threads; n *= 2) {
+    double add =
+        Run(n, iterations, [](int) { Metrics::add(Metrics::REQUESTS); });
+    double record = Run(n, iterations, [](int i) {
+      Metrics::record(Metrics::PARSE, i & 4095);
+    });
+    double atomic = Run(n, iterations, [&shared](int) {
+      shared.fetch_add(1, std::memory_order_relaxed);
+    });
+    printf("%d threads: add %.2fns, record %.2fns, shared fetch_add %.2fns\n",
+           n, add, record, atomic);
+  }
+  return Metrics::instance()->counter(Metrics::REQUESTS) > 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// 运行指标测试
+// 1. 多个线程的计数相加，线程退出后数据块被新线程复用，数值不丢失
+// 2. 分桶的边界连续，分位数的相对误差不超过12.5%
+// 3. render输出计数器、直方图和collector，注销后的collector不再被调用
+// 4. 其他线程记录的同时导出，直方图的累计值单调，+Inf与_count相等
+//   ./metrics_test
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../code/log/metrics.h"
+#include "testutil.h"
+
+static bool Contains(const std::string &text, const std::string &line) {
+  return text.find(line) != std::string::npos;
+}
+
+int main() {
+  Metrics *metrics = Metrics::instance();
+  const int threads = 4, per_thread = 100000;
+  // 第二轮的线程复用第一轮归还的数据块，累加在原来的数值上
+  for (int round = 0; round < 2; ++round) {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+      workers.emplace_back([] {
+        for (int i = 0; i < per_thread; ++i) {
+          Metrics::add(Metrics::REQUESTS);
+          Metrics::record(Metrics::PARSE, i % 1000);
+        }
+        Metrics::add(Metrics::BYTES_SENT, 1000);
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+  Check(metrics->counter(Metrics::REQUESTS) == 2ull * threads * per_thread &&
+            metrics->counter(Metrics::BYTES_SENT) == 2ull * threads * 1000,
+        "counters summed across threads");
+  Check(metrics->histogram(Metrics::PARSE).count ==
+            2ull * threads * per_thread,
+        "histogram count summed");
+  std::string text;
+  Check(metrics->counter(Metrics::ACCEPTS) == 0, "untouched counter is zero");
+
+  bool contiguous = true;
+  for (int b = 1; b < Metrics::BUCKETS - 1; ++b) {
+    uint64_t lower = Metrics::bucketUpper(b - 1);
+    contiguous = contiguous && Metrics::bucketOf(lower) == b &&
+                 Metrics::bucketOf(Metrics::bucketUpper(b) - 1) == b;
+  }
+  Check(contiguous && Metrics::bucketOf(0) == 0 &&
+            Metrics::bucketOf(UINT64_MAX) == Metrics::BUCKETS - 1,
+        "bucket boundaries contiguous");
+
+  Metrics::Histogram hist{};
+  std::mt19937_64 rng(1);
+  std::vector<uint64_t> values;
+  for (int i = 0; i < 100000; ++i) {
+    // 对数均匀分布在1us到10s之间
+    uint64_t us = std::exp(std::uniform_real_distribution<>(0, 23)(rng));
+    values.push_back(us);
+    hist.counts[Metrics::bucketOf(us)]++;
+    hist.count++;
+  }
+  std::sort(values.begin(), values.end());
+  double worst = 0;
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    double exact = values[std::ceil(q * values.size()) - 1];
+    worst = std::max(worst, std::abs(hist.quantile(q) - exact) / exact);
+  }
+  printf("worst quantile error %.2f%%\n", worst * 100);
+  Check(worst <= 0.125, "quantile error within 12.5%");
+
+  Metrics::record(Metrics::DB, 3000);
+  int calls = 0;
+  int id = metrics->addCollector([&calls](std::string &out) {
+    calls++;
+    Metrics::family(out, "test_gauge", "gauge", "A test gauge.");
+    Metrics::sample(out, "test_gauge", "kind=\"a\"", 1.5);
+  });
+  text = metrics->render();
+  Check(Contains(text, "# TYPE webserver_requests_total counter\n") &&
+            Contains(text, "webserver_requests_total 800000\n"),
+        "counter rendered");
+  Check(Contains(text,
+                 "webserver_stage_seconds_bucket{stage=\"db\",le=\"0.002048\"}"
+                 " 0\n") &&
+            Contains(text,
+                     "webserver_stage_seconds_bucket{stage=\"db\","
+                     "le=\"0.004096\"} 1\n") &&
+            Contains(text, "webserver_stage_seconds_count{stage=\"db\"} 1\n") &&
+            Contains(text, "webserver_stage_seconds_sum{stage=\"db\"} 0.003\n"),
+        "histogram rendered cumulatively");
+  Check(Contains(text, "test_gauge{kind=\"a\"} 1.5\n") && calls == 1,
+        "collector called");
+  metrics->removeCollector(id);
+  text = metrics->render();
+  Check(!Contains(text, "test_gauge") && calls == 1, "removed collector");
+
+  // 导出与记录并发，每次导出的桶都要单调且不超过+Inf
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; ++t) {
+    writers.emplace_back([&stop, t] {
+      for (uint64_t i = t; !stop; ++i) {
+        Metrics::record(Metrics::WRITE, i * 7919 % 100000);
+      }
+    });
+  }
+  const std::string bucket = "webserver_stage_seconds_bucket{stage=\"write\"";
+  const std::string count = "webserver_stage_seconds_count{stage=\"write\"} ";
+  bool monotonic = true;
+  for (int scrape = 0; scrape < 200 && monotonic; ++scrape) {
+    text = metrics->render();
+    uint64_t last = 0;
+    for (size_t pos = text.find(bucket); pos != std::string::npos;
+         pos = text.find(bucket, pos + 1)) {
+      uint64_t value = strtoull(text.c_str() + text.find("} ", pos) + 2,
+                                nullptr, 10);
+      monotonic = monotonic && value >= last;
+      last = value;
+    }
+    size_t pos = text.find(count);
+    monotonic = monotonic && pos != std::string::npos &&
+                strtoull(text.c_str() + pos + count.size(), nullptr, 10) ==
+                    last;
+  }
+  stop = true;
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  Check(monotonic, "concurrent scrape stays monotonic");
+
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,481 @@
+// 核心数据结构的微基准测试，结果写成JSON，可以保存为基线在提交之间比较
+//   ./microbench [-o result.json] [-b baseline.json] [-f filter] [-t ms]
+//                [-r repeats] [-R resources]
+// 每项先倍增迭代次数校准到约t毫秒，再重复repeats次，
+// 取每次操作耗时(ns)的中位数和最小值
+// -b给出基线时输出每项相对基线的变化；-f只运行名字包含filter的项
+// 在仓库根目录运行(HttpResponse读取-R目录下的文件)
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../code/buffer/buffer.h"
+#include "../code/http/request.h"
+#include "../code/http/response.h"
+#include "../code/log/blockqueue.h"
+#include "../code/log/log.h"
+#include "../code/pool/threadpool.hpp"
+#include "../code/utility/timer.h"
+#include "../code/utility/timewheel.h"
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 执行n次操作，返回计时部分的耗时(ns)，准备工作不计入
+using BenchFn = std::function<int64_t(int64_t n)>;
+
+struct Result {
+  std::string name;
+  double ns_per_op;  // 中位数
+  double min_ns_per_op;
+  int64_t iterations;  // 每次重复的操作数
+};
+
+static int g_min_ms = 200;
+static int g_repeats = 5;
+static std::string g_filter;
+static std::vector<Result> g_results;
+
+static void Run(const std::string &name, const BenchFn &fn) {
+  if (name.find(g_filter) == std::string::npos) {
+    return;
+  }
+  // 耗时达到目标的1/16之前倍增，之后按比例估算
+  int64_t n = 1;
+  int64_t target_ns = g_min_ms * 1000000LL;
+  int64_t cost = fn(n);
+  while (cost < target_ns / 16 && n < (1LL << 40)) {
+    n *= 2;
+    cost = fn(n);
+  }
+  n = std::max<int64_t>(n * target_ns / std::max<int64_t>(cost, 1), 1);
+  std::vector<double> samples;
+  for (int i = 0; i < g_repeats; ++i) {
+    samples.push_back(fn(n) * 1.0 / n);
+  }
+  std::sort(samples.begin(), samples.end());
+  Result result{name, samples[samples.size() / 2], samples[0], n};
+  g_results.push_back(result);
+  fprintf(stderr, "%-36s %12.1f ns/op (min %.1f, %ld ops)\n", name.c_str(),
+          result.ns_per_op, result.min_ns_per_op, n);
+}
+
+static void BenchBuffer() {
+  std::string chunk(64, 'x');
+  Run("buffer/append_64B", [&chunk](int64_t n) {
+    Buffer buff;
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      buff.Append(chunk);
+      // 与请求处理一样，写满一个请求的大小后取走
+      if (buff.ReadableBytes() >= 4096) {
+        buff.Retrieve(buff.ReadableBytes());
+      }
+    }
+    return NowNs() - begin;
+  });
+  std::string page(16384, 'y');
+  Run("buffer/append_16KB", [&page](int64_t n) {
+    Buffer buff;
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      buff.Append(page);
+      buff.Retrieve(buff.ReadableBytes());
+    }
+    return NowNs() - begin;
+  });
+  Run("buffer/retrieve_all_1KB", [](int64_t n) {
+    Buffer buff;
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      buff.Append("GET / HTTP/1.1\r\n\r\n", 18);
+      buff.RetrieveAll();
+    }
+    return NowNs() - begin;
+  });
+  // 每次从管道读入一个典型请求大小的数据，包括readv系统调用
+  Run("buffer/read_fd_512B", [](int64_t n) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+      return int64_t(0);
+    }
+    char data[512] = {};
+    Buffer buff;
+    int err = 0;
+    int64_t cost = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      if (write(fds[1], data, sizeof(data)) < 0) {
+        break;
+      }
+      int64_t begin = NowNs();
+      buff.ReadFd(fds[0], &err);
+      buff.Retrieve(buff.ReadableBytes());
+      cost += NowNs() - begin;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return cost;
+  });
+}
+
+static void BenchRequest() {
+  // 浏览器的典型请求头
+  const std::string get =
+      "GET /images/instagram-image1.jpg HTTP/1.1\r\n"
+      "Host: localhost:10000\r\n"
+      "Connection: keep-alive\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+      "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+      "Accept: image/avif,image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+      "Referer: http://localhost:10000/picture.html\r\n"
+      "Accept-Encoding: gzip, deflate, br\r\n"
+      "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+      "Cookie: theme=dark; lang=zh\r\n\r\n";
+  const std::string body = "username=alice&password=secret%21pw";
+  const std::string post =
+      "POST /login.html HTTP/1.1\r\n"
+      "Host: localhost:10000\r\n"
+      "Connection: keep-alive\r\n"
+      "Content-Type: application/x-www-form-urlencoded\r\n"
+      "Origin: http://localhost:10000\r\n"
+      "Referer: http://localhost:10000/login.html\r\n"
+      "Content-Length: " +
+      std::to_string(body.size()) + "\r\n\r\n" + body;
+  for (auto &item : {std::make_pair("request/parse_get_browser", &get),
+                     std::make_pair("request/parse_post_form", &post)}) {
+    const std::string &text = *item.second;
+    Run(item.first, [&text](int64_t n) {
+      HttpRequest request;
+      Buffer buff;
+      int64_t cost = 0;
+      for (int64_t i = 0; i < n; ++i) {
+        buff.Append(text);
+        int64_t begin = NowNs();
+        request.init();
+        request.parse(buff);
+        cost += NowNs() - begin;
+        buff.Retrieve(buff.ReadableBytes());
+      }
+      return cost;
+    });
+  }
+}
+
+static void BenchResponse(const std::string &src_dir) {
+  // 包括stat、open、mmap和munmap
+  Run("response/make_file_index", [&src_dir](int64_t n) {
+    HttpResponse response;
+    Buffer buff;
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      std::string path = "/index.html";
+      response.Init(src_dir, path, true, 200);
+      response.MakeResponse(buff);
+      buff.Retrieve(buff.ReadableBytes());
+      response.UnmapFile();
+    }
+    return NowNs() - begin;
+  });
+  Run("response/make_body", [&src_dir](int64_t n) {
+    HttpResponse response;
+    Buffer buff;
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      std::string path = "/ready";
+      response.Init(src_dir, path, true, 200);
+      response.SetBody("ready\n");
+      response.MakeResponse(buff);
+      buff.Retrieve(buff.ReadableBytes());
+    }
+    return NowNs() - begin;
+  });
+}
+
+// add：向已有scale个定时器的容器中加入新定时器
+// adjust：随机续期已有的定时器(每次读写事件)
+// tick：scale个定时器同时到期，平均每个的处理耗时
+template <typename Timer>
+static void BenchTimer(const char *kind, int scale) {
+  std::string prefix =
+      std::string("timer/") + kind + "/" + std::to_string(scale) + "/";
+  auto fill = [scale](Timer &timer, int timeout) {
+    for (int i = 0; i < scale; ++i) {
+      timer.add(i, timeout + i % 1000, [] {});
+    }
+  };
+  Run(prefix + "add", [&fill, scale](int64_t n) {
+    int64_t cost = 0;
+    for (int64_t done = 0; done < n;) {
+      Timer timer;
+      fill(timer, 60000);
+      int64_t count = std::min<int64_t>(n - done, scale);
+      int64_t begin = NowNs();
+      for (int64_t i = 0; i < count; ++i) {
+        timer.add(scale + i, 60000 + i % 1000, [] {});
+      }
+      cost += NowNs() - begin;
+      done += count;
+    }
+    return cost;
+  });
+  Run(prefix + "adjust", [&fill, scale](int64_t n) {
+    Timer timer;
+    fill(timer, 60000);
+    std::mt19937 rng(1);
+    std::vector<int> ids(std::min<int64_t>(n, 1 << 20));
+    for (auto &id : ids) {
+      id = rng() % scale;
+    }
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      timer.adjust(ids[i % ids.size()], 60000 + i % 1000);
+    }
+    return NowNs() - begin;
+  });
+  Run(prefix + "tick", [&fill, scale](int64_t n) {
+    int64_t cost = 0;
+    for (int64_t done = 0; done < n; done += scale) {
+      Timer timer;
+      fill(timer, -1000);
+      int64_t begin = NowNs();
+      timer.tick();
+      cost += NowNs() - begin;
+    }
+    // 按整轮计数，与n可能略有出入
+    return cost * n / (((n + scale - 1) / scale) * scale);
+  });
+}
+
+// P个生产者和C个消费者收发n个元素，返回总耗时
+// 取到最后一个元素的消费者调用finish，唤醒仍在等待的消费者
+template <typename Push, typename Pop, typename Finish>
+static int64_t ProducerConsumer(int64_t n, int producers, int consumers,
+                                Push push, Pop pop, Finish finish) {
+  std::atomic<int64_t> consumed{0};
+  std::vector<std::thread> threads;
+  int64_t begin = NowNs();
+  for (int p = 0; p < producers; ++p) {
+    int64_t count = n / producers + (p < n % producers ? 1 : 0);
+    threads.emplace_back([count, &push] {
+      for (int64_t i = 0; i < count; ++i) {
+        push(i);
+      }
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([n, &consumed, &pop, &finish] {
+      while (consumed.load(std::memory_order_relaxed) < n) {
+        if (pop() &&
+            consumed.fetch_add(1, std::memory_order_relaxed) == n - 1) {
+          finish();
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return NowNs() - begin;
+}
+
+static void BenchQueues() {
+  for (auto [producers, consumers] : {std::pair(1, 1), std::pair(2, 2)}) {
+    std::string shape = std::to_string(producers) + "p" +
+                        std::to_string(consumers) + "c";
+    // 线程多于CPU时忙等的生产者会等满整个时间片，结果没有意义
+    if (producers + consumers > 2 &&
+        std::thread::hardware_concurrency() <
+            static_cast<unsigned>(producers + consumers)) {
+      fprintf(stderr, "%-36s skipped: %u cpus\n", ("*/" + shape).c_str(),
+              std::thread::hardware_concurrency());
+      continue;
+    }
+    Run("boundqueue/" + shape, [producers = producers,
+                                consumers = consumers](int64_t n) {
+      BoundQueue<int64_t> queue;
+      queue.Init(1024);
+      return ProducerConsumer(
+          n, producers, consumers,
+          [&queue](int64_t i) {
+            while (!queue.Enqueue(i)) {
+              std::this_thread::yield();
+            }
+          },
+          [&queue] {
+            int64_t value;
+            if (queue.Dequeue(&value)) {
+              return true;
+            }
+            std::this_thread::yield();
+            return false;
+          },
+          [] {});
+    });
+    // BlockDeque是日志原来使用的阻塞队列，满或空时在条件变量上等待
+    Run("blockdeque/" + shape, [producers = producers,
+                                consumers = consumers](int64_t n) {
+      BlockDeque<int64_t> queue(1024);
+      return ProducerConsumer(
+          n, producers, consumers,
+          [&queue](int64_t i) { queue.push_back(i); },
+          [&queue] {
+            int64_t value;
+            return queue.pop(value);
+          },
+          [&queue] { queue.close(); });
+    });
+  }
+}
+
+static void BenchLog(const std::string &dir) {
+  Log *log = Log::instance();
+  log->init(1, dir.c_str(), ".log", 1024);
+  log->setRateLimit(0, 0);
+  Run("log/info_async", [](int64_t n) {
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      LOG_INFO("client[%d](%s:%d) in", static_cast<int>(i), "127.0.0.1",
+               40000 + static_cast<int>(i % 1000));
+    }
+    return NowNs() - begin;
+  });
+  Run("log/debug_filtered", [](int64_t n) {
+    int64_t begin = NowNs();
+    for (int64_t i = 0; i < n; ++i) {
+      LOG_DEBUG("filtered %d", static_cast<int>(i));
+    }
+    return NowNs() - begin;
+  });
+  log->flush();
+  fprintf(stderr, "log dropped %lu lines\n", log->dropped());
+}
+
+static void WriteJson(const std::string &path) {
+  FILE *fp = path == "-" ? stdout : fopen(path.c_str(), "w");
+  if (!fp) {
+    fprintf(stderr, "open %s error\n", path.c_str());
+    return;
+  }
+  utsname host{};
+  uname(&host);
+  fprintf(fp,
+          "{\"machine\":\"%s\",\"kernel\":\"%s\",\"cpus\":%u,"
+          "\"compiler\":\"%s\",\"min_ms\":%d,\"repeats\":%d,\n"
+          "\"results\":[\n",
+          host.machine, host.release, std::thread::hardware_concurrency(),
+          __VERSION__, g_min_ms, g_repeats);
+  // 每项一行，便于直接diff
+  for (size_t i = 0; i < g_results.size(); ++i) {
+    const Result &r = g_results[i];
+    fprintf(fp,
+            "{\"name\":\"%s\",\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f,"
+            "\"ops_per_s\":%.0f,\"iterations\":%ld}%s\n",
+            r.name.c_str(), r.ns_per_op, r.min_ns_per_op, 1e9 / r.ns_per_op,
+            r.iterations, i + 1 < g_results.size() ? "," : "");
+  }
+  fprintf(fp, "]}\n");
+  if (fp != stdout) {
+    fclose(fp);
+  }
+}
+
+// 读取WriteJson输出的文件，返回每项的ns_per_op
+static std::map<std::string, double> ReadBaseline(const std::string &path) {
+  std::map<std::string, double> baseline;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t name = line.find("{\"name\":\"");
+    size_t value = line.find("\"ns_per_op\":");
+    if (name == std::string::npos || value == std::string::npos) {
+      continue;
+    }
+    name += 9;
+    baseline[line.substr(name, line.find('"', name) - name)] =
+        atof(line.c_str() + value + 12);
+  }
+  return baseline;
+}
+
+int main(int argc, char *argv[]) {
+  std::string output = "microbench.json";
+  std::string baseline_path;
+  std::string resources = "./resources";
+  int opt;
+  while ((opt = getopt(argc, argv, "o:b:f:t:r:R:")) != -1) {
+    switch (opt) {
+      case 'o':
+        output = optarg;
+        break;
+      case 'b':
+        baseline_path = optarg;
+        break;
+      case 'f':
+        g_filter = optarg;
+        break;
+      case 't':
+        g_min_ms = std::max(atoi(optarg), 1);
+        break;
+      case 'r':
+        g_repeats = std::max(atoi(optarg), 1);
+        break;
+      case 'R':
+        resources = optarg;
+        break;
+      default:
+        fprintf(stderr,
+                "usage: %s [-o result.json] [-b baseline.json] [-f filter] "
+                "[-t ms] [-r repeats] [-R resources]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+
+  BenchBuffer();
+  BenchRequest();
+  BenchResponse(resources);
+  for (int scale : {1000, 10000, 100000}) {
+    BenchTimer<HeapTimer>("heap", scale);
+    BenchTimer<TimingWheel>("wheel", scale);
+  }
+  BenchQueues();
+  // 日志写入临时目录，结束后删除
+  char dir[] = "/tmp/microbench_log_XXXXXX";
+  if (mkdtemp(dir)) {
+    BenchLog(dir);
+  }
+
+  WriteJson(output);
+  if (!baseline_path.empty()) {
+    std::map<std::string, double> baseline = ReadBaseline(baseline_path);
+    printf("%-36s %12s %12s %8s\n", "name", "baseline", "current", "change");
+    for (const Result &r : g_results) {
+      auto it = baseline.find(r.name);
+      if (it == baseline.end() || it->second <= 0) {
+        printf("%-36s %12s %12.1f %8s\n", r.name.c_str(), "-", r.ns_per_op,
+               "new");
+        continue;
+      }
+      printf("%-36s %12.1f %12.1f %+7.1f%%\n", r.name.c_str(), it->second,
+             r.ns_per_op, (r.ns_per_op / it->second - 1) * 100);
+    }
+  }
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  return 0;
+}
@@ -0,0 +1,873 @@
+// MySQL客户端库的替身，见mysql/mysql.h
+// 报文格式：4字节长度 + 内容。请求是SQL文本，或者以一个控制字符开头的预编译语句命令：
+//   \x01<SQL>   \x02<语句id>\n<长度>:<参数>...   \x03(ping)
+// 应答以一个字符区分类型：
+//   O<affected rows>   E<errno> <message>   R<列数>\n<以\t分隔字段、\n结尾的行>
+//   S<语句id> <参数个数> <列数>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mysql/errmsg.h"
+#include "mysql/mysql.h"
+#include "mysql/mysqld_error.h"
+
+struct st_mysql {
+  int fd{-1};
+  unsigned long thread_id{0};
+  unsigned int err{0};
+  std::string error;
+  uint64_t affected{0};
+  std::string in;
+  MYSQL_RES *result{nullptr};
+};
+
+struct st_mysql_res {
+  unsigned int fields{0};
+  std::vector<std::vector<std::string>> rows;
+  std::vector<char *> current;
+  size_t next{0};
+};
+
+struct st_mysql_stmt {
+  MYSQL *mysql{nullptr};
+  unsigned long id{0};
+  unsigned int err{0};
+  std::string error;
+  unsigned int params{0};
+  unsigned int fields{0};
+  uint64_t affected{0};
+  MYSQL_BIND *param_bind{nullptr};
+  MYSQL_BIND *result_bind{nullptr};
+  MYSQL_RES *result{nullptr};
+};
+
+namespace {
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void AppendFrame(std::string &out, const std::string &payload) {
+  uint32_t len = payload.size();
+  out.append(reinterpret_cast<const char *>(&len), sizeof(len));
+  out += payload;
+}
+
+bool TakeFrame(std::string &in, std::string *payload) {
+  uint32_t len;
+  if (in.size() < sizeof(len)) {
+    return false;
+  }
+  memcpy(&len, in.data(), sizeof(len));
+  if (in.size() < sizeof(len) + len) {
+    return false;
+  }
+  payload->assign(in, sizeof(len), len);
+  in.erase(0, sizeof(len) + len);
+  return true;
+}
+
+bool WriteAll(int fd, const std::string &data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    // 对端已关闭时返回EPIPE而不是产生SIGPIPE
+    ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EAGAIN) {
+      pollfd pfd{fd, POLLOUT, 0};
+      poll(&pfd, 1, -1);
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+const char PREPARE = '\x01';
+const char EXECUTE = '\x02';
+const char PING = '\x03';
+
+// 取出单引号中的字符串，按MySQL字符串字面量的规则还原转义
+std::vector<std::string> Quoted(const std::string &sql) {
+  std::vector<std::string> values;
+  size_t pos = 0;
+  while ((pos = sql.find('\'', pos)) != std::string::npos) {
+    std::string value;
+    for (++pos; pos < sql.size() && sql[pos] != '\''; ++pos) {
+      char ch = sql[pos];
+      if (ch == '\\' && pos + 1 < sql.size()) {
+        ch = sql[++pos];
+        ch = ch == '0' ? '\0' : ch == 'n' ? '\n' : ch == 'r' ? '\r' : ch;
+      }
+      value += ch;
+    }
+    values.push_back(value);
+    ++pos;
+  }
+  return values;
+}
+
+// 语句结果的列数
+unsigned int Fields(const std::string &sql) {
+  if (sql.rfind("SELECT username, password", 0) == 0) {
+    return 2;
+  }
+  return sql.rfind("SELECT", 0) == 0 ? 1 : 0;
+}
+
+// 进程内的mock数据库服务，所有连接的服务端由一个线程处理
+class MockServer {
+ public:
+  static MockServer &instance() {
+    // 服务线程是detach的，进程退出时不能析构它仍在使用的数据
+    static MockServer *server = new MockServer;
+    return *server;
+  }
+
+  void attach(int fd) {
+    {
+      std::lock_guard locker(mtx_);
+      new_fds_.push_back(fd);
+    }
+    wake();
+  }
+
+  void setLatency(int ms) { latency_ms_ = ms; }
+  void addUser(const char *name, const char *pwd) {
+    std::lock_guard locker(mtx_);
+    users_[name] = pwd;
+  }
+  int queryCount() const { return query_count_; }
+  int prepareCount() const { return prepare_count_; }
+  int commitCount() const { return commit_count_; }
+  void resetStatements() {
+    std::lock_guard locker(mtx_);
+    stmts_.clear();
+  }
+  bool getUser(const char *name, std::string *pwd) {
+    std::lock_guard locker(mtx_);
+    auto it = users_.find(name);
+    if (it == users_.end()) {
+      return false;
+    }
+    *pwd = it->second;
+    return true;
+  }
+  int maxInflight() const { return max_inflight_; }
+  void dropAll() {
+    drop_ = true;
+    wake();
+  }
+  void setDown(bool down) {
+    down_ = down;
+    if (down) {
+      dropAll();
+    }
+  }
+  bool down() const { return down_; }
+  void setStall(bool stall) { stall_ = stall; }
+
+ private:
+  struct Pending {
+    int64_t due;
+    int fd;
+    std::string frame;
+    bool query;
+  };
+
+  MockServer() {
+    pipe2(wake_, O_CLOEXEC | O_NONBLOCK);
+    std::thread([this] { run(); }).detach();
+  }
+
+  void wake() {
+    char c = 0;
+    ssize_t n = write(wake_[1], &c, 1);
+    (void)n;
+  }
+
+  void schedule(int fd, const std::string &payload, bool query) {
+    if (stall_) {
+      // 读走请求但永不应答，socket保持打开
+      return;
+    }
+    Pending pending{NowMs() + latency_ms_, fd, "", query};
+    AppendFrame(pending.frame, payload);
+    pending_.push_back(std::move(pending));
+    if (query) {
+      int inflight = ++inflight_;
+      max_inflight_ = std::max(max_inflight_.load(), inflight);
+    }
+  }
+
+  void closeFd(int fd) {
+    close(fd);
+    inbuf_.erase(fd);
+    {
+      std::lock_guard locker(mtx_);
+      stmts_.erase(fd);
+      // 断开时未提交的事务回滚
+      txns_.erase(fd);
+    }
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      if (it->fd == fd) {
+        inflight_ -= it->query;
+        it = pending_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void run() {
+    while (true) {
+      {
+        std::lock_guard locker(mtx_);
+        for (int fd : new_fds_) {
+          inbuf_[fd];
+          // 握手应答，同样有延迟
+          schedule(fd, "O0", false);
+        }
+        new_fds_.clear();
+      }
+      if (drop_.exchange(false)) {
+        while (!inbuf_.empty()) {
+          closeFd(inbuf_.begin()->first);
+        }
+      }
+      int64_t now = NowMs();
+      for (auto it = pending_.begin(); it != pending_.end();) {
+        if (it->due <= now) {
+          WriteAll(it->fd, it->frame);
+          inflight_ -= it->query;
+          it = pending_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      int timeout = -1;
+      for (const Pending &pending : pending_) {
+        int remain = static_cast<int>(std::max<int64_t>(pending.due - now, 0));
+        timeout = timeout < 0 ? remain : std::min(timeout, remain);
+      }
+      std::vector<pollfd> pfds{{wake_[0], POLLIN, 0}};
+      for (auto &entry : inbuf_) {
+        pfds.push_back({entry.first, POLLIN, 0});
+      }
+      poll(pfds.data(), pfds.size(), timeout);
+      if (pfds[0].revents) {
+        char buf[64];
+        while (read(wake_[0], buf, sizeof(buf)) > 0) {
+        }
+      }
+      for (size_t i = 1; i < pfds.size(); ++i) {
+        if (!pfds[i].revents) {
+          continue;
+        }
+        int fd = pfds[i].fd;
+        char buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+          closeFd(fd);
+          continue;
+        }
+        std::string &in = inbuf_[fd];
+        in.append(buf, n);
+        std::string sql;
+        while (TakeFrame(in, &sql)) {
+          query_count_ += sql != std::string(1, PING);
+          schedule(fd, handle(fd, sql), true);
+        }
+      }
+    }
+  }
+
+  std::string handle(int fd, const std::string &request) {
+    std::lock_guard locker(mtx_);
+    if (request.size() == 1 && request[0] == PING) {
+      return "O0";
+    }
+    if (request.empty() || (request[0] != PREPARE && request[0] != EXECUTE)) {
+      return execute(fd, request, Quoted(request));
+    }
+    if (request[0] == PREPARE) {
+      std::string sql = request.substr(1);
+      unsigned long id = ++stmt_seq_;
+      stmts_[fd][id] = sql;
+      ++prepare_count_;
+      return "S" + std::to_string(id) + " " +
+             std::to_string(std::count(sql.begin(), sql.end(), '?')) + " " +
+             std::to_string(Fields(sql));
+    }
+    size_t pos = request.find('\n');
+    unsigned long id = strtoul(request.c_str() + 1, nullptr, 10);
+    auto it = stmts_[fd].find(id);
+    if (it == stmts_[fd].end()) {
+      return "E" + std::to_string(ER_UNKNOWN_STMT_HANDLER) +
+             " Unknown prepared statement handler given to EXECUTE";
+    }
+    std::vector<std::string> params;
+    for (++pos; pos < request.size();) {
+      size_t colon = request.find(':', pos);
+      size_t len = strtoul(request.c_str() + pos, nullptr, 10);
+      params.push_back(request.substr(colon + 1, len));
+      pos = colon + 1 + len;
+    }
+    return execute(fd, it->second, params);
+  }
+
+  // 参数来自SQL文本中的字符串或者预编译语句的绑定
+  std::string execute(int fd, const std::string &sql,
+                      const std::vector<std::string> &params) {
+    auto param = [&](size_t i) { return i < params.size() ? params[i] : ""; };
+    // 事务中的INSERT在COMMIT时才写入user表，不支持嵌套
+    if (sql == "START TRANSACTION") {
+      txns_[fd].clear();
+      return "O0";
+    }
+    if (sql == "COMMIT" || sql == "ROLLBACK") {
+      auto txn = txns_.find(fd);
+      if (txn != txns_.end()) {
+        if (sql == "COMMIT") {
+          users_.insert(txn->second.begin(), txn->second.end());
+          ++commit_count_;
+        }
+        txns_.erase(txn);
+      }
+      return "O0";
+    }
+    auto txn = txns_.find(fd);
+    auto exists = [&](const std::string &name) {
+      return users_.count(name) ||
+             (txn != txns_.end() && txn->second.count(name));
+    };
+    if (sql.rfind("SELECT username FROM user WHERE username IN", 0) == 0) {
+      std::string reply = "R1\n";
+      std::set<std::string> found;
+      for (const std::string &name : params) {
+        if (exists(name) && found.insert(name).second) {
+          reply += name + "\n";
+        }
+      }
+      return reply;
+    }
+    if (sql.rfind("SELECT username, password FROM user", 0) == 0) {
+      auto it = users_.find(param(0));
+      if (it == users_.end()) {
+        return "R2\n";
+      }
+      return "R2\n" + it->first + "\t" + it->second + "\n";
+    }
+    if (sql.rfind("INSERT INTO user", 0) == 0) {
+      // 多行INSERT：每两个参数一行，任何一行重复则整条语句失败(username是唯一键)
+      std::map<std::string, std::string> rows;
+      for (size_t i = 0; i < std::max<size_t>(params.size(), 2); i += 2) {
+        std::string name = param(i);
+        if (exists(name) || !rows.emplace(name, param(i + 1)).second) {
+          return "E" + std::to_string(ER_DUP_ENTRY) + " Duplicate entry";
+        }
+      }
+      if (txn != txns_.end()) {
+        txn->second.insert(rows.begin(), rows.end());
+      } else {
+        users_.insert(rows.begin(), rows.end());
+        ++commit_count_;
+      }
+      return "O" + std::to_string(rows.size());
+    }
+    if (sql.rfind("UPDATE user SET password", 0) == 0) {
+      // 参数依次为新密码、用户名、旧密码，只在旧密码匹配时修改
+      auto it = users_.find(param(1));
+      if (it == users_.end() || it->second != param(2)) {
+        return "O0";
+      }
+      it->second = param(0);
+      ++commit_count_;
+      return "O1";
+    }
+    if (sql.rfind("SELECT", 0) == 0) {
+      return "R1\n1\n";
+    }
+    return "E" + std::to_string(ER_PARSE_ERROR) +
+           " You have an error in your SQL syntax";
+  }
+
+  std::mutex mtx_;
+  std::map<std::string, std::string> users_;
+  // 每个连接上未提交的INSERT
+  std::map<int, std::map<std::string, std::string>> txns_;
+  std::vector<int> new_fds_;
+  // 每个连接上的预编译语句
+  std::map<int, std::map<unsigned long, std::string>> stmts_;
+  unsigned long stmt_seq_{0};
+  int wake_[2];
+  std::atomic<int> latency_ms_{0};
+  std::atomic<int> query_count_{0};
+  std::atomic<int> prepare_count_{0};
+  std::atomic<int> commit_count_{0};
+  std::atomic<int> inflight_{0};
+  std::atomic<int> max_inflight_{0};
+  std::atomic<bool> drop_{false};
+  std::atomic<bool> down_{false};
+  std::atomic<bool> stall_{false};
+  // 以下只由服务线程访问
+  std::map<int, std::string> inbuf_;
+  std::vector<Pending> pending_;
+};
+
+// 读取一条完整的应答，数据未到齐时返回false；对端关闭时以错误结束
+bool ReadReply(MYSQL *mysql, std::string *reply) {
+  while (!TakeFrame(mysql->in, reply)) {
+    char buf[4096];
+    ssize_t n = read(mysql->fd, buf, sizeof(buf));
+    if (n < 0 && errno == EAGAIN) {
+      return false;
+    }
+    if (n <= 0) {
+      *reply = "E" + std::to_string(CR_SERVER_LOST) +
+               " Lost connection to MySQL server during query";
+      return true;
+    }
+    mysql->in.append(buf, n);
+  }
+  return true;
+}
+
+// 解析应答，返回是否出错
+bool ApplyReply(MYSQL *mysql, const std::string &reply) {
+  delete mysql->result;
+  mysql->result = nullptr;
+  mysql->err = 0;
+  mysql->error.clear();
+  mysql->affected = 0;
+  if (reply.empty()) {
+    return true;
+  }
+  if (reply[0] == 'E') {
+    mysql->err = strtoul(reply.c_str() + 1, nullptr, 10);
+    size_t space = reply.find(' ');
+    mysql->error = space == std::string::npos ? "" : reply.substr(space + 1);
+    return false;
+  }
+  if (reply[0] == 'O') {
+    mysql->affected = strtoull(reply.c_str() + 1, nullptr, 10);
+    return true;
+  }
+  MYSQL_RES *res = new MYSQL_RES;
+  size_t line_end = reply.find('\n');
+  res->fields = strtoul(reply.c_str() + 1, nullptr, 10);
+  size_t pos = line_end + 1;
+  while (pos < reply.size()) {
+    size_t end = reply.find('\n', pos);
+    std::string line = reply.substr(pos, end - pos);
+    std::vector<std::string> row;
+    size_t field = 0;
+    while (true) {
+      size_t tab = line.find('\t', field);
+      row.push_back(line.substr(field, tab - field));
+      if (tab == std::string::npos) {
+        break;
+      }
+      field = tab + 1;
+    }
+    row.resize(res->fields);
+    res->rows.push_back(std::move(row));
+    pos = end + 1;
+  }
+  mysql->affected = res->rows.size();
+  mysql->result = res;
+  return true;
+}
+
+// 阻塞地发送一个请求并等待应答
+std::string RoundTrip(MYSQL *mysql, const std::string &request) {
+  std::string frame;
+  AppendFrame(frame, request);
+  if (!WriteAll(mysql->fd, frame)) {
+    return "E" + std::to_string(CR_SERVER_GONE_ERROR) +
+           " MySQL server has gone away";
+  }
+  std::string reply;
+  while (!ReadReply(mysql, &reply)) {
+    pollfd pfd{mysql->fd, POLLIN, 0};
+    poll(&pfd, 1, -1);
+  }
+  return reply;
+}
+
+void StmtError(MYSQL_STMT *stmt, unsigned int err, const std::string &error) {
+  stmt->err = err;
+  stmt->error = error;
+}
+
+std::atomic<unsigned long> g_thread_id{0};
+
+}  // namespace
+
+int mysql_server_init(int, char **, char **) { return 0; }
+void mysql_server_end() {}
+
+MYSQL *mysql_init(MYSQL *mysql) { return mysql ? mysql : new MYSQL; }
+
+int mysql_options(MYSQL *, enum mysql_option, const void *) { return 0; }
+
+void mysql_close(MYSQL *mysql) {
+  if (!mysql) {
+    return;
+  }
+  if (mysql->fd >= 0) {
+    close(mysql->fd);
+  }
+  delete mysql->result;
+  delete mysql;
+}
+
+unsigned int mysql_errno(MYSQL *mysql) { return mysql->err; }
+const char *mysql_error(MYSQL *mysql) { return mysql->error.c_str(); }
+int mysql_get_socket(const MYSQL *mysql) { return mysql->fd; }
+unsigned int mysql_get_timeout_value_ms(const MYSQL *) { return 0; }
+uint64_t mysql_affected_rows(MYSQL *mysql) { return mysql->affected; }
+unsigned long mysql_thread_id(MYSQL *mysql) { return mysql->thread_id; }
+
+int mysql_real_connect_start(MYSQL **ret, MYSQL *mysql, const char *,
+                             const char *, const char *, const char *,
+                             unsigned int, const char *, unsigned long) {
+  if (MockServer::instance().down()) {
+    mysql->err = CR_CONNECTION_ERROR;
+    mysql->error = "Can't connect to MySQL server";
+    *ret = nullptr;
+    return 0;
+  }
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    mysql->err = CR_CONNECTION_ERROR;
+    mysql->error = strerror(errno);
+    *ret = nullptr;
+    return 0;
+  }
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  mysql->fd = fds[0];
+  mysql->thread_id = ++g_thread_id;
+  MockServer::instance().attach(fds[1]);
+  return MYSQL_WAIT_READ;
+}
+
+int mysql_real_connect_cont(MYSQL **ret, MYSQL *mysql, int) {
+  std::string reply;
+  if (!ReadReply(mysql, &reply)) {
+    return MYSQL_WAIT_READ;
+  }
+  *ret = ApplyReply(mysql, reply) ? mysql : nullptr;
+  return 0;
+}
+
+int mysql_real_query_start(int *ret, MYSQL *mysql, const char *q,
+                           unsigned long length) {
+  std::string frame;
+  AppendFrame(frame, std::string(q, length));
+  if (!WriteAll(mysql->fd, frame)) {
+    mysql->err = CR_SERVER_GONE_ERROR;
+    mysql->error = "MySQL server has gone away";
+    *ret = 1;
+    return 0;
+  }
+  return MYSQL_WAIT_READ;
+}
+
+int mysql_real_query_cont(int *ret, MYSQL *mysql, int) {
+  std::string reply;
+  if (!ReadReply(mysql, &reply)) {
+    return MYSQL_WAIT_READ;
+  }
+  *ret = ApplyReply(mysql, reply) ? 0 : 1;
+  return 0;
+}
+
+int mysql_store_result_start(MYSQL_RES **ret, MYSQL *mysql) {
+  // 结果在查询应答中已经全部收到
+  *ret = mysql->result;
+  mysql->result = nullptr;
+  return 0;
+}
+
+int mysql_store_result_cont(MYSQL_RES **ret, MYSQL *mysql, int) {
+  return mysql_store_result_start(ret, mysql);
+}
+
+MYSQL *mysql_real_connect(MYSQL *mysql, const char *host, const char *user,
+                          const char *passwd, const char *db,
+                          unsigned int port, const char *unix_socket,
+                          unsigned long flags) {
+  MYSQL *ret = nullptr;
+  int status = mysql_real_connect_start(&ret, mysql, host, user, passwd, db,
+                                        port, unix_socket, flags);
+  while (status) {
+    pollfd pfd{mysql->fd, POLLIN, 0};
+    poll(&pfd, 1, -1);
+    status = mysql_real_connect_cont(&ret, mysql, MYSQL_WAIT_READ);
+  }
+  return ret;
+}
+
+int mysql_real_query(MYSQL *mysql, const char *q, unsigned long length) {
+  int ret = 0;
+  int status = mysql_real_query_start(&ret, mysql, q, length);
+  while (status) {
+    pollfd pfd{mysql->fd, POLLIN, 0};
+    poll(&pfd, 1, -1);
+    status = mysql_real_query_cont(&ret, mysql, MYSQL_WAIT_READ);
+  }
+  return ret;
+}
+
+int mysql_ping(MYSQL *mysql) {
+  return ApplyReply(mysql, RoundTrip(mysql, std::string(1, PING))) ? 0 : 1;
+}
+
+bool mysql_commit(MYSQL *mysql) { return mysql_query(mysql, "COMMIT") != 0; }
+
+bool mysql_rollback(MYSQL *mysql) {
+  return mysql_query(mysql, "ROLLBACK") != 0;
+}
+
+int mysql_query(MYSQL *mysql, const char *q) {
+  return mysql_real_query(mysql, q, strlen(q));
+}
+
+MYSQL_RES *mysql_store_result(MYSQL *mysql) {
+  MYSQL_RES *res = nullptr;
+  mysql_store_result_start(&res, mysql);
+  return res;
+}
+
+unsigned int mysql_num_fields(MYSQL_RES *res) { return res->fields; }
+
+MYSQL_ROW mysql_fetch_row(MYSQL_RES *res) {
+  if (!res || res->next >= res->rows.size()) {
+    return nullptr;
+  }
+  res->current.clear();
+  for (std::string &field : res->rows[res->next]) {
+    res->current.push_back(field.data());
+  }
+  res->next++;
+  return res->current.data();
+}
+
+void mysql_free_result(MYSQL_RES *res) { delete res; }
+
+void mock_mysql_set_latency(int ms) { MockServer::instance().setLatency(ms); }
+void mock_mysql_add_user(const char *name, const char *pwd) {
+  MockServer::instance().addUser(name, pwd);
+}
+int mock_mysql_query_count() { return MockServer::instance().queryCount(); }
+int mock_mysql_max_inflight() { return MockServer::instance().maxInflight(); }
+void mock_mysql_drop_connections() { MockServer::instance().dropAll(); }
+void mock_mysql_set_down(bool down) { MockServer::instance().setDown(down); }
+void mock_mysql_set_stall(bool stall) {
+  MockServer::instance().setStall(stall);
+}
+
+MYSQL_STMT *mysql_stmt_init(MYSQL *mysql) {
+  MYSQL_STMT *stmt = new MYSQL_STMT;
+  stmt->mysql = mysql;
+  return stmt;
+}
+
+int mysql_stmt_prepare_start(int *ret, MYSQL_STMT *stmt, const char *q,
+                             unsigned long length) {
+  std::string frame;
+  AppendFrame(frame, PREPARE + std::string(q, length));
+  if (!WriteAll(stmt->mysql->fd, frame)) {
+    StmtError(stmt, CR_SERVER_GONE_ERROR, "MySQL server has gone away");
+    *ret = 1;
+    return 0;
+  }
+  return MYSQL_WAIT_READ;
+}
+
+int mysql_stmt_prepare_cont(int *ret, MYSQL_STMT *stmt, int) {
+  std::string reply;
+  if (!ReadReply(stmt->mysql, &reply)) {
+    return MYSQL_WAIT_READ;
+  }
+  if (reply[0] != 'S') {
+    ApplyReply(stmt->mysql, reply);
+    StmtError(stmt, stmt->mysql->err, stmt->mysql->error);
+    *ret = 1;
+    return 0;
+  }
+  char *end;
+  stmt->id = strtoul(reply.c_str() + 1, &end, 10);
+  stmt->params = strtoul(end, &end, 10);
+  stmt->fields = strtoul(end, &end, 10);
+  StmtError(stmt, 0, "");
+  *ret = 0;
+  return 0;
+}
+
+int mysql_stmt_prepare(MYSQL_STMT *stmt, const char *q, unsigned long length) {
+  int ret = 0;
+  int status = mysql_stmt_prepare_start(&ret, stmt, q, length);
+  while (status) {
+    pollfd pfd{stmt->mysql->fd, POLLIN, 0};
+    poll(&pfd, 1, -1);
+    status = mysql_stmt_prepare_cont(&ret, stmt, MYSQL_WAIT_READ);
+  }
+  return ret;
+}
+
+bool mysql_stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bind) {
+  stmt->param_bind = bind;
+  return false;
+}
+
+bool mysql_stmt_bind_result(MYSQL_STMT *stmt, MYSQL_BIND *bind) {
+  stmt->result_bind = bind;
+  return false;
+}
+
+int mysql_stmt_execute_start(int *ret, MYSQL_STMT *stmt) {
+  std::string request = EXECUTE + std::to_string(stmt->id) + "\n";
+  for (unsigned int i = 0; i < stmt->params; ++i) {
+    MYSQL_BIND &bind = stmt->param_bind[i];
+    unsigned long len = bind.length ? *bind.length : bind.buffer_length;
+    request += std::to_string(len) + ":";
+    request.append(static_cast<const char *>(bind.buffer), len);
+  }
+  std::string frame;
+  AppendFrame(frame, request);
+  if (!WriteAll(stmt->mysql->fd, frame)) {
+    StmtError(stmt, CR_SERVER_GONE_ERROR, "MySQL server has gone away");
+    *ret = 1;
+    return 0;
+  }
+  return MYSQL_WAIT_READ;
+}
+
+int mysql_stmt_execute_cont(int *ret, MYSQL_STMT *stmt, int) {
+  std::string reply;
+  if (!ReadReply(stmt->mysql, &reply)) {
+    return MYSQL_WAIT_READ;
+  }
+  bool ok = ApplyReply(stmt->mysql, reply);
+  StmtError(stmt, stmt->mysql->err, stmt->mysql->error);
+  if (!ok) {
+    *ret = 1;
+    return 0;
+  }
+  delete stmt->result;
+  stmt->result = stmt->mysql->result;
+  stmt->mysql->result = nullptr;
+  stmt->affected = stmt->mysql->affected;
+  *ret = 0;
+  return 0;
+}
+
+int mysql_stmt_execute(MYSQL_STMT *stmt) {
+  int ret = 0;
+  int status = mysql_stmt_execute_start(&ret, stmt);
+  while (status) {
+    pollfd pfd{stmt->mysql->fd, POLLIN, 0};
+    poll(&pfd, 1, -1);
+    status = mysql_stmt_execute_cont(&ret, stmt, MYSQL_WAIT_READ);
+  }
+  return ret;
+}
+
+// 结果在执行的应答中已经全部收到
+int mysql_stmt_store_result_start(int *ret, MYSQL_STMT *) {
+  *ret = 0;
+  return 0;
+}
+
+int mysql_stmt_store_result_cont(int *ret, MYSQL_STMT *stmt, int) {
+  return mysql_stmt_store_result_start(ret, stmt);
+}
+
+int mysql_stmt_store_result(MYSQL_STMT *) { return 0; }
+
+int mysql_stmt_fetch(MYSQL_STMT *stmt) {
+  MYSQL_RES *res = stmt->result;
+  if (!res || res->next >= res->rows.size()) {
+    return MYSQL_NO_DATA;
+  }
+  int status = 0;
+  std::vector<std::string> &row = res->rows[res->next++];
+  for (unsigned int i = 0; i < stmt->fields; ++i) {
+    MYSQL_BIND &bind = stmt->result_bind[i];
+    *bind.length = row[i].size();
+    if (bind.is_null) {
+      *bind.is_null = false;
+    }
+    memcpy(bind.buffer, row[i].data(),
+           std::min<size_t>(row[i].size(), bind.buffer_length));
+    if (row[i].size() > bind.buffer_length) {
+      status = MYSQL_DATA_TRUNCATED;
+    }
+  }
+  return status;
+}
+
+int mysql_stmt_fetch_column(MYSQL_STMT *stmt, MYSQL_BIND *bind,
+                            unsigned int column, unsigned long offset) {
+  MYSQL_RES *res = stmt->result;
+  if (!res || res->next == 0 || column >= stmt->fields) {
+    return 1;
+  }
+  const std::string &value = res->rows[res->next - 1][column];
+  size_t len = value.size() > offset ? value.size() - offset : 0;
+  memcpy(bind->buffer, value.data() + offset,
+         std::min<size_t>(len, bind->buffer_length));
+  if (bind->length) {
+    *bind->length = value.size();
+  }
+  return 0;
+}
+
+bool mysql_stmt_free_result(MYSQL_STMT *stmt) {
+  delete stmt->result;
+  stmt->result = nullptr;
+  return false;
+}
+
+bool mysql_stmt_close(MYSQL_STMT *stmt) {
+  delete stmt->result;
+  delete stmt;
+  return false;
+}
+
+unsigned int mysql_stmt_field_count(MYSQL_STMT *stmt) { return stmt->fields; }
+uint64_t mysql_stmt_affected_rows(MYSQL_STMT *stmt) { return stmt->affected; }
+unsigned int mysql_stmt_errno(MYSQL_STMT *stmt) { return stmt->err; }
+const char *mysql_stmt_error(MYSQL_STMT *stmt) { return stmt->error.c_str(); }
+
+int mock_mysql_prepare_count() {
+  return MockServer::instance().prepareCount();
+}
+void mock_mysql_reset_statements() { MockServer::instance().resetStatements(); }
+int mock_mysql_commit_count() {
+  return MockServer::instance().commitCount();
+}
+
+bool mock_mysql_get_user(const char *name, std::string *pwd) {
+  return MockServer::instance().getUser(name, pwd);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// mock客户端库使用的错误码，与MariaDB Connector/C一致
+#define CR_UNKNOWN_ERROR 2000
+#define CR_CONNECTION_ERROR 2002
+#define CR_SERVER_GONE_ERROR 2006
+#define CR_SERVER_LOST 2013
@@ -0,0 +1,122 @@
+#pragma once
+
+// 测试用的MySQL客户端库替身，实现服务器用到的MariaDB Connector/C接口子集，
+// 包括非阻塞的mysql_*_start/_cont和预编译语句。每个连接是一对socketpair，
+// 另一端由进程内的mock服务线程按设定的延迟应答，数据保存在内存中的user表
+#include <cstdint>
+#include <string>
+
+typedef struct st_mysql MYSQL;
+typedef struct st_mysql_res MYSQL_RES;
+typedef struct st_mysql_stmt MYSQL_STMT;
+typedef char **MYSQL_ROW;
+
+enum enum_field_types { MYSQL_TYPE_LONG = 3, MYSQL_TYPE_STRING = 254 };
+
+typedef struct st_mysql_bind {
+  unsigned long *length;
+  bool *is_null;
+  void *buffer;
+  bool *error;
+  enum enum_field_types buffer_type;
+  unsigned long buffer_length;
+} MYSQL_BIND;
+
+enum mysql_option {
+  MYSQL_OPT_CONNECT_TIMEOUT,
+  MYSQL_OPT_READ_TIMEOUT,
+  MYSQL_OPT_WRITE_TIMEOUT,
+  MYSQL_OPT_NONBLOCK
+};
+
+#define MYSQL_WAIT_READ 1
+#define MYSQL_WAIT_WRITE 2
+#define MYSQL_WAIT_EXCEPT 4
+#define MYSQL_WAIT_TIMEOUT 8
+
+#define MYSQL_NO_DATA 100
+#define MYSQL_DATA_TRUNCATED 101
+
+int mysql_server_init(int argc, char **argv, char **groups);
+void mysql_server_end();
+MYSQL *mysql_init(MYSQL *mysql);
+int mysql_options(MYSQL *mysql, enum mysql_option option, const void *arg);
+void mysql_close(MYSQL *mysql);
+unsigned int mysql_errno(MYSQL *mysql);
+const char *mysql_error(MYSQL *mysql);
+int mysql_get_socket(const MYSQL *mysql);
+unsigned int mysql_get_timeout_value_ms(const MYSQL *mysql);
+uint64_t mysql_affected_rows(MYSQL *mysql);
+// 每次连接都分配新的id，重连后变化
+unsigned long mysql_thread_id(MYSQL *mysql);
+
+MYSQL *mysql_real_connect(MYSQL *mysql, const char *host, const char *user,
+                          const char *passwd, const char *db,
+                          unsigned int port, const char *unix_socket,
+                          unsigned long flags);
+int mysql_ping(MYSQL *mysql);
+int mysql_query(MYSQL *mysql, const char *q);
+int mysql_real_query(MYSQL *mysql, const char *q, unsigned long length);
+MYSQL_RES *mysql_store_result(MYSQL *mysql);
+bool mysql_commit(MYSQL *mysql);
+bool mysql_rollback(MYSQL *mysql);
+
+int mysql_real_connect_start(MYSQL **ret, MYSQL *mysql, const char *host,
+                             const char *user, const char *passwd,
+                             const char *db, unsigned int port,
+                             const char *unix_socket, unsigned long flags);
+int mysql_real_connect_cont(MYSQL **ret, MYSQL *mysql, int status);
+int mysql_real_query_start(int *ret, MYSQL *mysql, const char *q,
+                           unsigned long length);
+int mysql_real_query_cont(int *ret, MYSQL *mysql, int status);
+int mysql_store_result_start(MYSQL_RES **ret, MYSQL *mysql);
+int mysql_store_result_cont(MYSQL_RES **ret, MYSQL *mysql, int status);
+
+unsigned int mysql_num_fields(MYSQL_RES *res);
+MYSQL_ROW mysql_fetch_row(MYSQL_RES *res);
+void mysql_free_result(MYSQL_RES *res);
+
+MYSQL_STMT *mysql_stmt_init(MYSQL *mysql);
+int mysql_stmt_prepare(MYSQL_STMT *stmt, const char *q, unsigned long length);
+bool mysql_stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bind);
+bool mysql_stmt_bind_result(MYSQL_STMT *stmt, MYSQL_BIND *bind);
+int mysql_stmt_execute(MYSQL_STMT *stmt);
+int mysql_stmt_store_result(MYSQL_STMT *stmt);
+int mysql_stmt_fetch(MYSQL_STMT *stmt);
+int mysql_stmt_fetch_column(MYSQL_STMT *stmt, MYSQL_BIND *bind,
+                            unsigned int column, unsigned long offset);
+bool mysql_stmt_free_result(MYSQL_STMT *stmt);
+bool mysql_stmt_close(MYSQL_STMT *stmt);
+unsigned int mysql_stmt_field_count(MYSQL_STMT *stmt);
+uint64_t mysql_stmt_affected_rows(MYSQL_STMT *stmt);
+unsigned int mysql_stmt_errno(MYSQL_STMT *stmt);
+const char *mysql_stmt_error(MYSQL_STMT *stmt);
+
+int mysql_stmt_prepare_start(int *ret, MYSQL_STMT *stmt, const char *q,
+                             unsigned long length);
+int mysql_stmt_prepare_cont(int *ret, MYSQL_STMT *stmt, int status);
+int mysql_stmt_execute_start(int *ret, MYSQL_STMT *stmt);
+int mysql_stmt_execute_cont(int *ret, MYSQL_STMT *stmt, int status);
+int mysql_stmt_store_result_start(int *ret, MYSQL_STMT *stmt);
+int mysql_stmt_store_result_cont(int *ret, MYSQL_STMT *stmt, int status);
+
+// 以下只有mock提供，用于控制和观察mock服务
+void mock_mysql_set_latency(int ms);
+void mock_mysql_add_user(const char *name, const char *pwd);
+int mock_mysql_query_count();
+// 同时在等待应答的查询数的最大值
+int mock_mysql_max_inflight();
+// 服务端关闭所有连接，模拟数据库重启
+void mock_mysql_drop_connections();
+// 数据库停止服务：关闭所有连接，恢复之前新的连接都会失败
+void mock_mysql_set_down(bool down);
+// 数据库挂起：连接保持打开，之后的握手和请求都不再应答
+void mock_mysql_set_stall(bool stall);
+// 服务端执行的prepare次数
+int mock_mysql_prepare_count();
+// 服务端丢弃所有预编译语句，之后执行返回ER_UNKNOWN_STMT_HANDLER
+void mock_mysql_reset_statements();
+// 读取user表中的密码，用户不存在时返回false
+bool mock_mysql_get_user(const char *name, std::string *pwd);
+// 提交的事务数，自动提交的INSERT也算一次
+int mock_mysql_commit_count();
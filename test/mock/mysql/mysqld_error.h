@@ -0,0 +1,7 @@
+#pragma once
+
+// mock服务端返回的错误码，与MySQL服务端一致
+#define ER_DUP_ENTRY 1062
+#define ER_PARSE_ERROR 1064
+#define ER_UNKNOWN_STMT_HANDLER 1243
+#define ER_NEED_REPREPARE 1615
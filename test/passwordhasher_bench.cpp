@@ -0,0 +1,108 @@
+// 密码慢哈希基准测试
+// 1. 不同目标耗时校准得到的cost和单次哈希的实际耗时
+// 2. 1..threads个线程并发哈希的吞吐
+// 3. 处理请求的线程池在有/没有哈希负载(计算线程nice)时的任务延迟
+//   ./passwordhasher_bench [threads] [target_ms]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/passwordhasher.h"
+
+static int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// threads个线程各哈希count次，返回每秒的哈希数
+static double Throughput(int threads, int count) {
+  PasswordHasher *hasher = PasswordHasher::instance();
+  int64_t begin = NowUs();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&] {
+      for (int j = 0; j < count; ++j) {
+        hasher->hashNow("benchmark");
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return threads * count * 1e6 / (NowUs() - begin);
+}
+
+// 模拟处理请求：每个任务占用CPU约200us，返回排队+执行延迟的p50/p99(us)
+static std::pair<int64_t, int64_t> RequestLatency(ThreadPool &requests,
+                                                  int tasks) {
+  std::vector<int64_t> latency(tasks);
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < tasks; ++i) {
+    int64_t submit = NowUs();
+    futures.push_back(requests.Enqueue([&latency, i, submit] {
+      int64_t end = NowUs() + 200;
+      while (NowUs() < end) {
+      }
+      latency[i] = NowUs() - submit;
+    }));
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+  for (auto &future : futures) {
+    future.get();
+  }
+  std::sort(latency.begin(), latency.end());
+  return {latency[tasks / 2], latency[tasks * 99 / 100]};
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  int target = argc > 2 ? atoi(argv[2]) : 50;
+  PasswordHasher *hasher = PasswordHasher::instance();
+  PasswordHasher::Options options;
+  options.threads = 2;
+  options.target_ms = target;
+  hasher->init(options);
+  int64_t begin = NowUs();
+  hasher->hashNow("benchmark");
+  printf("target %dms: N=2^%d, one hash %.1fms, %u cpus\n", target,
+         hasher->stats().log_n, (NowUs() - begin) / 1000.0,
+         std::thread::hardware_concurrency());
+
+  for (int n = 1; n <= threads; n *= 2) {
+    printf("%d threads: %.1f hashes/s\n", n, Throughput(n, 8));
+  }
+
+  ThreadPool requests(2, 1024);
+  auto idle = RequestLatency(requests, 400);
+  // 哈希负载：计算线程始终忙碌
+  std::atomic<bool> stop{false};
+  std::atomic<int> inflight{0};
+  std::thread load([&] {
+    while (!stop) {
+      if (inflight < 4 && hasher->hashAsync("load", [&](std::string) {
+            inflight--;
+          })) {
+        inflight++;
+      } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  });
+  auto busy = RequestLatency(requests, 400);
+  stop = true;
+  load.join();
+  while (inflight > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  PasswordHasher::Stats stats = hasher->stats();
+  printf("request latency p50/p99: idle %ld/%ldus, hashing %ld/%ldus "
+         "(%lu hashes, nice %d)\n",
+         idle.first, idle.second, busy.first, busy.second, stats.hashes,
+         options.nice);
+  return 0;
+}
@@ -0,0 +1,156 @@
+// 密码慢哈希测试，使用test/mock中的客户端库替身
+// 1. 编码格式、加盐、错误密码、迁移前的明文密码、损坏或cost过大的哈希
+// 2. 校准得到的cost在上下限之内，计算队列已满时提交失败而不是无限排队
+// 3. 注册写入数据库的是哈希；登录在计算线程中校验，之后命中UserCache不再计算
+//    迁移之前的明文密码登录成功后在后台升级为哈希，同步和异步校验都是
+// 4. 异步校验的结果回到事件循环线程
+//   ./passwordhasher_test [target_ms]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "verifyutil.h"
+
+int main(int argc, char *argv[]) {
+  int target = argc > 1 ? atoi(argv[1]) : 20;
+  PasswordHasher *hasher = PasswordHasher::instance();
+  std::string stored;
+  Check(hasher->hash("plain", &stored) && stored == "plain",
+        "disabled hasher keeps plaintext");
+
+  PasswordHasher::Options options;
+  options.threads = 1;
+  options.queue_size = 4;
+  options.target_ms = target;
+  options.min_log_n = 10;
+  options.max_log_n = 14;
+  Check(hasher->init(options), "init");
+  int log_n = hasher->stats().log_n;
+  Check(log_n >= 10 && log_n <= 14, "calibrated cost within bounds");
+  int64_t begin = NowMs();
+  std::string a = hasher->hashNow("secret");
+  printf("calibrated N=2^%d, one hash %ldms (target %dms)\n", log_n,
+         NowMs() - begin, target);
+
+  std::string b = hasher->hashNow("secret");
+  std::string head = "$scrypt$ln=" + std::to_string(log_n) + ",r=8,p=1$";
+  Check(PasswordHasher::isHashed(a) && a.compare(0, head.size(), head) == 0 &&
+            std::count(a.begin(), a.end(), '$') == 4,
+        "encoded format");
+  Check(a != b, "salted: same password, different hashes");
+  Check(hasher->verifyNow("secret", a) && hasher->verifyNow("secret", b),
+        "correct password verifies");
+  Check(!hasher->verifyNow("Secret", a) && !hasher->verifyNow("", a),
+        "wrong password rejected");
+  Check(hasher->verifyNow("123456", "123456") &&
+            !hasher->verifyNow("12345", "123456"),
+        "legacy plaintext compared as plaintext");
+  std::string big = a;
+  big.replace(big.find("ln=") + 3, std::to_string(log_n).size(), "30");
+  Check(!hasher->verifyNow("secret", big) &&
+            !hasher->verifyNow("secret", a.substr(0, a.size() - 8)) &&
+            !hasher->verifyNow("secret", "$scrypt$garbage"),
+        "corrupt or oversized hash rejected");
+  bool match = false;
+  Check(hasher->verify("secret", a, &match) && match &&
+            hasher->hash("other", &stored) && hasher->verifyNow("other", stored),
+        "blocking hash/verify through the pool");
+
+  // 1个计算线程、4个排队位置，突发的提交有一部分被拒绝
+  std::atomic<int> finished{0};
+  int queued = 0;
+  for (int i = 0; i < 32; ++i) {
+    queued += hasher->hashAsync("burst", [&](std::string) { finished++; });
+  }
+  while (finished < queued) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  Check(queued < 32 && hasher->stats().rejected >= uint64_t(32 - queued),
+        "full queue rejects instead of growing");
+
+  mock_mysql_set_latency(1);
+  mock_mysql_add_user("root", "123456");
+  mock_mysql_add_user("carol", "pw4");
+  UserCache::Options cache_options;
+  cache_options.remember_verified = true;
+  UserCache::instance()->init(cache_options);
+  SqlConnPool *pool = SqlConnPool::instance();
+  SqlConnPool::Options pool_options;
+  pool_options.min_size = pool_options.max_size = 2;
+  pool->init("localhost", 3306, "root", "12345678", "webserver", pool_options);
+  while (!pool->ready()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  Check(Verify("/register", "alice", "pw1") == "/welcome.html" &&
+            mock_mysql_get_user("alice", &stored) &&
+            PasswordHasher::isHashed(stored),
+        "register stores a hash");
+  uint64_t verifies = hasher->stats().verifies;
+  Check(Verify("/login", "alice", "pw1") == "/welcome.html" &&
+            hasher->stats().verifies == verifies + 1,
+        "first login verifies with scrypt");
+  Check(Verify("/login", "alice", "pw1") == "/welcome.html" &&
+            Verify("/login", "alice", "bad") == "/error.html" &&
+            hasher->stats().verifies == verifies + 1,
+        "later logins hit the cache");
+  Check(Verify("/login", "root", "12345") == "/error.html" &&
+            mock_mysql_get_user("root", &stored) && stored == "123456",
+        "wrong password leaves plaintext alone");
+  Check(Verify("/login", "root", "123456") == "/welcome.html",
+        "legacy plaintext user logs in");
+  // 升级在计算线程中完成，等它写回数据库
+  int64_t deadline = NowMs() + 2000;
+  while (mock_mysql_get_user("root", &stored) &&
+         !PasswordHasher::isHashed(stored) && NowMs() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  Check(PasswordHasher::isHashed(stored) &&
+            hasher->verifyNow("123456", stored),
+        "plaintext upgraded to a hash after login");
+  Check(Verify("/login", "root", "123456") == "/welcome.html" &&
+            Verify("/login", "root", "12345") == "/error.html",
+        "upgraded user logs in");
+
+  Epoller epoller;
+  AsyncSqlClient client(&epoller);
+  client.init("localhost", 3306, "root", "12345678", "webserver", 2);
+  Check(VerifyAsync(epoller, client, "/register", "bob", "pw2") ==
+                "/welcome.html" &&
+            mock_mysql_get_user("bob", &stored) &&
+            PasswordHasher::isHashed(stored),
+        "async register stores a hash");
+  Check(VerifyAsync(epoller, client, "/login", "bob", "pw2") ==
+                "/welcome.html" &&
+            VerifyAsync(epoller, client, "/login", "bob", "pw3") ==
+                "/error.html" &&
+            VerifyAsync(epoller, client, "/login", "alice", "pw1") ==
+                "/welcome.html",
+        "async login on the loop thread");
+  Check(VerifyAsync(epoller, client, "/login", "carol", "pw4") ==
+            "/welcome.html",
+        "async legacy plaintext user logs in");
+  // 哈希在计算线程中完成，UPDATE在事件循环中执行
+  RunLoop(epoller, client, [&] {
+    return mock_mysql_get_user("carol", &stored) &&
+           PasswordHasher::isHashed(stored);
+  });
+  Check(PasswordHasher::isHashed(stored) && hasher->verifyNow("pw4", stored),
+        "async login upgrades plaintext");
+  Check(VerifyAsync(epoller, client, "/login", "carol", "pw4") ==
+                "/welcome.html" &&
+            VerifyAsync(epoller, client, "/login", "carol", "pw") ==
+                "/error.html",
+        "async upgraded user logs in");
+
+  PasswordHasher::Stats stats = hasher->stats();
+  printf("hashes %lu, verifies %lu, rejected %lu, avg %.1fms\n", stats.hashes,
+         stats.verifies, stats.rejected,
+         stats.compute_us / 1000.0 / (stats.hashes + stats.verifies));
+  pool->closePool();
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// 注册合并提交测试，使用test/mock中的客户端库替身
+// 1. 并发注册合并成少数几个事务，每个请求得到自己的结果，占用的连接次数减少
+// 2. 批内重复的用户名只有一个成功，已存在的用户名返回DUPLICATE
+// 3. 单个请求直接INSERT，不开启事务
+// 4. 数据库不可用时所有请求失败而不是一直等待
+//   ./registerbatcher_test [threads] [latency_ms]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "verifyutil.h"
+
+struct Burst {
+  int ok;
+  int commits;
+  uint64_t acquires;
+  int64_t ms;
+};
+
+// threads个线程同时注册prefix0...prefixN
+static Burst Register(int threads, const std::string &prefix) {
+  MysqlUserStore store;
+  int commits = mock_mysql_commit_count();
+  uint64_t acquires = SqlConnPool::instance()->stats().acquires;
+  int64_t begin = NowMs();
+  std::atomic<int> ok{0};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&, i] {
+      ok += store.insert(prefix + std::to_string(i), "pwd");
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return {ok, mock_mysql_commit_count() - commits,
+          SqlConnPool::instance()->stats().acquires - acquires,
+          NowMs() - begin};
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 64;
+  int latency = argc > 2 ? atoi(argv[2]) : 2;
+  mock_mysql_set_latency(latency);
+  mock_mysql_add_user("root", "123456");
+  SqlConnPool *pool = SqlConnPool::instance();
+  SqlConnPool::Options pool_options;
+  pool_options.min_size = pool_options.max_size = 4;
+  pool_options.wait_timeout_ms = 5000;
+  pool->init("localhost", 3306, "root", "12345678", "webserver", pool_options);
+  while (!pool->ready()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  Burst single = Register(threads, "single");
+  Check(single.ok == threads && single.commits == threads,
+        "without batching: one commit per registration");
+
+  RegisterBatcher *batcher = RegisterBatcher::instance();
+  RegisterBatcher::Options options;
+  options.max_delay_ms = 5;
+  batcher->init(options);
+  Burst batched = Register(threads, "batched");
+  bool all = true;
+  std::string pwd;
+  for (int i = 0; i < threads; ++i) {
+    all = all && mock_mysql_get_user(("batched" + std::to_string(i)).c_str(),
+                                     &pwd) &&
+          pwd == "pwd";
+  }
+  Check(batched.ok == threads && all, "every batched registration inserted");
+  Check(batched.commits <= threads / 4, "commits per registration drop");
+  Check(batched.acquires < single.acquires / 4,
+        "pool acquisitions per registration drop");
+  printf("%d registrations: %d commits, %lu pool acquires, %ldms unbatched; "
+         "%d commits, %lu pool acquires, %ldms batched\n",
+         threads, single.commits, single.acquires, single.ms, batched.commits,
+         batched.acquires, batched.ms);
+
+  // 同一批中重复的用户名和已存在的用户名
+  std::atomic<int> dup_ok{0}, dup_conflict{0};
+  RegisterBatcher::Result existing = RegisterBatcher::Result::ERROR;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < 8; ++i) {
+    workers.emplace_back([&] {
+      RegisterBatcher::Result result = batcher->submit("twin", "pwd");
+      dup_ok += result == RegisterBatcher::Result::OK;
+      dup_conflict += result == RegisterBatcher::Result::DUPLICATE;
+    });
+  }
+  workers.emplace_back([&] { existing = batcher->submit("root", "x"); });
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  Check(dup_ok == 1 && dup_conflict == 7, "duplicates within a batch");
+  Check(existing == RegisterBatcher::Result::DUPLICATE &&
+            mock_mysql_get_user("root", &pwd) && pwd == "123456",
+        "existing user reported as duplicate");
+
+  int commits = mock_mysql_commit_count();
+  Check(batcher->submit("alone", "pwd") == RegisterBatcher::Result::OK &&
+            mock_mysql_commit_count() == commits + 1,
+        "single request inserted directly");
+
+  Check(Verify("/register", "web", "pwd") == "/welcome.html" &&
+            Verify("/register", "web", "pwd") == "/error.html" &&
+            Verify("/login", "web", "pwd") == "/welcome.html",
+        "register through userVerify");
+
+  mock_mysql_set_down(true);
+  int64_t begin = NowMs();
+  Check(batcher->submit("down", "pwd") == RegisterBatcher::Result::ERROR &&
+            NowMs() - begin < 6000,
+        "fails while db is down");
+  mock_mysql_set_down(false);
+
+  batcher->close();
+  RegisterBatcher::Stats stats = batcher->stats();
+  printf("requests %lu, commits %lu, inserted %lu, duplicates %lu, "
+         "errors %lu, fallbacks %lu, largest %lu\n",
+         stats.requests, stats.commits, stats.inserted, stats.duplicates,
+         stats.errors, stats.fallbacks, stats.largest);
+  pool->closePool();
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+// 会话表基准测试：sessions个会话，1..threads个线程随机查询的吞吐
+//   ./session_bench [threads] [sessions] [seconds]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/sessionstore.h"
+
+static int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  int sessions = argc > 2 ? atoi(argv[2]) : 100000;
+  double seconds = argc > 3 ? atof(argv[3]) : 1;
+  LoopClock::update();
+  SessionStore *store = SessionStore::instance();
+  SessionStore::Options options;
+  options.capacity = sessions * 2;
+  store->init(options);
+  std::vector<std::string> ids;
+  int64_t begin = NowUs();
+  for (int i = 0; i < sessions; ++i) {
+    ids.push_back(store->create("user" + std::to_string(i)));
+  }
+  int64_t cost = NowUs() - begin;
+  SessionStore::Stats stats = store->stats();
+  printf("%d sessions created in %ldms, %zuKB (%zuB per session)\n", sessions,
+         cost / 1000, stats.memory_bytes >> 10,
+         stats.memory_bytes / stats.active);
+
+  for (int n = 1; n <= threads; n *= 2) {
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < n; ++t) {
+      workers.emplace_back([&, t] {
+        std::mt19937 rng(t);
+        std::string user;
+        uint64_t count = 0, hits = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+          for (int i = 0; i < 1024; ++i) {
+            hits += store->lookup(ids[rng() % ids.size()], &user);
+          }
+          count += 1024;
+        }
+        total += count;
+        if (hits != count) {
+          printf("unexpected miss\n");
+        }
+      });
+    }
+    begin = NowUs();
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6)));
+    stop = true;
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    cost = NowUs() - begin;
+    printf("%d threads: %.2fM lookups/s\n", n, total * 1.0 / cost);
+  }
+  return 0;
+}
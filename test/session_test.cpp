@@ -0,0 +1,123 @@
+// 会话表测试
+// 1. 创建/查询/删除，格式不对或不存在的ID查询失败
+// 2. 空闲的会话按idle_ttl_ms过期，被访问的会话顺延但不超过max_ttl_ms，
+//    tick驱动时间轮删除过期的会话
+// 3. 已满时不再创建
+// 4. 登录成功后HttpRequest创建会话，之后的请求凭Cookie识别用户
+//   ./session_test
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "verifyutil.h"
+
+// 与事件循环一样更新缓存时钟并驱动tick
+static void Advance(SessionStore *store, int ms) {
+  int64_t end = LoopClock::nowMs() + ms;
+  while (LoopClock::nowMs() < end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    LoopClock::update();
+    store->tick();
+  }
+}
+
+static HttpRequest Parse(const std::string &text) {
+  HttpRequest request;
+  Buffer buff;
+  buff.Append(text);
+  request.parse(buff);
+  return request;
+}
+
+int main() {
+  LoopClock::update();
+  SessionStore *store = SessionStore::instance();
+  std::string user;
+  Check(store->create("x").empty() && !store->lookup("00", &user),
+        "disabled before init");
+
+  SessionStore::Options options;
+  options.shards = 4;
+  options.capacity = 64;
+  options.idle_ttl_ms = 200;
+  options.max_ttl_ms = 500;
+  options.tick_ms = 10;
+  store->init(options);
+
+  std::string sid = store->create("alice");
+  Check(sid.size() == 32 &&
+            sid.find_first_not_of("0123456789abcdef") == std::string::npos,
+        "session id is 128-bit hex");
+  Check(store->lookup(sid, &user) && user == "alice", "lookup");
+  std::string upper = sid;
+  upper[0] = 'G';
+  Check(!store->lookup(upper, &user) && !store->lookup(sid.substr(1), &user) &&
+            !store->lookup(std::string(32, '0'), &user),
+        "bad or unknown ids rejected");
+  Check(store->create("alice") != sid, "each login gets a new id");
+  store->destroy(sid);
+  Check(!store->lookup(sid, &user), "destroyed session is gone");
+
+  // 时钟粒度为几毫秒(CLOCK_MONOTONIC_COARSE)，期限留出余量
+  std::string idle = store->create("idle");
+  std::string busy = store->create("busy");
+  for (int i = 0; i < 6; ++i) {
+    Advance(store, 50);
+    store->lookup(busy, &user);
+  }
+  Check(!store->lookup(idle, &user) && store->lookup(busy, &user),
+        "idle session expires, active one is extended");
+  // 前面第二次登录"alice"的会话同样空闲过期
+  Check(store->stats().active == 1 && store->stats().expired >= 2,
+        "tick removes expired sessions");
+  for (int i = 0; i < 5; ++i) {
+    Advance(store, 50);
+    store->lookup(busy, &user);
+  }
+  Check(!store->lookup(busy, &user), "max lifetime caps extension");
+  Advance(store, 250);
+  Check(store->stats().active == 0, "all sessions reclaimed");
+
+  int created = 0;
+  for (int i = 0; i < 200; ++i) {
+    created += !store->create("user" + std::to_string(i)).empty();
+  }
+  SessionStore::Stats stats = store->stats();
+  Check(created <= 64 && stats.active <= 64 && stats.rejected >= 136,
+        "capacity bound");
+  Check(stats.memory_bytes > stats.active * 32, "memory accounted");
+  printf("active %zu, memory %zuB (%zuB per session), rejected %lu\n",
+         stats.active, stats.memory_bytes,
+         stats.memory_bytes / std::max<size_t>(stats.active, 1),
+         stats.rejected);
+  Advance(store, 250);
+  // 长用户名另占的堆内存计入，删除后减去
+  std::string long_sid = store->create(std::string(100, 'x'));
+  size_t grown = store->stats().memory_bytes;
+  store->destroy(long_sid);
+  Check(!long_sid.empty() && grown >= store->stats().memory_bytes + 101,
+        "long user names counted and released");
+
+  HttpRequest login = Parse(FormRequest("/login", "bob", "pw"));
+  login.finishVerify(true);
+  std::string session = login.newSession();
+  Check(!session.empty() && login.user() == "bob", "login creates a session");
+  HttpRequest next = Parse(
+      "GET /welcome HTTP/1.1\r\nCookie: theme=dark; sid=" + session +
+      "; lang=zh\r\n\r\n");
+  Check(next.user() == "bob" && next.getCookie("theme") == "dark" &&
+            next.getCookie("lang") == "zh" && next.getCookie("si").empty(),
+        "cookie identifies the user");
+  HttpRequest failed = Parse(FormRequest("/login", "bob", "pw"));
+  failed.finishVerify(false);
+  Check(failed.newSession().empty() && failed.user().empty(),
+        "failed login creates no session");
+  Check(Parse("GET / HTTP/1.1\r\nCookie: sid=" + std::string(32, 'a') +
+              "\r\n\r\n")
+            .user()
+            .empty(),
+        "forged cookie ignored");
+
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+// 慢速攻击测试：需要先启动服务器
+//   ./slowloris_test [port] [slow_conns] [seconds] [trickle_ms]
+// 三类慢速连接：连接后不发送数据、逐字节发送请求头、发送请求头后逐字节发送请求体
+// 同时有正常客户端不断发起短连接请求，统计慢速连接被关闭的时间和正常请求的成功率
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testutil.h"
+
+static int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+enum Kind { SILENT, HEADER, BODY, KINDS };
+static const char *kKindName[] = {"silent", "header", "body"};
+
+struct SlowConn {
+  int fd;
+  Kind kind;
+  int64_t closed_ms{-1};
+};
+
+// 正常客户端：每次新建连接请求首页，超过timeout_ms未收到完整响应算失败
+static void Legit(int port, int timeout_ms, std::atomic<bool> *stop,
+                  std::vector<int64_t> *latency, int *failed) {
+  const char request[] =
+      "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+  while (!*stop) {
+    int64_t begin = NowMs();
+    int fd = Connect(port);
+    bool ok = false;
+    if (fd >= 0 && send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) > 0) {
+      char buf[4096];
+      size_t total = 0;
+      pollfd pfd{fd, POLLIN, 0};
+      while (poll(&pfd, 1, timeout_ms - (NowMs() - begin)) > 0) {
+        ssize_t len = recv(fd, buf, sizeof(buf), 0);
+        if (len <= 0) {
+          break;
+        }
+        if (total == 0 && strncmp(buf, "HTTP/1.1 200", 12) == 0) {
+          ok = true;
+        }
+        total += len;
+      }
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (ok) {
+      latency->push_back(NowMs() - begin);
+    } else {
+      ++*failed;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int port = argc > 1 ? atoi(argv[1]) : 10000;
+  int slow = argc > 2 ? atoi(argv[2]) : 600;
+  int seconds = argc > 3 ? atoi(argv[3]) : 40;
+  int trickle_ms = argc > 4 ? atoi(argv[4]) : 1000;
+
+  rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  std::vector<SlowConn> conns;
+  for (int i = 0; i < slow; ++i) {
+    int fd = Connect(port);
+    if (fd < 0) {
+      printf("connect failed at %d: %s\n", i, strerror(errno));
+      return 1;
+    }
+    conns.push_back({fd, static_cast<Kind>(i % KINDS)});
+    if (conns.back().kind == BODY) {
+      const char header[] =
+          "POST /login HTTP/1.1\r\nContent-Length: 100000\r\n"
+          "Content-Type: application/x-www-form-urlencoded\r\n\r\n";
+      send(fd, header, sizeof(header) - 1, MSG_NOSIGNAL);
+    }
+  }
+
+  std::atomic<bool> stop{false};
+  std::vector<int64_t> latency;
+  int failed = 0;
+  std::thread legit(Legit, port, 2000, &stop, &latency, &failed);
+
+  const std::string request_line = "GET / HTTP/1.1\r\nX-Slow: ";
+  int64_t begin = NowMs();
+  int open = slow;
+  for (int round = 0; open > 0 && NowMs() - begin < seconds * 1000; ++round) {
+    for (auto &conn : conns) {
+      if (conn.closed_ms >= 0) {
+        continue;
+      }
+      char buf[256];
+      ssize_t len = recv(conn.fd, buf, sizeof(buf), MSG_DONTWAIT);
+      bool closed = len == 0 || (len < 0 && errno != EAGAIN);
+      if (!closed && conn.kind != SILENT) {
+        // 每轮只发送一个字节
+        char byte = conn.kind == HEADER && round < (int)request_line.size()
+                        ? request_line[round]
+                        : 'a';
+        closed = send(conn.fd, &byte, 1, MSG_NOSIGNAL) < 0;
+      }
+      if (closed) {
+        conn.closed_ms = NowMs() - begin;
+        close(conn.fd);
+        --open;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(trickle_ms));
+  }
+  stop = true;
+  legit.join();
+
+  for (int kind = 0; kind < KINDS; ++kind) {
+    int total = 0, closed = 0;
+    int64_t max_ms = 0;
+    for (auto &conn : conns) {
+      if (conn.kind != kind) {
+        continue;
+      }
+      ++total;
+      if (conn.closed_ms >= 0) {
+        ++closed;
+        max_ms = std::max(max_ms, conn.closed_ms);
+      } else {
+        close(conn.fd);
+      }
+    }
+    printf("%-7s slow conns closed by server: %d/%d, last after %ldms\n",
+           kKindName[kind], closed, total, max_ms);
+  }
+  std::sort(latency.begin(), latency.end());
+  int64_t p99 = latency.empty() ? 0 : latency[latency.size() * 99 / 100];
+  printf("legit requests: %zu ok, %d failed, p99 %ldms\n", latency.size(),
+         failed, p99);
+  bool ok = open == 0 && failed == 0 && !latency.empty();
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+// 连接池测试，使用test/mock中的客户端库替身
+// 1. 连接数在min_size和max_size之间伸缩，空闲的连接按idle_timeout回收
+// 2. 取不到连接时按到达顺序排队，超时返回nullptr，等待时间有上限
+// 3. 数据库重启后，断开的连接被检查出来并在后台重连，查询恢复
+// 4. 启动时数据库不可用不会放入无效的连接，恢复后自动补足
+// 5. init不阻塞，min_size个连接并行建立
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/sqlconnRAII.h"
+#include "testutil.h"
+
+// 等待cond成立，最多limit_ms
+template <typename Cond>
+static bool WaitFor(Cond cond, int limit_ms) {
+  int64_t end = NowMs() + limit_ms;
+  while (!cond() && NowMs() < end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return cond();
+}
+
+static const int SELECT_ONE = SqlStmtCache::define("SELECT 1");
+
+static bool Query(SqlConnPool *pool) {
+  SqlConn conn(pool);
+  if (!conn.get()) {
+    return false;
+  }
+  SqlResult result;
+  return conn.stmts()->execute(SELECT_ONE, {}, &result) &&
+         result.rows.size() == 1;
+}
+
+static SqlConnPool::Options TestOptions() {
+  SqlConnPool::Options options;
+  options.min_size = 2;
+  options.max_size = 4;
+  options.wait_timeout_ms = 100;
+  options.check_interval_ms = 50;
+  options.idle_timeout_ms = 200;
+  options.reconnect_ms = 50;
+  return options;
+}
+
+int main() {
+  SqlConnPool *pool = SqlConnPool::instance();
+  pool->init("localhost", 3306, "root", "12345678", "webserver",
+             TestOptions());
+  Check(WaitFor([&] { return pool->ready(); }, 1000) &&
+            pool->stats().total == 2 && pool->getFreeConnCount() == 2,
+        "starts with min_size connections");
+
+  std::vector<MYSQL *> held;
+  for (int i = 0; i < 4; ++i) {
+    held.push_back(pool->getConn());
+  }
+  bool all = true;
+  for (MYSQL *sql : held) {
+    all = all && sql;
+  }
+  Check(all && pool->stats().total == 4 && pool->stats().in_use == 4,
+        "grows to max_size on demand");
+
+  int64_t begin = NowMs();
+  MYSQL *extra = pool->getConn();
+  int64_t waited = NowMs() - begin;
+  Check(!extra && waited >= 100 && waited < 300 && pool->stats().timeouts == 1,
+        "bounded wait times out at max_size");
+
+  // 排队的线程按顺序拿到归还的连接
+  std::vector<int> order;
+  std::mutex order_mtx;
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < 2; ++i) {
+    waiters.emplace_back([&, i] {
+      MYSQL *sql = pool->getConn(1000);
+      {
+        std::lock_guard locker(order_mtx);
+        order.push_back(sql ? i : -1);
+      }
+      if (sql) {
+        pool->freeConn(sql);
+      }
+    });
+    WaitFor([&] { return pool->stats().waiting == i + 1; }, 1000);
+  }
+  pool->freeConn(held.back());
+  held.pop_back();
+  for (auto &waiter : waiters) {
+    waiter.join();
+  }
+  Check(order.size() == 2 && order[0] == 0 && order[1] == 1,
+        "waiters served in arrival order");
+  for (MYSQL *sql : held) {
+    pool->freeConn(sql);
+  }
+  held.clear();
+
+  Check(WaitFor([&] { return pool->stats().total == 2; }, 1000) &&
+            pool->stats().closed_idle == 2,
+        "idle connections shrink to min_size");
+
+  // 数据库重启：空闲连接的ping失败，后台重新建立
+  mock_mysql_drop_connections();
+  Check(WaitFor([&] { return pool->stats().reconnects >= 2; }, 1000) &&
+            pool->stats().total == 2,
+        "dead idle connections reconnected");
+  Check(Query(pool), "query after reconnect");
+
+  // 使用中的连接断开：归还时丢弃，不会再交给其他线程
+  {
+    SqlConn conn(pool);
+    mock_mysql_drop_connections();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    SqlResult result;
+    Check(!conn.stmts()->execute(SELECT_ONE, {}, &result) &&
+              (result.err == CR_SERVER_LOST ||
+               result.err == CR_SERVER_GONE_ERROR),
+          "query on dropped connection fails");
+  }
+  Check(WaitFor([&] { return Query(pool); }, 1000),
+        "broken connection replaced");
+
+  // 数据库停止服务期间取连接的等待仍然有上限
+  mock_mysql_set_down(true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  begin = NowMs();
+  bool failed = true;
+  for (int i = 0; i < 5; ++i) {
+    failed = failed && !Query(pool);
+  }
+  waited = NowMs() - begin;
+  Check(failed && waited < 5 * 150, "requests fail fast while db is down");
+  mock_mysql_set_down(false);
+  Check(WaitFor([&] { return Query(pool); }, 1000), "recovers when db is up");
+
+  pool->closePool();
+  Check(pool->getConn() == nullptr, "closed pool returns nullptr");
+
+  // 启动时数据库不可用
+  mock_mysql_set_down(true);
+  pool->init("localhost", 3306, "root", "12345678", "webserver",
+             TestOptions());
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  Check(!pool->ready() && pool->stats().total == 0 &&
+            pool->getFreeConnCount() == 0,
+        "no broken connections pooled at init");
+  mock_mysql_set_down(false);
+  Check(WaitFor([&] { return pool->stats().total == 2 && pool->ready(); },
+                1000),
+        "fills to min_size once db is up");
+  pool->closePool();
+
+  // 每次握手100ms，8个连接串行建立需要800ms
+  mock_mysql_set_latency(100);
+  SqlConnPool::Options options = TestOptions();
+  options.min_size = options.max_size = 8;
+  options.check_interval_ms = 5000;
+  begin = NowMs();
+  pool->init("localhost", 3306, "root", "12345678", "webserver", options);
+  int64_t init_ms = NowMs() - begin;
+  Check(init_ms < 50 && !pool->ready(), "init does not wait for connections");
+  Check(WaitFor([&] { return pool->ready(); }, 1000) &&
+            pool->stats().total == 8,
+        "all connections ready");
+  int64_t ready_ms = NowMs() - begin;
+  printf("init %ldms, 8 connections ready in %ldms\n", init_ms, ready_ms);
+  Check(ready_ms < 400, "connections established in parallel");
+
+  SqlConnPool::Stats stats = pool->stats();
+  printf("acquires %lu, timeouts %lu, max wait %.1fms, connects %lu, "
+         "connect errors %lu, reconnects %lu, pings %lu\n",
+         stats.acquires, stats.timeouts, stats.max_wait_us / 1000.0,
+         stats.connects, stats.connect_errors, stats.reconnects, stats.pings);
+  pool->closePool();
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+// 预编译语句缓存测试，使用test/mock中的客户端库替身
+// 1. 同步校验(HttpRequest::verify)的登录/注册结果正确，每个连接上每条语句只prepare一次
+// 2. 参数按二进制绑定：含引号的用户名不能注入，超长的用户名和密码不会被截断
+// 3. 服务端丢弃语句后自动重新prepare，查询仍然成功
+//   ./sqlstmt_test [logins]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "verifyutil.h"
+
+int main(int argc, char *argv[]) {
+  int logins = argc > 1 ? atoi(argv[1]) : 1000;
+  mock_mysql_add_user("root", "123456");
+  SqlConnPool *pool = SqlConnPool::instance();
+  pool->init("localhost", 3306, "root", "12345678", "webserver", 1);
+
+  Check(Verify("/login", "root", "123456") == "/welcome.html",
+        "login with correct password");
+  Check(Verify("/login", "root", "bad") == "/error.html",
+        "login with wrong password");
+  Check(Verify("/login", "ghost", "x") == "/error.html", "login unknown user");
+  Check(Verify("/register", "alice", "pw") == "/welcome.html",
+        "register new user");
+  Check(Verify("/register", "alice", "pw") == "/error.html",
+        "register existing user");
+  Check(Verify("/login", "alice", "pw") == "/welcome.html",
+        "login registered user");
+
+  int prepares = mock_mysql_prepare_count();
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < logins; ++i) {
+    Verify("/login", "root", "123456");
+  }
+  double cost = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - begin)
+                    .count();
+  printf("%d logins: %.1fus per login\n", logins, cost / logins);
+  Check(prepares == 2 && mock_mysql_prepare_count() == prepares,
+        "each statement prepared once per connection");
+
+  // 拼接SQL时这个用户名会让WHERE条件恒为真
+  std::string inject = "x' OR '1'='1";
+  Check(Verify("/login", inject, "123456") == "/error.html",
+        "quoted name is not injected");
+  Check(Verify("/register", inject, "p'w") == "/welcome.html" &&
+            Verify("/login", inject, "p'w") == "/welcome.html",
+        "quoted name stored verbatim");
+
+  // 超过旧的256字节SQL缓冲区和结果列缓冲区
+  std::string long_name(300, 'n');
+  std::string long_pwd(1000, 'p');
+  std::string stored;
+  Check(Verify("/register", long_name, long_pwd) == "/welcome.html" &&
+            mock_mysql_get_user(long_name.c_str(), &stored) &&
+            stored == long_pwd,
+        "long name and password not truncated");
+  Check(Verify("/login", long_name, long_pwd) == "/welcome.html",
+        "login reads back long password");
+
+  mock_mysql_reset_statements();
+  prepares = mock_mysql_prepare_count();
+  Check(Verify("/login", "root", "123456") == "/welcome.html" &&
+            mock_mysql_prepare_count() == prepares + 1,
+        "re-prepare after statements lost");
+
+  pool->closePool();
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+// 测试程序共用的小工具，只有头文件
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// 任何一项检查失败，main最后输出FAIL并返回非0
+inline bool g_ok = true;
+
+inline void Check(bool cond, const char *what) {
+  printf("%-48s %s\n", what, cond ? "ok" : "FAIL");
+  g_ok = g_ok && cond;
+}
+
+inline int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
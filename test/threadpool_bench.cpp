@@ -0,0 +1,100 @@
+// 线程池等待策略基准测试
+// 突发负载：每轮快速提交一批任务，然后空闲一段时间
+// 统计任务从提交到开始执行的延迟分位数，以及整个过程消耗的CPU时间
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../code/pool/threadpool.hpp"
+
+using SteadyClock = std::chrono::steady_clock;
+
+struct BenchConfig {
+  int threads{4};
+  int bursts{200};
+  int burst_size{64};
+  int gap_us{2000};
+};
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             SteadyClock::now().time_since_epoch())
+      .count();
+}
+
+static double CpuSeconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static double Percentile(const std::vector<int64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t idx = static_cast<size_t>(p * (sorted.size() - 1));
+  return sorted[idx] / 1000.0;
+}
+
+static void RunOne(const char* name, WaitStrategy* strategy,
+                   const BenchConfig& cfg) {
+  const int total = cfg.bursts * cfg.burst_size;
+  std::vector<int64_t> latency(total, 0);
+  std::atomic<int> done{0};
+
+  double cpu_begin = CpuSeconds();
+  int64_t wall_begin = NowNs();
+  {
+    ThreadPool pool(cfg.threads, total, strategy);
+    int idx = 0;
+    for (int b = 0; b < cfg.bursts; ++b) {
+      for (int i = 0; i < cfg.burst_size; ++i, ++idx) {
+        int64_t submit = NowNs();
+        int slot = idx;
+        pool.Enqueue([&latency, &done, slot, submit] {
+          latency[slot] = NowNs() - submit;
+          done.fetch_add(1);
+        });
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(cfg.gap_us));
+    }
+    while (done.load() < total) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  double wall = (NowNs() - wall_begin) / 1e9;
+  double cpu = CpuSeconds() - cpu_begin;
+
+  std::sort(latency.begin(), latency.end());
+  printf("%-14s %9.1f %9.1f %9.1f %9.1f %10.1f %9.3f %7.1f%%\n", name,
+         Percentile(latency, 0.50), Percentile(latency, 0.90),
+         Percentile(latency, 0.99), Percentile(latency, 0.999),
+         latency.back() / 1000.0, cpu, cpu / wall * 100);
+}
+
+int main(int argc, char* argv[]) {
+  BenchConfig cfg;
+  if (argc > 1) cfg.threads = atoi(argv[1]);
+  if (argc > 2) cfg.bursts = atoi(argv[2]);
+  if (argc > 3) cfg.burst_size = atoi(argv[3]);
+  if (argc > 4) cfg.gap_us = atoi(argv[4]);
+
+  printf("threads=%d bursts=%d burst_size=%d gap=%dus pause/us=%lu\n",
+         cfg.threads, cfg.bursts, cfg.burst_size, cfg.gap_us,
+         AdaptiveWaitStrategy::PausePerMicroSecond());
+  printf("%-14s %9s %9s %9s %9s %10s %9s %8s\n", "strategy", "p50(us)",
+         "p90(us)", "p99(us)", "p999(us)", "max(us)", "cpu(s)", "cpu/wall");
+
+  RunOne("block", new BlockWaitStrategy(), cfg);
+  RunOne("timeout_block", new TimeoutBlockWaitStrategy(10), cfg);
+  RunOne("sleep", new SleepWaitStrategy(), cfg);
+  RunOne("yield", new YieldWaitStrategy(), cfg);
+  RunOne("adaptive", new AdaptiveWaitStrategy(), cfg);
+  return 0;
+}
@@ -0,0 +1,137 @@
+// 定时器基准测试：TimingWheel与HeapTimer
+//   1. 正确性：随机超时、延长、提前、取消，检查回调不早于到期时间且取消的不会触发
+//   2. 性能：10k/100k/1M个定时器下add、adjust(模拟每次读写事件续期)、
+//      cancel以及到期处理的平均耗时
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../code/utility/timer.h"
+#include "../code/utility/timewheel.h"
+
+using SteadyClock = std::chrono::steady_clock;
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             SteadyClock::now().time_since_epoch())
+      .count();
+}
+
+// 与定时器读取同一个缓存时钟
+static int64_t NowMs() {
+  return std::chrono::duration_cast<MS>(Clock::now().time_since_epoch())
+      .count();
+}
+
+template <typename Timer>
+static bool Check(const char *name) {
+  const int n = 2000;
+  Timer timer;
+  std::mt19937 rng(7);
+  std::vector<int64_t> deadline(n), fired(n, -1);
+  std::vector<bool> cancelled(n, false);
+  int64_t begin = NowMs();
+  for (int i = 0; i < n; ++i) {
+    int timeout = rng() % 300;
+    deadline[i] = begin + timeout;
+    timer.add(i, timeout, [&fired, i] { fired[i] = NowMs(); });
+  }
+  for (int i = 0; i < n; i += 3) {
+    int timeout = 100 + rng() % 300;
+    deadline[i] = NowMs() + timeout;
+    timer.adjust(i, timeout);
+  }
+  for (int i = 1; i < n; i += 7) {
+    timer.cancel(i);
+    cancelled[i] = true;
+  }
+  // 重新add可以把到期时间提前
+  for (int i = 2; i < n; i += 11) {
+    int timeout = rng() % 50;
+    deadline[i] = NowMs() + timeout;
+    timer.add(i, timeout, [&fired, i] { fired[i] = NowMs(); });
+  }
+  int tick;
+  while ((tick = timer.getNextTick()) >= 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(tick));
+    LoopClock::update();
+  }
+
+  int early = 0, missing = 0, unexpected = 0;
+  int64_t max_late = 0;
+  for (int i = 0; i < n; ++i) {
+    if (cancelled[i] && i % 11 != 2) {
+      unexpected += fired[i] >= 0;
+      continue;
+    }
+    if (fired[i] < 0) {
+      ++missing;
+    } else if (fired[i] + 1 < deadline[i]) {
+      // 两种定时器都只有毫秒精度，允许1ms误差
+      ++early;
+    } else {
+      max_late = std::max(max_late, fired[i] - deadline[i]);
+    }
+  }
+  bool ok = early == 0 && missing == 0 && unexpected == 0;
+  printf("%-12s check: early %d, missing %d, cancelled fired %d, "
+         "max late %ldms, %s\n",
+         name, early, missing, unexpected, max_late, ok ? "PASS" : "FAIL");
+  return ok;
+}
+
+template <typename Timer>
+static void Bench(const char *name, int n, int adjusts) {
+  std::mt19937 rng(42);
+  std::vector<int> ids(adjusts);
+  for (auto &id : ids) {
+    id = rng() % n;
+  }
+  Timer timer;
+  int expired = 0;
+  TimeoutCallback cb = [&expired] { ++expired; };
+
+  int64_t t0 = NowNs();
+  for (int i = 0; i < n; ++i) {
+    timer.add(i, 60000 + rng() % 1000, cb);
+  }
+  int64_t t1 = NowNs();
+  for (int id : ids) {
+    timer.adjust(id, 60000);
+  }
+  int64_t t2 = NowNs();
+  for (int i = 0; i < n; i += 2) {
+    timer.cancel(i);
+  }
+  int64_t t3 = NowNs();
+  // 剩余的一半改为立即到期，统计批量到期处理的耗时
+  for (int i = 1; i < n; i += 2) {
+    timer.add(i, 0, cb);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  LoopClock::update();
+  int64_t t4 = NowNs();
+  timer.tick();
+  int64_t t5 = NowNs();
+
+  printf("%-12s n=%-8d add %6.1fns  adjust %6.1fns  cancel %6.1fns  "
+         "expire %6.1fns  (%d fired)\n",
+         name, n, double(t1 - t0) / n, double(t2 - t1) / adjusts,
+         double(t3 - t2) / (n / 2), double(t5 - t4) / (n / 2), expired);
+}
+
+int main(int argc, char *argv[]) {
+  int adjusts = argc > 1 ? atoi(argv[1]) : 1000000;
+  // 与服务器相同，由循环驱动缓存时钟
+  LoopClock::update();
+  bool ok = Check<HeapTimer>("HeapTimer");
+  ok = Check<TimingWheel>("TimingWheel") && ok;
+  for (int n : {10000, 100000, 1000000}) {
+    Bench<HeapTimer>("HeapTimer", n, adjusts);
+    Bench<TimingWheel>("TimingWheel", n, adjusts);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+// 请求追踪测试
+// 1. 关闭时不采样，开启后每N个请求采样一个，ID从1开始递增
+// 2. 多个线程的记录都能导出，环形缓冲区写满后保留最新的记录
+// 3. 导出的JSON中阶段为X事件，整个请求为一对b/e事件，路径中的特殊字符被转义
+// 4. 信号只设置标志，取走一次后清除
+//   ./trace_test
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../code/log/trace.h"
+#include "testutil.h"
+
+static size_t Count(const std::string &text, const std::string &word) {
+  size_t count = 0;
+  for (size_t pos = text.find(word); pos != std::string::npos;
+       pos = text.find(word, pos + 1)) {
+    count++;
+  }
+  return count;
+}
+
+int main() {
+  Trace *trace = Trace::instance();
+  Check(!trace->isEnabled() && trace->sample() == 0, "disabled by default");
+
+  Trace::Options options;
+  options.sample = 4;
+  options.ring_size = 16;
+  trace->init(options);
+  std::vector<uint64_t> ids;
+  for (int i = 0; i < 12; ++i) {
+    uint64_t id = trace->sample();
+    if (id) {
+      ids.push_back(id);
+    }
+  }
+  Check(ids == std::vector<uint64_t>({1, 2, 3}), "one in N sampled");
+
+  Trace::span(0, "read", 100, 200);
+  Check(Count(trace->dump(), "\"ph\"") == 0, "unsampled request not recorded");
+
+  // 三个线程都记录完才退出，各自占用一个缓冲区
+  std::atomic<int> recorded{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < 3; ++t) {
+    workers.emplace_back([t, &recorded] {
+      for (int i = 0; i < 10; ++i) {
+        Trace::span(t + 1, "parse", 1000 + i, 1010 + i);
+      }
+      recorded++;
+      while (recorded < 3) {
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::string text = trace->dump();
+  Check(Count(text, "\"name\":\"parse\"") == 30 &&
+            Count(text, "\"req\":1}") == 10 && Count(text, "\"req\":3}") == 10,
+        "spans from all threads");
+
+  // 新线程复用前面归还的缓冲区，写满后覆盖最旧的
+  std::thread([] {
+    for (int i = 0; i < 40; ++i) {
+      Trace::span(9, i < 30 ? "old" : "new", i, i + 1);
+    }
+  }).join();
+  text = trace->dump();
+  Check(Count(text, "\"name\":\"new\"") == 10 &&
+            Count(text, "\"name\":\"old\"") == 6,
+        "ring keeps the newest spans");
+  Check(Count(text, "\"name\":\"parse\"") == 20, "other rings untouched");
+
+  Trace::request(7, "GET /a\"b\\c\n 200", 5000, 5250);
+  text = trace->dump();
+  Check(Count(text, "\"ph\":\"b\",\"id\":7,\"ts\":5000,") == 1 &&
+            Count(text, "\"ph\":\"e\",\"id\":7,\"ts\":5250,") == 1,
+        "request as async begin/end");
+  Check(Count(text, "GET /a\\\"b\\\\c\\u000a 200") == 2, "detail escaped");
+  Check(text.front() == '{' &&
+            text.find("\"traceEvents\":[") != std::string::npos &&
+            text.find(",,") == std::string::npos &&
+            text.substr(text.size() - 4) == "\n]}\n",
+        "chrome trace envelope");
+  Check(Count(text, "\"dur\":10,") == 20, "duration recorded");
+
+  Check(!Trace::takeDumpRequest(), "no dump requested");
+  Trace::requestDump(0);
+  Check(Trace::takeDumpRequest() && !Trace::takeDumpRequest(),
+        "signal flag taken once");
+  Check(trace->dumpFile("/tmp/trace_test.json"), "dump to file");
+  remove("/tmp/trace_test.json");
+
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+// 用户缓存测试，使用test/mock中的客户端库替身
+// 1. 缓存本身：命中/负缓存/TTL过期/LRU淘汰/查询期间的invalidate
+// 2. 同步校验：重复登录只查一次数据库，并发未命中合并为一次查询，注册后缓存失效
+// 3. 异步校验：并发未命中同样合并
+//   ./usercache_test [threads] [latency_ms]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "verifyutil.h"
+
+static HttpRequest MakeRequest(const char *path, const std::string &name,
+                               const std::string &pwd) {
+  HttpRequest request;
+  Buffer buff;
+  buff.Append(FormRequest(path, name, pwd));
+  request.parse(buff);
+  return request;
+}
+
+// 执行过的查询数，不含prepare
+static int Executes() {
+  return mock_mysql_query_count() - mock_mysql_prepare_count();
+}
+
+static UserCache::Load Found(const char *pwd) {
+  UserCache::Load load;
+  load.ok = true;
+  load.exists = true;
+  load.password = pwd;
+  return load;
+}
+
+static void TestCache(UserCache *cache) {
+  using State = UserCache::State;
+  Check(cache->lookup("u", "p") == State::MISS, "miss before load");
+  Check(cache->join("u", nullptr), "first caller loads");
+  cache->complete("u", Found("p"), 100);
+  Check(cache->lookup("u", "p") == State::MATCH &&
+            cache->lookup("u", "x") == State::MISMATCH,
+        "hit compares password digest");
+
+  UserCache::Load absent;
+  absent.ok = true;
+  cache->join("nobody", nullptr);
+  cache->complete("nobody", absent, 100);
+  Check(cache->lookup("nobody", "p") == State::ABSENT, "negative entry");
+
+  // 查询出错的结果不缓存，等待者收到错误
+  int waited = 0;
+  cache->join("err", nullptr);
+  Check(!cache->join("err", [&](const UserCache::Load &load) {
+    waited += !load.ok;
+  }),
+        "second caller waits");
+  cache->complete("err", UserCache::Load(), 0);
+  Check(waited == 1 && cache->lookup("err", "p") == State::MISS,
+        "errors are not cached");
+
+  // 查询期间被invalidate，结果不写入缓存
+  cache->join("race", nullptr);
+  cache->invalidate("race");
+  cache->complete("race", absent, 100);
+  Check(cache->lookup("race", "p") == State::MISS,
+        "invalidate during load discards result");
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  Check(cache->lookup("nobody", "p") == State::MISS &&
+            cache->lookup("u", "p") == State::MATCH,
+        "negative ttl shorter than positive");
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  Check(cache->lookup("u", "p") == State::MISS, "entry expires after ttl");
+
+  for (int i = 0; i < 200; ++i) {
+    std::string name = "lru" + std::to_string(i);
+    cache->join(name, nullptr);
+    cache->complete(name, Found("p"), 100);
+  }
+  UserCache::Stats stats = cache->stats();
+  Check(stats.size <= 64 && stats.evictions >= 200 - 64,
+        "lru bounded by capacity");
+  Check(cache->lookup("lru199", "p") == State::MATCH,
+        "most recent entry kept");
+  cache->invalidate("lru199");
+
+  // 慢哈希校验通过后的缓存默认关闭
+  cache->remember("slow", "p");
+  Check(cache->lookup("slow", "p") == State::MISS,
+        "remember is off by default");
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 8;
+  int latency = argc > 2 ? atoi(argv[2]) : 20;
+  UserCache::Options options;
+  options.capacity = 64;
+  options.shards = 4;
+  options.ttl_ms = 200;
+  options.negative_ttl_ms = 100;
+  UserCache *cache = UserCache::instance();
+  cache->init(options);
+  TestCache(cache);
+
+  mock_mysql_set_latency(latency);
+  mock_mysql_add_user("root", "123456");
+  SqlConnPool::instance()->init("localhost", 3306, "root", "12345678",
+                                "webserver", threads);
+
+  int before = Executes();
+  bool ok = true;
+  for (int i = 0; i < 10; ++i) {
+    ok = ok && Verify("/login", "root", "123456") == "/welcome.html";
+  }
+  Check(ok && Executes() == before + 1, "repeated logins query once");
+  Check(Verify("/login", "root", "bad") == "/error.html" &&
+            Executes() == before + 1,
+        "wrong password answered from cache");
+
+  // 所有线程同时登录同一个未缓存的用户
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  before = Executes();
+  std::atomic<int> passed{0};
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&] {
+      passed += Verify("/login", "root", "123456") == "/welcome.html";
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  Check(passed == threads && Executes() == before + 1,
+        "concurrent misses coalesced");
+
+  Check(Verify("/login", "ghost", "pw") == "/error.html", "unknown user");
+  before = Executes();
+  Check(Verify("/login", "ghost", "pw") == "/error.html" &&
+            Executes() == before,
+        "unknown user answered from negative cache");
+  Check(Verify("/register", "ghost", "pw") == "/welcome.html" &&
+            Verify("/login", "ghost", "pw") == "/welcome.html",
+        "register invalidates negative entry");
+
+  // 异步校验：回调在事件循环中执行
+  Epoller epoller;
+  AsyncSqlClient client(&epoller);
+  client.init("localhost", 3306, "root", "12345678", "webserver", 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  before = Executes();
+  int finished = 0;
+  int welcomed = 0;
+  std::vector<HttpRequest> requests;
+  for (int i = 0; i < threads; ++i) {
+    requests.push_back(MakeRequest("/login", "root", "123456"));
+  }
+  for (HttpRequest &request : requests) {
+    request.verifyAsync(&client, [&](bool ok) {
+      finished++;
+      welcomed += ok;
+    });
+  }
+  RunLoop(epoller, client, [&] { return finished == threads; });
+  Check(welcomed == threads && Executes() == before + 1,
+        "async concurrent misses coalesced");
+
+  UserCache::Stats stats = cache->stats();
+  printf("hits %lu (negative %lu), misses %lu, coalesced %lu, loads %lu, "
+         "evictions %lu, expirations %lu, saved %.1fms\n",
+         stats.hits, stats.negative_hits, stats.misses, stats.coalesced,
+         stats.loads, stats.evictions, stats.expirations,
+         stats.saved_us / 1000.0);
+  SqlConnPool::instance()->closePool();
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
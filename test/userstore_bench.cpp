@@ -0,0 +1,112 @@
+// 用户存储基准测试：进程内存储与MySQL存储(test/mock中的客户端库替身，
+// 每次查询经过socketpair往返，相当于本机上没有延迟的数据库)的对比
+// 1. 每个线程循环登录随机的已有用户，统计每秒查询数
+// 2. 混合负载：每20次登录有一次注册
+// 3. 进程内存储关闭后重新打开，统计恢复时间
+//   ./userstore_bench [threads] [seconds] [users]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/memuserstore.h"
+
+using SteadyClock = std::chrono::steady_clock;
+
+static double ElapsedSec(SteadyClock::time_point begin) {
+  return std::chrono::duration<double>(SteadyClock::now() - begin).count();
+}
+
+static std::string UserName(int i) { return "user" + std::to_string(i); }
+
+// threads个线程运行seconds秒，每20次操作中有write_per_20次注册
+static double Run(UserStore *store, int threads, double seconds, int users,
+                  int write_per_20) {
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> ops{0};
+  std::atomic<int> next_user{users};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      std::mt19937 rng(t);
+      uint64_t n = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (static_cast<int>(n % 20) < write_per_20) {
+          store->insert(UserName(next_user++), "pwd");
+        } else {
+          UserCache::Load load = store->find(UserName(rng() % users));
+          if (!load.ok || !load.exists) {
+            fprintf(stderr, "lookup failed\n");
+            exit(1);
+          }
+        }
+        n++;
+      }
+      ops += n;
+    });
+  }
+  auto begin = SteadyClock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return ops / ElapsedSec(begin);
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  double seconds = argc > 2 ? atof(argv[2]) : 2;
+  int users = argc > 3 ? atoi(argv[3]) : 100000;
+  std::string dir = std::filesystem::temp_directory_path() / "userstore_bench";
+  std::filesystem::remove_all(dir);
+
+  MemUserStore::Options options;
+  options.dir = dir;
+  auto mem = std::make_unique<MemUserStore>();
+  mem->init(options);
+  auto begin = SteadyClock::now();
+  for (int i = 0; i < users; ++i) {
+    mem->insert(UserName(i), "pwd");
+  }
+  printf("memory: %d inserts %.0f/s\n", users, users / ElapsedSec(begin));
+
+  // MySQL存储的数据放在替身中
+  for (int i = 0; i < users; ++i) {
+    mock_mysql_add_user(UserName(i).c_str(), "pwd");
+  }
+  SqlConnPool::instance()->init("localhost", 3306, "root", "12345678",
+                                "webserver", threads);
+  while (!SqlConnPool::instance()->ready()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  MysqlUserStore mysql;
+
+  printf("%-8s %-10s %14s\n", "store", "workload", "ops/s");
+  double mem_read = Run(mem.get(), threads, seconds, users, 0);
+  printf("%-8s %-10s %14.0f\n", "memory", "login", mem_read);
+  double mysql_read = Run(&mysql, threads, seconds, users, 0);
+  printf("%-8s %-10s %14.0f\n", "mysql", "login", mysql_read);
+  printf("%-8s %-10s %14.0f\n", "memory", "mixed",
+         Run(mem.get(), threads, seconds, users, 1));
+  printf("%-8s %-10s %14.0f\n", "mysql", "mixed",
+         Run(&mysql, threads, seconds, users, 1));
+  printf("memory/mysql login: %.1fx\n", mem_read / mysql_read);
+  SqlConnPool::instance()->closePool();
+
+  MemUserStore::Stats stats = mem->stats();
+  mem->close();
+  mem = std::make_unique<MemUserStore>();
+  mem->init(options);
+  MemUserStore::Stats recovered = mem->stats();
+  printf("recover %lu users (snapshot %.1fMB): %.1fms\n", recovered.recovered,
+         std::filesystem::file_size(dir + "/users.snap") / 1048576.0,
+         recovered.recover_us / 1000.0);
+  mem->close();
+  std::filesystem::remove_all(dir);
+  return recovered.recovered == stats.users ? 0 : 1;
+}
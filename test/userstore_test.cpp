@@ -0,0 +1,168 @@
+// 进程内用户存储测试
+// 1. 插入/查询，重复的用户名被拒绝
+// 2. 关闭时写快照，重新打开从快照恢复；进程崩溃(不关闭)时从日志恢复
+// 3. 日志末尾写了一半的记录被截掉，之后的写入仍然能恢复
+//    修改的密码以日志中最后一条记录为准
+// 4. 快照与并发的注册交错时不丢失用户
+// 5. 安装为UserStore后登录/注册不访问MySQL
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/memuserstore.h"
+#include "verifyutil.h"
+
+namespace fs = std::filesystem;
+
+static bool Exists(MemUserStore *store, const std::string &name,
+                   const std::string &pwd) {
+  UserCache::Load load = store->find(name);
+  return load.ok && load.exists && load.password == pwd;
+}
+
+// 复制目录，相当于进程在这一刻崩溃后留下的文件
+static std::string Crash(const std::string &dir) {
+  std::string copy = dir + ".crash";
+  fs::remove_all(copy);
+  fs::copy(dir, copy);
+  return copy;
+}
+
+static MemUserStore::Options TestOptions(const std::string &dir) {
+  MemUserStore::Options options;
+  options.dir = dir;
+  options.shards = 8;
+  options.check_interval_ms = 10;
+  return options;
+}
+
+int main() {
+  std::string dir = fs::temp_directory_path() / "userstore_test";
+  fs::remove_all(dir);
+
+  {
+    MemUserStore store;
+    Check(store.init(TestOptions(dir)), "init empty dir");
+    Check(store.insert("alice", "pw1") && store.insert("bob", "pw2"), "insert");
+    Check(!store.insert("alice", "other") && Exists(&store, "alice", "pw1"),
+          "duplicate name rejected");
+    UserCache::Load load = store.find("carol");
+    Check(load.ok && !load.exists, "unknown user");
+  }
+  {
+    MemUserStore store;
+    Check(store.init(TestOptions(dir)) && store.stats().recovered == 2 &&
+              Exists(&store, "bob", "pw2"),
+          "recovered from snapshot");
+    Check(fs::exists(dir + "/users.snap"), "snapshot written on close");
+
+    // 崩溃时只有日志中的记录
+    store.insert("carol", "pw3");
+    std::string crashed = Crash(dir);
+    MemUserStore recovered;
+    Check(recovered.init(TestOptions(crashed)) &&
+              recovered.stats().recovered == 3 &&
+              Exists(&recovered, "carol", "pw3"),
+          "recovered from log after crash");
+    recovered.close();
+
+    // 写到一半的记录
+    crashed = Crash(dir);
+    std::string log;
+    for (const auto &entry : fs::directory_iterator(crashed)) {
+      if (entry.path().extension() == ".log" && fs::file_size(entry) > 0) {
+        log = entry.path();
+      }
+    }
+    FILE *fp = fopen(log.c_str(), "ab");
+    fwrite("\x05\x00\x00\x00\x03\x00", 1, 6, fp);
+    fclose(fp);
+    uintmax_t torn = fs::file_size(log);
+    MemUserStore truncated;
+    Check(truncated.init(TestOptions(crashed)) &&
+              Exists(&truncated, "carol", "pw3") &&
+              fs::file_size(log) == torn - 6,
+          "torn record truncated");
+    truncated.insert("dave", "pw4");
+    std::string again = Crash(crashed);
+    MemUserStore after;
+    Check(after.init(TestOptions(again)) && Exists(&after, "dave", "pw4"),
+          "writes after truncation recovered");
+
+    // 密码只在旧值匹配时修改，修改追加在日志中
+    Check(!truncated.update("dave", "bad", "pw5") &&
+              !truncated.update("nobody", "pw4", "pw5") &&
+              truncated.update("dave", "pw4", "pw5") &&
+              Exists(&truncated, "dave", "pw5"),
+          "update checks the old password");
+    std::string updated = Crash(crashed);
+    MemUserStore replayed;
+    Check(replayed.init(TestOptions(updated)) &&
+              Exists(&replayed, "dave", "pw5"),
+          "update recovered from log");
+    replayed.close();
+    fs::remove_all(updated);
+    after.close();
+    truncated.close();
+    fs::remove_all(crashed);
+    fs::remove_all(again);
+  }
+
+  // 注册和快照并发
+  {
+    MemUserStore store;
+    store.init(TestOptions(dir));
+    const int THREADS = 4, USERS = 5000;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < THREADS; ++t) {
+      writers.emplace_back([&store, t] {
+        for (int i = 0; i < USERS; ++i) {
+          store.insert("u" + std::to_string(t) + "_" + std::to_string(i), "p");
+        }
+      });
+    }
+    int snapshots = 0;
+    while (store.stats().inserts < THREADS * USERS) {
+      snapshots += store.snapshot();
+    }
+    for (auto &writer : writers) {
+      writer.join();
+    }
+    std::string crashed = Crash(dir);
+    MemUserStore recovered;
+    bool all = recovered.init(TestOptions(crashed));
+    for (int t = 0; all && t < THREADS; ++t) {
+      for (int i = 0; all && i < USERS; ++i) {
+        all = Exists(&recovered,
+                     "u" + std::to_string(t) + "_" + std::to_string(i), "p");
+      }
+    }
+    printf("%d snapshots during %d inserts\n", snapshots, THREADS * USERS);
+    Check(all && snapshots > 0, "no users lost across concurrent snapshots");
+    recovered.close();
+    fs::remove_all(crashed);
+  }
+
+  // 登录/注册走安装的存储
+  auto store = std::make_unique<MemUserStore>();
+  MemUserStore *mem = store.get();
+  mem->init(TestOptions(dir));
+  UserStore::install(std::move(store));
+  int queries = mock_mysql_query_count();
+  Check(Verify("/login", "alice", "pw1") == "/welcome.html" &&
+            Verify("/login", "alice", "bad") == "/error.html",
+        "login against installed store");
+  Check(Verify("/register", "erin", "pw5") == "/welcome.html" &&
+            Verify("/register", "erin", "pw5") == "/error.html" &&
+            Verify("/login", "erin", "pw5") == "/welcome.html",
+        "register against installed store");
+  Check(mock_mysql_query_count() == queries, "mysql not used");
+  mem->close();
+  UserStore::install(nullptr);
+  fs::remove_all(dir);
+
+  printf("%s\n", g_ok ? "PASS" : "FAIL");
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+// 登录/注册相关测试共用的请求构造和事件循环，需要链接HttpRequest和mock
+#pragma once
+
+#include <cctype>
+#include <string>
+#include <thread>
+
+#include "../code/http/request.h"
+#include "../code/pool/asyncsql.h"
+#include "testutil.h"
+
+// 构造登录/注册表单的POST请求，用户名和密码按百分号编码，可以包含任意字节
+inline std::string FormRequest(const char *path, const std::string &name,
+                               const std::string &pwd) {
+  static const char *hex = "0123456789ABCDEF";
+  auto encode = [](const std::string &value) {
+    std::string out;
+    for (unsigned char ch : value) {
+      if (isalnum(ch)) {
+        out += ch;
+      } else {
+        out += '%';
+        out += hex[ch >> 4];
+        out += hex[ch & 15];
+      }
+    }
+    return out;
+  };
+  std::string body = "username=" + encode(name) + "&password=" + encode(pwd);
+  return "POST " + std::string(path) +
+         " HTTP/1.1\r\nConnection: keep-alive\r\n"
+         "Content-Type: application/x-www-form-urlencoded\r\n"
+         "Content-Length: " +
+         std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// 同步校验，返回校验后的页面，请求无法解析时返回空字符串
+inline std::string Verify(const char *path, const std::string &name,
+                          const std::string &pwd) {
+  HttpRequest request;
+  Buffer buff;
+  buff.Append(FormRequest(path, name, pwd));
+  if (!request.parse(buff) || !request.needVerify()) {
+    return "";
+  }
+  request.verify();
+  return request.path();
+}
+
+// 与WebServer::start相同的事件循环，直到done为真或超时
+template <typename Done>
+void RunLoop(Epoller &epoller, AsyncSqlClient &client, Done done,
+             int limit_ms = 5000) {
+  int64_t end = NowMs() + limit_ms;
+  while (!done() && NowMs() < end) {
+    int timeout = 10;
+    int next = client.nextTimeout();
+    if (next >= 0 && next < timeout) {
+      timeout = next;
+    }
+    int n = epoller.Wait(timeout);
+    LoopClock::update();
+    client.checkTimeouts();
+    for (int i = 0; i < n; ++i) {
+      int fd = epoller.GetEventFd(i);
+      if (client.owns(fd)) {
+        client.handleEvent(fd, epoller.GetEvents(i));
+      }
+    }
+  }
+}
+
+// 异步校验，返回校验后的页面；请求无法解析、没有完成或回调不在事件循环线程中
+// 执行时返回空字符串
+inline std::string VerifyAsync(Epoller &epoller, AsyncSqlClient &client,
+                               const char *path, const std::string &name,
+                               const std::string &pwd) {
+  HttpRequest request;
+  Buffer buff;
+  buff.Append(FormRequest(path, name, pwd));
+  if (!request.parse(buff) || !request.needVerify()) {
+    return "";
+  }
+  std::thread::id loop = std::this_thread::get_id();
+  bool finished = false, passed = false, on_loop = false;
+  bool queued = request.verifyAsync(&client, [&](bool ok) {
+    finished = true;
+    passed = ok;
+    on_loop = std::this_thread::get_id() == loop;
+  });
+  RunLoop(epoller, client, [&] { return finished; });
+  if (!queued || !finished || !on_loop) {
+    return "";
+  }
+  request.finishVerify(passed);
+  return request.path();
+}